@@ -79,10 +79,13 @@ void idt_set_gate(int num, uint64_t handler, uint16_t selector, uint8_t type_att
 void idt_flush(uint64_t idt_ptr_addr);
 
 /* Exception handlers */
-void exception_handler(uint32_t exception_num, uint64_t error_code);
+void exception_handler(uint32_t exception_num, uint64_t error_code, uint64_t *rip);
 
 /* IRQ handlers */
+typedef void (*irq_callback_t)(void);
+
 void irq_handler(uint32_t irq_num);
+int  irq_register_handler(uint8_t irq, irq_callback_t handler);
 
 /* Assembly interrupt handlers - CPU Exceptions (ISRs 0-21) */
 extern void isr0(void);   // Division by zero
@@ -25,6 +25,7 @@
 #define USER_VIRTUAL_BASE   0x0000000060000000UL   /* 4MB (user space start) */
 #define KERNEL_HEAP_START   0xFFFFFFFF90000000UL   /* Kernel heap start */
 #define USER_STACK_TOP      0x0000000070000000UL      /* 1.25GB - above identity map */
+#define USER_VIRTUAL_END    0x0000000100000000UL   /* End of user window: stack, mmap, data page */
 
 /* Page Table Entry Type */
 typedef uint64_t page_entry_t;
@@ -87,6 +88,7 @@ void paging_flush_page(uint64_t virtual_addr);
 /* Page Mapping Functions */
 int paging_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags);
 int paging_unmap_page(uint64_t virtual_addr);
+int paging_unmap_page_keep_frame(uint64_t virtual_addr);
 int paging_is_mapped(uint64_t virtual_addr);
 uint64_t paging_get_physical_address(uint64_t virtual_addr);
 
@@ -124,6 +126,8 @@ uint64_t paging_align_down(uint64_t addr, uint64_t alignment);
 
 /* Exception Handler */
 void page_fault_handler(uint64_t error_code, uint64_t fault_addr);
+int  page_fault_resolve(uint64_t error_code, uint64_t fault_addr);   /* x86 */
+void page_fault_report(uint64_t error_code, uint64_t fault_addr);    /* x86 */
 
 /* Page Table Index Extraction Macros (for 4-level paging) */
 #define PML4_INDEX(addr) (((addr) >> 39) & 0x1FF)   /* Bits 47-39 */
@@ -35,6 +35,8 @@
 extern uint8_t shift_pressed;
 extern uint8_t ctrl_pressed;
 
+struct epoll_source;
+
 /* Public API */
 void keyboard_init(void);
 char scan_code_to_ascii(uint8_t scan_code);
@@ -43,6 +45,7 @@ void keyboard_handler(void);
 char keyboard_getchar(void);           /* kernel interactive use (buffered) */
 char keyboard_getchar_buffered(void);  /* syscall/scroll use (waits on IRQ) */
 int keyboard_try_getchar(char *out);   /* non-blocking; returns 1 on char */
+int keyboard_poll(struct epoll_source **source); /* EPOLL_IN when a char waits */
 void keyboard_flush_buffer(void);      /* drop buffered key repeats */
 void keyboard_discard_pending(char target);
 int keyboard_is_special_pressed(char target);
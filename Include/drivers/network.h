@@ -11,8 +11,18 @@
 #define NET_HTTP_PATH_LEN      192
 #define NET_HTTP_HEADER_VALUE_LEN 64
 
+/* Return codes of the net_* calls */
+#define NET_OK                   0
+#define NET_ERR_GENERIC         -1
+#define NET_ERR_UNAVAILABLE     -2
+#define NET_ERR_TIMEOUT         -3
+#define NET_ERR_NOT_CONFIGURED  -4
+#define NET_ERR_INVALID         -5
+#define NET_ERR_CLOSED          -6
+
 #define NET_CLIENT_FLAG_INSECURE       0x00000001u
 #define NET_HTTP_FLAG_INCLUDE_HEADERS  0x00000002u
+#define NET_HTTP_FLAG_CLOSE            0x00000004u  /* Do not keep the connection */
 
 struct net_info {
     uint8_t  present;
@@ -83,14 +93,27 @@ struct net_http_result {
     uint8_t  secure;
     uint8_t  truncated;
     uint8_t  headers_included;
-    uint8_t  reserved0;
+    uint8_t  reused;             /* Served on a pooled connection */
     uint32_t bytes_received;
     uint32_t body_offset;
     uint8_t  remote_ip[NET_IPV4_ADDR_LEN];
     char     content_type[NET_HTTP_HEADER_VALUE_LEN];
     char     location[NET_HTTP_PATH_LEN];
+    uint32_t content_length;     /* 0 when the response had none */
 };
 
+/*
+ * Receives the response of net_http_fetch_ipv4 as it arrives.  result has
+ * the status and headers filled in before the first call.  Return 0 to keep
+ * going, a positive value to stop early or a NET_ERR_* code to fail.
+ */
+typedef int (*net_http_sink_t)(void *ctx,
+                               const struct net_http_result *result,
+                               const void *data,
+                               size_t len);
+
+struct epoll_source;
+
 void net_init(void);
 void net_poll(void);
 int  net_is_available(void);
@@ -105,7 +128,21 @@ int  net_tcp_connect_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
 ssize_t net_tcp_send(int handle, const void *buf, size_t len, uint32_t timeout_ms);
 ssize_t net_tcp_recv(int handle, void *buf, size_t len, uint32_t timeout_ms);
 int  net_tcp_close(int handle, uint32_t timeout_ms);
+int  net_tcp_release(int handle);
 int  net_tcp_get_info(int handle, struct net_tcp_info *out);
+int  net_tcp_poll(int handle, struct epoll_source **source);
+int  net_tcp_listen(uint16_t port, uint32_t backlog);
+int  net_tcp_accept(int listener, uint32_t timeout_ms);
+int  net_tcp_unlisten(int listener);
+int  net_tcp_listener_poll(int listener, struct epoll_source **source);
+int  net_udp_open(uint16_t port);
+int  net_udp_close(int handle);
+int  net_udp_poll(int handle, struct epoll_source **source);
+ssize_t net_udp_sendto(int handle, const uint8_t addr[NET_IPV4_ADDR_LEN], uint16_t port,
+                       const void *buf, size_t len);
+ssize_t net_udp_recvfrom(int handle, void *buf, size_t len,
+                         uint8_t addr[NET_IPV4_ADDR_LEN], uint16_t *port,
+                         uint32_t timeout_ms);
 int  net_tls_probe_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
                         uint16_t port,
                         const char *server_name,
@@ -116,6 +153,10 @@ ssize_t net_http_get_ipv4(const struct net_http_request *request,
                           void *buf,
                           size_t len,
                           struct net_http_result *out);
+ssize_t net_http_fetch_ipv4(const struct net_http_request *request,
+                            net_http_sink_t sink,
+                            void *ctx,
+                            struct net_http_result *out);
 void net_print_status(void);
 
 #endif /* NET_H */
@@ -0,0 +1,44 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "lib/base.h"
+
+/*
+ * Directory entry cache shared by the VFS back ends.
+ *
+ * Entries are keyed by (filesystem id, parent directory, component name)
+ * and record where the on-disk entry lives plus a copy of its raw bytes.
+ * Negative entries remember names that were looked up and not found.
+ * Names compare case-insensitively, matching FAT semantics.
+ */
+
+#define DCACHE_BUCKETS       256
+#define DCACHE_MAX_ENTRIES   512
+#define DCACHE_NAME_MAX      63
+#define DCACHE_DATA_MAX      32
+
+#define DCACHE_FS_FAT32      1
+
+#define DCACHE_MISS          (-1)
+#define DCACHE_NEGATIVE      0
+#define DCACHE_HIT           1
+
+struct dcache_hit {
+    uint32_t loc_cluster;           /* Directory cluster holding the entry */
+    uint32_t loc_index;             /* Entry index inside that cluster */
+    uint8_t  data[DCACHE_DATA_MAX]; /* Raw on-disk entry */
+};
+
+void dcache_init(void);
+int  dcache_lookup(uint32_t fs, uint32_t parent, const char *name,
+                   struct dcache_hit *out);
+void dcache_insert(uint32_t fs, uint32_t parent, const char *name,
+                   uint32_t loc_cluster, uint32_t loc_index,
+                   const void *data, size_t len);
+void dcache_insert_negative(uint32_t fs, uint32_t parent, const char *name);
+void dcache_invalidate(uint32_t fs, uint32_t parent, const char *name);
+void dcache_invalidate_location(uint32_t fs, uint32_t loc_cluster,
+                                uint32_t loc_index);
+void dcache_invalidate_fs(uint32_t fs);
+
+#endif /* DCACHE_H */
@@ -83,6 +83,11 @@ struct fat32_lfn_entry {
 #define FAT32_ATTR_DIRECTORY    0x10
 #define FAT32_ATTR_ARCHIVE      0x20
 #define FAT32_ATTR_LONG_NAME    0x0F  /* LFN marker */
+
+/* Long filename entry layout */
+#define FAT32_LFN_LAST_ENTRY    0x40  /* Set in order of the final LFN slot */
+#define FAT32_LFN_ORDER_MASK    0x1F
+#define FAT32_LFN_CHARS         13    /* UCS-2 characters per LFN slot */
 
 /* FAT Entry Values */
 #define FAT32_FREE_CLUSTER      0x00000000
@@ -90,6 +95,11 @@ struct fat32_lfn_entry {
 #define FAT32_EOC_MIN           0x0FFFFFF8  /* End of chain minimum */
 #define FAT32_EOC_MAX           0x0FFFFFFF  /* End of chain maximum */
 #define FAT32_FSINFO_UNKNOWN    0xFFFFFFFFu
+
+/* FSInfo signatures */
+#define FAT32_FSINFO_LEAD_SIG   0x41615252u
+#define FAT32_FSINFO_STRUCT_SIG 0x61417272u
+#define FAT32_FSINFO_TRAIL_SIG  0xAA550000u
 
 /* Maximum path and filename lengths */
 #define FAT32_MAX_PATH          260
@@ -110,11 +120,21 @@ struct fat32_fs {
     uint32_t partition_lba_start;
     
     uint8_t *fat_cache;             /* Cached FAT table */
+    uint64_t *free_bitmap;          /* One bit per cluster, set = free */
+    int fsinfo_valid;               /* FSInfo signatures checked out */
+    int fsinfo_dirty;               /* FSInfo needs writing back */
     
     uint32_t current_directory;     /* Current directory cluster */
     int mounted;                    /* Filesystem mounted flag */
 };
 
+/* Run of physically contiguous clusters in a file's chain */
+struct fat32_extent {
+    uint32_t file_cluster;          /* Index of the first cluster in the file */
+    uint32_t disk_cluster;          /* First cluster number on disk */
+    uint32_t length;                /* Number of clusters in the run */
+};
+
 /* File descriptor for open files */
 struct fat32_file {
     char name[FAT32_MAX_FILENAME];
@@ -128,6 +148,24 @@ struct fat32_file {
     uint8_t attr;
     int flags;
     int in_use;
+
+    /* Cluster chain cache, filled lazily as the file is accessed */
+    struct fat32_extent *extents;
+    uint32_t extent_count;
+    uint32_t extent_cap;
+    uint32_t extent_hint;           /* Last extent hit, for sequential I/O */
+    uint32_t mapped_clusters;       /* Clusters covered by extents */
+    int chain_complete;             /* Extents reach the end of the chain */
+
+    /* Read-ahead / write-behind window, allocated on first partial I/O */
+    uint8_t *stream;
+    uint32_t stream_first;          /* File cluster index of stream[0] */
+    uint32_t stream_count;          /* Clusters held in the window */
+    uint32_t dirty_first;           /* Dirty window clusters, [first, end) */
+    uint32_t dirty_end;
+    uint32_t ra_clusters;           /* Current read-ahead size */
+    uint32_t seq_next;              /* Offset a sequential access resumes at */
+    int size_dirty;                 /* Directory entry size not yet written */
 };
 
 /* Directory entry for listing */
@@ -158,6 +196,7 @@ int fat32_mount(void);
 /* Directory Operations */
 int fat32_chdir(const char *path);
 int fat32_readdir(struct fat32_dirent *entries, int max_entries);
+int fat32_readdir_at(uint32_t *cursor, struct fat32_dirent *entries, int max_entries);
 uint32_t fat32_get_current_directory(void);
 void fat32_set_current_directory(uint32_t cluster);
 
@@ -166,6 +205,11 @@ int fat32_open(const char *path, int flags);
 int fat32_close(int fd);
 ssize_t fat32_read(int fd, void *buf, size_t count);
 ssize_t fat32_write(int fd, const void *buf, size_t count);
+ssize_t fat32_pread(int fd, void *buf, size_t count, uint32_t offset);
+ssize_t fat32_pwrite(int fd, const void *buf, size_t count, uint32_t offset);
+int     fat32_reserve(int fd, uint32_t offset, uint32_t len);
+int64_t fat32_seek(int fd, int64_t offset, int whence);
+int fat32_fstat(int fd, struct fat32_dirent *stat);
 int fat32_stat(const char *path, struct fat32_dirent *stat);
 
 /* Cluster Operations */
@@ -174,6 +218,8 @@ uint32_t fat32_next_cluster(uint32_t cluster);
 
 /* Sector I/O */
 int fat32_read_sector(uint32_t sector, void *buffer);
+int fat32_read_sectors(uint32_t sector, uint32_t count, void *buffer);
+int fat32_write_sectors(uint32_t sector, uint32_t count, const void *buffer);
 int fat32_read_cluster(uint32_t cluster, void *buffer);
 
 /* Utility Functions */
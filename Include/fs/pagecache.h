@@ -0,0 +1,29 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include "lib/base.h"
+
+/*
+ * File page cache shared by every mapping of a file.
+ *
+ * Pages are keyed by (mount, file, page index), where the file id is the
+ * back end's stable identity (first cluster on FAT32, inode number on
+ * tmpfs).  Two processes that map the same file fault in the same frames.
+ * A page is pinned while any mapping references it; unpinned pages stay
+ * cached and are recycled round-robin once the pool is full.  write()
+ * through the VFS updates cached pages in place so mappings see the data.
+ */
+
+#define PAGECACHE_MAX_PAGES  1024   /* 4 MiB of cached file data */
+#define PAGECACHE_BUCKETS    256
+#define PAGECACHE_PAGE_SIZE  4096
+
+void     pagecache_init(void);
+uint64_t pagecache_get(int vfs_fd, uint32_t mount, uint32_t file, uint32_t index);
+void     pagecache_put(uint64_t phys);
+void     pagecache_update(uint32_t mount, uint32_t file, uint32_t offset,
+                          const void *buf, size_t len);
+void     pagecache_invalidate_file(uint32_t mount, uint32_t file);
+uint32_t pagecache_cached_pages(void);
+
+#endif /* PAGECACHE_H */
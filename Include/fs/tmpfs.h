@@ -0,0 +1,36 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "lib/base.h"
+#include "fs/vfs.h"
+
+/*
+ * In-memory filesystem for scratch files.
+ *
+ * File data lives in page-sized heap blocks referenced from a growable page
+ * table, so appends are amortized O(1) and never touch the disk.  Each
+ * directory keeps its children in a hash table that doubles as it fills.
+ * Open flags and attribute bits are the FAT32 ones, so callers can treat
+ * both back ends the same way.
+ */
+
+#define TMPFS_PAGE_SIZE      4096
+#define TMPFS_MAX_PAGES      4096   /* 16 MiB of file data */
+#define TMPFS_INITIAL_HANDLES 16    /* Handle table doubles from here */
+
+int     tmpfs_init(void);
+int     tmpfs_open(const char *path, int flags);
+int     tmpfs_close(int handle);
+ssize_t tmpfs_read(int handle, void *buf, size_t count);
+ssize_t tmpfs_write(int handle, const void *buf, size_t count);
+ssize_t tmpfs_pread(int handle, void *buf, size_t count, uint32_t offset);
+ssize_t tmpfs_pwrite(int handle, const void *buf, size_t count, uint32_t offset);
+int64_t tmpfs_seek(int handle, int64_t offset, int whence);
+int     tmpfs_fstat(int handle, struct vfs_stat *st);
+int     tmpfs_stat(const char *path, struct vfs_stat *st);
+int     tmpfs_listdir(const char *path, struct vfs_dirent *entries, int max_entries);
+int     tmpfs_readdir(const char *path, uint32_t *cursor,
+                      struct vfs_dirent *entries, int max_entries);
+int     tmpfs_mkdir(const char *path);
+
+#endif /* TMPFS_H */
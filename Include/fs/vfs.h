@@ -4,13 +4,18 @@
 #include "lib/base.h"
 
 #define VFS_MAX_MOUNTS       4
-#define VFS_MAX_OPEN_FILES   16
+#define VFS_MAX_SPECIAL      4      /* Pathless file types such as sockets */
+#define VFS_INITIAL_OPEN_FILES 16   /* Open-file table doubles from here */
 #define VFS_PATH_MAX         260
 #define VFS_NAME_MAX         255
 
 #define VFS_NODE_FILE        1
 #define VFS_NODE_DIRECTORY   2
 
+#define VFS_SEEK_SET         0
+#define VFS_SEEK_CUR         1
+#define VFS_SEEK_END         2
+
 struct vfs_stat {
     char     name[VFS_NAME_MAX];
     uint32_t size;
@@ -27,6 +32,8 @@ struct vfs_dirent {
     uint32_t fs_data;
 };
 
+struct epoll_source;
+
 struct vfs_ops {
     int     (*open)(const char *path, int flags);
     int     (*close)(int handle);
@@ -34,15 +41,39 @@ struct vfs_ops {
     ssize_t (*write)(int handle, const void *buf, size_t count);
     int     (*stat)(const char *path, struct vfs_stat *st);
     int     (*listdir)(const char *path, struct vfs_dirent *entries, int max_entries);
+    ssize_t (*pread)(int handle, void *buf, size_t count, uint32_t offset);
+    ssize_t (*pwrite)(int handle, const void *buf, size_t count, uint32_t offset);
+    int64_t (*seek)(int handle, int64_t offset, int whence);
+    int     (*fstat)(int handle, struct vfs_stat *st);
+    int     (*reserve)(int handle, uint32_t offset, uint32_t len);
+    int     (*readdir)(const char *path, uint32_t *cursor,
+                       struct vfs_dirent *entries, int max_entries);
+    int     (*poll)(int handle, struct epoll_source **source);
 };
 
 int     vfs_init(void);
 int     vfs_register_fat32_root(void);
+int     vfs_register_tmpfs(const char *mount_point);
+int     vfs_register_special(const char *name, const struct vfs_ops *ops);
+int     vfs_open_special(int type, int handle);
+int     vfs_special_handle(int fd, int type);
 int     vfs_open(const char *path, int flags);
 int     vfs_close(int fd);
 ssize_t vfs_read(int fd, void *buf, size_t count);
 ssize_t vfs_write(int fd, const void *buf, size_t count);
+ssize_t vfs_pread(int fd, void *buf, size_t count, uint32_t offset);
+ssize_t vfs_pwrite(int fd, const void *buf, size_t count, uint32_t offset);
+int64_t vfs_seek(int fd, int64_t offset, int whence);
+ssize_t vfs_copy_range(int in_fd, int64_t in_off, int out_fd, int64_t out_off,
+                       size_t len);
+int     vfs_fstat(int fd, struct vfs_stat *st);
+int     vfs_poll(int fd, struct epoll_source **source);
+int     vfs_file_id(int fd, uint32_t *mount_id, uint32_t *file_id);
+int     vfs_map_ref(int fd);
+void    vfs_map_unref(int fd);
 int     vfs_stat(const char *path, struct vfs_stat *st);
 int     vfs_listdir(const char *path, struct vfs_dirent *entries, int max_entries);
+int     vfs_readdir(const char *path, uint64_t *cursor,
+                    struct vfs_dirent *entries, int max_entries);
 
 #endif /* VFS_H */
@@ -0,0 +1,52 @@
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include "lib/base.h"
+
+/*
+ * Readiness multiplexing.
+ *
+ * An event source (TCP connection or listener, UDP socket, the keyboard)
+ * embeds an epoll_source and calls epoll_source_notify() whenever its
+ * state may have changed, which is safe from IRQ context.  Every
+ * registration watching the source is then put on its instance's ready
+ * list, so epoll_wait() re-checks only what changed rather than every
+ * registration.  Level-triggered registrations stay on the list while
+ * they remain ready; edge-triggered ones leave it once reported.  Timer
+ * objects have no source: their deadlines bound the sleep instead.
+ */
+
+#define EPOLL_IN          0x001u
+#define EPOLL_OUT         0x004u
+#define EPOLL_ERR         0x008u
+#define EPOLL_HUP         0x010u
+#define EPOLL_ET          0x80000000u   /* Report each change once */
+
+#define EPOLL_CTL_ADD     1
+#define EPOLL_CTL_DEL     2
+#define EPOLL_CTL_MOD     3
+
+/* What a registration's id names */
+#define EPOLL_KIND_FD     0     /* Descriptor; 0 is the keyboard */
+#define EPOLL_KIND_TIMER  1     /* Timer object id */
+#define EPOLL_KIND_TCP    2     /* Handle from SYS_NET_TCP_CONNECT */
+
+#define EPOLL_MAX_EVENTS  256   /* Per epoll_wait() call */
+
+struct epoll_item;
+struct numos_epoll_event;
+
+struct epoll_source {
+    struct epoll_item *watchers;
+};
+
+void epoll_source_notify(struct epoll_source *source);
+void epoll_source_detach(struct epoll_source *source);
+
+int epoll_create(void);
+int epoll_ctl(int ep_vfs_fd, int op, int kind, int id, int vfs_fd,
+              uint32_t events, uint64_t data);
+int epoll_wait(int ep_vfs_fd, struct numos_epoll_event *out, int max_events,
+               int64_t timeout_ms);
+
+#endif /* EPOLL_H */
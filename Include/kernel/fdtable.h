@@ -0,0 +1,31 @@
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include "lib/base.h"
+
+/*
+ * Per-process file descriptor tables.
+ *
+ * Each process (thread group) owns a table that maps its descriptors to
+ * VFS open-file objects.  Descriptors 0-2 stay reserved for the console,
+ * the table doubles when full, and destroying it closes every file it
+ * still holds.  Each descriptor owns its VFS open file outright; there
+ * is no dup, so no two descriptors share a file position.
+ */
+
+#define FD_TABLE_FIRST    3     /* Lowest descriptor backed by the table */
+#define FD_TABLE_INITIAL  16
+
+struct fd_table {
+    int *files;                 /* VFS fd per slot, -1 when free */
+    int  count;                 /* Slots allocated */
+    int  next_free;             /* No free slot below this index */
+};
+
+struct fd_table *fd_table_create(void);
+void fd_table_destroy(struct fd_table *table);
+int  fd_install(struct fd_table *table, int vfs_fd);
+int  fd_lookup(const struct fd_table *table, int fd);
+int  fd_remove(struct fd_table *table, int fd);
+
+#endif /* FDTABLE_H */
@@ -0,0 +1,46 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "lib/base.h"
+
+/*
+ * File-backed memory mappings.
+ *
+ * Mappings live in a per-address-space list inside a fixed user window
+ * above the stack.  Pages are not touched at mmap time; the first access
+ * faults and maps the shared page-cache frame read-only, so every process
+ * mapping the same file shares physical memory.  A mapping holds a
+ * reference on its VFS file, which stays open until the mapping is gone.
+ */
+
+#define MMAP_BASE        0x0000000080000000UL
+#define MMAP_LIMIT       0x00000000C0000000UL
+
+#define MMAP_PROT_READ   0x1
+#define MMAP_PROT_WRITE  0x2
+#define MMAP_PROT_EXEC   0x4
+
+#define MMAP_SHARED      0x01
+#define MMAP_PRIVATE     0x02
+#define MMAP_FIXED       0x10
+#define MMAP_ANONYMOUS   0x20
+
+struct process_vm_space;
+
+struct mmap_region {
+    uint64_t start;
+    uint64_t end;
+    uint32_t mount;                 /* Page cache key: mount slot */
+    uint32_t file;                  /* Page cache key: file id */
+    uint32_t pgoff;                 /* File page mapped at start */
+    int      vfs_fd;
+    struct mmap_region *next;
+};
+
+int  mmap_create(struct process_vm_space *vm, uint64_t length, int vfs_fd,
+                 uint64_t offset, uint64_t *out_addr);
+int  mmap_remove(struct process_vm_space *vm, uint64_t addr, uint64_t length);
+int  mmap_handle_fault(struct process_vm_space *vm, uint64_t fault_addr);
+void mmap_release_all(struct process_vm_space *vm);
+
+#endif /* MMAP_H */
@@ -4,8 +4,11 @@
 #include "lib/base.h"
 #include "cpu/fpu.h"
 #include "kernel/procinfo.h"
+#include "kernel/waitqueue.h"
 
 struct elf_load_result;
+struct mmap_region;
+struct fd_table;
 
 /* =========================================================================
  * NumOS Process Scheduler
@@ -43,10 +46,18 @@ typedef enum {
     PROC_ZOMBIE  = 4,   /* Exited but not yet reaped                          */
 } proc_state_t;
 
+/* ---- Why a PROC_BLOCKED process is blocked ------------------------------- */
+typedef enum {
+    PROC_BLOCK_NONE  = 0,
+    PROC_BLOCK_SLEEP = 1,   /* process_sleep_until(); woken by the tick        */
+    PROC_BLOCK_WAIT  = 2,   /* On a wait queue, optionally until wake_at_ms    */
+} proc_block_t;
+
 /* ---- Process flags ------------------------------------------------------- */
 #define PROC_FLAG_VERIFIED 0x01  /* Preinstalled or required process          */
 #define PROC_FLAG_IDLE     0x02  /* Scheduler idle task                       */
 #define PROC_FLAG_KERNEL_THREAD 0x04
+#define PROC_FLAG_DETACHED 0x08  /* Parent exited; slot freed once zombie    */
 
 /* ---- Saved register state (callee-saved + rsp + rip) --------------------- */
 /* This is what context_switch() saves/restores on the kernel stack.
@@ -76,6 +87,8 @@ struct process_vm_space {
     uint64_t tls_filesz;
     uint64_t tls_memsz;
     uint64_t tls_align;
+    struct mmap_region *mmap_regions;     /* File mappings, sorted by address */
+    struct fd_table *fds;                 /* Open descriptors, created lazily */
 };
 
 /* ---- Process Control Block (PCB) ----------------------------------------- */
@@ -88,6 +101,7 @@ struct process {
     proc_state_t state;                     /* Current state                  */
     int      exit_code;                     /* Exit status (set on ZOMBIE)    */
     uint32_t flags;                         /* PROC_FLAG_*                    */
+    int      parent_pid;                    /* Spawning thread group, 0=kernel */
 
     /* Scheduling */
     int      ticks_remaining;              /* Ticks left in current slice     */
@@ -116,8 +130,14 @@ struct process {
     uint64_t thread_exit_value;           /* Full-width thread return value   */
     uint8_t  fpu_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
 
-    /* Sleep support */
-    uint64_t wake_at_ms;                  /* Uptime (ms) to unblock at        */
+    /* Sleep and wait-queue support */
+    uint64_t wake_at_ms;                  /* Uptime (ms) to unblock at, 0=never */
+    proc_block_t block_reason;            /* Valid while PROC_BLOCKED         */
+    int      wait_result;                 /* 0 = woken, -1 = deadline passed  */
+    struct wait_queue *wait_queue;        /* Queue slept on, NULL when awake  */
+    struct process *wait_next;            /* Link on that queue               */
+    struct wait_queue exit_waiters;       /* sys_thread_join sleepers         */
+    struct wait_queue child_exit;         /* Group leader: waitpid sleepers   */
 
     /* Linked list for run-queue */
     struct process *next;
@@ -179,6 +199,11 @@ int process_configure_image(struct process *proc,
 void process_exit(int exit_code);
 void process_exit_value(uint64_t exit_value);
 
+/* Reap an exited child of the caller's thread group.  pid > 0 waits for that
+ * child, pid == -1 for any.  Returns the child pid, 0 if nohang and none has
+ * exited yet, or -1 if there is no matching child.                         */
+int process_wait_child(int pid, int *exit_code, int nohang);
+
 /* Block the current process until uptime_ms >= wake_ms                    */
 void process_sleep_until(uint64_t wake_ms);
 
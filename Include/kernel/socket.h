@@ -0,0 +1,34 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include "lib/base.h"
+
+/*
+ * BSD-style sockets over the IPv4 stack.
+ *
+ * A socket is a VFS special file, so it lives in the ordinary descriptor
+ * table: read(), write() and close() work on it like on any file, and
+ * the socket calls below take the VFS fd behind a user descriptor.
+ * Stream sockets either connect() or bind(), listen() and accept();
+ * datagram sockets bind() (or get an ephemeral port on first send) and
+ * exchange whole datagrams.  Calls block until they can complete.
+ * Errors are negative SYSCALL_E* values.
+ */
+
+#define SOCKET_STREAM    1      /* TCP */
+#define SOCKET_DGRAM     2      /* UDP */
+
+#define SOCKET_BACKLOG_DEFAULT 8
+
+int     socket_create(int type);
+int     socket_bind(int vfs_fd, uint16_t port);
+int     socket_listen(int vfs_fd, int backlog);
+int     socket_accept(int vfs_fd, uint8_t peer_ip[4], uint16_t *peer_port);
+int     socket_connect(int vfs_fd, const uint8_t ip[4], uint16_t port);
+ssize_t socket_sendto(int vfs_fd, const void *buf, size_t len,
+                      const uint8_t ip[4], uint16_t port);
+ssize_t socket_recvfrom(int vfs_fd, void *buf, size_t len,
+                        uint8_t ip[4], uint16_t *port);
+int     socket_errno(int net_rc);
+
+#endif /* SOCKET_H */
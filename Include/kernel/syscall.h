@@ -27,9 +27,15 @@
 #define SYS_MMAP        9
 #define SYS_MUNMAP      11
 #define SYS_BRK         12
+#define SYS_PREAD64     17
+#define SYS_PWRITE64    18
+#define SYS_READV       19
+#define SYS_WRITEV      20
 #define SYS_SLEEP_MS    35
 #define SYS_GETPID      39
 #define SYS_EXIT        60
+/* Reap a child (wait4 number, no rusage). arg1=pid, arg2=&status, arg3=options */
+#define SYS_WAITPID     61
 #define SYS_UPTIME_MS   96
 #define SYS_SYSINFO     99
 #define SYS_HWINFO      100
@@ -86,6 +92,29 @@
 #define SYS_NET_TCP_INFO         239
 #define SYS_NET_TLS_PROBE        240
 #define SYS_NET_HTTP_GET         241
+#define SYS_COPY_FILE_RANGE      242
+/* Stream directory records. arg1=path, arg2=buf, arg3=len, arg4=&cursor */
+#define SYS_GETDENTS             243
+/* Start a user ELF without waiting. arg1=path, arg2=cmdline (may be NULL) */
+#define SYS_SPAWN                244
+/* BSD-style sockets.  Socket descriptors share the fd table, so read(),
+ * write() and close() work on them too.  Addresses are numos_sockaddr_in. */
+#define SYS_SOCKET               245   /* arg1=type (1 stream, 2 datagram) */
+#define SYS_BIND                 246   /* arg1=fd, arg2=&addr (port only) */
+#define SYS_LISTEN               247   /* arg1=fd, arg2=backlog */
+#define SYS_ACCEPT               248   /* arg1=fd, arg2=&peer (may be NULL) */
+#define SYS_CONNECT              249   /* arg1=fd, arg2=&addr */
+#define SYS_SENDTO               250   /* arg1=fd, arg2=buf, arg3=len, arg4=&addr */
+#define SYS_RECVFROM             251   /* arg1=fd, arg2=buf, arg3=len, arg4=&from */
+/* Readiness multiplexing; see kernel/epoll.h for events and kinds.
+ * SYS_EPOLL_CTL:  arg1=epfd, arg2=op, arg3=kind, arg4=id, arg5=&event
+ * SYS_EPOLL_WAIT: arg1=epfd, arg2=events, arg3=max, arg4=timeout_ms (<0 forever) */
+#define SYS_EPOLL_CREATE         252
+#define SYS_EPOLL_CTL            253
+#define SYS_EPOLL_WAIT           254
+/* GET over a pooled keep-alive connection, streaming a 2xx body into a file.
+ * arg1=&request, arg2=fd, arg3=&result.  Returns bytes written or SYSCALL_E*. */
+#define SYS_NET_HTTP_FETCH       255
 
 /* ---- Framebuffer syscalls -----------------------------------------------
  *
@@ -139,11 +168,24 @@
 
 /* Return value conventions */
 #define SYSCALL_SUCCESS   0
+#define SYSCALL_ENOENT  (-2)
 #define SYSCALL_EBADF   (-9)
+#define SYSCALL_ECHILD  (-10)
 #define SYSCALL_ENOMEM  (-12)
 #define SYSCALL_EFAULT  (-14)
+#define SYSCALL_EEXIST  (-17)
 #define SYSCALL_EINVAL  (-22)
+#define SYSCALL_ESPIPE  (-29)
 #define SYSCALL_ENOSYS  (-38)
+#define SYSCALL_ENOTSOCK    (-88)
+#define SYSCALL_EADDRINUSE  (-98)
+#define SYSCALL_ENETDOWN    (-100)
+#define SYSCALL_ECONNRESET  (-104)
+#define SYSCALL_ENOTCONN    (-107)
+#define SYSCALL_ETIMEDOUT   (-110)
+
+/* sys_waitpid options */
+#define WAIT_WNOHANG    1
 
 /* Saved CPU state at syscall entry */
 struct syscall_regs {
@@ -174,6 +216,26 @@ struct syscall_stats {
 
 struct fat32_dirent;
 
+/*
+ * Record produced by SYS_GETDENTS.  Records are packed back to back;
+ * d_reclen is the distance to the next one and keeps them 8-byte aligned.
+ */
+struct numos_dirent {
+    uint32_t d_size;
+    uint16_t d_reclen;
+    uint8_t  d_type;            /* 1 = file, 2 = directory */
+    uint8_t  d_attr;            /* FAT32_ATTR_* bits */
+    char     d_name[];          /* NUL-terminated */
+};
+
+/* One buffer of a SYS_READV / SYS_WRITEV request */
+#define NUMOS_IOV_MAX 1024
+
+struct numos_iovec {
+    void    *iov_base;
+    uint64_t iov_len;
+};
+
 #define NUMOS_DISK_MODEL_LEN 41
 
 struct numos_disk_info {
@@ -252,6 +314,18 @@ struct numos_net_tcp_info {
     uint8_t  remote_ip[4];
 };
 
+struct numos_sockaddr_in {
+    uint8_t  addr[4];
+    uint16_t port;
+    uint16_t reserved;
+};
+
+struct numos_epoll_event {
+    uint32_t events;
+    uint32_t reserved;
+    uint64_t data;
+};
+
 struct numos_net_tls_result {
     uint8_t  success;
     uint8_t  secure;
@@ -280,12 +354,13 @@ struct numos_net_http_result {
     uint8_t  secure;
     uint8_t  truncated;
     uint8_t  headers_included;
-    uint8_t  reserved0;
+    uint8_t  reused;
     uint32_t bytes_received;
     uint32_t body_offset;
     uint8_t  remote_ip[4];
     char     content_type[64];
     char     location[192];
+    uint32_t content_length;
 };
 
 void    syscall_init(void);
@@ -295,6 +370,16 @@ int64_t sys_read(int fd, void *buf, size_t count);
 int64_t sys_write(int fd, const void *buf, size_t count);
 int64_t sys_open(const char *path, int flags, int mode);
 int64_t sys_close(int fd);
+int64_t sys_lseek(int fd, int64_t offset, int whence);
+int64_t sys_pread(int fd, void *buf, size_t count, uint64_t offset);
+int64_t sys_pwrite(int fd, const void *buf, size_t count, uint64_t offset);
+int64_t sys_readv(int fd, const struct numos_iovec *iov, int iovcnt);
+int64_t sys_writev(int fd, const struct numos_iovec *iov, int iovcnt);
+int64_t sys_copy_file_range(int fd_in, int64_t *off_in, int fd_out,
+                            int64_t *off_out, size_t len, uint32_t flags);
+int64_t sys_mmap(uint64_t addr, size_t length, int prot, int flags,
+                 int fd, uint64_t offset);
+int64_t sys_munmap(uint64_t addr, size_t length);
 int64_t sys_exit(int status);
 int64_t sys_getpid(void);
 int64_t sys_sleep_ms(uint64_t ms);
@@ -307,8 +392,11 @@ int64_t sys_input_peek(char *out);
 int64_t sys_reboot(void);
 int64_t sys_exec(const char *path);
 int64_t sys_exec_argv(const char *path, const char *cmdline);
+int64_t sys_spawn(const char *path, const char *cmdline);
+int64_t sys_waitpid(int pid, int *status, int options);
 int64_t sys_get_cmdline(char *buf, size_t len);
 int64_t sys_listdir(const char *path, struct fat32_dirent *entries, int max_entries);
+int64_t sys_getdents(const char *path, void *buf, size_t len, uint64_t *cursor);
 int64_t sys_proclist(struct proc_info *out, size_t max);
 int64_t sys_yield(void);
 int64_t sys_time_read(struct numos_calendar_time *out);
@@ -337,6 +425,19 @@ int64_t sys_net_tcp_send(int handle, const void *buf, size_t len, uint32_t timeo
 int64_t sys_net_tcp_recv(int handle, void *buf, size_t len, uint32_t timeout_ms);
 int64_t sys_net_tcp_close(int handle, uint32_t timeout_ms);
 int64_t sys_net_tcp_info(int handle, struct numos_net_tcp_info *out);
+int64_t sys_socket(int type);
+int64_t sys_bind(int fd, const struct numos_sockaddr_in *addr);
+int64_t sys_listen(int fd, int backlog);
+int64_t sys_accept(int fd, struct numos_sockaddr_in *peer);
+int64_t sys_connect(int fd, const struct numos_sockaddr_in *addr);
+int64_t sys_sendto(int fd, const void *buf, size_t len,
+                   const struct numos_sockaddr_in *addr);
+int64_t sys_recvfrom(int fd, void *buf, size_t len, struct numos_sockaddr_in *from);
+int64_t sys_epoll_create(void);
+int64_t sys_epoll_ctl(int epfd, int op, int kind, int id,
+                      const struct numos_epoll_event *event);
+int64_t sys_epoll_wait(int epfd, struct numos_epoll_event *events, int max_events,
+                       int64_t timeout_ms);
 int64_t sys_net_tls_probe(const uint8_t *ipv4,
                           uint16_t port,
                           const char *server_name,
@@ -347,6 +448,9 @@ int64_t sys_net_http_get(const struct numos_net_http_request *request,
                          void *buf,
                          size_t len,
                          struct numos_net_http_result *out);
+int64_t sys_net_http_fetch(const struct numos_net_http_request *request,
+                           int fd,
+                           struct numos_net_http_result *out);
 int64_t sys_poweroff(void);
 
 /* Framebuffer syscall implementations */
@@ -0,0 +1,32 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include "lib/base.h"
+
+/*
+ * Kernel access to user memory.
+ *
+ * Each helper checks the whole range against the user half of the address
+ * space once, then copies in bulk.  A page fault (or #GP) on one of the
+ * copy instructions is not fatal: the exception handler finds the faulting
+ * instruction in the __ex_table section and resumes at its fixup, so a
+ * pointer into an unmapped hole returns an error instead of halting.
+ */
+
+/* First non-canonical address; user pointers must lie below it */
+#define USER_ADDR_LIMIT  0x0000800000000000UL
+
+struct uaccess_extable_entry {
+    uint64_t insn;                      /* Address of a user-access insn */
+    uint64_t fixup;                     /* Where to resume if it faults  */
+};
+
+int  user_access_ok(const void *ptr, size_t len);
+int  copy_from_user(void *dst, const void *user_src, size_t len);
+int  copy_to_user(void *user_dst, const void *src, size_t len);
+long strncpy_from_user(char *dst, const char *user_src, size_t cap);
+
+/* Exception path: redirect *rip to its fixup if it is a user access */
+int  uaccess_fixup(uint64_t *rip);
+
+#endif /* UACCESS_H */
@@ -0,0 +1,49 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include "lib/base.h"
+#include "drivers/timer.h"
+
+/*
+ * Shared kernel data page.
+ *
+ * One physical page, written only by the timer IRQ, is mapped read-only
+ * at VDSO_DATA_ADDR in every user address space (on first touch, like
+ * stack pages).  User code reads uptime, the wall clock and process
+ * counters from it without a syscall.  Updates use a sequence lock:
+ * seq is odd while the kernel is writing, so a reader samples seq, reads
+ * the fields, and retries if seq was odd or has changed.
+ *
+ * tsc_at_tick and tsc_to_ns_mult let readers interpolate between ticks:
+ *   ns = uptime_ms * 1000000 + ((rdtsc() - tsc_at_tick) * mult >> 32)
+ * with the TSC delta clamped to tsc_per_tick.  The mult stays 0 until the
+ * TSC has been calibrated against the PIT, so readers fall back to tick
+ * resolution.  The layout is ABI; user/include/syscalls.h mirrors it.
+ */
+
+#define VDSO_DATA_ADDR      0x00000000C0000000UL   /* Just above the mmap window */
+#define VDSO_MAGIC          0x4F53444Eu            /* "NDSO" */
+#define VDSO_VERSION        1
+
+struct numos_vdso_data {
+    uint32_t magic;
+    uint32_t version;
+    volatile uint32_t seq;              /* Odd while an update is in progress */
+    uint32_t tick_hz;
+    uint64_t ticks;
+    uint64_t uptime_ms;
+    uint64_t tsc_at_tick;               /* TSC sampled at the last tick */
+    uint64_t tsc_khz;                   /* 0 until calibrated */
+    uint64_t tsc_to_ns_mult;            /* ns per cycle, 32.32 fixed point */
+    uint64_t tsc_per_tick;              /* Upper bound for the TSC delta */
+    struct numos_calendar_time wall_clock;  /* Refreshed once per second */
+    uint64_t processes_active;
+    uint64_t processes_created;
+    uint64_t context_switches;
+};
+
+void vdso_init(uint32_t tick_hz);
+void vdso_update(uint64_t ticks);
+int  vdso_handle_fault(uint64_t fault_addr);
+
+#endif /* VDSO_H */
@@ -0,0 +1,32 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include "lib/base.h"
+
+/*
+ * Wait queues.
+ *
+ * A wait queue is a FIFO of blocked processes waiting for one event.  A
+ * sleeper checks its condition with interrupts disabled, then calls
+ * wait_queue_sleep() or wait_queue_sleep_until(), which link it in, mark
+ * it BLOCKED and yield.  Wakers may run in IRQ context; they make queued
+ * processes READY again.  A deadline is enforced by the scheduler tick,
+ * which unlinks the sleeper when it passes.  Sleepers must recheck their
+ * condition after waking since several may race for one event.
+ */
+
+struct process;
+
+struct wait_queue {
+    struct process *head;
+    struct process *tail;
+};
+
+void wait_queue_init(struct wait_queue *wq);
+void wait_queue_sleep(struct wait_queue *wq);
+int  wait_queue_sleep_until(struct wait_queue *wq, uint64_t deadline_ms);
+void wait_queue_wake_one(struct wait_queue *wq);
+void wait_queue_wake_all(struct wait_queue *wq);
+void wait_queue_remove(struct wait_queue *wq, struct process *proc);
+
+#endif /* WAITQUEUE_H */
@@ -155,11 +155,12 @@ isr_common_stub:
     mov fs, ax
     mov gs, ax
     
-    ; Set up parameters for exception_handler(int_no, err_code)
-    ; x86-64 calling convention: RDI = 1st arg, RSI = 2nd arg
+    ; Set up parameters for exception_handler(int_no, err_code, &rip)
+    ; x86-64 calling convention: RDI = 1st arg, RSI = 2nd arg, RDX = 3rd
     ; Stack: 15 GPRs (120 bytes) + 1 DS (8 bytes) = 128 bytes
     mov rdi, [rsp + 128]    ; Interrupt number
     mov rsi, [rsp + 136]    ; Error code
+    lea rdx, [rsp + 144]    ; Saved RIP, rewritten for user-access fixups
     
     ; Call C exception handler
     cld                     ; C code expects direction flag cleared
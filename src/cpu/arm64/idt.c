@@ -19,11 +19,18 @@ void idt_flush(uint64_t idt_ptr_addr) {
     (void)idt_ptr_addr;
 }
 
-void exception_handler(uint32_t exception_num, uint64_t error_code) {
+void exception_handler(uint32_t exception_num, uint64_t error_code, uint64_t *rip) {
     (void)exception_num;
     (void)error_code;
+    (void)rip;
 }
 
 void irq_handler(uint32_t irq_num) {
     (void)irq_num;
 }
+
+int irq_register_handler(uint8_t irq, irq_callback_t handler) {
+    (void)irq;
+    (void)handler;
+    return -1;
+}
@@ -192,6 +192,10 @@ int paging_unmap_page(uint64_t virtual_addr) {
     return 0;
 }
 
+int paging_unmap_page_keep_frame(uint64_t virtual_addr) {
+    return paging_unmap_page(virtual_addr);
+}
+
 int paging_is_mapped(uint64_t virtual_addr) {
     struct page_table *l1 = arm64_get_next_table(active_root,
                                                  PML4_INDEX(virtual_addr),
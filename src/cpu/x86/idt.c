@@ -10,7 +10,8 @@
  *   process (recoverable) or halts the kernel (unrecoverable).
  *
  * IRQ handler:
- *   Dispatches timer and keyboard events, then sends EOI to the PIC.
+ *   Dispatches timer and keyboard events, plus any driver callback
+ *   registered for a PCI interrupt line, then sends EOI to the PIC.
  *
  * The timer IRQ additionally calls scheduler_tick() to drive preemptive
  * scheduling.
@@ -19,6 +20,7 @@
 #include "cpu/idt.h"
 #include "kernel/kernel.h"
 #include "kernel/scheduler.h"
+#include "kernel/uaccess.h"
 #include "drivers/keyboard.h"
 #include "drivers/graphices/vga.h"
 #include "drivers/pic.h"
@@ -35,6 +37,9 @@
 static struct idt_entry idt[IDT_ENTRIES]       __attribute__((aligned(16)));
 static struct idt_ptr   idt_pointer            __attribute__((aligned(16)));
 
+/* Driver callbacks for lines the kernel does not handle itself */
+static irq_callback_t irq_callbacks[16];
+
 /* Per-vector interrupt counts for diagnostics */
 static uint64_t interrupt_counts[IDT_ENTRIES] = {0};
 
@@ -185,11 +190,13 @@ void idt_init(void) {
 /*
  * exception_handler - C-level exception dispatcher.
  *
- * Page faults are forwarded to page_fault_handler() which may satisfy them
- * via demand-paging.  All other exceptions in a user process kill that
- * process and reschedule.  Exceptions in the kernel (idle process) halt.
+ * Page faults are first offered to demand paging.  A page fault or #GP
+ * that is left over on a kernel user-access instruction resumes at its
+ * fixup (rip points at the saved RIP in the trap frame).  All other
+ * exceptions in a user process kill that process and reschedule.
+ * Exceptions in the kernel (idle process) halt.
  */
-void exception_handler(uint32_t exception_num, uint64_t error_code) {
+void exception_handler(uint32_t exception_num, uint64_t error_code, uint64_t *rip) {
     /* Update statistics */
     if (exception_num < 32) exception_counts[exception_num]++;
     interrupt_counts[exception_num]++;
@@ -200,10 +207,14 @@ void exception_handler(uint32_t exception_num, uint64_t error_code) {
     if (exception_num == EXCEPTION_PAGE_FAULT) {
         uint64_t fault_addr;
         __asm__ volatile("mov %%cr2, %0" : "=r"(fault_addr));
-        page_fault_handler(error_code, fault_addr);
+        if (page_fault_resolve(error_code, fault_addr)) return;
+        if (!(error_code & 4) && uaccess_fixup(rip)) return;
+        page_fault_report(error_code, fault_addr);
         return;
     }
 
+    if (exception_num == 13 && uaccess_fixup(rip)) return;
+
     /* Print exception information */
     vga_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
     vga_writestring("\n\n===== CPU EXCEPTION =====\n");
@@ -266,8 +277,24 @@ void irq_handler(uint32_t irq_num) {
 
         default:
             /* Unhandled IRQ: EOI is still sent below */
+            if (irq_num < 16 && irq_callbacks[irq_num]) {
+                irq_callbacks[irq_num]();
+            }
             break;
     }
 
     pic_send_eoi(irq_num);
 }
+
+/*
+ * irq_register_handler - route a legacy IRQ line to a driver callback.
+ * Lines 0-2 belong to the kernel, and a line carries one callback only.
+ * Returns 0 on success, -1 otherwise.  The caller unmasks the line.
+ */
+int irq_register_handler(uint8_t irq, irq_callback_t handler) {
+    if (irq < 3 || irq >= 16 || !handler) return -1;
+    if (irq_callbacks[irq] && irq_callbacks[irq] != handler) return -1;
+
+    irq_callbacks[irq] = handler;
+    return 0;
+}
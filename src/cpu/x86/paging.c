@@ -270,6 +270,14 @@ int paging_unmap_page(uint64_t virtual_addr) {
     return paging_unmap_page_advanced(virtual_addr, 1);
 }
 
+/*
+ * paging_unmap_page_keep_frame - unmap virtual_addr but leave the frame
+ * allocated, for pages owned by someone else such as the page cache.
+ */
+int paging_unmap_page_keep_frame(uint64_t virtual_addr) {
+    return paging_unmap_page_advanced(virtual_addr, 0);
+}
+
 /*
  * paging_is_mapped - return 1 if virtual_addr has a present mapping, 0 if not.
  */
@@ -340,7 +348,7 @@ struct page_table *paging_get_page_table(uint64_t virtual_addr, int create) {
 
     /* User-space mappings need the PAGE_USER bit set on all levels */
     int user_mapping = (virtual_addr >= USER_VIRTUAL_BASE &&
-                        virtual_addr <  USER_STACK_TOP) ? 1 : 0;
+                        virtual_addr <  USER_VIRTUAL_END) ? 1 : 0;
 
     struct page_table *pml4 = current_pml4;
 
@@ -565,18 +573,18 @@ uint64_t paging_align_down(uint64_t addr, uint64_t alignment) {
  * ======================================================================= */
 
 /*
- * page_fault_handler - called from the IDT exception handler for vector 14.
- * Attempts demand-paging if the faulting address is inside a known VM region.
- * User stack growth also stays active during syscalls, because the kernel may
- * touch a user buffer before that stack page has been committed.
- * Halts the kernel for unhandled faults.
+ * page_fault_resolve - try to satisfy a fault by demand-paging, either
+ * inside a known VM region or through the current process (stack growth,
+ * file mappings).  User stack growth also stays active during syscalls,
+ * because the kernel may touch a user buffer before that stack page has
+ * been committed.  Returns 1 if the faulting access can be retried.
  */
-void page_fault_handler(uint64_t error_code, uint64_t fault_addr) {
+int page_fault_resolve(uint64_t error_code, uint64_t fault_addr) {
     paging_stats.page_faults++;
 
     if (!(error_code & 1) &&
         scheduler_handle_user_page_fault(fault_addr)) {
-        return;
+        return 1;
     }
 
     struct vm_region *region = paging_find_vm_region(fault_addr);
@@ -588,11 +596,26 @@ void page_fault_handler(uint64_t error_code, uint64_t fault_addr) {
             uint64_t page_addr = paging_align_down(fault_addr, PAGE_SIZE);
             if (paging_map_page_advanced(page_addr, physical,
                                          region->flags, 0) == 0) {
-                return;  /* fault satisfied */
+                return 1;  /* fault satisfied */
             }
             pmm_free_frame(physical);
         }
     }
+    return 0;
+}
+
+/*
+ * page_fault_handler - called for vector 14 when no fixup applies.
+ * Halts the kernel for unhandled faults.
+ */
+void page_fault_handler(uint64_t error_code, uint64_t fault_addr) {
+    if (page_fault_resolve(error_code, fault_addr)) return;
+    page_fault_report(error_code, fault_addr);
+}
+
+/* page_fault_report - display diagnostics for an unhandled fault and halt */
+void page_fault_report(uint64_t error_code, uint64_t fault_addr) {
+    struct vm_region *region = paging_find_vm_region(fault_addr);
 
     /* Unhandled page fault: display diagnostics and halt */
     vga_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
@@ -22,7 +22,9 @@
  */
 
 #include "drivers/keyboard.h"
+#include "kernel/epoll.h"
 #include "kernel/kernel.h"
+#include "kernel/waitqueue.h"
 
 /* =========================================================================
  * Scan-code translation tables
@@ -74,6 +76,10 @@ static volatile char   keyboard_buffer[KEYBOARD_BUFFER_SIZE];
 static volatile size_t buffer_head = 0;
 static volatile size_t buffer_tail = 0;
 
+/* Readers blocked in keyboard_getchar_buffered(); woken by buffer_push() */
+static struct wait_queue keyboard_waiters;
+static struct epoll_source keyboard_poll_source;
+
 /* =========================================================================
  * Helper: push one char into the ring buffer (called from IRQ context)
  * ======================================================================= */
@@ -82,6 +88,8 @@ static void buffer_push(char c) {
     if (next != buffer_tail) {
         keyboard_buffer[buffer_head] = c;
         buffer_head = next;
+        wait_queue_wake_all(&keyboard_waiters);
+        epoll_source_notify(&keyboard_poll_source);
     }
 }
 
@@ -290,8 +298,12 @@ void keyboard_handler(void) {
  * buffer.  Used by syscall/scroll contexts; must NOT be called from IRQ.
  */
 char keyboard_getchar_buffered(void) {
-    while (buffer_head == buffer_tail)
-        __asm__ volatile("sti; hlt; cli" ::: "memory");
+    __asm__ volatile("cli" ::: "memory");
+    while (buffer_head == buffer_tail) {
+        /* A process sleeps until the IRQ pushes a key; the kernel halts */
+        wait_queue_sleep(&keyboard_waiters);
+        __asm__ volatile("cli" ::: "memory");
+    }
 
     char c      = keyboard_buffer[buffer_tail];
     buffer_tail = (buffer_tail + 1) % KEYBOARD_BUFFER_SIZE;
@@ -325,6 +337,12 @@ int keyboard_try_getchar(char *out) {
     return 1;
 }
 
+/* keyboard_poll - EPOLL_IN while the ring buffer holds a character */
+int keyboard_poll(struct epoll_source **source) {
+    if (source) *source = &keyboard_poll_source;
+    return (buffer_head != buffer_tail) ? EPOLL_IN : 0;
+}
+
 void keyboard_flush_buffer(void) {
     __asm__ volatile("cli");
     buffer_tail = buffer_head;
@@ -36,10 +36,6 @@
 
 #define TLS_RSA_ENC_MIN_LEN         64
 
-#define NET_OK                   0
-#define NET_ERR_GENERIC         -1
-#define NET_ERR_INVALID         -5
-
 struct tls_sha256_ctx {
     uint32_t state[8];
     uint64_t total_len;
@@ -1303,9 +1299,83 @@ int net_tls_probe_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
     return rc;
 }
 
-static void tls_parse_http_headers(const uint8_t *data, size_t len, struct net_http_result *out) {
+#define HTTP_POOL_SIZE          4
+#define HTTP_IDLE_TIMEOUT_MS    15000u
+#define HTTP_HEADER_MAX         4096u
+#define HTTP_LINE_MAX           64u
+#define HTTP_RX_BUF_LEN         (TLS_MAX_RECORD_LEN + 2048u)
+#define HTTP_BODY_STOPPED       1
+
+/*
+ * A kept-alive HTTP connection.  A busy slot belongs to one request; idle
+ * slots are matched by (address, port, secure, host) and reused until the
+ * peer closes them or they sit idle for HTTP_IDLE_TIMEOUT_MS.  The TLS
+ * session holds the TCP handle for plain connections too.
+ */
+struct http_conn {
+    uint8_t  in_use;
+    uint8_t  busy;
+    uint8_t  secure;
+    uint8_t  reserved0;
+    uint8_t  remote_ip[NET_IPV4_ADDR_LEN];
+    uint16_t remote_port;
+    char     host[NET_HOST_NAME_LEN];
+    uint64_t idle_since_ms;
+    uint8_t *rx;                        /* Received bytes, decrypted if secure */
+    size_t   rx_pos;
+    size_t   rx_len;
+    struct tls_session session;
+};
+
+/* How the body of a response is delimited */
+struct http_framing {
+    int      have_length;
+    uint32_t content_length;
+    int      chunked;
+    int      keep_alive;
+};
+
+struct http_body_state {
+    net_http_sink_t         sink;
+    void                   *ctx;
+    struct net_http_result *result;
+    size_t                  total;
+};
+
+static struct http_conn g_http_pool[HTTP_POOL_SIZE];
+
+static int http_lower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (c - 'A' + 'a') : c;
+}
+
+static int http_name_is(const uint8_t *name, size_t len, const char *want) {
+    size_t i = 0;
+    for (; i < len && want[i]; i++) {
+        if (http_lower(name[i]) != want[i]) return 0;
+    }
+    return i == len && want[i] == '\0';
+}
+
+static int http_value_has(const uint8_t *value, size_t len, const char *token) {
+    size_t token_len = strlen(token);
+    for (size_t start = 0; start + token_len <= len; start++) {
+        if (http_name_is(value + start, token_len, token)) return 1;
+    }
+    return 0;
+}
+
+static void http_copy_value(char *dst, size_t cap, const uint8_t *value, size_t len) {
+    if (len >= cap) len = cap - 1;
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+}
+
+static void http_parse_headers(const uint8_t *data, size_t len,
+                               struct net_http_result *out,
+                               struct http_framing *framing) {
     size_t header_end = 0;
 
+    memset(framing, 0, sizeof(*framing));
     if (!data || !out || len == 0) return;
 
     for (size_t i = 0; i + 3 < len; i++) {
@@ -1328,6 +1398,8 @@ static void tls_parse_http_headers(const uint8_t *data, size_t len, struct net_h
     status_line[i] = '\0';
     const char *space = strstr(status_line, " ");
     if (space) out->status_code = (uint16_t)tls_parse_status_code(space + 1);
+    /* HTTP/1.1 connections persist unless a side says otherwise */
+    framing->keep_alive = strstr(status_line, "HTTP/1.0") != status_line;
 
     size_t line_start = 0;
     while (line_start < header_end && data[line_start] != '\n') line_start++;
@@ -1347,6 +1419,8 @@ static void tls_parse_http_headers(const uint8_t *data, size_t len, struct net_h
         }
 
         if (have_colon && colon > line_start) {
+            const uint8_t *name = data + line_start;
+            size_t name_len = colon - line_start;
             const uint8_t *value = data + colon + 1;
             size_t value_len = line_end - colon - 1;
             size_t start = 0;
@@ -1360,37 +1434,30 @@ static void tls_parse_http_headers(const uint8_t *data, size_t len, struct net_h
                    (value[end - 1] == ' ' || value[end - 1] == '\t')) {
                 end--;
             }
-
-            if ((colon - line_start) == 8 &&
-                (data[line_start + 0] == 'L' || data[line_start + 0] == 'l') &&
-                (data[line_start + 1] == 'o' || data[line_start + 1] == 'O') &&
-                (data[line_start + 2] == 'c' || data[line_start + 2] == 'C') &&
-                (data[line_start + 3] == 'a' || data[line_start + 3] == 'A') &&
-                (data[line_start + 4] == 't' || data[line_start + 4] == 'T') &&
-                (data[line_start + 5] == 'i' || data[line_start + 5] == 'I') &&
-                (data[line_start + 6] == 'o' || data[line_start + 6] == 'O') &&
-                (data[line_start + 7] == 'n' || data[line_start + 7] == 'N')) {
-                size_t copy = end - start;
-                if (copy >= sizeof(out->location)) copy = sizeof(out->location) - 1;
-                memcpy(out->location, value + start, copy);
-                out->location[copy] = '\0';
-            } else if ((colon - line_start) == 12 &&
-                       (data[line_start + 0] == 'C' || data[line_start + 0] == 'c') &&
-                       (data[line_start + 1] == 'o' || data[line_start + 1] == 'O') &&
-                       (data[line_start + 2] == 'n' || data[line_start + 2] == 'N') &&
-                       (data[line_start + 3] == 't' || data[line_start + 3] == 'T') &&
-                       (data[line_start + 4] == 'e' || data[line_start + 4] == 'E') &&
-                       (data[line_start + 5] == 'n' || data[line_start + 5] == 'N') &&
-                       (data[line_start + 6] == 't' || data[line_start + 6] == 'T') &&
-                       data[line_start + 7] == '-' &&
-                       (data[line_start + 8] == 'T' || data[line_start + 8] == 't') &&
-                       (data[line_start + 9] == 'y' || data[line_start + 9] == 'Y') &&
-                       (data[line_start + 10] == 'p' || data[line_start + 10] == 'P') &&
-                       (data[line_start + 11] == 'e' || data[line_start + 11] == 'E')) {
-                size_t copy = end - start;
-                if (copy >= sizeof(out->content_type)) copy = sizeof(out->content_type) - 1;
-                memcpy(out->content_type, value + start, copy);
-                out->content_type[copy] = '\0';
+            value += start;
+            value_len = end - start;
+
+            if (http_name_is(name, name_len, "location")) {
+                http_copy_value(out->location, sizeof(out->location), value, value_len);
+            } else if (http_name_is(name, name_len, "content-type")) {
+                http_copy_value(out->content_type, sizeof(out->content_type), value, value_len);
+            } else if (http_name_is(name, name_len, "content-length")) {
+                uint64_t length = 0;
+                size_t digits = 0;
+                while (digits < value_len && value[digits] >= '0' && value[digits] <= '9' &&
+                       length <= 0xFFFFFFFFull) {
+                    length = (length * 10u) + (uint64_t)(value[digits] - '0');
+                    digits++;
+                }
+                if (digits > 0 && digits == value_len && length <= 0xFFFFFFFFull) {
+                    framing->have_length = 1;
+                    framing->content_length = (uint32_t)length;
+                }
+            } else if (http_name_is(name, name_len, "transfer-encoding")) {
+                framing->chunked = http_value_has(value, value_len, "chunked");
+            } else if (http_name_is(name, name_len, "connection")) {
+                if (http_value_has(value, value_len, "close")) framing->keep_alive = 0;
+                else if (http_value_has(value, value_len, "keep-alive")) framing->keep_alive = 1;
             }
         }
 
@@ -1401,126 +1468,449 @@ static void tls_parse_http_headers(const uint8_t *data, size_t len, struct net_h
     }
 }
 
-ssize_t net_http_get_ipv4(const struct net_http_request *request,
-                          void *buf,
-                          size_t len,
-                          struct net_http_result *out) {
-    struct tls_session session;
-    uint8_t request_buf[512];
-    uint8_t *record_buf = (uint8_t *)kmalloc(TLS_MAX_RECORD_LEN);
-    size_t request_len = 0;
-    size_t total = 0;
-    uint8_t *dst = (uint8_t *)buf;
-    uint32_t timeout_ms;
-    int secure;
+static void http_conn_drop(struct http_conn *conn) {
+    if (conn->session.tcp_handle > 0) (void)net_tcp_release(conn->session.tcp_handle);
+    if (conn->rx) kfree(conn->rx);
+    memset(conn, 0, sizeof(*conn));
+}
 
-    if (!request || !buf || !out || request->remote_port == 0) return NET_ERR_INVALID;
-    if (!record_buf) return NET_ERR_GENERIC;
-    secure = request->secure ? 1 : 0;
-    timeout_ms = request->timeout_ms ? request->timeout_ms : 5000u;
-    memset(&session, 0, sizeof(session));
-    session.protocol_version = TLS_VERSION_1_2;
-    tls_copy_string(session.server_name, request->host, sizeof(session.server_name));
+/* An idle connection is only worth reusing if nothing arrived on it since */
+static int http_conn_idle_ok(struct http_conn *conn, uint64_t now) {
+    struct net_tcp_info info;
 
-    if (secure && (request->flags & NET_CLIENT_FLAG_INSECURE) == 0) return NET_ERR_INVALID;
-    {
-        static const char prefix1[] = "GET ";
-        static const char prefix2[] = " HTTP/1.1\r\nHost: ";
-        static const char suffix[] = "\r\nConnection: close\r\nUser-Agent: NumOS-Kernel\r\n\r\n";
-        const char *path = request->path[0] ? request->path : "/";
-        size_t need = strlen(prefix1) + strlen(path) + strlen(prefix2) + strlen(request->host) + strlen(suffix);
-        if (strlen(request->host) == 0 || need > sizeof(request_buf)) return NET_ERR_INVALID;
-        memcpy(request_buf + request_len, prefix1, strlen(prefix1));
-        request_len += strlen(prefix1);
-        memcpy(request_buf + request_len, path, strlen(path));
-        request_len += strlen(path);
-        memcpy(request_buf + request_len, prefix2, strlen(prefix2));
-        request_len += strlen(prefix2);
-        memcpy(request_buf + request_len, request->host, strlen(request->host));
-        request_len += strlen(request->host);
-        memcpy(request_buf + request_len, suffix, strlen(suffix));
-        request_len += strlen(suffix);
-    }
-
-    session.tcp_handle = net_tcp_connect_ipv4(request->remote_ip, request->remote_port, timeout_ms);
-    if (session.tcp_handle < 0) {
-        kfree(record_buf);
-        return session.tcp_handle;
+    if (now - conn->idle_since_ms > HTTP_IDLE_TIMEOUT_MS) return 0;
+    if (conn->rx_pos != conn->rx_len) return 0;
+    if (net_tcp_get_info(conn->session.tcp_handle, &info) != NET_OK) return 0;
+    return !info.reset && !info.remote_closed && info.recv_ready == 0;
+}
+
+/*
+ * http_conn_acquire - claim an idle pooled connection to the request's
+ * server, or connect a new one in a free slot (evicting the least recently
+ * used idle connection when the pool is full).  *reused tells which.
+ * Returns NET_OK with *out marked busy, or a NET_ERR_* code.
+ */
+static int http_conn_acquire(const struct net_http_request *request,
+                             int secure,
+                             uint32_t timeout_ms,
+                             struct http_conn **out,
+                             int *reused) {
+    struct http_conn *slot = NULL;
+    uint64_t now = timer_get_uptime_ms();
+    int handle;
+
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        struct http_conn *conn = &g_http_pool[i];
+        if (!conn->in_use || conn->busy) continue;
+        if (!http_conn_idle_ok(conn, now)) {
+            http_conn_drop(conn);
+            continue;
+        }
+        if (conn->secure == secure &&
+            conn->remote_port == request->remote_port &&
+            memcmp(conn->remote_ip, request->remote_ip, NET_IPV4_ADDR_LEN) == 0 &&
+            strcmp(conn->host, request->host) == 0) {
+            conn->busy = 1;
+            *out = conn;
+            *reused = 1;
+            return NET_OK;
+        }
     }
 
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        struct http_conn *conn = &g_http_pool[i];
+        if (!conn->in_use) {
+            slot = conn;
+            break;
+        }
+        if (!conn->busy && (!slot || conn->idle_since_ms < slot->idle_since_ms)) slot = conn;
+    }
+    if (!slot) return NET_ERR_UNAVAILABLE;
+    if (slot->in_use) http_conn_drop(slot);
+
+    /* Claim the slot before blocking so no other request picks it */
+    slot->in_use = 1;
+    slot->busy = 1;
+    slot->secure = (uint8_t)secure;
+    slot->remote_port = request->remote_port;
+    memcpy(slot->remote_ip, request->remote_ip, NET_IPV4_ADDR_LEN);
+    tls_copy_string(slot->host, request->host, sizeof(slot->host));
+    slot->session.protocol_version = TLS_VERSION_1_2;
+    tls_copy_string(slot->session.server_name, request->host, sizeof(slot->session.server_name));
+
+    slot->rx = (uint8_t *)kmalloc(HTTP_RX_BUF_LEN);
+    if (!slot->rx) {
+        http_conn_drop(slot);
+        return NET_ERR_GENERIC;
+    }
+
+    handle = net_tcp_connect_ipv4(request->remote_ip, request->remote_port, timeout_ms);
+    if (handle < 0) {
+        http_conn_drop(slot);
+        return handle;
+    }
+    slot->session.tcp_handle = handle;
+
     if (secure) {
-        int rc = tls_handshake(&session, timeout_ms);
+        int rc = tls_handshake(&slot->session, timeout_ms);
         if (rc != NET_OK) {
-            (void)net_tcp_close(session.tcp_handle, timeout_ms);
-            kfree(record_buf);
+            http_conn_drop(slot);
             return rc;
         }
-        if (!tls_send_encrypted_record(&session, TLS_RECORD_APPLICATION, request_buf, request_len, timeout_ms)) {
-            tls_send_close_notify(&session, timeout_ms);
-            (void)net_tcp_close(session.tcp_handle, timeout_ms);
-            kfree(record_buf);
-            return NET_ERR_GENERIC;
+    }
+
+    *out = slot;
+    *reused = 0;
+    return NET_OK;
+}
+
+static void http_conn_release(struct http_conn *conn, int keep) {
+    if (!keep) {
+        if (conn->secure) tls_send_close_notify(&conn->session, 1000u);
+        http_conn_drop(conn);
+        return;
+    }
+    conn->busy = 0;
+    conn->idle_since_ms = timer_get_uptime_ms();
+}
+
+static int http_conn_send(struct http_conn *conn, const uint8_t *data, size_t len,
+                          uint32_t timeout_ms) {
+    if (!conn->secure) {
+        return net_tcp_send(conn->session.tcp_handle, data, len, timeout_ms) == (ssize_t)len
+                   ? NET_OK : NET_ERR_CLOSED;
+    }
+    while (len > 0) {
+        size_t chunk = len > TLS_MAX_FRAGMENT_LEN ? TLS_MAX_FRAGMENT_LEN : len;
+        if (!tls_send_encrypted_record(&conn->session, TLS_RECORD_APPLICATION,
+                                       data, chunk, timeout_ms)) {
+            return NET_ERR_CLOSED;
         }
-    } else if (net_tcp_send(session.tcp_handle, request_buf, request_len, timeout_ms) != (ssize_t)request_len) {
-        (void)net_tcp_close(session.tcp_handle, timeout_ms);
-        kfree(record_buf);
-        return NET_ERR_GENERIC;
+        data += chunk;
+        len -= chunk;
     }
+    return NET_OK;
+}
 
-    memset(out, 0, sizeof(*out));
-    out->secure = secure ? 1u : 0u;
-    out->headers_included = (request->flags & NET_HTTP_FLAG_INCLUDE_HEADERS) ? 1u : 0u;
-    out->protocol_version = secure ? session.protocol_version : 0;
-    out->cipher_suite = secure ? session.cipher_suite : 0;
-    out->remote_port = request->remote_port;
-    memcpy(out->remote_ip, request->remote_ip, NET_IPV4_ADDR_LEN);
+/*
+ * http_conn_fill - make sure unread response bytes are buffered.
+ * Returns 1 when data is available, 0 at end of stream or a NET_ERR_* code.
+ */
+static int http_conn_fill(struct http_conn *conn, uint32_t timeout_ms) {
+    if (conn->rx_pos < conn->rx_len) return 1;
+    conn->rx_pos = 0;
+    conn->rx_len = 0;
+
+    if (!conn->secure) {
+        ssize_t got = net_tcp_recv(conn->session.tcp_handle, conn->rx, HTTP_RX_BUF_LEN, timeout_ms);
+        if (got <= 0) return (int)got;
+        conn->rx_len = (size_t)got;
+        return 1;
+    }
 
-    if (secure) {
-        for (;;) {
-            uint8_t type = 0;
-            size_t record_len = 0;
-            if (!tls_recv_record(&session, &type, record_buf, &record_len, sizeof(record_buf), timeout_ms, 1) ||
-                type == TLS_RECORD_ALERT) {
-                break;
-            }
-            if (type != TLS_RECORD_APPLICATION) continue;
-            size_t copy_len = record_len;
-            if (copy_len > len - total) {
-                copy_len = len - total;
-                out->truncated = 1;
-            }
-            memcpy(dst + total, record_buf, copy_len);
-            total += copy_len;
-            if (total == len) break;
+    for (;;) {
+        uint8_t type = 0;
+        size_t record_len = 0;
+        /* Servers often drop the connection without close_notify */
+        if (!tls_recv_record(&conn->session, &type, conn->rx, &record_len,
+                             HTTP_RX_BUF_LEN, timeout_ms, 1) ||
+            type == TLS_RECORD_ALERT) {
+            return 0;
         }
-        tls_send_close_notify(&session, timeout_ms);
-    } else {
-        for (;;) {
-            ssize_t got = net_tcp_recv(session.tcp_handle, record_buf, sizeof(record_buf), timeout_ms);
-            if (got <= 0) break;
-            size_t copy_len = (size_t)got;
-            if (copy_len > len - total) {
-                copy_len = len - total;
-                out->truncated = 1;
-            }
-            memcpy(dst + total, record_buf, copy_len);
-            total += copy_len;
-            if (total == len) break;
+        if (type != TLS_RECORD_APPLICATION || record_len == 0) continue;
+        conn->rx_len = record_len;
+        return 1;
+    }
+}
+
+static int http_conn_read_byte(struct http_conn *conn, uint32_t timeout_ms, uint8_t *out) {
+    int rc = http_conn_fill(conn, timeout_ms);
+    if (rc <= 0) return rc == 0 ? NET_ERR_CLOSED : rc;
+    *out = conn->rx[conn->rx_pos++];
+    return NET_OK;
+}
+
+/* Read one CRLF-terminated line, keeping at most cap - 1 bytes of it */
+static int http_read_line(struct http_conn *conn, char *line, size_t cap, uint32_t timeout_ms) {
+    size_t len = 0;
+
+    for (;;) {
+        uint8_t c = 0;
+        int rc = http_conn_read_byte(conn, timeout_ms, &c);
+        if (rc != NET_OK) return rc;
+        if (c == '\n') break;
+        if (c != '\r' && len + 1 < cap) line[len++] = (char)c;
+    }
+    line[len] = '\0';
+    return NET_OK;
+}
+
+/*
+ * http_read_head - read the status line and headers of the next final
+ * response, skipping any 1xx interim ones.  *len counts the bytes kept, so
+ * the caller can tell whether anything arrived at all.
+ */
+static int http_read_head(struct http_conn *conn, uint8_t *buf, size_t *len,
+                          uint32_t timeout_ms,
+                          struct net_http_result *out,
+                          struct http_framing *framing) {
+    for (;;) {
+        size_t n = 0;
+
+        while (n < 4 || buf[n - 4] != '\r' || buf[n - 3] != '\n' ||
+               buf[n - 2] != '\r' || buf[n - 1] != '\n') {
+            int rc;
+            if (n == HTTP_HEADER_MAX) return NET_ERR_INVALID;
+            rc = http_conn_read_byte(conn, timeout_ms, &buf[n]);
+            if (rc != NET_OK) return rc;
+            *len = ++n;
         }
+
+        memset(out, 0, sizeof(*out));
+        http_parse_headers(buf, n, out, framing);
+        if (out->status_code == 0) return NET_ERR_INVALID;
+        if (out->status_code >= 200) return NET_OK;
     }
+}
 
-    (void)net_tcp_close(session.tcp_handle, timeout_ms);
-    kfree(record_buf);
-    out->bytes_received = (uint32_t)total;
-    tls_parse_http_headers(dst, total, out);
+static int http_deliver(struct http_body_state *body, const void *data, size_t len) {
+    int rc;
+
+    if (len == 0) return NET_OK;
+    rc = body->sink(body->ctx, body->result, data, len);
+    if (rc < 0) return rc;
+    body->total += len;
+    return rc > 0 ? HTTP_BODY_STOPPED : NET_OK;
+}
+
+static int http_read_span(struct http_conn *conn, struct http_body_state *body,
+                          uint32_t remaining, uint32_t timeout_ms) {
+    while (remaining > 0) {
+        int rc = http_conn_fill(conn, timeout_ms);
+        if (rc <= 0) return rc == 0 ? NET_ERR_CLOSED : rc;
+
+        size_t n = conn->rx_len - conn->rx_pos;
+        if (n > remaining) n = remaining;
+        rc = http_deliver(body, conn->rx + conn->rx_pos, n);
+        conn->rx_pos += n;
+        remaining -= (uint32_t)n;
+        if (rc != NET_OK) return rc;
+    }
+    return NET_OK;
+}
+
+static int http_read_until_close(struct http_conn *conn, struct http_body_state *body,
+                                 uint32_t timeout_ms) {
+    for (;;) {
+        int rc = http_conn_fill(conn, timeout_ms);
+        if (rc <= 0) return rc;
 
-    if ((request->flags & NET_HTTP_FLAG_INCLUDE_HEADERS) == 0 &&
-        out->body_offset > 0 && out->body_offset < out->bytes_received) {
-        size_t body_len = out->bytes_received - out->body_offset;
-        memmove(dst, dst + out->body_offset, body_len);
-        out->bytes_received = (uint32_t)body_len;
-        out->body_offset = 0;
+        size_t n = conn->rx_len - conn->rx_pos;
+        rc = http_deliver(body, conn->rx + conn->rx_pos, n);
+        conn->rx_pos += n;
+        if (rc != NET_OK) return rc;
     }
+}
 
-    return (ssize_t)out->bytes_received;
+static int http_read_chunked(struct http_conn *conn, struct http_body_state *body,
+                             uint32_t timeout_ms) {
+    char line[HTTP_LINE_MAX];
+    int rc;
+
+    for (;;) {
+        uint32_t size = 0;
+        int digits = 0;
+
+        rc = http_read_line(conn, line, sizeof(line), timeout_ms);
+        if (rc != NET_OK) return rc;
+        for (const char *p = line; *p; p++) {
+            int v = http_lower((uint8_t)*p);
+            if (v >= '0' && v <= '9') v -= '0';
+            else if (v >= 'a' && v <= 'f') v = v - 'a' + 10;
+            else break;
+            if (size > 0x0FFFFFFFu) return NET_ERR_INVALID;
+            size = (size << 4) | (uint32_t)v;
+            digits++;
+        }
+        if (digits == 0) return NET_ERR_INVALID;
+        if (size == 0) break;
+
+        rc = http_read_span(conn, body, size, timeout_ms);
+        if (rc != NET_OK) return rc;
+        rc = http_read_line(conn, line, sizeof(line), timeout_ms);
+        if (rc != NET_OK) return rc;
+        if (line[0] != '\0') return NET_ERR_INVALID;
+    }
+
+    /* Skip the trailer section up to its closing empty line */
+    do {
+        rc = http_read_line(conn, line, sizeof(line), timeout_ms);
+        if (rc != NET_OK) return rc;
+    } while (line[0] != '\0');
+    return NET_OK;
+}
+
+static size_t http_append(uint8_t *buf, size_t cap, size_t len, const char *text) {
+    size_t n = strlen(text);
+    if (len + n > cap) return cap + 1;
+    memcpy(buf + len, text, n);
+    return len + n;
+}
+
+static size_t http_build_request(const struct net_http_request *request,
+                                 uint8_t *buf, size_t cap) {
+    size_t len = 0;
+
+    len = http_append(buf, cap, len, "GET ");
+    len = http_append(buf, cap, len, request->path[0] ? request->path : "/");
+    len = http_append(buf, cap, len, " HTTP/1.1\r\nHost: ");
+    len = http_append(buf, cap, len, request->host);
+    len = http_append(buf, cap, len, (request->flags & NET_HTTP_FLAG_CLOSE)
+                                         ? "\r\nConnection: close"
+                                         : "\r\nConnection: keep-alive");
+    len = http_append(buf, cap, len, "\r\nUser-Agent: NumOS-Kernel\r\n\r\n");
+    return len > cap ? 0 : len;
+}
+
+/*
+ * net_http_fetch_ipv4 - issue one GET and stream the response to sink as
+ * it arrives.  Content-Length, chunked and close-delimited bodies are all
+ * decoded, so sink only ever sees body bytes (preceded by the header block
+ * when NET_HTTP_FLAG_INCLUDE_HEADERS is set).  Connections are kept in a
+ * small per-host pool, so redirects and follow-up requests to the same
+ * server skip the TCP and TLS handshakes.
+ * Returns the number of bytes passed to sink, or a NET_ERR_* code.
+ */
+ssize_t net_http_fetch_ipv4(const struct net_http_request *request,
+                            net_http_sink_t sink,
+                            void *ctx,
+                            struct net_http_result *out) {
+    struct net_http_request req;
+    struct http_conn *conn = NULL;
+    struct http_framing framing;
+    struct http_body_state body;
+    uint8_t request_buf[512];
+    uint8_t *header_buf;
+    size_t request_len;
+    size_t header_len = 0;
+    uint32_t timeout_ms;
+    int secure;
+    int reused = 0;
+    int keep;
+    int rc;
+
+    if (!request || !sink || !out || request->remote_port == 0) return NET_ERR_INVALID;
+    req = *request;
+    req.host[sizeof(req.host) - 1] = '\0';
+    req.path[sizeof(req.path) - 1] = '\0';
+    secure = req.secure ? 1 : 0;
+    timeout_ms = req.timeout_ms ? req.timeout_ms : 5000u;
+
+    if (secure && (req.flags & NET_CLIENT_FLAG_INSECURE) == 0) return NET_ERR_INVALID;
+    if (req.host[0] == '\0') return NET_ERR_INVALID;
+    request_len = http_build_request(&req, request_buf, sizeof(request_buf));
+    if (request_len == 0) return NET_ERR_INVALID;
+
+    header_buf = (uint8_t *)kmalloc(HTTP_HEADER_MAX);
+    if (!header_buf) return NET_ERR_GENERIC;
+
+    /* A pooled connection the server closed while idle fails before any
+     * response byte arrives; give such a request one fresh connection. */
+    for (int attempt = 0;; attempt++) {
+        rc = http_conn_acquire(&req, secure, timeout_ms, &conn, &reused);
+        if (rc != NET_OK) {
+            kfree(header_buf);
+            return rc;
+        }
+        header_len = 0;
+        rc = http_conn_send(conn, request_buf, request_len, timeout_ms);
+        if (rc == NET_OK) rc = http_read_head(conn, header_buf, &header_len, timeout_ms, out, &framing);
+        if (rc == NET_OK) break;
+
+        http_conn_release(conn, 0);
+        if (!reused || header_len > 0 || attempt > 0) {
+            kfree(header_buf);
+            return rc;
+        }
+    }
+
+    out->secure = (uint8_t)secure;
+    out->reused = (uint8_t)reused;
+    out->headers_included = (req.flags & NET_HTTP_FLAG_INCLUDE_HEADERS) ? 1u : 0u;
+    out->protocol_version = secure ? conn->session.protocol_version : 0;
+    out->cipher_suite = secure ? conn->session.cipher_suite : 0;
+    out->remote_port = req.remote_port;
+    memcpy(out->remote_ip, req.remote_ip, NET_IPV4_ADDR_LEN);
+    out->content_length = framing.have_length ? framing.content_length : 0;
+
+    body.sink = sink;
+    body.ctx = ctx;
+    body.result = out;
+    body.total = 0;
+
+    rc = NET_OK;
+    if (out->headers_included) rc = http_deliver(&body, header_buf, header_len);
+    else out->body_offset = 0;
+    kfree(header_buf);
+
+    if (rc == NET_OK) {
+        if (out->status_code == 204 || out->status_code == 304) {
+            /* No body by definition */
+        } else if (framing.chunked) {
+            rc = http_read_chunked(conn, &body, timeout_ms);
+        } else if (framing.have_length) {
+            rc = http_read_span(conn, &body, framing.content_length, timeout_ms);
+        } else {
+            framing.keep_alive = 0;
+            rc = http_read_until_close(conn, &body, timeout_ms);
+        }
+    }
+
+    keep = rc == NET_OK && framing.keep_alive && (req.flags & NET_HTTP_FLAG_CLOSE) == 0;
+    http_conn_release(conn, keep);
+    out->bytes_received = (uint32_t)body.total;
+    if (rc == HTTP_BODY_STOPPED) rc = NET_OK;
+    return rc == NET_OK ? (ssize_t)body.total : rc;
+}
+
+struct http_buffer_sink {
+    uint8_t *dst;
+    size_t   cap;
+    size_t   len;
+    int      truncated;
+};
+
+static int http_buffer_write(void *ctx, const struct net_http_result *result,
+                             const void *data, size_t len) {
+    struct http_buffer_sink *buffer = (struct http_buffer_sink *)ctx;
+    size_t copy = len;
+
+    (void)result;
+    if (copy > buffer->cap - buffer->len) {
+        copy = buffer->cap - buffer->len;
+        buffer->truncated = 1;
+    }
+    memcpy(buffer->dst + buffer->len, data, copy);
+    buffer->len += copy;
+    return buffer->truncated ? HTTP_BODY_STOPPED : 0;
+}
+
+ssize_t net_http_get_ipv4(const struct net_http_request *request,
+                          void *buf,
+                          size_t len,
+                          struct net_http_result *out) {
+    struct http_buffer_sink buffer;
+    ssize_t rc;
+
+    if (!buf) return NET_ERR_INVALID;
+    buffer.dst = (uint8_t *)buf;
+    buffer.cap = len;
+    buffer.len = 0;
+    buffer.truncated = 0;
+
+    rc = net_http_fetch_ipv4(request, http_buffer_write, &buffer, out);
+    if (rc < 0) return rc;
+    out->truncated = (uint8_t)buffer.truncated;
+    out->bytes_received = (uint32_t)buffer.len;
+    return (ssize_t)buffer.len;
 }
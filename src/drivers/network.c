@@ -1,9 +1,13 @@
 #include "drivers/network.h"
 
+#include "cpu/heap.h"
+#include "cpu/idt.h"
 #include "cpu/paging.h"
 #include "drivers/device.h"
 #include "drivers/graphices/vga.h"
+#include "drivers/pic.h"
 #include "drivers/timer.h"
+#include "kernel/epoll.h"
 #include "kernel/kernel.h"
 #include "kernel/scheduler.h"
 
@@ -11,6 +15,7 @@
 #define PCI_COMMAND_IO           0x0001
 #define PCI_COMMAND_MEMORY       0x0002
 #define PCI_COMMAND_BUSMASTER    0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
 
 #define E1000_VENDOR_ID          0x8086
 #define E1000_DEVICE_ID_82540EM  0x100E
@@ -18,6 +23,9 @@
 #define PCNET_VENDOR_ID          0x1022
 #define PCNET_DEVICE_ID          0x2000
 
+#define VIRTIO_VENDOR_ID         0x1AF4
+#define VIRTIO_DEVICE_ID_NET     0x1000   /* Transitional: legacy I/O BAR */
+
 #define E1000_MMIO_VIRT_BASE     0xFFFFFFFFC1000000UL
 #define E1000_MMIO_MAP_SIZE      0x00020000UL
 
@@ -25,6 +33,8 @@
 #define E1000_REG_STATUS         0x0008
 #define E1000_REG_EERD           0x0014
 #define E1000_REG_ICR            0x00C0
+#define E1000_REG_ITR            0x00C4
+#define E1000_REG_IMS            0x00D0
 #define E1000_REG_IMC            0x00D8
 #define E1000_REG_RCTL           0x0100
 #define E1000_REG_TCTL           0x0400
@@ -34,11 +44,14 @@
 #define E1000_REG_RDLEN          0x2808
 #define E1000_REG_RDH            0x2810
 #define E1000_REG_RDT            0x2818
+#define E1000_REG_RDTR           0x2820
+#define E1000_REG_RADV           0x282C
 #define E1000_REG_TDBAL          0x3800
 #define E1000_REG_TDBAH          0x3804
 #define E1000_REG_TDLEN          0x3808
 #define E1000_REG_TDH            0x3810
 #define E1000_REG_TDT            0x3818
+#define E1000_REG_RXCSUM         0x5000
 #define E1000_REG_MTA            0x5200
 #define E1000_REG_RAL            0x5400
 #define E1000_REG_RAH            0x5404
@@ -47,9 +60,26 @@
 #define E1000_CTRL_RST           0x04000000UL
 #define E1000_STATUS_LU          0x00000002UL
 
+#define E1000_ICR_LSC            0x00000004UL
+#define E1000_ICR_RXDMT0         0x00000010UL
+#define E1000_ICR_RXO            0x00000040UL
+#define E1000_ICR_RXT0           0x00000080UL
+#define E1000_ICR_RX_BITS        (E1000_ICR_RXDMT0 | E1000_ICR_RXO | E1000_ICR_RXT0)
+
+/*
+ * RX interrupt moderation.  ITR caps the rate at about 8000 interrupts a
+ * second (units of 256 ns); RDTR holds an interrupt for 16 us after each
+ * frame so a burst raises one, and RADV bounds that delay at 64 us.
+ */
+#define E1000_ITR_INTERVAL       488
+#define E1000_RDTR_DELAY         16
+#define E1000_RADV_DELAY         64
+
 #define E1000_RCTL_EN            0x00000002UL
 #define E1000_RCTL_BAM           0x00008000UL
 #define E1000_RCTL_SECRC         0x04000000UL
+#define E1000_RXCSUM_IPOFL       0x00000100UL
+#define E1000_RXCSUM_TUOFL       0x00000200UL
 
 #define E1000_TCTL_EN            0x00000002UL
 #define E1000_TCTL_PSP           0x00000008UL
@@ -59,8 +89,19 @@
 #define E1000_TX_CMD_EOP         0x01
 #define E1000_TX_CMD_IFCS        0x02
 #define E1000_TX_CMD_RS          0x08
+#define E1000_TX_CMD_DEXT        0x20   /* Extended (context/data) descriptor */
+#define E1000_TX_DTYP_DATA       0x10   /* DTYP in the high nibble of byte 10 */
+#define E1000_TX_POPTS_IXSM      0x01   /* Insert the IPv4 header checksum */
+#define E1000_TX_POPTS_TXSM      0x02   /* Insert the TCP/UDP checksum */
+#define E1000_TXCTX_TCP          0x01
+#define E1000_TXCTX_IP           0x02
 #define E1000_TX_STATUS_DD       0x01
 #define E1000_RX_STATUS_DD       0x01
+#define E1000_RX_STATUS_IXSM     0x04   /* Checksum bits below are meaningless */
+#define E1000_RX_STATUS_TCPCS    0x20
+#define E1000_RX_STATUS_IPCS     0x40
+#define E1000_RX_ERR_TCPE        0x20
+#define E1000_RX_ERR_IPE         0x40
 
 #define PCNET_IO_RDP             0x10
 #define PCNET_IO_RAP             0x12
@@ -73,6 +114,8 @@
 #define PCNET_CSR0_TDMD          0x0008
 #define PCNET_CSR0_TXON          0x0010
 #define PCNET_CSR0_RXON          0x0020
+#define PCNET_CSR0_IENA          0x0040
+#define PCNET_CSR0_INTR          0x0080
 #define PCNET_CSR0_IDON          0x0100
 #define PCNET_CSR0_TINT          0x0200
 #define PCNET_CSR0_RINT          0x0400
@@ -84,6 +127,9 @@
 #define PCNET_CSR0_ACK_BITS      0x7F00
 
 #define PCNET_CSR3_DEFAULT       0x0000
+#define PCNET_CSR3_IDONM         0x0100
+#define PCNET_CSR3_TINTM         0x0200
+#define PCNET_CSR3_RINTM         0x0400
 #define PCNET_CSR4_AUTO_PAD_TX   0x0800
 
 #define PCNET_BCR2_ASEL          0x0002
@@ -94,11 +140,91 @@
 #define PCNET_DESC_STP           0x02
 #define PCNET_DESC_ENP           0x01
 
-#define NET_RX_DESC_COUNT        32
-#define NET_TX_DESC_COUNT        8
+/* Legacy virtio-PCI register block at BAR0 (I/O space, MSI-X off) */
+#define VIRTIO_IO_DEVICE_FEATURES 0x00
+#define VIRTIO_IO_GUEST_FEATURES 0x04
+#define VIRTIO_IO_QUEUE_PFN      0x08
+#define VIRTIO_IO_QUEUE_SIZE     0x0C
+#define VIRTIO_IO_QUEUE_SELECT   0x0E
+#define VIRTIO_IO_QUEUE_NOTIFY   0x10
+#define VIRTIO_IO_DEVICE_STATUS  0x12
+#define VIRTIO_IO_ISR_STATUS     0x13
+#define VIRTIO_IO_NET_MAC        0x14
+#define VIRTIO_IO_NET_STATUS     0x1A
+#define VIRTIO_IO_NET_MAX_PAIRS  0x1C
+
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER     0x02
+#define VIRTIO_STATUS_DRIVER_OK  0x04
+#define VIRTIO_STATUS_FAILED     0x80
+#define VIRTIO_ISR_QUEUE         0x01
+#define VIRTIO_ISR_CONFIG        0x02
+
+#define VIRTIO_NET_F_CSUM        (1u << 0)    /* Device finishes our checksums */
+#define VIRTIO_NET_F_GUEST_CSUM  (1u << 1)    /* We accept partial checksums */
+#define VIRTIO_NET_F_MAC         (1u << 5)
+#define VIRTIO_NET_F_HOST_TSO4   (1u << 11)
+#define VIRTIO_NET_F_MRG_RXBUF   (1u << 15)
+#define VIRTIO_NET_F_STATUS      (1u << 16)
+#define VIRTIO_NET_F_CTRL_VQ     (1u << 17)
+#define VIRTIO_NET_F_MQ          (1u << 22)
+#define VIRTIO_F_ANY_LAYOUT      (1u << 27)
+#define VIRTIO_NET_S_LINK_UP     0x0001
+
+#define VIRTQ_DESC_F_NEXT        0x0001
+#define VIRTQ_DESC_F_WRITE       0x0002
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x0001
+#define VIRTQ_USED_F_NO_NOTIFY   0x0001
+#define VIRTQ_LEGACY_ALIGN       4096
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 0x01
+#define VIRTIO_NET_HDR_F_DATA_VALID 0x02
+#define VIRTIO_NET_HDR_GSO_TCPV4 1
+#define VIRTIO_NET_CTRL_MQ       4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_CTRL_OK       0
+
+/*
+ * e1000 ring sizes, overridable at build time.  Ring lengths must be a
+ * multiple of 128 bytes, i.e. 8 descriptors.  PCnet encodes its ring
+ * sizes as log2 in the init block and keeps small fixed rings.
+ */
+#ifndef NET_E1000_RX_DESC_COUNT
+#define NET_E1000_RX_DESC_COUNT  256
+#endif
+#ifndef NET_E1000_TX_DESC_COUNT
+#define NET_E1000_TX_DESC_COUNT  256
+#endif
+#define NET_E1000_MAX_DESC       4096
+#if NET_E1000_RX_DESC_COUNT > NET_E1000_MAX_DESC || NET_E1000_RX_DESC_COUNT % 8 != 0 || \
+    NET_E1000_TX_DESC_COUNT > NET_E1000_MAX_DESC || NET_E1000_TX_DESC_COUNT % 8 != 0
+#error "e1000 ring sizes must be multiples of 8, at most 4096"
+#endif
+#define NET_PCNET_RX_LOG2        5
+#define NET_PCNET_TX_LOG2        3
+#define NET_TX_RS_INTERVAL       32     /* Ask for a status write-back this often */
+#define NET_DMA_IDENTITY_LIMIT   0x40000000UL   /* Boot identity map: first 1 GiB */
+#define NET_RX_BUDGET            64     /* Frames per poll before yielding */
+#define NET_VIRTIO_MAX_PAIRS     4      /* Queue pairs used when MQ is offered */
+#define NET_VIRTIO_RX_BUFFERS    256    /* Per RX queue, capped at the queue size */
+#define NET_VIRTIO_TX_SLOTS      64     /* Shared by every TX queue */
+#define NET_VIRTIO_TSO_MAX       NET_TCP_SEND_BUFFER_SIZE   /* Largest TSO payload */
 #define NET_PACKET_BUFFER_SIZE   2048
-#define NET_ARP_CACHE_SIZE       8
+#define NET_TX_HEADROOM          (sizeof(struct net_eth_header) + sizeof(struct net_ipv4_header))
+#define NET_ARP_CACHE_SIZE       128
+#define NET_ARP_HASH_BUCKETS     64
+#define NET_ARP_REACHABLE_MS     30000  /* Confirmed entries are used without asking */
+#define NET_ARP_RETRY_MS         1000   /* Between requests for one neighbour */
+#define NET_ARP_MAX_PROBES       3      /* Unanswered requests before giving up */
+#define NET_ARP_GC_MS            300000 /* Unused neighbours are forgotten */
+#define NET_ARP_SCAN_MS          250
+#define NET_ARP_PENDING_MAX      16     /* Frames parked on unresolved neighbours */
+#define NET_ARP_PENDING_PER_NEIGH 4
+#define NET_ARP_INCOMPLETE       1
+#define NET_ARP_VALID            2
 #define NET_ETH_FRAME_MIN        60
+#define NET_RX_CSUM_IP           0x01   /* NIC verified the IPv4 header checksum */
+#define NET_RX_CSUM_L4           0x02   /* NIC verified the TCP/UDP checksum */
 
 #define ETH_TYPE_IPV4            0x0800
 #define ETH_TYPE_ARP             0x0806
@@ -139,20 +265,43 @@
 #define TCP_FLAG_PSH             0x08
 #define TCP_FLAG_ACK             0x10
 
-#define NET_TCP_MAX_CONNECTIONS  8
-#define NET_TCP_RECV_BUFFER_SIZE 8192
-#define NET_TCP_WINDOW_SIZE      NET_TCP_RECV_BUFFER_SIZE
-#define NET_TCP_TX_MSS           1200
+#define NET_TCP_MAX_CONNECTIONS  512      /* Handle table size */
+#define NET_TCP_HASH_BUCKETS     256      /* 4-tuple demultiplexing, power of two */
+#define NET_TCP_MAX_LISTENERS    16
+#define NET_TCP_BACKLOG_MAX      32       /* Connections parked per listener */
+#define NET_TCP_SYN_RETRIES      5        /* SYN-ACK retransmissions before giving up */
+#define NET_TCP_ORPHAN_TIMEOUT_MS 30000   /* Released connections get this long to close */
+#define NET_TCP_RX_INITIAL       16384
+#define NET_TCP_RX_MAX           262144   /* Receive autotuning stops here */
+#define NET_TCP_WSCALE           3        /* NET_TCP_RX_MAX >> 3 fits 16 bits */
+#define NET_TCP_OOO_MAX          4        /* Out-of-order ranges remembered */
+#define NET_TCP_SACK_BLOCKS      3
+#define NET_TCP_SEND_BUFFER_SIZE 16384
+#define NET_MTU                  1500
+#define NET_TCP_MAX_MSS          (NET_MTU - 40)   /* Minus IPv4 and TCP headers */
+#define NET_TCP_DEFAULT_MSS      536              /* Peer sent no MSS option */
+#define NET_TCP_OPT_MSS          2
+#define NET_TCP_OPT_MSS_LEN      4
+#define NET_TCP_OPT_NOP          1
+#define NET_TCP_OPT_WSCALE       3
+#define NET_TCP_OPT_SACK_PERM    4
+#define NET_TCP_OPT_SACK         5
+#define NET_TCP_SYN_OPT_LEN      12       /* MSS, NOP+WS, SACK-permitted+NOPs */
+#define NET_TCP_MAX_OPT_LEN      40
+#define NET_TCP_SSTHRESH_INITIAL 65535u
+#define NET_TCP_DUPACK_THRESHOLD 3
+#define NET_TCP_RTO_INITIAL_MS   1000
+#define NET_TCP_RTO_MIN_MS       200
+#define NET_TCP_RTO_MAX_MS       60000
+#define NET_TCP_CLOCK_GRANULARITY_MS 10   /* Uptime advances per 100 Hz tick */
 #define NET_TCP_DEFAULT_TIMEOUT  5000
 #define NET_TCP_EPHEMERAL_BASE   40000
-
-#define NET_OK                   0
-#define NET_ERR_GENERIC         -1
-#define NET_ERR_UNAVAILABLE     -2
-#define NET_ERR_TIMEOUT         -3
-#define NET_ERR_NOT_CONFIGURED  -4
-#define NET_ERR_INVALID         -5
-#define NET_ERR_CLOSED          -6
+#define NET_TCP_BUSY_POLL_MS     10     /* Spin on the NIC this long first */
+#define NET_TCP_POLL_INTERVAL_MS 10     /* Then re-poll this often asleep  */
+#define NET_UDP_MAX_SOCKETS      64
+#define NET_UDP_EPHEMERAL_BASE   40000
+#define NET_UDP_HASH_BUCKETS     32       /* Port demultiplexing, power of two */
+#define NET_UDP_QUEUE_SIZE       16384    /* Datagram ring per socket */
 
 struct e1000_rx_desc {
     uint64_t addr;
@@ -173,10 +322,106 @@ struct e1000_tx_desc {
     uint16_t special;
 } __attribute__((packed));
 
+/*
+ * Loads the offsets the e1000 uses for IXSM/TXSM on the data descriptors
+ * that follow.  It takes one ring slot and stays in effect until the next.
+ */
+struct e1000_tx_context_desc {
+    uint8_t  ipcss;                     /* IPv4 header start */
+    uint8_t  ipcso;                     /* IPv4 checksum field */
+    uint16_t ipcse;                     /* Last byte of the IPv4 header */
+    uint8_t  tucss;                     /* TCP/UDP checksum start */
+    uint8_t  tucso;                     /* TCP/UDP checksum field */
+    uint16_t tucse;                     /* 0: to the end of the frame */
+    uint16_t paylen;
+    uint8_t  dtyp;
+    uint8_t  tucmd;
+    uint8_t  status;
+    uint8_t  hdr_len;
+    uint16_t mss;
+} __attribute__((packed));
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t len;
+} __attribute__((packed));
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+/* Precedes every frame; num_buffers only exists with MRG_RXBUF */
+struct virtio_net_hdr {
+    uint8_t  flags;
+    uint8_t  gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} __attribute__((packed));
+
 enum net_backend_type {
     NET_BACKEND_NONE = 0,
     NET_BACKEND_E1000 = 1,
     NET_BACKEND_PCNET = 2,
+    NET_BACKEND_VIRTIO = 3,
+};
+
+/*
+ * One split virtqueue in the legacy layout: descriptor table and
+ * available ring, then the used ring on the next 4 KiB boundary.
+ */
+struct net_virtq {
+    uint16_t index;                     /* Queue number on the device */
+    uint16_t size;                      /* Fixed by the device */
+    uint16_t last_used;                 /* used->idx already consumed */
+    uint16_t pending;                   /* Made available since the last kick */
+    uint16_t discard;                   /* RX: buffers of a torn merged frame to drop */
+    struct virtq_desc *desc;
+    volatile struct virtq_avail *avail;
+    volatile struct virtq_used *used;
+};
+
+struct net_virtio_state {
+    uint32_t features;                  /* Negotiated */
+    uint16_t pairs;                     /* Queue pairs in use */
+    uint16_t hdr_len;                   /* 10, or 12 with mergeable RX buffers */
+    struct net_virtq rx[NET_VIRTIO_MAX_PAIRS];
+    struct net_virtq tx[NET_VIRTIO_MAX_PAIRS];
+    struct net_virtq ctrl;
+    uint8_t *ctrl_buf;
+    uint64_t ctrl_buf_phys;
+    uint8_t  tx_busy[NET_VIRTIO_TX_SLOTS];      /* Slot is on some TX queue */
+};
+
+/*
+ * Offload requests for the frame being built, cleared by net_tx_get().
+ * A nonzero csum_start asks the NIC to fold the bytes from there on into
+ * the 16-bit field at csum_start + csum_offset; a nonzero gso_size asks
+ * it to cut the TCP payload into segments of that size.
+ */
+struct net_tx_meta {
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t gso_size;
+    uint16_t hdr_len;                   /* Ethernet through TCP options */
+    uint8_t  ip_csum;                   /* NIC fills the IPv4 header checksum */
 };
 
 struct pcnet_init_block {
@@ -190,11 +435,40 @@ struct pcnet_init_block {
     uint32_t tx_ring;
 } __attribute__((packed));
 
+/* A frame built for a neighbour still being resolved */
+struct net_arp_pending {
+    struct net_arp_pending *next;
+    uint16_t len;
+    struct net_tx_meta meta;
+    uint8_t  frame[NET_PACKET_BUFFER_SIZE];
+};
+
+/*
+ * A neighbour.  INCOMPLETE entries are being resolved and hold the frames
+ * sent to them meanwhile.  VALID entries confirmed in the last
+ * NET_ARP_REACHABLE_MS are used as they are; older ones are still used
+ * but each use may send a unicast request, and they are dropped once
+ * NET_ARP_MAX_PROBES of those go unanswered.
+ */
 struct net_arp_entry {
-    uint8_t  valid;
+    uint8_t  state;                     /* 0 (free), INCOMPLETE or VALID */
+    uint8_t  probes;                    /* Requests sent without an answer */
+    uint8_t  pending_count;
     uint8_t  ip[NET_IPV4_ADDR_LEN];
     uint8_t  mac[NET_MAC_ADDR_LEN];
-    uint64_t seen_ms;
+    uint64_t confirmed_ms;
+    uint64_t used_ms;
+    uint64_t probe_ms;                  /* Last request sent */
+    struct net_arp_entry *hash_next;    /* Bucket chain, or the free list */
+    struct net_arp_pending *pending_head;
+    struct net_arp_pending *pending_tail;
+};
+
+/* Where an outgoing IPv4 packet goes on the link */
+struct net_next_hop {
+    uint8_t ip[NET_IPV4_ADDR_LEN];
+    uint8_t mac[NET_MAC_ADDR_LEN];
+    uint8_t resolved;                   /* 0: park the frame until ARP answers */
 };
 
 struct net_dhcp_state {
@@ -231,8 +505,16 @@ enum net_tcp_conn_state {
     NET_TCP_CLOSING = 6,
     NET_TCP_LAST_ACK = 7,
     NET_TCP_RESET = 8,
+    NET_TCP_SYN_RCVD = 9,
+};
+
+struct net_tcp_range {
+    uint32_t start;
+    uint32_t end;
 };
 
+struct net_tcp_listener;
+
 struct net_tcp_conn {
     uint8_t  used;
     uint8_t  state;
@@ -240,16 +522,99 @@ struct net_tcp_conn {
     uint8_t  reset;
     uint16_t local_port;
     uint16_t remote_port;
+    int      handle;                    /* 0 until connected or accepted */
+    struct net_tcp_conn *hash_next;     /* 4-tuple bucket chain */
+    struct net_tcp_conn *queue_next;    /* Listener queues or orphan list */
+    struct net_tcp_listener *listener;  /* Set until accept() takes it */
+    uint8_t  syn_retries;
+    uint64_t orphan_deadline_ms;        /* Released by its owner, reset after this */
     uint32_t iss;
     uint32_t snd_una;
-    uint32_t snd_nxt;
+    uint32_t snd_nxt;                   /* Next sequence to transmit */
+    uint32_t snd_max;                   /* Highest sequence ever transmitted */
     uint32_t rcv_nxt;
     uint8_t  remote_ip[NET_IPV4_ADDR_LEN];
-    uint32_t rx_head;
-    uint32_t rx_tail;
     uint64_t last_activity_ms;
     int      owner_pid;
-    uint8_t  rx_buffer[NET_TCP_RECV_BUFFER_SIZE];
+    struct wait_queue waiters;          /* Owner blocked in send/recv */
+    struct epoll_source poll;
+
+    /* Sender: unacknowledged and unsent bytes start at snd_una */
+    uint16_t mss;                       /* min(our MTU, peer's SYN option) */
+    uint8_t  dup_acks;
+    uint8_t  in_recovery;               /* NewReno fast recovery */
+    uint8_t  fin_pending;               /* close() queued a FIN after the data */
+    uint8_t  fin_acked;
+    uint8_t  rtt_active;                /* rtt_seq is being timed */
+    uint8_t  output_active;             /* tcp_output() on the stack */
+    uint32_t snd_wnd;                   /* Peer's advertised window */
+    uint32_t cwnd;
+    uint32_t ssthresh;
+    uint32_t recover;                   /* snd_max when recovery began */
+    uint32_t rtt_seq;
+    uint64_t rtt_start_ms;
+    uint32_t srtt8;                     /* Smoothed RTT, ms << 3 (0 = none yet) */
+    uint32_t rttvar4;                   /* RTT variance, ms << 2 */
+    uint32_t rto_ms;
+    uint64_t rto_deadline_ms;           /* 0 while the timer is stopped */
+    uint32_t tx_head;                   /* Ring index of the byte at snd_una */
+    uint32_t tx_len;
+    uint8_t  tx_buffer[NET_TCP_SEND_BUFFER_SIZE];
+
+    /*
+     * Receiver: in-order bytes, then out-of-order data at its final
+     * offset, share one heap ring that recv() doubles when the reader
+     * drains a large share of it each RTT.
+     */
+    uint8_t *rx_buffer;
+    uint32_t rx_size;
+    uint32_t rx_head;                   /* Ring index of the oldest unread byte */
+    uint32_t rx_len;                    /* In-order bytes waiting for recv() */
+    uint32_t rcv_adv;                   /* Right window edge last advertised */
+    uint32_t rx_copied;                 /* Bytes read in this autotuning epoch */
+    uint64_t rx_epoch_ms;
+    uint8_t  snd_wscale;                /* Peer's shift, applied to its windows */
+    uint8_t  rcv_wscale;                /* Our shift, 0 unless the peer agreed */
+    uint8_t  sack_ok;
+    uint8_t  ooo_count;
+    struct net_tcp_range ooo[NET_TCP_OOO_MAX];  /* Most recent first */
+};
+
+/*
+ * A passive socket.  Connection objects for incoming SYNs are allocated
+ * by listen() and accept(), never on the receive path, which may run in
+ * an interrupt where the heap cannot be used.  A SYN takes one from the
+ * free list; once the handshake completes it moves to the accept queue.
+ */
+struct net_tcp_listener {
+    uint16_t port;
+    uint16_t backlog;
+    int      owner_pid;
+    struct net_tcp_conn *free;          /* Ready for incoming SYNs */
+    struct net_tcp_conn *accept_head;   /* Established, not yet accepted */
+    struct net_tcp_conn *accept_tail;
+    uint32_t accept_count;
+    struct wait_queue waiters;          /* Owner blocked in accept() */
+    struct epoll_source poll;
+};
+
+/* Datagrams queue as {net_udp_record, payload} in a byte ring */
+struct net_udp_record {
+    uint16_t len;
+    uint16_t src_port;
+    uint8_t  src_ip[NET_IPV4_ADDR_LEN];
+};
+
+struct net_udp_socket {
+    uint16_t port;
+    int      handle;
+    struct net_udp_socket *hash_next;
+    uint8_t *queue;                     /* NET_UDP_QUEUE_SIZE bytes */
+    uint32_t queue_head;
+    uint32_t queue_len;
+    uint64_t dropped;
+    struct wait_queue waiters;
+    struct epoll_source poll;
 };
 
 struct net_state {
@@ -283,23 +648,62 @@ struct net_state {
     uint64_t pcnet_rx_ring_phys;
     uint64_t pcnet_tx_ring_phys;
     uint64_t pcnet_init_phys;
-    void    *rx_buffers[NET_RX_DESC_COUNT];
-    void    *tx_buffers[NET_TX_DESC_COUNT];
-    uint64_t rx_buffers_phys[NET_RX_DESC_COUNT];
-    uint64_t tx_buffers_phys[NET_TX_DESC_COUNT];
+    uint8_t *rx_block;                  /* rx_count buffers, NET_PACKET_BUFFER_SIZE apart */
+    uint8_t *tx_block;                  /* tx_count buffers, tx_stride apart */
+    uint64_t rx_block_phys;
+    uint64_t tx_block_phys;
+    uint32_t rx_count;
+    uint32_t tx_count;
+    uint32_t tx_stride;
+    uint32_t tx_frame_offset;           /* Room for a NIC header before the frame */
     uint32_t rx_index;
-    uint32_t tx_index;
+    uint32_t tx_index;                  /* Next descriptor to fill */
+    uint32_t tx_clean;                  /* Oldest e1000 descriptor not reclaimed */
+    uint32_t tx_unflushed;              /* Filled since the tail was last written */
+    uint32_t tx_since_rs;
+    uint8_t  tx_batch;                  /* net_tx_batch_begin() nesting */
+    volatile uint8_t tx_reserved;       /* A DMA buffer is being filled */
+    uint8_t  tx_csum_offload;           /* NIC completes TCP checksums */
+    uint8_t  tx_ip_csum_offload;        /* NIC computes IPv4 header checksums */
+    uint8_t  rx_csum_valid;             /* NET_RX_CSUM_* for the frame being handled */
+    uint32_t e1000_tx_context;          /* Offsets loaded by the last context, 0: none */
+    uint32_t tso_max;                   /* Largest TCP payload per frame, 0: no TSO */
+    struct net_tx_meta tx_meta;
+    struct net_virtio_state virtio;
     uint16_t next_ip_id;
     uint16_t next_ping_seq;
     uint16_t next_tcp_port;
+    uint16_t next_udp_port;
+    volatile uint8_t stack_busy;        /* Poll or TCP update in progress */
+    uint8_t  irq;                       /* Legacy PCI interrupt line */
+    uint8_t  irq_enabled;               /* 0: the ring is polled every pass */
+    volatile uint8_t rx_scheduled;      /* RX interrupt masked, ring needs a poll */
+    uint64_t irq_count;
+    uint64_t rx_budget_exhausted;
+    uint64_t rx_csum_errors;
+    uint64_t tcp_syn_dropped;           /* Backlog full */
     uint64_t rx_packets;
     uint64_t tx_packets;
     uint64_t rx_bytes;
     uint64_t tx_bytes;
+    uint32_t arp_entries;
+    uint64_t arp_dropped;               /* Frames lost waiting for resolution */
+    uint64_t arp_conflicts;             /* Another host claimed our address */
+    uint64_t arp_next_scan_ms;
     struct net_arp_entry arp_cache[NET_ARP_CACHE_SIZE];
+    struct net_arp_entry *arp_hash[NET_ARP_HASH_BUCKETS];
+    struct net_arp_entry *arp_free;
+    struct net_arp_pending arp_pending[NET_ARP_PENDING_MAX];
+    struct net_arp_pending *arp_pending_free;
     struct net_dhcp_state dhcp;
     struct net_ping_state ping;
-    struct net_tcp_conn tcp[NET_TCP_MAX_CONNECTIONS];
+    uint32_t tcp_count;
+    struct net_tcp_conn *tcp[NET_TCP_MAX_CONNECTIONS];     /* By handle - 1 */
+    struct net_tcp_conn *tcp_hash[NET_TCP_HASH_BUCKETS];
+    struct net_tcp_conn *tcp_orphans;   /* Closing without an owner */
+    struct net_tcp_listener *tcp_listeners[NET_TCP_MAX_LISTENERS];
+    struct net_udp_socket *udp[NET_UDP_MAX_SOCKETS];       /* By handle - 1 */
+    struct net_udp_socket *udp_hash[NET_UDP_HASH_BUCKETS];
 };
 
 struct net_eth_header {
@@ -406,6 +810,39 @@ static int net_phys32(uint64_t phys, uint32_t *out) {
     return 1;
 }
 
+/*
+ * net_dma_alloc - bytes of zeroed, physically contiguous memory for a
+ * descriptor ring or buffer block.  Frames come straight from the PMM,
+ * whose bump allocator hands out consecutive frames, and are used
+ * through the boot identity map.  Returns NULL if either fails to hold.
+ */
+static void *net_dma_alloc(size_t bytes, uint64_t *phys_out) {
+    size_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t first = pmm_alloc_frame();
+
+    if (!first) return NULL;
+    for (size_t i = 1; i < pages; i++) {
+        if (pmm_alloc_frame() != first + i * PAGE_SIZE) return NULL;
+    }
+    if (first + pages * PAGE_SIZE > NET_DMA_IDENTITY_LIMIT) return NULL;
+
+    memset((void *)(uintptr_t)first, 0, pages * PAGE_SIZE);
+    *phys_out = first;
+    return (void *)(uintptr_t)first;
+}
+
+static uint8_t *net_rx_buffer(uint32_t index) {
+    return g_net.rx_block + (size_t)index * NET_PACKET_BUFFER_SIZE;
+}
+
+static uint8_t *net_tx_buffer(uint32_t index) {
+    return g_net.tx_block + (size_t)index * g_net.tx_stride + g_net.tx_frame_offset;
+}
+
+static uint32_t net_ring_next(uint32_t index, uint32_t count) {
+    return (index + 1u == count) ? 0 : index + 1u;
+}
+
 static uint16_t pcnet_read_csr(uint16_t reg) {
     outw(g_net.io_base + PCNET_IO_RAP, reg);
     return inw(g_net.io_base + PCNET_IO_RDP);
@@ -421,6 +858,11 @@ static uint16_t pcnet_read_bcr(uint16_t reg) {
     return inw(g_net.io_base + PCNET_IO_BDP);
 }
 
+/* CSR0 writes clear IENA unless it is written back as 1 */
+static uint16_t pcnet_csr0_ien(void) {
+    return g_net.irq_enabled ? PCNET_CSR0_IENA : 0;
+}
+
 static void pcnet_write_bcr(uint16_t reg, uint16_t value) {
     outw(g_net.io_base + PCNET_IO_RAP, reg);
     outw(g_net.io_base + PCNET_IO_BDP, value);
@@ -556,6 +998,43 @@ static void mac_to_str(const uint8_t mac[NET_MAC_ADDR_LEN], char *out, size_t ca
     out[pos] = '\0';
 }
 
+/*
+ * net_stack_enter - claim the protocol state.  The timer IRQ polls the NIC
+ * too, so process-context code that updates TCP state claims the stack
+ * first; a poll that finds it busy returns and the owner catches up.
+ * Returns 1 if claimed, 0 if someone (possibly the caller) already has it.
+ */
+static uint64_t net_irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static void net_irq_restore(uint64_t flags) {
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+}
+
+static int net_stack_enter(void) {
+    uint64_t flags = net_irq_save();
+    int claimed = !g_net.stack_busy;
+
+    if (claimed) g_net.stack_busy = 1;
+    net_irq_restore(flags);
+    return claimed;
+}
+
+static void net_stack_leave(void) {
+    g_net.stack_busy = 0;
+}
+
+/*
+ * net_stack_claim - net_stack_enter for process context paths that must
+ * not skip their work: yield until the current holder lets go.
+ */
+static void net_stack_claim(void) {
+    while (!net_stack_enter()) schedule();
+}
+
 static void net_delay(void) {
     for (volatile int i = 0; i < 200000; i++);
 }
@@ -572,23 +1051,64 @@ static void e1000_write32(uint32_t offset, uint32_t value) {
     *net_reg(offset) = value;
 }
 
-static uint16_t net_checksum16(const void *data, size_t len) {
+typedef uint64_t net_unaligned_u64 __attribute__((aligned(1), may_alias));
+typedef uint32_t net_unaligned_u32 __attribute__((aligned(1), may_alias));
+typedef uint16_t net_unaligned_u16 __attribute__((aligned(1), may_alias));
+
+/*
+ * net_checksum16_partial - add data, as big-endian 16-bit words, to a
+ * running one's-complement sum and return it folded to 16 bits.  The
+ * one's-complement sum does not depend on byte order (RFC 1071), so the
+ * data is summed as native 32-bit halves of 64-bit loads in a 64-bit
+ * accumulator, 32 bytes per iteration, and byte-swapped once at the end.
+ */
+static uint32_t net_checksum16_partial(uint32_t sum, const void *data, size_t len) {
     const uint8_t *bytes = (const uint8_t *)data;
-    uint32_t sum = 0;
-
-    while (len > 1) {
-        sum += (uint32_t)(((uint16_t)bytes[0] << 8) | bytes[1]);
+    uint64_t acc = 0;
+
+    while (len >= 32) {
+        uint64_t a = *(const net_unaligned_u64 *)(bytes + 0);
+        uint64_t b = *(const net_unaligned_u64 *)(bytes + 8);
+        uint64_t c = *(const net_unaligned_u64 *)(bytes + 16);
+        uint64_t d = *(const net_unaligned_u64 *)(bytes + 24);
+
+        acc += (a & 0xFFFFFFFFu) + (a >> 32) + (b & 0xFFFFFFFFu) + (b >> 32);
+        acc += (c & 0xFFFFFFFFu) + (c >> 32) + (d & 0xFFFFFFFFu) + (d >> 32);
+        bytes += 32;
+        len -= 32;
+    }
+    while (len >= 8) {
+        uint64_t a = *(const net_unaligned_u64 *)bytes;
+        acc += (a & 0xFFFFFFFFu) + (a >> 32);
+        bytes += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        acc += *(const net_unaligned_u32 *)bytes;
+        bytes += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        acc += *(const net_unaligned_u16 *)bytes;
         bytes += 2;
         len -= 2;
     }
     if (len) {
-        sum += (uint32_t)((uint16_t)bytes[0] << 8);
+        acc += bytes[0];                /* High byte of a big-endian word */
     }
 
+    while (acc >> 16) {
+        acc = (acc & 0xFFFFu) + (acc >> 16);
+    }
+    sum += (uint32_t)(((acc & 0xFFu) << 8) | (acc >> 8));
     while (sum >> 16) {
         sum = (sum & 0xFFFFu) + (sum >> 16);
     }
-    return (uint16_t)(~sum & 0xFFFFu);
+    return sum;
+}
+
+static uint16_t net_checksum16(const void *data, size_t len) {
+    return (uint16_t)(~net_checksum16_partial(0, data, len) & 0xFFFFu);
 }
 
 static int tcp_seq_before(uint32_t a, uint32_t b) {
@@ -600,63 +1120,314 @@ static int tcp_seq_after(uint32_t a, uint32_t b) {
 }
 
 static uint32_t tcp_conn_rx_len(const struct net_tcp_conn *conn) {
-    if (conn->rx_tail >= conn->rx_head) {
-        return conn->rx_tail - conn->rx_head;
-    }
-    return NET_TCP_RECV_BUFFER_SIZE - conn->rx_head + conn->rx_tail;
+    return conn->rx_len;
 }
 
 static uint32_t tcp_conn_rx_space(const struct net_tcp_conn *conn) {
-    return (NET_TCP_RECV_BUFFER_SIZE - 1u) - tcp_conn_rx_len(conn);
+    return conn->rx_size - conn->rx_len;
+}
+
+/* Window to advertise, already shifted for the header field */
+static uint16_t tcp_conn_rx_window(const struct net_tcp_conn *conn, int syn) {
+    uint32_t window = tcp_conn_rx_space(conn) >> (syn ? 0 : conn->rcv_wscale);
+    return (window > 0xFFFFu) ? 0xFFFFu : (uint16_t)window;
+}
+
+static uint32_t tcp_hash_bucket(const uint8_t remote_ip[NET_IPV4_ADDR_LEN],
+                                uint16_t remote_port,
+                                uint16_t local_port) {
+    uint32_t h = read_be32(remote_ip) * 0x9E3779B1u;
+
+    h ^= (((uint32_t)remote_port << 16) | local_port) * 0x85EBCA6Bu;
+    return (h ^ (h >> 15)) & (NET_TCP_HASH_BUCKETS - 1u);
+}
+
+/*
+ * tcp_conn_hash / tcp_conn_unhash - add conn to, or remove it from, the
+ * 4-tuple table the receive path demultiplexes with.  Interrupts are
+ * held off so a poll never sees a half-linked chain.
+ */
+static void tcp_conn_hash(struct net_tcp_conn *conn) {
+    uint32_t b = tcp_hash_bucket(conn->remote_ip, conn->remote_port, conn->local_port);
+    uint64_t flags = net_irq_save();
+
+    conn->hash_next = g_net.tcp_hash[b];
+    g_net.tcp_hash[b] = conn;
+    net_irq_restore(flags);
 }
 
+static void tcp_conn_unhash(struct net_tcp_conn *conn) {
+    uint32_t b = tcp_hash_bucket(conn->remote_ip, conn->remote_port, conn->local_port);
+    uint64_t flags = net_irq_save();
+    struct net_tcp_conn **link = &g_net.tcp_hash[b];
+
+    while (*link && *link != conn) link = &(*link)->hash_next;
+    if (*link) *link = conn->hash_next;
+    conn->hash_next = NULL;
+    net_irq_restore(flags);
+}
+
+/*
+ * tcp_conn_release - unlink conn from demultiplexing and its handle and
+ * free it.  Only process context frees connections; the receive path
+ * recycles embryonic ones into their listener instead.
+ */
 static void tcp_conn_release(struct net_tcp_conn *conn) {
+    uint64_t flags;
+
     if (!conn) return;
-    memset(conn, 0, sizeof(*conn));
+    tcp_conn_unhash(conn);
+    epoll_source_detach(&conn->poll);
+
+    flags = net_irq_save();
+    if (conn->handle > 0) g_net.tcp[conn->handle - 1] = NULL;
+    g_net.tcp_count--;
+    net_irq_restore(flags);
+
+    if (conn->rx_buffer) kfree(conn->rx_buffer);
+    kfree(conn);
 }
 
-static int tcp_conn_queue(struct net_tcp_conn *conn, const uint8_t *data, size_t len) {
-    if (!conn || (!data && len != 0)) return 0;
-    if (len > tcp_conn_rx_space(conn)) return 0;
+/*
+ * net_wait_on - give up the CPU while waiting for the network.  For
+ * NET_TCP_BUSY_POLL_MS after busy_start the caller only yields between
+ * polls to catch a fast reply.  After that it sleeps on wq until the NIC
+ * interrupt (or, on a polled NIC, some other poller) processes a packet
+ * for it or its own next poll is due, and never past deadline.
+ */
+static void net_wait_on(struct wait_queue *wq, uint64_t busy_start, uint64_t deadline) {
+    uint64_t now = timer_get_uptime_ms();
+    uint64_t wake = now + NET_TCP_POLL_INTERVAL_MS;
 
-    for (size_t i = 0; i < len; i++) {
-        conn->rx_buffer[conn->rx_tail] = data[i];
-        conn->rx_tail = (conn->rx_tail + 1u) % NET_TCP_RECV_BUFFER_SIZE;
+    if (now < busy_start + NET_TCP_BUSY_POLL_MS) {
+        schedule();
+        return;
     }
-    return 1;
+    if (wake > deadline) wake = deadline;
+
+    __asm__ volatile("cli");
+    (void)wait_queue_sleep_until(wq, wake);
 }
 
-static size_t tcp_conn_dequeue(struct net_tcp_conn *conn, uint8_t *out, size_t len) {
-    size_t copied = 0;
+static void tcp_conn_wait(struct net_tcp_conn *conn, uint64_t busy_start,
+                          uint64_t deadline) {
+    net_wait_on(&conn->waiters, busy_start, deadline);
+}
+
+/* Copy len bytes into the receive ring, offset bytes past the unread data */
+static void tcp_conn_rx_write(struct net_tcp_conn *conn, uint32_t offset,
+                              const uint8_t *data, uint32_t len) {
+    uint32_t pos = (conn->rx_head + conn->rx_len + offset) % conn->rx_size;
+    uint32_t first = conn->rx_size - pos;
+
+    if (first > len) first = len;
+    memcpy(conn->rx_buffer + pos, data, first);
+    memcpy(conn->rx_buffer, data + first, len - first);
+}
+
+static void tcp_conn_rx_read(const struct net_tcp_conn *conn, uint8_t *out, uint32_t len) {
+    uint32_t first = conn->rx_size - conn->rx_head;
+
+    if (first > len) first = len;
+    memcpy(out, conn->rx_buffer + conn->rx_head, first);
+    memcpy(out + first, conn->rx_buffer, len - first);
+}
+
+static void tcp_ooo_remove(struct net_tcp_conn *conn, uint32_t index) {
+    conn->ooo_count--;
+    for (uint32_t i = index; i < conn->ooo_count; i++) conn->ooo[i] = conn->ooo[i + 1];
+}
+
+/* Record [start, end) as held, merging neighbours; the newest goes first for SACK */
+static void tcp_ooo_add(struct net_tcp_conn *conn, uint32_t start, uint32_t end) {
+    uint32_t i = 0;
+
+    while (i < conn->ooo_count) {
+        struct net_tcp_range *r = &conn->ooo[i];
+        if (tcp_seq_before(end, r->start) || tcp_seq_before(r->end, start)) {
+            i++;
+            continue;
+        }
+        if (tcp_seq_before(r->start, start)) start = r->start;
+        if (tcp_seq_after(r->end, end)) end = r->end;
+        tcp_ooo_remove(conn, i);
+    }
+
+    if (conn->ooo_count == NET_TCP_OOO_MAX) conn->ooo_count--;
+    for (i = conn->ooo_count; i > 0; i--) conn->ooo[i] = conn->ooo[i - 1];
+    conn->ooo[0].start = start;
+    conn->ooo[0].end = end;
+    conn->ooo_count++;
+}
+
+/*
+ * tcp_conn_receive - place a data segment in the receive ring.  Data at
+ * rcv_nxt is delivered along with any queued ranges it now joins; data
+ * past it is stored at its final offset and remembered for SACK.
+ * Anything outside the window is trimmed.
+ */
+static void tcp_conn_receive(struct net_tcp_conn *conn, uint32_t seq,
+                             const uint8_t *data, uint32_t len) {
+    uint32_t offset;
+    uint32_t space = tcp_conn_rx_space(conn);
+
+    if (tcp_seq_before(seq, conn->rcv_nxt)) {
+        uint32_t dup = conn->rcv_nxt - seq;
+        if (dup >= len) return;
+        data += dup;
+        len -= dup;
+        seq = conn->rcv_nxt;
+    }
+
+    offset = seq - conn->rcv_nxt;
+    if (offset >= space) return;
+    if (len > space - offset) len = space - offset;
+
+    tcp_conn_rx_write(conn, offset, data, len);
+    if (offset > 0) {
+        tcp_ooo_add(conn, seq, seq + len);
+        return;
+    }
+
+    conn->rcv_nxt += len;
+    conn->rx_len += len;
+    for (uint32_t i = 0; i < conn->ooo_count;) {
+        struct net_tcp_range *r = &conn->ooo[i];
+        if (tcp_seq_after(r->start, conn->rcv_nxt)) {
+            i++;
+            continue;
+        }
+        if (tcp_seq_after(r->end, conn->rcv_nxt)) {
+            conn->rx_len += r->end - conn->rcv_nxt;
+            conn->rcv_nxt = r->end;
+        }
+        tcp_ooo_remove(conn, i);
+        i = 0;
+    }
+}
 
-    if (!conn || !out) return 0;
-    while (copied < len && conn->rx_head != conn->rx_tail) {
-        out[copied++] = conn->rx_buffer[conn->rx_head];
-        conn->rx_head = (conn->rx_head + 1u) % NET_TCP_RECV_BUFFER_SIZE;
+/*
+ * tcp_conn_rx_grow - double the receive ring, keeping unread and
+ * out-of-order bytes at the same logical offsets.  Called from recv()
+ * rather than the receive path so the heap is never entered from an IRQ.
+ */
+static void tcp_conn_rx_grow(struct net_tcp_conn *conn) {
+    uint32_t extent = conn->rx_len;
+    uint32_t new_size = conn->rx_size * 2u;
+    uint8_t *buffer;
+
+    if (new_size > NET_TCP_RX_MAX) return;
+    for (uint32_t i = 0; i < conn->ooo_count; i++) {
+        uint32_t end = conn->rx_len + (conn->ooo[i].end - conn->rcv_nxt);
+        if (end > extent) extent = end;
     }
+
+    buffer = (uint8_t *)kmalloc(new_size);
+    if (!buffer) return;
+    tcp_conn_rx_read(conn, buffer, extent);
+    kfree(conn->rx_buffer);
+    conn->rx_buffer = buffer;
+    conn->rx_size = new_size;
+    conn->rx_head = 0;
+}
+
+static size_t tcp_conn_dequeue(struct net_tcp_conn *conn, uint8_t *out, size_t len) {
+    uint32_t copied = (len < conn->rx_len) ? (uint32_t)len : conn->rx_len;
+
+    tcp_conn_rx_read(conn, out, copied);
+    conn->rx_head = (conn->rx_head + copied) % conn->rx_size;
+    conn->rx_len -= copied;
     return copied;
 }
 
 static int tcp_conn_ack_valid(const struct net_tcp_conn *conn, uint32_t ack_num) {
     if (!conn) return 0;
     if (tcp_seq_before(ack_num, conn->snd_una)) return 0;
-    if (tcp_seq_after(ack_num, conn->snd_nxt)) return 0;
+    if (tcp_seq_after(ack_num, conn->snd_max)) return 0;
     return 1;
 }
 
+static uint32_t tcp_conn_flight(const struct net_tcp_conn *conn) {
+    return conn->snd_nxt - conn->snd_una;
+}
+
+/* Buffered bytes not yet transmitted since the last rewind */
+static uint32_t tcp_conn_unsent(const struct net_tcp_conn *conn) {
+    uint32_t sent = tcp_conn_flight(conn);
+    return (sent < conn->tx_len) ? conn->tx_len - sent : 0;
+}
+
+static uint32_t tcp_conn_tx_space(const struct net_tcp_conn *conn) {
+    return NET_TCP_SEND_BUFFER_SIZE - conn->tx_len;
+}
+
+static void tcp_conn_tx_append(struct net_tcp_conn *conn, const uint8_t *data, uint32_t len) {
+    uint32_t pos = (conn->tx_head + conn->tx_len) % NET_TCP_SEND_BUFFER_SIZE;
+    uint32_t first = NET_TCP_SEND_BUFFER_SIZE - pos;
+
+    if (first > len) first = len;
+    memcpy(conn->tx_buffer + pos, data, first);
+    memcpy(conn->tx_buffer, data + first, len - first);
+    conn->tx_len += len;
+}
+
+static void tcp_conn_tx_copy(const struct net_tcp_conn *conn, uint32_t offset,
+                             uint8_t *out, uint32_t len) {
+    uint32_t pos = (conn->tx_head + offset) % NET_TCP_SEND_BUFFER_SIZE;
+    uint32_t first = NET_TCP_SEND_BUFFER_SIZE - pos;
+
+    if (first > len) first = len;
+    memcpy(out, conn->tx_buffer + pos, first);
+    memcpy(out + first, conn->tx_buffer, len - first);
+}
+
+static void tcp_conn_tx_drop(struct net_tcp_conn *conn, uint32_t len) {
+    if (len > conn->tx_len) len = conn->tx_len;
+    conn->tx_head = (conn->tx_head + len) % NET_TCP_SEND_BUFFER_SIZE;
+    conn->tx_len -= len;
+}
+
+/* RFC 5681 initial window */
+static uint32_t tcp_initial_cwnd(uint32_t mss) {
+    uint32_t iw = 4u * mss;
+    uint32_t floor = (2u * mss > 4380u) ? 2u * mss : 4380u;
+    return (iw < floor) ? iw : floor;
+}
+
+/* RFC 6298 smoothed RTT and retransmission timeout */
+static void tcp_rtt_sample(struct net_tcp_conn *conn, uint32_t rtt_ms) {
+    uint32_t var;
+
+    if (rtt_ms == 0) rtt_ms = 1;
+    if (conn->srtt8 == 0) {
+        conn->srtt8 = rtt_ms << 3;
+        conn->rttvar4 = rtt_ms << 1;
+    } else {
+        int32_t delta = (int32_t)rtt_ms - (int32_t)(conn->srtt8 >> 3);
+        conn->srtt8 = (uint32_t)((int32_t)conn->srtt8 + delta);
+        if (delta < 0) delta = -delta;
+        delta -= (int32_t)(conn->rttvar4 >> 2);
+        conn->rttvar4 = (uint32_t)((int32_t)conn->rttvar4 + delta);
+    }
+
+    var = conn->rttvar4;
+    if (var < NET_TCP_CLOCK_GRANULARITY_MS) var = NET_TCP_CLOCK_GRANULARITY_MS;
+    conn->rto_ms = (conn->srtt8 >> 3) + var;
+    if (conn->rto_ms < NET_TCP_RTO_MIN_MS) conn->rto_ms = NET_TCP_RTO_MIN_MS;
+    if (conn->rto_ms > NET_TCP_RTO_MAX_MS) conn->rto_ms = NET_TCP_RTO_MAX_MS;
+}
+
 static struct net_tcp_conn *tcp_conn_from_handle(int handle) {
     if (handle <= 0 || handle > NET_TCP_MAX_CONNECTIONS) return NULL;
-    struct net_tcp_conn *conn = &g_net.tcp[handle - 1];
-    if (!conn->used) return NULL;
-    return conn;
+    return g_net.tcp[handle - 1];
 }
 
 static struct net_tcp_conn *tcp_conn_find(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
                                           uint16_t src_port,
                                           uint16_t dst_port) {
-    for (int i = 0; i < NET_TCP_MAX_CONNECTIONS; i++) {
-        struct net_tcp_conn *conn = &g_net.tcp[i];
-        if (!conn->used) continue;
+    struct net_tcp_conn *conn = g_net.tcp_hash[tcp_hash_bucket(src_ip, src_port, dst_port)];
+
+    for (; conn; conn = conn->hash_next) {
         if (conn->local_port != dst_port) continue;
         if (conn->remote_port != src_port) continue;
         if (!ip_equal(conn->remote_ip, src_ip)) continue;
@@ -665,19 +1436,57 @@ static struct net_tcp_conn *tcp_conn_find(const uint8_t src_ip[NET_IPV4_ADDR_LEN
     return NULL;
 }
 
+/*
+ * tcp_conn_alloc - allocate a closed connection with its initial receive
+ * ring.  Process context only.  Returns NULL when the heap is exhausted.
+ */
 static struct net_tcp_conn *tcp_conn_alloc(void) {
+    struct net_tcp_conn *conn = (struct net_tcp_conn *)kzalloc(sizeof(*conn));
+    if (!conn) return NULL;
+
+    conn->rx_buffer = (uint8_t *)kmalloc(NET_TCP_RX_INITIAL);
+    if (!conn->rx_buffer) {
+        kfree(conn);
+        return NULL;
+    }
+    conn->rx_size = NET_TCP_RX_INITIAL;
+    conn->used = 1;
+    conn->state = NET_TCP_CLOSED;
+    g_net.tcp_count++;
+    return conn;
+}
+
+/* Give conn a handle.  Returns it, or 0 when the handle table is full. */
+static int tcp_conn_install(struct net_tcp_conn *conn) {
     for (int i = 0; i < NET_TCP_MAX_CONNECTIONS; i++) {
-        struct net_tcp_conn *conn = &g_net.tcp[i];
-        if (conn->used) continue;
-        memset(conn, 0, sizeof(*conn));
-        conn->used = 1;
-        conn->state = NET_TCP_CLOSED;
-        return conn;
+        if (g_net.tcp[i]) continue;
+        g_net.tcp[i] = conn;
+        conn->handle = i + 1;
+        return conn->handle;
+    }
+    return 0;
+}
+
+static struct net_tcp_listener *tcp_listener_find(uint16_t port) {
+    for (int i = 0; i < NET_TCP_MAX_LISTENERS; i++) {
+        struct net_tcp_listener *l = g_net.tcp_listeners[i];
+        if (l && l->port == port) return l;
     }
     return NULL;
 }
 
-static uint16_t tcp_pick_local_port(void) {
+static struct net_tcp_listener *tcp_listener_from_handle(int handle) {
+    if (handle <= 0 || handle > NET_TCP_MAX_LISTENERS) return NULL;
+    return g_net.tcp_listeners[handle - 1];
+}
+
+/*
+ * tcp_pick_local_port - an ephemeral port whose 4-tuple towards the
+ * remote end is unused.  Ports are shared between different peers, so
+ * the search is one hash probe per candidate.  Returns 0 if none is free.
+ */
+static uint16_t tcp_pick_local_port(const uint8_t remote_ip[NET_IPV4_ADDR_LEN],
+                                    uint16_t remote_port) {
     uint16_t start = g_net.next_tcp_port;
     if (start < NET_TCP_EPHEMERAL_BASE) start = NET_TCP_EPHEMERAL_BASE;
 
@@ -685,14 +1494,7 @@ static uint16_t tcp_pick_local_port(void) {
         uint16_t port = (uint16_t)(start + attempt);
         if (port < NET_TCP_EPHEMERAL_BASE) port = (uint16_t)(NET_TCP_EPHEMERAL_BASE + attempt);
 
-        int used = 0;
-        for (int i = 0; i < NET_TCP_MAX_CONNECTIONS; i++) {
-            if (g_net.tcp[i].used && g_net.tcp[i].local_port == port) {
-                used = 1;
-                break;
-            }
-        }
-        if (!used) {
+        if (!tcp_conn_find(remote_ip, remote_port, port) && !tcp_listener_find(port)) {
             g_net.next_tcp_port = (uint16_t)(port + 1u);
             if (g_net.next_tcp_port < NET_TCP_EPHEMERAL_BASE) {
                 g_net.next_tcp_port = NET_TCP_EPHEMERAL_BASE;
@@ -704,183 +1506,439 @@ static uint16_t tcp_pick_local_port(void) {
     return 0;
 }
 
-static uint32_t net_checksum16_partial(uint32_t sum, const void *data, size_t len) {
-    const uint8_t *bytes = (const uint8_t *)data;
-
-    while (len > 1) {
-        sum += (uint32_t)(((uint16_t)bytes[0] << 8) | bytes[1]);
-        bytes += 2;
-        len -= 2;
-    }
-    if (len) {
-        sum += (uint32_t)((uint16_t)bytes[0] << 8);
-    }
-    while (sum >> 16) {
-        sum = (sum & 0xFFFFu) + (sum >> 16);
-    }
-    return sum;
+static uint32_t tcp_initial_seq(uint16_t local_port, uint16_t remote_port) {
+    uint32_t iss = ((uint32_t)timer_get_uptime_ms() << 12) ^
+                   ((uint32_t)local_port << 4) ^
+                   remote_port ^
+                   g_net.next_ip_id;
+    return iss ? iss : 0x4E554D31u;
 }
 
-static uint16_t net_tcp_checksum(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
-                                 const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
-                                 const void *segment,
-                                 size_t segment_len) {
-    uint32_t sum = 0;
+static uint32_t net_pseudo_sum(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
+                               const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
+                               uint8_t protocol,
+                               size_t segment_len) {
     uint8_t pseudo[12];
 
     memcpy(pseudo + 0, src_ip, NET_IPV4_ADDR_LEN);
     memcpy(pseudo + 4, dst_ip, NET_IPV4_ADDR_LEN);
     pseudo[8] = 0;
-    pseudo[9] = IPV4_PROTO_TCP;
+    pseudo[9] = protocol;
     write_be16(pseudo + 10, (uint16_t)segment_len);
+    return net_checksum16_partial(0, pseudo, sizeof(pseudo));
+}
 
-    sum = net_checksum16_partial(0, pseudo, sizeof(pseudo));
-    sum = net_checksum16_partial(sum, segment, segment_len);
+static uint16_t net_checksum_fold(uint32_t sum) {
     while (sum >> 16) {
         sum = (sum & 0xFFFFu) + (sum >> 16);
     }
-    return (uint16_t)(~sum & 0xFFFFu);
+    return (uint16_t)sum;
 }
 
-static void arp_cache_update(const uint8_t ip[NET_IPV4_ADDR_LEN],
-                             const uint8_t mac[NET_MAC_ADDR_LEN]) {
-    int slot = -1;
-    uint64_t oldest = 0;
-    int oldest_slot = 0;
+static uint16_t net_l4_checksum(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
+                                const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
+                                uint8_t protocol,
+                                const void *segment,
+                                size_t segment_len) {
+    uint32_t sum = net_pseudo_sum(src_ip, dst_ip, protocol, segment_len);
 
-    for (int i = 0; i < NET_ARP_CACHE_SIZE; i++) {
-        struct net_arp_entry *entry = &g_net.arp_cache[i];
-        if (entry->valid && ip_equal(entry->ip, ip)) {
-            memcpy(entry->mac, mac, NET_MAC_ADDR_LEN);
-            entry->seen_ms = timer_get_uptime_ms();
-            return;
-        }
-        if (!entry->valid && slot < 0) slot = i;
-        if (i == 0 || entry->seen_ms < oldest) {
-            oldest = entry->seen_ms;
-            oldest_slot = i;
-        }
-    }
+    sum = net_checksum16_partial(sum, segment, segment_len);
+    return (uint16_t)(~net_checksum_fold(sum) & 0xFFFFu);
+}
 
-    if (slot < 0) slot = oldest_slot;
-    g_net.arp_cache[slot].valid = 1;
-    memcpy(g_net.arp_cache[slot].ip, ip, NET_IPV4_ADDR_LEN);
-    memcpy(g_net.arp_cache[slot].mac, mac, NET_MAC_ADDR_LEN);
-    g_net.arp_cache[slot].seen_ms = timer_get_uptime_ms();
+static void virtio_mb(void) {
+    __asm__ volatile("mfence" ::: "memory");
 }
 
-static int arp_cache_lookup(const uint8_t ip[NET_IPV4_ADDR_LEN],
-                            uint8_t mac[NET_MAC_ADDR_LEN]) {
-    for (int i = 0; i < NET_ARP_CACHE_SIZE; i++) {
-        struct net_arp_entry *entry = &g_net.arp_cache[i];
-        if (!entry->valid) continue;
-        if (!ip_equal(entry->ip, ip)) continue;
-        memcpy(mac, entry->mac, NET_MAC_ADDR_LEN);
-        return 1;
-    }
-    return 0;
+static size_t virtq_used_offset(uint16_t size) {
+    return (size_t)paging_align_up(16u * size + 6u + 2u * size, VIRTQ_LEGACY_ALIGN);
 }
 
-void net_poll(void);
+/*
+ * virtq_setup - allocate the ring for queue index at the size the device
+ * dictates and hand its page frame number to the device.
+ * Returns NET_OK, or an error if the queue does not exist.
+ */
+static int virtq_setup(struct net_virtq *q, uint16_t index) {
+    uint64_t phys = 0;
+    uint8_t *ring;
+    size_t bytes;
+
+    outw(g_net.io_base + VIRTIO_IO_QUEUE_SELECT, index);
+    q->size = inw(g_net.io_base + VIRTIO_IO_QUEUE_SIZE);
+    if (q->size == 0) return NET_ERR_UNAVAILABLE;
+
+    bytes = virtq_used_offset(q->size) +
+            (size_t)paging_align_up(6u + 8u * q->size, VIRTQ_LEGACY_ALIGN);
+    ring = (uint8_t *)net_dma_alloc(bytes, &phys);
+    if (!ring) return NET_ERR_GENERIC;
+
+    q->index = index;
+    q->last_used = 0;
+    q->pending = 0;
+    q->discard = 0;
+    q->desc = (struct virtq_desc *)ring;
+    q->avail = (volatile struct virtq_avail *)(ring + 16u * q->size);
+    q->used = (volatile struct virtq_used *)(ring + virtq_used_offset(q->size));
+    outl(g_net.io_base + VIRTIO_IO_QUEUE_PFN, (uint32_t)(phys / VIRTQ_LEGACY_ALIGN));
+    return NET_OK;
+}
 
-static int e1000_send_frame(const void *frame, size_t len) {
-    if (!g_net.ready || !frame || len == 0 || len > NET_PACKET_BUFFER_SIZE) {
-        return NET_ERR_INVALID;
-    }
+/* Publish the chain at head; the device is told at the next virtq_kick() */
+static void virtq_push(struct net_virtq *q, uint16_t head) {
+    uint16_t idx = q->avail->idx;
 
-    uint32_t idx = g_net.tx_index;
-    struct e1000_tx_desc *desc = &g_net.tx_descs[idx];
-    uint64_t wait_deadline = timer_get_uptime_ms() + 200;
+    q->avail->ring[idx % q->size] = head;
+    __asm__ volatile("" ::: "memory");  /* Descriptor before the index */
+    q->avail->idx = (uint16_t)(idx + 1u);
+    q->pending++;
+}
 
-    while (!(desc->status & E1000_TX_STATUS_DD)) {
-        if (timer_get_uptime_ms() >= wait_deadline) return NET_ERR_TIMEOUT;
-        net_poll();
+static void virtq_kick(struct net_virtq *q) {
+    if (!q->pending) return;
+    q->pending = 0;
+    virtio_mb();
+    if (!(q->used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        outw(g_net.io_base + VIRTIO_IO_QUEUE_NOTIFY, q->index);
     }
+}
 
-    memcpy(g_net.tx_buffers[idx], frame, len);
-    desc->length = (uint16_t)len;
-    desc->cmd = E1000_TX_CMD_EOP | E1000_TX_CMD_IFCS | E1000_TX_CMD_RS;
-    desc->status = 0;
-    desc->cso = 0;
-    desc->css = 0;
-    desc->special = 0;
+/* Take the next completed chain; returns 0 when the device has none */
+static int virtq_pop(struct net_virtq *q, uint32_t *id, uint32_t *len) {
+    volatile struct virtq_used_elem *elem;
 
-    g_net.tx_index = (idx + 1u) % NET_TX_DESC_COUNT;
-    e1000_write32(E1000_REG_TDT, g_net.tx_index);
+    if (q->used->idx == q->last_used) return 0;
+    elem = &q->used->ring[q->last_used % q->size];
+    *id = elem->id;
+    *len = elem->len;
+    q->last_used++;
+    return 1;
+}
 
-    g_net.tx_packets++;
-    g_net.tx_bytes += len;
-    return NET_OK;
+static void virtio_rx_post(uint32_t pair, uint16_t id) {
+    struct net_virtq *q = &g_net.virtio.rx[pair];
+    struct virtq_desc *desc = &q->desc[id];
+
+    desc->addr = g_net.rx_block_phys +
+                 ((uint64_t)pair * g_net.rx_count + id) * NET_PACKET_BUFFER_SIZE;
+    desc->len = NET_PACKET_BUFFER_SIZE;
+    desc->flags = VIRTQ_DESC_F_WRITE;
+    desc->next = 0;
+    virtq_push(q, id);
 }
 
-static int pcnet_send_frame(const void *frame, size_t len) {
-    uint32_t idx = g_net.tx_index;
-    uint8_t *ring = g_net.pcnet_tx_ring;
-    size_t frame_len = pcnet_frame_length(len);
-    uint64_t wait_deadline = timer_get_uptime_ms() + 200;
-    size_t off;
-    uint16_t bcnt;
+static void virtio_rx_kick(void) {
+    for (uint32_t p = 0; p < g_net.virtio.pairs; p++) virtq_kick(&g_net.virtio.rx[p]);
+}
 
-    if (!g_net.ready || !frame || len == 0 || frame_len > NET_PACKET_BUFFER_SIZE) {
-        return NET_ERR_INVALID;
+static int virtio_rx_pending(void) {
+    for (uint32_t p = 0; p < g_net.virtio.pairs; p++) {
+        const struct net_virtq *q = &g_net.virtio.rx[p];
+        if (q->used->idx != q->last_used) return 1;
     }
+    return 0;
+}
 
-    while (!pcnet_driver_owns(ring, idx)) {
-        if (timer_get_uptime_ms() >= wait_deadline) return NET_ERR_TIMEOUT;
-        net_poll();
+static void virtio_rx_irq_mask(uint16_t flags) {
+    for (uint32_t p = 0; p < g_net.virtio.pairs; p++) g_net.virtio.rx[p].avail->flags = flags;
+}
+
+static void virtio_update_link(void) {
+    if (g_net.virtio.features & VIRTIO_NET_F_STATUS) {
+        g_net.link_up = (inw(g_net.io_base + VIRTIO_IO_NET_STATUS) & VIRTIO_NET_S_LINK_UP) ? 1u : 0u;
+    } else {
+        g_net.link_up = 1;
     }
+}
 
-    memcpy(g_net.tx_buffers[idx], frame, len);
-    if (frame_len > len) {
-        memset((uint8_t *)g_net.tx_buffers[idx] + len, 0, frame_len - len);
+/* Return every TX slot the device has finished with */
+static void virtio_tx_reclaim(void) {
+    for (uint32_t p = 0; p < g_net.virtio.pairs; p++) {
+        uint32_t id, len;
+        while (virtq_pop(&g_net.virtio.tx[p], &id, &len)) {
+            if (id < NET_VIRTIO_TX_SLOTS) g_net.virtio.tx_busy[id] = 0;
+        }
     }
+}
 
-    off = pcnet_ring_offset(idx);
-    bcnt = (uint16_t)(-(int)frame_len);
-    bcnt &= 0x0FFFu;
-    bcnt |= 0xF000u;
+/*
+ * virtio_tx_pick - queue pair for a frame.  TCP and UDP flows hash on
+ * their ports and peer so each flow stays on one queue and in order;
+ * everything else uses the first pair.
+ */
+static uint32_t virtio_tx_pick(const uint8_t *frame, size_t len) {
+    const struct net_ipv4_header *ip =
+        (const struct net_ipv4_header *)(frame + sizeof(struct net_eth_header));
+    size_t ihl;
+    uint32_t hash;
+
+    if (g_net.virtio.pairs < 2 || len < NET_TX_HEADROOM) return 0;
+    if (read_be16(frame + 12) != ETH_TYPE_IPV4) return 0;
+    if (ip->protocol != IPV4_PROTO_TCP && ip->protocol != IPV4_PROTO_UDP) return 0;
+    ihl = (size_t)(ip->version_ihl & 0x0Fu) * 4u;
+    if (len < sizeof(struct net_eth_header) + ihl + 4u) return 0;
+
+    hash = read_be32((const uint8_t *)ip + ihl) ^ read_be32(ip->dst);
+    hash *= 0x9E3779B1u;
+    return (hash >> 16) % g_net.virtio.pairs;
+}
 
-    memset(ring + off + 8, 0, 8);
-    memcpy(ring + off + 4, &bcnt, sizeof(bcnt));
-    ring[off + 7] = PCNET_DESC_OWN | PCNET_DESC_STP | PCNET_DESC_ENP;
+static void virtio_tx_commit(uint32_t slot, size_t len) {
+    struct net_virtio_state *v = &g_net.virtio;
+    uint8_t *base = g_net.tx_block + (size_t)slot * g_net.tx_stride;
+    struct virtio_net_hdr *hdr = (struct virtio_net_hdr *)base;
+    struct net_virtq *q = &v->tx[virtio_tx_pick(base + g_net.tx_frame_offset, len)];
+    struct virtq_desc *desc = &q->desc[slot];
+
+    memset(hdr, 0, v->hdr_len);
+    if (g_net.tx_meta.csum_start) {
+        hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr->csum_start = g_net.tx_meta.csum_start;
+        hdr->csum_offset = g_net.tx_meta.csum_offset;
+    }
+    if (g_net.tx_meta.gso_size) {
+        hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        hdr->gso_size = g_net.tx_meta.gso_size;
+        hdr->hdr_len = g_net.tx_meta.hdr_len;
+    }
+
+    /* Slot n always uses descriptor n of whichever queue carries it */
+    desc->addr = g_net.tx_block_phys + (uint64_t)slot * g_net.tx_stride;
+    desc->len = (uint32_t)(v->hdr_len + len);
+    desc->flags = 0;
+    desc->next = 0;
+    v->tx_busy[slot] = 1;
+    virtq_push(q, (uint16_t)slot);
+}
 
-    g_net.tx_index = (idx + 1u) % NET_TX_DESC_COUNT;
-    pcnet_write_csr(0, PCNET_CSR0_TDMD);
+void net_poll(void);
+static void net_setup_irq(uint8_t irq);
 
-    g_net.tx_packets++;
-    g_net.tx_bytes += frame_len;
-    return NET_OK;
+/* Reclaim up to the last completed descriptor that asked for status */
+static void e1000_tx_reclaim(void) {
+    while (g_net.tx_clean != g_net.tx_index) {
+        uint32_t i = g_net.tx_clean;
+
+        while (i != g_net.tx_index && !(g_net.tx_descs[i].cmd & E1000_TX_CMD_RS)) {
+            i = net_ring_next(i, g_net.tx_count);
+        }
+        if (i == g_net.tx_index || !(g_net.tx_descs[i].status & E1000_TX_STATUS_DD)) break;
+        g_net.tx_clean = net_ring_next(i, g_net.tx_count);
+    }
 }
 
-static int net_send_frame(const void *frame, size_t len) {
+static uint32_t e1000_tx_free(void) {
+    uint32_t used = (g_net.tx_index + g_net.tx_count - g_net.tx_clean) % g_net.tx_count;
+    return g_net.tx_count - 1u - used;
+}
+
+static int net_tx_slot_free(void) {
     if (g_net.backend == NET_BACKEND_E1000) {
-        return e1000_send_frame(frame, len);
+        /* Descriptors are only reclaimed once the ring runs low */
+        if (e1000_tx_free() < NET_TX_RS_INTERVAL) e1000_tx_reclaim();
+        return e1000_tx_free() > 1;     /* Room for a context descriptor too */
     }
-    if (g_net.backend == NET_BACKEND_PCNET) {
-        return pcnet_send_frame(frame, len);
+    if (g_net.backend == NET_BACKEND_VIRTIO) {
+        if (g_net.virtio.tx_busy[g_net.tx_index]) virtio_tx_reclaim();
+        return !g_net.virtio.tx_busy[g_net.tx_index];
     }
-    return NET_ERR_UNAVAILABLE;
+    return pcnet_driver_owns(g_net.pcnet_tx_ring, g_net.tx_index);
 }
 
-static int net_send_arp(uint16_t opcode,
-                        const uint8_t target_mac[NET_MAC_ADDR_LEN],
-                        const uint8_t target_ip[NET_IPV4_ADDR_LEN]) {
-    uint8_t frame[sizeof(struct net_eth_header) + sizeof(struct net_arp_packet)];
-    struct net_eth_header *eth = (struct net_eth_header *)frame;
-    struct net_arp_packet *arp =
-        (struct net_arp_packet *)(frame + sizeof(struct net_eth_header));
+/* Hand every filled descriptor to the NIC with a single doorbell */
+static void net_tx_flush(void) {
+    uint64_t flags = net_irq_save();
 
-    if (opcode == ARP_OP_REQUEST) {
-        memset(eth->dst, 0xFF, NET_MAC_ADDR_LEN);
-        memset(arp->tha, 0x00, NET_MAC_ADDR_LEN);
-    } else {
-        if (!target_mac) return NET_ERR_INVALID;
-        memcpy(eth->dst, target_mac, NET_MAC_ADDR_LEN);
-        memcpy(arp->tha, target_mac, NET_MAC_ADDR_LEN);
+    if (!g_net.tx_unflushed) {
+        net_irq_restore(flags);
+        return;
     }
 
-    memcpy(eth->src, g_net.mac, NET_MAC_ADDR_LEN);
-    write_be16(&eth->ethertype, ETH_TYPE_ARP);
+    if (g_net.backend == NET_BACKEND_E1000) {
+        uint32_t last = (g_net.tx_index + g_net.tx_count - 1u) % g_net.tx_count;
+        g_net.tx_descs[last].cmd |= E1000_TX_CMD_RS;
+        e1000_write32(E1000_REG_TDT, g_net.tx_index);
+    } else if (g_net.backend == NET_BACKEND_PCNET) {
+        pcnet_write_csr(0, (uint16_t)(PCNET_CSR0_TDMD | pcnet_csr0_ien()));
+    } else if (g_net.backend == NET_BACKEND_VIRTIO) {
+        for (uint32_t p = 0; p < g_net.virtio.pairs; p++) virtq_kick(&g_net.virtio.tx[p]);
+    }
+    g_net.tx_unflushed = 0;
+    g_net.tx_since_rs = 0;
+    net_irq_restore(flags);
+}
+
+/*
+ * net_tx_batch_begin/end - defer the doorbell for frames queued in
+ * between, so a poll or a burst of segments costs one register write.
+ */
+static void net_tx_batch_begin(void) {
+    g_net.tx_batch++;
+}
+
+static void net_tx_batch_end(void) {
+    if (g_net.tx_batch && --g_net.tx_batch == 0) net_tx_flush();
+}
+
+/*
+ * net_tx_get - reserve the DMA buffer of the next free TX descriptor.
+ * The caller builds its frame in place and must call net_tx_commit()
+ * without transmitting anything else in between; polls from the NIC
+ * interrupt stand aside meanwhile.  Offload requests for the frame go
+ * in g_net.tx_meta, which starts out clear.  Returns NULL if the ring
+ * stays full for 200 ms.
+ */
+static uint8_t *net_tx_get(void) {
+    uint64_t wait_deadline = timer_get_uptime_ms() + 200;
+
+    if (!g_net.ready) return NULL;
+    for (;;) {
+        uint64_t flags = net_irq_save();
+        if (net_tx_slot_free()) {
+            g_net.tx_reserved = 1;
+            memset(&g_net.tx_meta, 0, sizeof(g_net.tx_meta));
+            net_irq_restore(flags);
+            return net_tx_buffer(g_net.tx_index);
+        }
+        net_irq_restore(flags);
+
+        net_tx_flush();
+        if (timer_get_uptime_ms() >= wait_deadline) return NULL;
+        net_poll();
+    }
+}
+
+/*
+ * e1000_tx_context - make the NIC's checksum context match the frame
+ * about to be queued, spending a descriptor only when it changes.  A
+ * frame that just wants its IPv4 checksum runs under whatever context
+ * is loaded, since IXSM ignores the TCP offsets.
+ */
+static void e1000_tx_context(void) {
+    struct e1000_tx_context_desc *ctx;
+    uint32_t key;
+
+    if (g_net.tx_meta.csum_start) {
+        key = ((uint32_t)g_net.tx_meta.csum_start << 16) | g_net.tx_meta.csum_offset;
+    } else if (g_net.e1000_tx_context) {
+        return;
+    } else {
+        key = ((uint32_t)NET_TX_HEADROOM << 16) | offsetof(struct net_tcp_header, checksum);
+    }
+    if (key == g_net.e1000_tx_context) return;
+
+    ctx = (struct e1000_tx_context_desc *)&g_net.tx_descs[g_net.tx_index];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->ipcss = sizeof(struct net_eth_header);
+    ctx->ipcso = sizeof(struct net_eth_header) + offsetof(struct net_ipv4_header, checksum);
+    ctx->ipcse = NET_TX_HEADROOM - 1u;
+    ctx->tucss = (uint8_t)(key >> 16);
+    ctx->tucso = (uint8_t)((key >> 16) + (key & 0xFFFFu));
+    ctx->tucmd = E1000_TX_CMD_DEXT | E1000_TXCTX_IP | E1000_TXCTX_TCP;
+    g_net.tx_index = net_ring_next(g_net.tx_index, g_net.tx_count);
+    g_net.e1000_tx_context = key;
+}
+
+static void net_tx_commit(size_t len) {
+    uint32_t slot = g_net.tx_index;
+    uint32_t idx = slot;
+    uint64_t flags = net_irq_save();
+
+    if (g_net.backend == NET_BACKEND_E1000) {
+        struct e1000_tx_desc *desc;
+        uint8_t popts = 0;
+
+        if (g_net.tx_meta.ip_csum) popts |= E1000_TX_POPTS_IXSM;
+        if (g_net.tx_meta.csum_start) popts |= E1000_TX_POPTS_TXSM;
+        if (popts) {
+            e1000_tx_context();
+            idx = g_net.tx_index;
+        }
+
+        /* A context descriptor may have pushed the frame one slot on */
+        desc = &g_net.tx_descs[idx];
+        desc->addr = g_net.tx_block_phys + (uint64_t)slot * g_net.tx_stride;
+        desc->length = (uint16_t)len;
+        desc->status = 0;
+        desc->special = 0;
+        if (popts) {
+            desc->cmd = E1000_TX_CMD_EOP | E1000_TX_CMD_IFCS | E1000_TX_CMD_DEXT;
+            desc->cso = E1000_TX_DTYP_DATA;
+            desc->css = popts;
+        } else {
+            desc->cmd = E1000_TX_CMD_EOP | E1000_TX_CMD_IFCS;
+            desc->cso = 0;
+            desc->css = 0;
+        }
+        if (++g_net.tx_since_rs >= NET_TX_RS_INTERVAL) {
+            desc->cmd |= E1000_TX_CMD_RS;
+            g_net.tx_since_rs = 0;
+        }
+    } else if (g_net.backend == NET_BACKEND_VIRTIO) {
+        virtio_tx_commit(idx, len);
+    } else {
+        uint8_t *ring = g_net.pcnet_tx_ring;
+        size_t frame_len = pcnet_frame_length(len);
+        size_t off = pcnet_ring_offset(idx);
+        uint16_t bcnt;
+
+        if (frame_len > len) memset(net_tx_buffer(slot) + len, 0, frame_len - len);
+        len = frame_len;
+        bcnt = (uint16_t)(-(int)frame_len);
+        bcnt &= 0x0FFFu;
+        bcnt |= 0xF000u;
+
+        memset(ring + off + 8, 0, 8);
+        memcpy(ring + off + 4, &bcnt, sizeof(bcnt));
+        ring[off + 7] = PCNET_DESC_OWN | PCNET_DESC_STP | PCNET_DESC_ENP;
+    }
+
+    g_net.tx_index = net_ring_next(idx, g_net.tx_count);
+    g_net.tx_unflushed++;
+    g_net.tx_packets++;
+    g_net.tx_bytes += len;
+    if (!g_net.tx_batch) net_tx_flush();
+    g_net.tx_reserved = 0;
+    net_irq_restore(flags);
+}
+
+static int net_send_frame(const void *frame, size_t len) {
+    uint8_t *buffer;
+
+    if (!frame || len == 0 || len > NET_PACKET_BUFFER_SIZE) return NET_ERR_INVALID;
+    if (g_net.backend == NET_BACKEND_NONE) return NET_ERR_UNAVAILABLE;
+
+    buffer = net_tx_get();
+    if (!buffer) return NET_ERR_TIMEOUT;
+    memcpy(buffer, frame, len);
+    net_tx_commit(len);
+    return NET_OK;
+}
+
+static int net_send_arp(uint16_t opcode,
+                        const uint8_t target_mac[NET_MAC_ADDR_LEN],
+                        const uint8_t target_ip[NET_IPV4_ADDR_LEN]) {
+    uint8_t frame[sizeof(struct net_eth_header) + sizeof(struct net_arp_packet)];
+    struct net_eth_header *eth = (struct net_eth_header *)frame;
+    struct net_arp_packet *arp =
+        (struct net_arp_packet *)(frame + sizeof(struct net_eth_header));
+
+    if (opcode == ARP_OP_REQUEST) {
+        /* A known MAC turns the request into a unicast refresh */
+        if (target_mac) {
+            memcpy(eth->dst, target_mac, NET_MAC_ADDR_LEN);
+        } else {
+            memset(eth->dst, 0xFF, NET_MAC_ADDR_LEN);
+        }
+        memset(arp->tha, 0x00, NET_MAC_ADDR_LEN);
+    } else {
+        if (!target_mac) return NET_ERR_INVALID;
+        memcpy(eth->dst, target_mac, NET_MAC_ADDR_LEN);
+        memcpy(arp->tha, target_mac, NET_MAC_ADDR_LEN);
+    }
+
+    memcpy(eth->src, g_net.mac, NET_MAC_ADDR_LEN);
+    write_be16(&eth->ethertype, ETH_TYPE_ARP);
 
     write_be16(&arp->htype, 1);
     write_be16(&arp->ptype, ETH_TYPE_IPV4);
@@ -894,51 +1952,342 @@ static int net_send_arp(uint16_t opcode,
     return net_send_frame(frame, sizeof(frame));
 }
 
-static int net_send_ipv4(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
-                         uint8_t protocol,
-                         const void *payload,
-                         size_t payload_len) {
-    uint8_t next_hop_ip[NET_IPV4_ADDR_LEN];
-    uint8_t dst_mac[NET_MAC_ADDR_LEN];
-    uint8_t frame[1514];
-    struct net_eth_header *eth = (struct net_eth_header *)frame;
-    struct net_ipv4_header *ip =
-        (struct net_ipv4_header *)(frame + sizeof(struct net_eth_header));
-    uint8_t *out_payload = (uint8_t *)(frame + sizeof(struct net_eth_header) +
-                                       sizeof(struct net_ipv4_header));
-    size_t frame_len = sizeof(struct net_eth_header) + sizeof(struct net_ipv4_header) +
-                       payload_len;
+static void arp_init(void) {
+    for (int i = NET_ARP_CACHE_SIZE - 1; i >= 0; i--) {
+        g_net.arp_cache[i].hash_next = g_net.arp_free;
+        g_net.arp_free = &g_net.arp_cache[i];
+    }
+    for (int i = NET_ARP_PENDING_MAX - 1; i >= 0; i--) {
+        g_net.arp_pending[i].next = g_net.arp_pending_free;
+        g_net.arp_pending_free = &g_net.arp_pending[i];
+    }
+}
 
-    if (!g_net.ready) return NET_ERR_UNAVAILABLE;
-    if (!payload || payload_len == 0) return NET_ERR_INVALID;
-    if (!g_net.dhcp_configured && !ip_is_broadcast(dst_ip)) return NET_ERR_NOT_CONFIGURED;
-    if (frame_len > sizeof(frame)) return NET_ERR_INVALID;
+static uint32_t arp_hash_bucket(const uint8_t ip[NET_IPV4_ADDR_LEN]) {
+    return ((read_be32(ip) * 0x9E3779B1u) >> 16) % NET_ARP_HASH_BUCKETS;
+}
 
-    if (ip_is_broadcast(dst_ip)) {
-        memset(dst_mac, 0xFF, NET_MAC_ADDR_LEN);
-    } else {
-        if (ip_same_subnet(dst_ip, g_net.ipv4, g_net.netmask)) {
-            memcpy(next_hop_ip, dst_ip, NET_IPV4_ADDR_LEN);
-        } else if (!ip_is_zero(g_net.gateway)) {
-            memcpy(next_hop_ip, g_net.gateway, NET_IPV4_ADDR_LEN);
+/*
+ * The neighbour table is shared by senders in process context and the
+ * receive path, so every helper below runs with interrupts disabled
+ * unless it says otherwise.
+ */
+static struct net_arp_entry *arp_find(const uint8_t ip[NET_IPV4_ADDR_LEN]) {
+    struct net_arp_entry *e = g_net.arp_hash[arp_hash_bucket(ip)];
+
+    while (e && !ip_equal(e->ip, ip)) e = e->hash_next;
+    return e;
+}
+
+static void arp_pending_release(struct net_arp_pending *p) {
+    while (p) {
+        struct net_arp_pending *next = p->next;
+        p->next = g_net.arp_pending_free;
+        g_net.arp_pending_free = p;
+        p = next;
+    }
+}
+
+/* Unhash e and drop any frames parked on it */
+static void arp_entry_free(struct net_arp_entry *e) {
+    struct net_arp_entry **link = &g_net.arp_hash[arp_hash_bucket(e->ip)];
+
+    while (*link && *link != e) link = &(*link)->hash_next;
+    if (*link) *link = e->hash_next;
+
+    g_net.arp_dropped += e->pending_count;
+    arp_pending_release(e->pending_head);
+    memset(e, 0, sizeof(*e));
+    e->hash_next = g_net.arp_free;
+    g_net.arp_free = e;
+    g_net.arp_entries--;
+}
+
+/*
+ * arp_entry_alloc - hash a blank entry for ip, evicting the least
+ * recently used resolved neighbour if the table is full.  Returns NULL
+ * only when every entry is still being resolved.
+ */
+static struct net_arp_entry *arp_entry_alloc(const uint8_t ip[NET_IPV4_ADDR_LEN]) {
+    struct net_arp_entry *e = g_net.arp_free;
+    uint32_t b;
+
+    if (!e) {
+        struct net_arp_entry *victim = NULL;
+        for (int i = 0; i < NET_ARP_CACHE_SIZE; i++) {
+            struct net_arp_entry *c = &g_net.arp_cache[i];
+            if (c->state != NET_ARP_VALID) continue;
+            if (!victim || c->used_ms < victim->used_ms) victim = c;
+        }
+        if (!victim) return NULL;
+        arp_entry_free(victim);
+        e = g_net.arp_free;
+    }
+
+    g_net.arp_free = e->hash_next;
+    memcpy(e->ip, ip, NET_IPV4_ADDR_LEN);
+    b = arp_hash_bucket(ip);
+    e->hash_next = g_net.arp_hash[b];
+    g_net.arp_hash[b] = e;
+    g_net.arp_entries++;
+    return e;
+}
+
+/*
+ * arp_flush - transmit frames that were waiting for mac, then return
+ * their slots.  Interrupts need not be disabled.
+ */
+static void arp_flush(struct net_arp_pending *p, const uint8_t mac[NET_MAC_ADDR_LEN]) {
+    while (p) {
+        struct net_arp_pending *next = p->next;
+        uint8_t *buffer = net_tx_get();
+        uint64_t flags;
+
+        if (buffer) {
+            memcpy(p->frame, mac, NET_MAC_ADDR_LEN);    /* Ethernet destination */
+            memcpy(buffer, p->frame, p->len);
+            g_net.tx_meta = p->meta;
+            net_tx_commit(p->len);
         } else {
-            return NET_ERR_INVALID;
+            g_net.arp_dropped++;
         }
 
-        if (!arp_cache_lookup(next_hop_ip, dst_mac)) {
-            uint64_t deadline = timer_get_uptime_ms() + 1000;
-            if (net_send_arp(ARP_OP_REQUEST, NULL, next_hop_ip) != NET_OK) {
-                return NET_ERR_GENERIC;
+        flags = net_irq_save();
+        p->next = g_net.arp_pending_free;
+        g_net.arp_pending_free = p;
+        net_irq_restore(flags);
+        p = next;
+    }
+}
+
+/*
+ * arp_learn - ip is at mac.  A known neighbour is always updated; a new
+ * entry is made only if create is set, so broadcast chatter from other
+ * hosts cannot push out the neighbours we talk to.  Frames parked on the
+ * entry go out.  Interrupts need not be disabled.
+ */
+static void arp_learn(const uint8_t ip[NET_IPV4_ADDR_LEN],
+                      const uint8_t mac[NET_MAC_ADDR_LEN],
+                      int create) {
+    struct net_arp_pending *parked = NULL;
+    uint64_t now = timer_get_uptime_ms();
+    uint64_t flags = net_irq_save();
+    struct net_arp_entry *e = arp_find(ip);
+
+    if (!e && create) {
+        e = arp_entry_alloc(ip);
+        if (e) e->used_ms = now;
+    }
+    if (e) {
+        memcpy(e->mac, mac, NET_MAC_ADDR_LEN);
+        e->state = NET_ARP_VALID;
+        e->confirmed_ms = now;
+        e->probes = 0;
+        parked = e->pending_head;
+        e->pending_head = NULL;
+        e->pending_tail = NULL;
+        e->pending_count = 0;
+    }
+    net_irq_restore(flags);
+
+    arp_flush(parked, mac);
+}
+
+/*
+ * arp_confirm - a frame from ip arrived from mac, so a matching entry is
+ * still good and needs no refresh.  Interrupts need not be disabled.
+ */
+static void arp_confirm(const uint8_t ip[NET_IPV4_ADDR_LEN],
+                        const uint8_t mac[NET_MAC_ADDR_LEN]) {
+    uint64_t flags = net_irq_save();
+    struct net_arp_entry *e = arp_find(ip);
+
+    if (e && e->state == NET_ARP_VALID && memcmp(e->mac, mac, NET_MAC_ADDR_LEN) == 0) {
+        e->confirmed_ms = timer_get_uptime_ms();
+        e->probes = 0;
+    }
+    net_irq_restore(flags);
+}
+
+/*
+ * arp_park - the frame just built in the reserved TX buffer is for a
+ * neighbour still being resolved: copy it onto that neighbour's queue,
+ * dropping its oldest frame if the queue is full, and give the buffer
+ * back.  If the reply came in meanwhile the frame is sent instead.
+ * Interrupts need not be disabled.
+ */
+static void arp_park(const uint8_t ip[NET_IPV4_ADDR_LEN], size_t len) {
+    uint8_t *frame = net_tx_buffer(g_net.tx_index);
+    uint64_t flags = net_irq_save();
+    struct net_arp_entry *e = arp_find(ip);
+    struct net_arp_pending *p = NULL;
+
+    if (e && e->state == NET_ARP_VALID) {
+        memcpy(frame, e->mac, NET_MAC_ADDR_LEN);
+        net_irq_restore(flags);
+        net_tx_commit(len);
+        return;
+    }
+
+    if (e && len <= NET_PACKET_BUFFER_SIZE) {
+        if (e->pending_count < NET_ARP_PENDING_PER_NEIGH && g_net.arp_pending_free) {
+            p = g_net.arp_pending_free;
+            g_net.arp_pending_free = p->next;
+            e->pending_count++;
+        } else if (e->pending_head) {
+            p = e->pending_head;
+            e->pending_head = p->next;
+            if (!e->pending_head) e->pending_tail = NULL;
+            g_net.arp_dropped++;
+        }
+    }
+
+    if (p) {
+        p->next = NULL;
+        p->len = (uint16_t)len;
+        p->meta = g_net.tx_meta;
+        memcpy(p->frame, frame, len);
+        if (e->pending_tail) {
+            e->pending_tail->next = p;
+        } else {
+            e->pending_head = p;
+        }
+        e->pending_tail = p;
+    } else {
+        g_net.arp_dropped++;
+    }
+    g_net.tx_reserved = 0;
+    net_irq_restore(flags);
+}
+
+/*
+ * arp_run_timers - resend requests for incomplete entries, giving up
+ * after NET_ARP_MAX_PROBES, and forget neighbours whose refreshes went
+ * unanswered or that nobody used for NET_ARP_GC_MS.  Called from
+ * net_poll().
+ */
+static void arp_run_timers(void) {
+    uint64_t now = timer_get_uptime_ms();
+
+    if (now < g_net.arp_next_scan_ms || g_net.arp_entries == 0) return;
+    g_net.arp_next_scan_ms = now + NET_ARP_SCAN_MS;
+
+    for (int i = 0; i < NET_ARP_CACHE_SIZE; i++) {
+        struct net_arp_entry *e = &g_net.arp_cache[i];
+        uint8_t ip[NET_IPV4_ADDR_LEN];
+        int retry = 0;
+        uint64_t flags = net_irq_save();
+
+        if (e->state == NET_ARP_INCOMPLETE && now - e->probe_ms >= NET_ARP_RETRY_MS) {
+            if (e->probes >= NET_ARP_MAX_PROBES) {
+                arp_entry_free(e);
+            } else {
+                e->probes++;
+                e->probe_ms = now;
+                memcpy(ip, e->ip, NET_IPV4_ADDR_LEN);
+                retry = 1;
             }
-            while (timer_get_uptime_ms() < deadline) {
-                net_poll();
-                if (arp_cache_lookup(next_hop_ip, dst_mac)) break;
+        } else if (e->state == NET_ARP_VALID) {
+            if ((e->probes >= NET_ARP_MAX_PROBES && now - e->probe_ms >= NET_ARP_RETRY_MS) ||
+                now - e->used_ms >= NET_ARP_GC_MS) {
+                arp_entry_free(e);
             }
-            if (!arp_cache_lookup(next_hop_ip, dst_mac)) return NET_ERR_TIMEOUT;
         }
+        net_irq_restore(flags);
+
+        if (retry) (void)net_send_arp(ARP_OP_REQUEST, NULL, ip);
+    }
+}
+
+/*
+ * net_ipv4_resolve - pick dst_ip's next hop and look up its MAC.  A
+ * recently confirmed neighbour is used as is; an older one is still used
+ * while a unicast request re-confirms it.  On a miss a broadcast request
+ * goes out and hop->resolved stays 0: the caller builds its packet as
+ * usual and net_ipv4_output() parks it until the reply arrives, so
+ * nothing waits for ARP.
+ */
+static int net_ipv4_resolve(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
+                            struct net_next_hop *hop) {
+    struct net_arp_entry *e;
+    uint64_t now;
+    uint64_t flags;
+    int request = 0;
+
+    if (!g_net.ready) return NET_ERR_UNAVAILABLE;
+    if (!g_net.dhcp_configured && !ip_is_broadcast(dst_ip)) return NET_ERR_NOT_CONFIGURED;
+
+    hop->resolved = 1;
+    if (ip_is_broadcast(dst_ip)) {
+        memcpy(hop->ip, dst_ip, NET_IPV4_ADDR_LEN);
+        memset(hop->mac, 0xFF, NET_MAC_ADDR_LEN);
+        return NET_OK;
+    }
+
+    if (ip_same_subnet(dst_ip, g_net.ipv4, g_net.netmask)) {
+        memcpy(hop->ip, dst_ip, NET_IPV4_ADDR_LEN);
+    } else if (!ip_is_zero(g_net.gateway)) {
+        memcpy(hop->ip, g_net.gateway, NET_IPV4_ADDR_LEN);
+    } else {
+        return NET_ERR_INVALID;
+    }
+
+    now = timer_get_uptime_ms();
+    flags = net_irq_save();
+    e = arp_find(hop->ip);
+    if (!e) {
+        e = arp_entry_alloc(hop->ip);
+        if (!e) {
+            net_irq_restore(flags);
+            return NET_ERR_GENERIC;
+        }
+        e->state = NET_ARP_INCOMPLETE;
+        e->probes = 1;
+        e->probe_ms = now;
+        request = 1;
+    }
+    e->used_ms = now;
+
+    if (e->state == NET_ARP_VALID) {
+        memcpy(hop->mac, e->mac, NET_MAC_ADDR_LEN);
+        if (now - e->confirmed_ms >= NET_ARP_REACHABLE_MS &&
+            now - e->probe_ms >= NET_ARP_RETRY_MS) {
+            e->probes++;
+            e->probe_ms = now;
+            request = 1;
+        }
+    } else {
+        hop->resolved = 0;
     }
+    net_irq_restore(flags);
 
-    memcpy(eth->dst, dst_mac, NET_MAC_ADDR_LEN);
+    if (request) {
+        (void)net_send_arp(ARP_OP_REQUEST, hop->resolved ? hop->mac : NULL, hop->ip);
+    }
+    return NET_OK;
+}
+
+/*
+ * net_ipv4_alloc - reserve a TX buffer and return where the IPv4 payload
+ * goes.  The Ethernet and IPv4 headers are filled into the headroom in
+ * front of it by net_ipv4_output(), so callers build their transport
+ * header and data in DMA memory directly.
+ */
+static uint8_t *net_ipv4_alloc(void) {
+    uint8_t *frame = net_tx_get();
+    return frame ? frame + NET_TX_HEADROOM : NULL;
+}
+
+static int net_ipv4_output(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
+                           const struct net_next_hop *hop,
+                           uint8_t protocol,
+                           size_t payload_len) {
+    uint8_t *frame = net_tx_buffer(g_net.tx_index);
+    struct net_eth_header *eth = (struct net_eth_header *)frame;
+    struct net_ipv4_header *ip =
+        (struct net_ipv4_header *)(frame + sizeof(struct net_eth_header));
+
+    memcpy(eth->dst, hop->mac, NET_MAC_ADDR_LEN);
     memcpy(eth->src, g_net.mac, NET_MAC_ADDR_LEN);
     write_be16(&eth->ethertype, ETH_TYPE_IPV4);
 
@@ -951,10 +2300,38 @@ static int net_send_ipv4(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
     write_be16(&ip->flags_fragment, 0x4000);
     memcpy(ip->src, g_net.ipv4, NET_IPV4_ADDR_LEN);
     memcpy(ip->dst, dst_ip, NET_IPV4_ADDR_LEN);
-    memcpy(out_payload, payload, payload_len);
-    write_be16(&ip->checksum, net_checksum16(ip, sizeof(*ip)));
+    if (g_net.tx_ip_csum_offload) {
+        g_net.tx_meta.ip_csum = 1;      /* Field stays zero for the NIC */
+    } else {
+        write_be16(&ip->checksum, net_checksum16(ip, sizeof(*ip)));
+    }
+
+    if (hop->resolved) {
+        net_tx_commit(NET_TX_HEADROOM + payload_len);
+    } else {
+        arp_park(hop->ip, NET_TX_HEADROOM + payload_len);
+    }
+    return NET_OK;
+}
+
+static int net_send_ipv4(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
+                         uint8_t protocol,
+                         const void *payload,
+                         size_t payload_len) {
+    struct net_next_hop hop;
+    uint8_t *out_payload;
+    int rc;
 
-    return net_send_frame(frame, frame_len);
+    if (!payload || payload_len == 0) return NET_ERR_INVALID;
+    if (payload_len > NET_MTU - sizeof(struct net_ipv4_header)) return NET_ERR_INVALID;
+
+    rc = net_ipv4_resolve(dst_ip, &hop);
+    if (rc != NET_OK) return rc;
+
+    out_payload = net_ipv4_alloc();
+    if (!out_payload) return NET_ERR_TIMEOUT;
+    memcpy(out_payload, payload, payload_len);
+    return net_ipv4_output(dst_ip, &hop, protocol, payload_len);
 }
 
 static int net_send_udp(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
@@ -962,64 +2339,352 @@ static int net_send_udp(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
                         uint16_t dst_port,
                         const void *payload,
                         size_t payload_len) {
-    uint8_t packet[1472];
-    struct net_udp_header *udp = (struct net_udp_header *)packet;
+    struct net_next_hop hop;
+    struct net_udp_header *udp;
+    uint16_t checksum;
+    int rc;
+
+    if (sizeof(*udp) + payload_len > NET_MTU - sizeof(struct net_ipv4_header)) {
+        return NET_ERR_INVALID;
+    }
+    rc = net_ipv4_resolve(dst_ip, &hop);
+    if (rc != NET_OK) return rc;
 
-    if (sizeof(*udp) + payload_len > sizeof(packet)) return NET_ERR_INVALID;
+    udp = (struct net_udp_header *)net_ipv4_alloc();
+    if (!udp) return NET_ERR_TIMEOUT;
     write_be16(&udp->src_port, src_port);
     write_be16(&udp->dst_port, dst_port);
     write_be16(&udp->length, (uint16_t)(sizeof(*udp) + payload_len));
     write_be16(&udp->checksum, 0);
-    memcpy(packet + sizeof(*udp), payload, payload_len);
+    memcpy((uint8_t *)udp + sizeof(*udp), payload, payload_len);
+    checksum = net_l4_checksum(g_net.ipv4, dst_ip, IPV4_PROTO_UDP,
+                               udp, sizeof(*udp) + payload_len);
+    write_be16(&udp->checksum, checksum ? checksum : 0xFFFFu);   /* 0 means none */
 
-    return net_send_ipv4(dst_ip, IPV4_PROTO_UDP, packet,
-                         sizeof(*udp) + payload_len);
+    return net_ipv4_output(dst_ip, &hop, IPV4_PROTO_UDP, sizeof(*udp) + payload_len);
 }
 
-static int net_send_tcp_segment(struct net_tcp_conn *conn,
-                                uint8_t flags,
-                                const void *payload,
-                                size_t payload_len) {
-    uint8_t packet[sizeof(struct net_tcp_header) + NET_TCP_TX_MSS];
-    struct net_tcp_header *tcp = (struct net_tcp_header *)packet;
+/*
+ * net_send_tcp_raw - build and transmit one segment at seq without touching
+ * the connection's send state.  SYNs carry our MSS option.  The segment
+ * is built in the NIC's TX buffer; a NULL payload with a length takes the
+ * data straight from the send ring at seq.  With TSO a payload longer
+ * than the MSS goes out as one frame the NIC splits on the wire, and
+ * with checksum offload only the pseudo-header sum is filled in.
+ */
+/* Option bytes a non-SYN segment carries right now: only SACK blocks */
+static uint32_t tcp_data_opt_len(const struct net_tcp_conn *conn) {
+    uint32_t blocks;
+
+    if (!conn->sack_ok || conn->ooo_count == 0) return 0;
+    blocks = conn->ooo_count;
+    if (blocks > NET_TCP_SACK_BLOCKS) blocks = NET_TCP_SACK_BLOCKS;
+    return 4u + 8u * blocks;
+}
+
+/* Payload of one MTU-sized segment once its options are accounted for */
+static uint32_t tcp_seg_payload(const struct net_tcp_conn *conn) {
+    uint32_t opt = tcp_data_opt_len(conn);
+    return (opt < conn->mss) ? conn->mss - opt : conn->mss;
+}
+
+static int net_send_tcp_raw(struct net_tcp_conn *conn,
+                            uint32_t seq,
+                            uint8_t flags,
+                            const void *payload,
+                            size_t payload_len) {
+    struct net_next_hop hop;
+    uint8_t *packet;
+    struct net_tcp_header *tcp;
+    uint8_t *opt;
+    size_t header_len = sizeof(struct net_tcp_header);
     uint16_t window;
+    uint32_t edge;
     size_t segment_len;
 
     if (!conn) return NET_ERR_INVALID;
-    if (payload_len > NET_TCP_TX_MSS) return NET_ERR_INVALID;
+    if (payload_len > NET_TCP_MAX_MSS && payload_len > g_net.tso_max) return NET_ERR_INVALID;
+    if (net_ipv4_resolve(conn->remote_ip, &hop) != NET_OK) return NET_ERR_GENERIC;
+
+    packet = net_ipv4_alloc();
+    if (!packet) return NET_ERR_GENERIC;
+    tcp = (struct net_tcp_header *)packet;
+    opt = packet + sizeof(*tcp);
+
+    memset(packet, 0, sizeof(struct net_tcp_header) + NET_TCP_MAX_OPT_LEN);
+    if (flags & TCP_FLAG_SYN) {
+        opt[0] = NET_TCP_OPT_MSS;
+        opt[1] = NET_TCP_OPT_MSS_LEN;
+        write_be16(opt + 2, NET_TCP_MAX_MSS);
+        opt[4] = NET_TCP_OPT_NOP;
+        opt[5] = NET_TCP_OPT_WSCALE;
+        opt[6] = 3;
+        opt[7] = NET_TCP_WSCALE;
+        opt[8] = NET_TCP_OPT_SACK_PERM;
+        opt[9] = 2;
+        opt[10] = NET_TCP_OPT_NOP;
+        opt[11] = NET_TCP_OPT_NOP;
+        /* A SYN-ACK may only echo what the peer's SYN offered */
+        if ((flags & TCP_FLAG_ACK) && !conn->rcv_wscale) memset(opt + 4, NET_TCP_OPT_NOP, 4);
+        if ((flags & TCP_FLAG_ACK) && !conn->sack_ok) memset(opt + 8, NET_TCP_OPT_NOP, 2);
+        header_len += NET_TCP_SYN_OPT_LEN;
+    } else if (tcp_data_opt_len(conn) > 0) {
+        uint32_t blocks = (tcp_data_opt_len(conn) - 4u) / 8u;
+        opt[0] = NET_TCP_OPT_NOP;
+        opt[1] = NET_TCP_OPT_NOP;
+        opt[2] = NET_TCP_OPT_SACK;
+        opt[3] = (uint8_t)(2u + 8u * blocks);
+        for (uint32_t i = 0; i < blocks; i++) {
+            write_be32(opt + 4 + 8 * i, conn->ooo[i].start);
+            write_be32(opt + 8 + 8 * i, conn->ooo[i].end);
+        }
+        header_len += 4u + 8u * blocks;
+    }
 
-    memset(packet, 0, sizeof(packet));
     write_be16(&tcp->src_port, conn->local_port);
     write_be16(&tcp->dst_port, conn->remote_port);
-    write_be32(&tcp->seq_num, conn->snd_nxt);
+    write_be32(&tcp->seq_num, seq);
     write_be32(&tcp->ack_num, conn->rcv_nxt);
-    tcp->data_offset = (uint8_t)(sizeof(*tcp) / 4u) << 4;
+    tcp->data_offset = (uint8_t)(header_len / 4u) << 4;
     tcp->flags = flags;
-    window = (uint16_t)tcp_conn_rx_space(conn);
-    if (window == 0) window = 1;
+    window = tcp_conn_rx_window(conn, flags & TCP_FLAG_SYN);
     write_be16(&tcp->window, window);
     write_be16(&tcp->urgent_ptr, 0);
 
     if (payload_len > 0 && payload) {
-        memcpy(packet + sizeof(*tcp), payload, payload_len);
+        memcpy(packet + header_len, payload, payload_len);
+    } else if (payload_len > 0) {
+        tcp_conn_tx_copy(conn, seq - conn->snd_una, packet + header_len, (uint32_t)payload_len);
     }
 
-    segment_len = sizeof(*tcp) + payload_len;
+    segment_len = header_len + payload_len;
     write_be16(&tcp->checksum, 0);
-    write_be16(&tcp->checksum,
-               net_tcp_checksum(g_net.ipv4, conn->remote_ip, packet, segment_len));
+    if (g_net.tx_csum_offload) {
+        g_net.tx_meta.csum_start = NET_TX_HEADROOM;
+        g_net.tx_meta.csum_offset = offsetof(struct net_tcp_header, checksum);
+        write_be16(&tcp->checksum,
+                   net_checksum_fold(net_pseudo_sum(g_net.ipv4, conn->remote_ip,
+                                                    IPV4_PROTO_TCP, segment_len)));
+        if (payload_len > tcp_seg_payload(conn) && g_net.tso_max) {
+            g_net.tx_meta.gso_size = (uint16_t)tcp_seg_payload(conn);
+            g_net.tx_meta.hdr_len = (uint16_t)(NET_TX_HEADROOM + header_len);
+        }
+    } else {
+        write_be16(&tcp->checksum,
+                   net_l4_checksum(g_net.ipv4, conn->remote_ip, IPV4_PROTO_TCP,
+                                   packet, segment_len));
+    }
+
+    (void)net_ipv4_output(conn->remote_ip, &hop, IPV4_PROTO_TCP, segment_len);
+    conn->last_activity_ms = timer_get_uptime_ms();
+    edge = conn->rcv_nxt + ((uint32_t)window << ((flags & TCP_FLAG_SYN) ? 0 : conn->rcv_wscale));
+    if (tcp_seq_after(edge, conn->rcv_adv)) conn->rcv_adv = edge;
+    return NET_OK;
+}
+
+static void tcp_conn_note_sent(struct net_tcp_conn *conn) {
+    if (tcp_seq_after(conn->snd_nxt, conn->snd_max)) conn->snd_max = conn->snd_nxt;
+}
 
-    if (net_send_ipv4(conn->remote_ip, IPV4_PROTO_TCP, packet, segment_len) != NET_OK) {
+static int net_send_tcp_segment(struct net_tcp_conn *conn,
+                                uint8_t flags,
+                                const void *payload,
+                                size_t payload_len) {
+    if (!conn) return NET_ERR_INVALID;
+    if (net_send_tcp_raw(conn, conn->snd_nxt, flags, payload, payload_len) != NET_OK) {
         return NET_ERR_GENERIC;
     }
 
     if (flags & TCP_FLAG_SYN) conn->snd_nxt++;
     if (flags & TCP_FLAG_FIN) conn->snd_nxt++;
     conn->snd_nxt += (uint32_t)payload_len;
-    conn->last_activity_ms = timer_get_uptime_ms();
+    tcp_conn_note_sent(conn);
     return NET_OK;
 }
 
+/* Transmit len buffered bytes starting at seq, which must not precede snd_una */
+static int tcp_send_data(struct net_tcp_conn *conn, uint32_t seq, uint32_t len,
+                         uint8_t flags) {
+    return net_send_tcp_raw(conn, seq, flags, NULL, len);
+}
+
+/* Largest payload tcp_output() may hand the NIC: whole segments under TSO */
+static uint32_t tcp_send_quantum(const struct net_tcp_conn *conn) {
+    uint32_t seg = tcp_seg_payload(conn);
+
+    if (g_net.tso_max > seg) return g_net.tso_max - g_net.tso_max % seg;
+    return seg;
+}
+
+static void tcp_arm_rto(struct net_tcp_conn *conn) {
+    conn->rto_deadline_ms = timer_get_uptime_ms() + conn->rto_ms;
+}
+
+/*
+ * tcp_output - send as much buffered data as min(cwnd, peer window)
+ * allows, then the queued FIN once every byte has gone out.  A short
+ * segment is held back while earlier data is unacknowledged, so a stream
+ * of small writes coalesces into full segments.  Reentry from a nested
+ * poll is ignored; the outer loop rereads the state on every pass.
+ */
+static void tcp_output(struct net_tcp_conn *conn) {
+    if (conn->output_active) return;
+    conn->output_active = 1;
+    net_tx_batch_begin();
+
+    for (;;) {
+        uint32_t wnd = (conn->cwnd < conn->snd_wnd) ? conn->cwnd : conn->snd_wnd;
+        uint32_t flight = tcp_conn_flight(conn);
+        uint32_t unsent = tcp_conn_unsent(conn);
+        uint32_t seq = conn->snd_nxt;
+        uint32_t len;
+
+        if (unsent == 0 || flight >= wnd) break;
+        len = unsent;
+        if (len > tcp_send_quantum(conn)) len = tcp_send_quantum(conn);
+        if (len > wnd - flight) len = wnd - flight;
+        if (len < tcp_seg_payload(conn) && len < unsent && flight > 0) break;
+
+        conn->snd_nxt += len;
+        if (tcp_send_data(conn, seq, len,
+                          TCP_FLAG_ACK | (len == unsent ? TCP_FLAG_PSH : 0)) != NET_OK) {
+            if (conn->snd_nxt == seq + len) conn->snd_nxt = seq;
+            if (!conn->rto_deadline_ms) tcp_arm_rto(conn);
+            break;
+        }
+        tcp_conn_note_sent(conn);
+        if (!conn->rtt_active && !tcp_seq_before(seq, conn->snd_max - len)) {
+            conn->rtt_active = 1;
+            conn->rtt_seq = seq;
+            conn->rtt_start_ms = timer_get_uptime_ms();
+        }
+        if (!conn->rto_deadline_ms) tcp_arm_rto(conn);
+    }
+
+    if (conn->fin_pending && !conn->fin_acked &&
+        conn->snd_nxt == conn->snd_una + conn->tx_len) {
+        if (net_send_tcp_segment(conn, TCP_FLAG_ACK | TCP_FLAG_FIN, NULL, 0) == NET_OK &&
+            !conn->rto_deadline_ms) {
+            tcp_arm_rto(conn);
+        }
+    }
+
+    /* Window closed with data waiting: the same timer drives persist probes */
+    if (!conn->rto_deadline_ms && tcp_conn_flight(conn) == 0 && tcp_conn_unsent(conn) > 0) {
+        tcp_arm_rto(conn);
+    }
+
+    net_tx_batch_end();
+    conn->output_active = 0;
+}
+
+/* Resend the oldest unacknowledged segment, or the FIN if only it is left */
+static void tcp_retransmit_head(struct net_tcp_conn *conn) {
+    uint32_t len = conn->tx_len;
+
+    if (len > tcp_seg_payload(conn)) len = tcp_seg_payload(conn);
+    if (len > 0) {
+        (void)tcp_send_data(conn, conn->snd_una, len, TCP_FLAG_ACK);
+    } else if (conn->fin_pending && !conn->fin_acked) {
+        (void)net_send_tcp_raw(conn, conn->snd_una, TCP_FLAG_ACK | TCP_FLAG_FIN, NULL, 0);
+    }
+    conn->rtt_active = 0;               /* Karn: never time a retransmission */
+    tcp_arm_rto(conn);
+}
+
+static uint32_t tcp_half_flight(const struct net_tcp_conn *conn) {
+    uint32_t half = tcp_conn_flight(conn) / 2u;
+    return (half > 2u * conn->mss) ? half : 2u * conn->mss;
+}
+
+/*
+ * tcp_conn_recycle - put an embryonic connection back on its listener's
+ * free list, keeping its receive ring.  Safe on the receive path.
+ */
+static void tcp_conn_recycle(struct net_tcp_conn *conn) {
+    struct net_tcp_listener *l = conn->listener;
+    uint8_t *rx_buffer = conn->rx_buffer;
+    uint32_t rx_size = conn->rx_size;
+
+    tcp_conn_unhash(conn);
+    memset(conn, 0, offsetof(struct net_tcp_conn, tx_buffer));
+    memset(&conn->rx_buffer, 0, sizeof(*conn) - offsetof(struct net_tcp_conn, rx_buffer));
+    conn->rx_buffer = rx_buffer;
+    conn->rx_size = rx_size;
+    conn->listener = l;
+    conn->queue_next = l->free;
+    l->free = conn;
+}
+
+/* The SYN-ACK went unanswered: resend it, or give the slot back */
+static void tcp_syn_rcvd_timeout(struct net_tcp_conn *conn) {
+    if (++conn->syn_retries > NET_TCP_SYN_RETRIES) {
+        tcp_conn_recycle(conn);
+        return;
+    }
+
+    conn->rtt_active = 0;
+    (void)net_send_tcp_raw(conn, conn->iss, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+    conn->rto_ms *= 2u;
+    if (conn->rto_ms > NET_TCP_RTO_MAX_MS) conn->rto_ms = NET_TCP_RTO_MAX_MS;
+    tcp_arm_rto(conn);
+}
+
+/*
+ * tcp_conn_timeout - the retransmission timer fired: collapse cwnd to one
+ * segment, back the RTO off and go back to snd_una.  With nothing in
+ * flight it is the persist timer instead: a zero window is probed with a
+ * single byte, otherwise a send that failed earlier is retried.
+ */
+static void tcp_conn_timeout(struct net_tcp_conn *conn) {
+    conn->rto_deadline_ms = 0;
+    if (conn->state == NET_TCP_SYN_RCVD) {
+        tcp_syn_rcvd_timeout(conn);
+        return;
+    }
+
+    if (tcp_conn_flight(conn) == 0) {
+        if (tcp_conn_unsent(conn) == 0) return;
+        if (conn->snd_wnd != 0) {
+            tcp_output(conn);
+            return;
+        }
+        conn->snd_nxt++;
+        if (tcp_send_data(conn, conn->snd_nxt - 1u, 1, TCP_FLAG_ACK) != NET_OK) {
+            conn->snd_nxt--;
+        }
+        tcp_conn_note_sent(conn);
+    } else {
+        conn->ssthresh = tcp_half_flight(conn);
+        conn->cwnd = conn->mss;
+        conn->in_recovery = 0;
+        conn->dup_acks = 0;
+        conn->rtt_active = 0;
+        conn->snd_nxt = conn->snd_una;
+        tcp_output(conn);
+        if (tcp_conn_flight(conn) == 0) tcp_retransmit_head(conn);
+    }
+
+    conn->rto_ms *= 2u;
+    if (conn->rto_ms > NET_TCP_RTO_MAX_MS) conn->rto_ms = NET_TCP_RTO_MAX_MS;
+    tcp_arm_rto(conn);
+}
+
+static void tcp_run_timers(void) {
+    uint64_t now = timer_get_uptime_ms();
+
+    /* Every live connection is hashed; a timeout may recycle conn */
+    for (int b = 0; b < NET_TCP_HASH_BUCKETS; b++) {
+        struct net_tcp_conn *next;
+        for (struct net_tcp_conn *conn = g_net.tcp_hash[b]; conn; conn = next) {
+            next = conn->hash_next;
+            if (!conn->used || !conn->rto_deadline_ms) continue;
+            if (conn->state == NET_TCP_SYN_SENT || conn->state == NET_TCP_RESET) continue;
+            if (now >= conn->rto_deadline_ms) tcp_conn_timeout(conn);
+        }
+    }
+}
+
 static int net_send_icmp_echo_reply(const uint8_t dst_ip[NET_IPV4_ADDR_LEN],
                                     const uint8_t *request,
                                     size_t request_len) {
@@ -1117,32 +2782,29 @@ static void e1000_read_mac(uint8_t mac[NET_MAC_ADDR_LEN]) {
 }
 
 static int e1000_alloc_dma(void) {
-    g_net.rx_descs = (struct e1000_rx_desc *)vmm_alloc_pages(1,
-                    PAGE_PRESENT | PAGE_WRITABLE);
-    g_net.tx_descs = (struct e1000_tx_desc *)vmm_alloc_pages(1,
-                    PAGE_PRESENT | PAGE_WRITABLE);
-    if (!g_net.rx_descs || !g_net.tx_descs) return NET_ERR_GENERIC;
-
-    memset(g_net.rx_descs, 0, PAGE_SIZE);
-    memset(g_net.tx_descs, 0, PAGE_SIZE);
-    g_net.rx_descs_phys = paging_get_physical_address((uint64_t)(uintptr_t)g_net.rx_descs);
-    g_net.tx_descs_phys = paging_get_physical_address((uint64_t)(uintptr_t)g_net.tx_descs);
-
-    for (int i = 0; i < NET_RX_DESC_COUNT; i++) {
-        g_net.rx_buffers[i] = vmm_alloc_pages(1, PAGE_PRESENT | PAGE_WRITABLE);
-        if (!g_net.rx_buffers[i]) return NET_ERR_GENERIC;
-        g_net.rx_buffers_phys[i] =
-            paging_get_physical_address((uint64_t)(uintptr_t)g_net.rx_buffers[i]);
-        g_net.rx_descs[i].addr = g_net.rx_buffers_phys[i];
+    g_net.rx_count = NET_E1000_RX_DESC_COUNT;
+    g_net.tx_count = NET_E1000_TX_DESC_COUNT;
+    g_net.tx_stride = NET_PACKET_BUFFER_SIZE;
+
+    g_net.rx_descs = (struct e1000_rx_desc *)net_dma_alloc(
+        g_net.rx_count * sizeof(struct e1000_rx_desc), &g_net.rx_descs_phys);
+    g_net.tx_descs = (struct e1000_tx_desc *)net_dma_alloc(
+        g_net.tx_count * sizeof(struct e1000_tx_desc), &g_net.tx_descs_phys);
+    g_net.rx_block = (uint8_t *)net_dma_alloc(
+        (size_t)g_net.rx_count * NET_PACKET_BUFFER_SIZE, &g_net.rx_block_phys);
+    g_net.tx_block = (uint8_t *)net_dma_alloc(
+        (size_t)g_net.tx_count * NET_PACKET_BUFFER_SIZE, &g_net.tx_block_phys);
+    if (!g_net.rx_descs || !g_net.tx_descs || !g_net.rx_block || !g_net.tx_block) {
+        return NET_ERR_GENERIC;
+    }
+
+    for (uint32_t i = 0; i < g_net.rx_count; i++) {
+        g_net.rx_descs[i].addr = g_net.rx_block_phys + (uint64_t)i * NET_PACKET_BUFFER_SIZE;
         g_net.rx_descs[i].status = 0;
     }
 
-    for (int i = 0; i < NET_TX_DESC_COUNT; i++) {
-        g_net.tx_buffers[i] = vmm_alloc_pages(1, PAGE_PRESENT | PAGE_WRITABLE);
-        if (!g_net.tx_buffers[i]) return NET_ERR_GENERIC;
-        g_net.tx_buffers_phys[i] =
-            paging_get_physical_address((uint64_t)(uintptr_t)g_net.tx_buffers[i]);
-        g_net.tx_descs[i].addr = g_net.tx_buffers_phys[i];
+    for (uint32_t i = 0; i < g_net.tx_count; i++) {
+        g_net.tx_descs[i].addr = g_net.tx_block_phys + (uint64_t)i * NET_PACKET_BUFFER_SIZE;
         g_net.tx_descs[i].status = E1000_TX_STATUS_DD;
     }
 
@@ -1157,13 +2819,13 @@ static int e1000_init_rings(void) {
 
     e1000_write32(E1000_REG_RDBAL, (uint32_t)(g_net.rx_descs_phys & 0xFFFFFFFFu));
     e1000_write32(E1000_REG_RDBAH, (uint32_t)(g_net.rx_descs_phys >> 32));
-    e1000_write32(E1000_REG_RDLEN, NET_RX_DESC_COUNT * sizeof(struct e1000_rx_desc));
+    e1000_write32(E1000_REG_RDLEN, g_net.rx_count * sizeof(struct e1000_rx_desc));
     e1000_write32(E1000_REG_RDH, 0);
-    e1000_write32(E1000_REG_RDT, NET_RX_DESC_COUNT - 1);
+    e1000_write32(E1000_REG_RDT, g_net.rx_count - 1);
 
     e1000_write32(E1000_REG_TDBAL, (uint32_t)(g_net.tx_descs_phys & 0xFFFFFFFFu));
     e1000_write32(E1000_REG_TDBAH, (uint32_t)(g_net.tx_descs_phys >> 32));
-    e1000_write32(E1000_REG_TDLEN, NET_TX_DESC_COUNT * sizeof(struct e1000_tx_desc));
+    e1000_write32(E1000_REG_TDLEN, g_net.tx_count * sizeof(struct e1000_tx_desc));
     e1000_write32(E1000_REG_TDH, 0);
     e1000_write32(E1000_REG_TDT, 0);
 
@@ -1181,6 +2843,7 @@ static int e1000_init_rings(void) {
         e1000_write32(E1000_REG_MTA + i * 4, 0);
     }
 
+    e1000_write32(E1000_REG_RXCSUM, E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL);
     e1000_write32(E1000_REG_TIPG, 0x0060200Au);
     e1000_write32(E1000_REG_TCTL,
                   E1000_TCTL_EN |
@@ -1194,6 +2857,7 @@ static int e1000_init_rings(void) {
 
     g_net.rx_index = 0;
     g_net.tx_index = 0;
+    g_net.tx_clean = 0;
     return NET_OK;
 }
 
@@ -1222,6 +2886,7 @@ static int e1000_probe_device(void) {
         uint16_t pci_cmd = pci_config_read16(dev->pci_bus, dev->pci_slot,
                                              dev->pci_func, PCI_COMMAND_OFFSET);
         pci_cmd |= (PCI_COMMAND_MEMORY | PCI_COMMAND_BUSMASTER);
+        pci_cmd &= (uint16_t)~PCI_COMMAND_INTX_DISABLE;
         pci_config_write16(dev->pci_bus, dev->pci_slot,
                            dev->pci_func, PCI_COMMAND_OFFSET, pci_cmd);
 
@@ -1235,9 +2900,12 @@ static int e1000_probe_device(void) {
         e1000_read_mac(g_net.mac);
 
         if (e1000_init_rings() != NET_OK) return NET_ERR_GENERIC;
+        g_net.tx_csum_offload = 1;
+        g_net.tx_ip_csum_offload = 1;
 
         g_net.link_up = (e1000_read32(E1000_REG_STATUS) & E1000_STATUS_LU) ? 1u : 0u;
         g_net.ready = 1;
+        net_setup_irq(dev->pci_irq);
         return NET_OK;
     }
 
@@ -1270,22 +2938,25 @@ static int pcnet_alloc_dma(void) {
     if (!net_phys32(g_net.pcnet_rx_ring_phys, &phys32)) return NET_ERR_GENERIC;
     if (!net_phys32(g_net.pcnet_tx_ring_phys, &phys32)) return NET_ERR_GENERIC;
 
-    for (int i = 0; i < NET_RX_DESC_COUNT; i++) {
-        g_net.rx_buffers[i] = vmm_alloc_pages(1, PAGE_PRESENT | PAGE_WRITABLE);
-        if (!g_net.rx_buffers[i]) return NET_ERR_GENERIC;
-        g_net.rx_buffers_phys[i] =
-            paging_get_physical_address((uint64_t)(uintptr_t)g_net.rx_buffers[i]);
-        if (!net_phys32(g_net.rx_buffers_phys[i], &phys32)) return NET_ERR_GENERIC;
-        pcnet_init_desc(g_net.pcnet_rx_ring, (uint32_t)i, phys32, 1);
+    g_net.rx_count = 1u << NET_PCNET_RX_LOG2;
+    g_net.tx_count = 1u << NET_PCNET_TX_LOG2;
+    g_net.tx_stride = NET_PACKET_BUFFER_SIZE;
+    g_net.rx_block = (uint8_t *)net_dma_alloc(
+        (size_t)g_net.rx_count * NET_PACKET_BUFFER_SIZE, &g_net.rx_block_phys);
+    g_net.tx_block = (uint8_t *)net_dma_alloc(
+        (size_t)g_net.tx_count * NET_PACKET_BUFFER_SIZE, &g_net.tx_block_phys);
+    if (!g_net.rx_block || !g_net.tx_block) return NET_ERR_GENERIC;
+    if (!net_phys32(g_net.rx_block_phys, &phys32)) return NET_ERR_GENERIC;
+    if (!net_phys32(g_net.tx_block_phys, &phys32)) return NET_ERR_GENERIC;
+
+    for (uint32_t i = 0; i < g_net.rx_count; i++) {
+        phys32 = (uint32_t)g_net.rx_block_phys + i * NET_PACKET_BUFFER_SIZE;
+        pcnet_init_desc(g_net.pcnet_rx_ring, i, phys32, 1);
     }
 
-    for (int i = 0; i < NET_TX_DESC_COUNT; i++) {
-        g_net.tx_buffers[i] = vmm_alloc_pages(1, PAGE_PRESENT | PAGE_WRITABLE);
-        if (!g_net.tx_buffers[i]) return NET_ERR_GENERIC;
-        g_net.tx_buffers_phys[i] =
-            paging_get_physical_address((uint64_t)(uintptr_t)g_net.tx_buffers[i]);
-        if (!net_phys32(g_net.tx_buffers_phys[i], &phys32)) return NET_ERR_GENERIC;
-        pcnet_init_desc(g_net.pcnet_tx_ring, (uint32_t)i, phys32, 0);
+    for (uint32_t i = 0; i < g_net.tx_count; i++) {
+        phys32 = (uint32_t)g_net.tx_block_phys + i * NET_PACKET_BUFFER_SIZE;
+        pcnet_init_desc(g_net.pcnet_tx_ring, i, phys32, 0);
     }
 
     return NET_OK;
@@ -1305,8 +2976,8 @@ static int pcnet_init_rings(void) {
 
     memset(g_net.pcnet_init, 0, sizeof(*g_net.pcnet_init));
     g_net.pcnet_init->mode = 0;
-    g_net.pcnet_init->rlen = 5u << 4;
-    g_net.pcnet_init->tlen = 3u << 4;
+    g_net.pcnet_init->rlen = NET_PCNET_RX_LOG2 << 4;
+    g_net.pcnet_init->tlen = NET_PCNET_TX_LOG2 << 4;
     memcpy(g_net.pcnet_init->phys_addr, g_net.mac, NET_MAC_ADDR_LEN);
     g_net.pcnet_init->rx_ring = rx_ring_phys32;
     g_net.pcnet_init->tx_ring = tx_ring_phys32;
@@ -1317,7 +2988,7 @@ static int pcnet_init_rings(void) {
 
     csr4 = pcnet_read_csr(4);
     pcnet_write_csr(4, (uint16_t)(csr4 | PCNET_CSR4_AUTO_PAD_TX));
-    pcnet_write_csr(3, PCNET_CSR3_DEFAULT);
+    pcnet_write_csr(3, PCNET_CSR3_DEFAULT | PCNET_CSR3_IDONM | PCNET_CSR3_TINTM);
     pcnet_write_csr(1, (uint16_t)(init_phys32 & 0xFFFFu));
     pcnet_write_csr(2, (uint16_t)((init_phys32 >> 16) & 0xFFFFu));
     pcnet_write_csr(0, PCNET_CSR0_INIT);
@@ -1328,7 +2999,7 @@ static int pcnet_init_rings(void) {
             uint16_t csr0 = pcnet_read_csr(0);
             if (csr0 & PCNET_CSR0_IDON) {
                 pcnet_write_csr(0, PCNET_CSR0_IDON);
-                pcnet_write_csr(0, PCNET_CSR0_STRT);
+                pcnet_write_csr(0, (uint16_t)(PCNET_CSR0_STRT | pcnet_csr0_ien()));
                 g_net.rx_index = 0;
                 g_net.tx_index = 0;
                 g_net.link_up = 1;
@@ -1367,6 +3038,7 @@ static int pcnet_probe_device(void) {
         pci_cmd = pci_config_read16(dev->pci_bus, dev->pci_slot,
                                     dev->pci_func, PCI_COMMAND_OFFSET);
         pci_cmd |= (PCI_COMMAND_IO | PCI_COMMAND_BUSMASTER);
+        pci_cmd &= (uint16_t)~PCI_COMMAND_INTX_DISABLE;
         pci_config_write16(dev->pci_bus, dev->pci_slot,
                            dev->pci_func, PCI_COMMAND_OFFSET, pci_cmd);
 
@@ -1375,6 +3047,190 @@ static int pcnet_probe_device(void) {
         if (pcnet_init_rings() != NET_OK) return NET_ERR_GENERIC;
 
         g_net.ready = 1;
+        net_setup_irq(dev->pci_irq);
+        return NET_OK;
+    }
+
+    return NET_ERR_UNAVAILABLE;
+}
+
+static int virtio_fail(void) {
+    outb(g_net.io_base + VIRTIO_IO_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+    return NET_ERR_GENERIC;
+}
+
+static int virtio_alloc_dma(void) {
+    struct net_virtio_state *v = &g_net.virtio;
+
+    g_net.rx_count = NET_VIRTIO_RX_BUFFERS;
+    g_net.tx_count = NET_VIRTIO_TX_SLOTS;
+    for (uint32_t p = 0; p < v->pairs; p++) {
+        if (v->rx[p].size < g_net.rx_count) g_net.rx_count = v->rx[p].size;
+        if (v->tx[p].size < g_net.tx_count) g_net.tx_count = v->tx[p].size;
+    }
+
+    /* TSO frames carry up to a whole send buffer behind their headers */
+    g_net.tx_stride = g_net.tso_max ? NET_VIRTIO_TSO_MAX + NET_PACKET_BUFFER_SIZE
+                                    : NET_PACKET_BUFFER_SIZE;
+    g_net.tx_frame_offset = v->hdr_len;
+
+    g_net.rx_block = (uint8_t *)net_dma_alloc(
+        (size_t)v->pairs * g_net.rx_count * NET_PACKET_BUFFER_SIZE, &g_net.rx_block_phys);
+    g_net.tx_block = (uint8_t *)net_dma_alloc(
+        (size_t)g_net.tx_count * g_net.tx_stride, &g_net.tx_block_phys);
+    if (!g_net.rx_block || !g_net.tx_block) return NET_ERR_GENERIC;
+    if (v->features & VIRTIO_NET_F_CTRL_VQ) {
+        v->ctrl_buf = (uint8_t *)net_dma_alloc(PAGE_SIZE, &v->ctrl_buf_phys);
+        if (!v->ctrl_buf) return NET_ERR_GENERIC;
+    }
+
+    for (uint32_t p = 0; p < v->pairs; p++) {
+        v->tx[p].avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;   /* Reclaimed lazily */
+        for (uint32_t i = 0; i < g_net.rx_count; i++) virtio_rx_post(p, (uint16_t)i);
+    }
+    return NET_OK;
+}
+
+/*
+ * virtio_ctrl_command - run one control-queue command and spin for the
+ * device's answer.  The command is laid out as header, data and a
+ * device-written ack byte in three descriptors.
+ */
+static int virtio_ctrl_command(uint8_t cls, uint8_t cmd, const void *data, uint16_t len) {
+    struct net_virtq *q = &g_net.virtio.ctrl;
+    volatile uint8_t *ack = g_net.virtio.ctrl_buf + 64;
+    uint64_t phys = g_net.virtio.ctrl_buf_phys;
+    uint64_t deadline = timer_get_uptime_ms() + 200;
+    uint32_t id, used_len;
+
+    g_net.virtio.ctrl_buf[0] = cls;
+    g_net.virtio.ctrl_buf[1] = cmd;
+    memcpy(g_net.virtio.ctrl_buf + 2, data, len);
+    *ack = 0xFF;
+
+    q->desc[0].addr = phys;
+    q->desc[0].len = 2;
+    q->desc[0].flags = VIRTQ_DESC_F_NEXT;
+    q->desc[0].next = 1;
+    q->desc[1].addr = phys + 2;
+    q->desc[1].len = len;
+    q->desc[1].flags = VIRTQ_DESC_F_NEXT;
+    q->desc[1].next = 2;
+    q->desc[2].addr = phys + 64;
+    q->desc[2].len = 1;
+    q->desc[2].flags = VIRTQ_DESC_F_WRITE;
+    q->desc[2].next = 0;
+    virtq_push(q, 0);
+    virtq_kick(q);
+
+    while (!virtq_pop(q, &id, &used_len)) {
+        if (timer_get_uptime_ms() >= deadline) return NET_ERR_TIMEOUT;
+    }
+    return (*ack == VIRTIO_NET_CTRL_OK) ? NET_OK : NET_ERR_GENERIC;
+}
+
+/*
+ * virtio_probe_device - bring up a transitional virtio-net function
+ * through its legacy I/O interface.  Mergeable RX buffers, checksum
+ * offload, TSO and multiqueue are used whenever the device offers them.
+ * Devices without ANY_LAYOUT would need the header in its own
+ * descriptor and are left to the other drivers.
+ */
+static int virtio_probe_device(void) {
+    struct device_entry *devices[DEVICE_MAX_ENTRIES];
+    int count = device_get_by_type(DEVICE_TYPE_NETWORK, devices, DEVICE_MAX_ENTRIES);
+    const uint32_t wanted = VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC |
+                            VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_MRG_RXBUF |
+                            VIRTIO_NET_F_STATUS | VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ |
+                            VIRTIO_F_ANY_LAYOUT;
+
+    for (int i = 0; i < count; i++) {
+        struct device_entry *dev = devices[i];
+        struct net_virtio_state *v = &g_net.virtio;
+        uint16_t pci_cmd;
+        uint16_t max_pairs = 1;
+        uint32_t offered;
+
+        if (!dev || dev->bus != DEVICE_BUS_PCI) continue;
+        if (dev->vendor_id != VIRTIO_VENDOR_ID) continue;
+        if (dev->device_id != VIRTIO_DEVICE_ID_NET) continue;
+
+        memset(&g_net, 0, sizeof(g_net));
+        g_net.backend = NET_BACKEND_VIRTIO;
+        g_net.present = 1;
+        g_net.pci_bus = dev->pci_bus;
+        g_net.pci_slot = dev->pci_slot;
+        g_net.pci_func = dev->pci_func;
+        g_net.io_base = (uint16_t)(dev->pci_bar[0] & ~0x3u);
+        copy_name(g_net.interface_name, dev->name, sizeof(g_net.interface_name));
+        copy_name(g_net.driver, "virtio-net", sizeof(g_net.driver));
+
+        if (!(dev->pci_bar[0] & 0x1u) || !g_net.io_base) return NET_ERR_GENERIC;
+
+        pci_cmd = pci_config_read16(dev->pci_bus, dev->pci_slot,
+                                    dev->pci_func, PCI_COMMAND_OFFSET);
+        pci_cmd |= (PCI_COMMAND_IO | PCI_COMMAND_BUSMASTER);
+        pci_cmd &= (uint16_t)~PCI_COMMAND_INTX_DISABLE;
+        pci_config_write16(dev->pci_bus, dev->pci_slot,
+                           dev->pci_func, PCI_COMMAND_OFFSET, pci_cmd);
+
+        outb(g_net.io_base + VIRTIO_IO_DEVICE_STATUS, 0);   /* Reset */
+        outb(g_net.io_base + VIRTIO_IO_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+        outb(g_net.io_base + VIRTIO_IO_DEVICE_STATUS,
+             VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+        offered = inl(g_net.io_base + VIRTIO_IO_DEVICE_FEATURES);
+        if (!(offered & VIRTIO_F_ANY_LAYOUT) || !(offered & VIRTIO_NET_F_MAC)) {
+            return virtio_fail();
+        }
+        v->features = offered & wanted;
+        if (!(v->features & VIRTIO_NET_F_CSUM)) v->features &= ~VIRTIO_NET_F_HOST_TSO4;
+        if (!(v->features & VIRTIO_NET_F_CTRL_VQ)) v->features &= ~VIRTIO_NET_F_MQ;
+        outl(g_net.io_base + VIRTIO_IO_GUEST_FEATURES, v->features);
+
+        for (uint32_t b = 0; b < NET_MAC_ADDR_LEN; b++) {
+            g_net.mac[b] = inb((uint16_t)(g_net.io_base + VIRTIO_IO_NET_MAC + b));
+        }
+        v->hdr_len = (v->features & VIRTIO_NET_F_MRG_RXBUF)
+                         ? sizeof(struct virtio_net_hdr)
+                         : sizeof(struct virtio_net_hdr) - sizeof(uint16_t);
+        if (v->features & VIRTIO_NET_F_MQ) {
+            max_pairs = inw(g_net.io_base + VIRTIO_IO_NET_MAX_PAIRS);
+            if (max_pairs == 0) max_pairs = 1;
+        }
+        v->pairs = (max_pairs < NET_VIRTIO_MAX_PAIRS) ? max_pairs : NET_VIRTIO_MAX_PAIRS;
+        g_net.tx_csum_offload = (v->features & VIRTIO_NET_F_CSUM) ? 1u : 0u;
+        g_net.tso_max = (v->features & VIRTIO_NET_F_HOST_TSO4) ? NET_VIRTIO_TSO_MAX : 0;
+
+        /* Pair n is RX queue 2n and TX queue 2n+1; control follows the last pair */
+        for (uint16_t p = 0; p < v->pairs; p++) {
+            if (virtq_setup(&v->rx[p], (uint16_t)(2u * p)) != NET_OK ||
+                virtq_setup(&v->tx[p], (uint16_t)(2u * p + 1u)) != NET_OK) {
+                return virtio_fail();
+            }
+        }
+        if ((v->features & VIRTIO_NET_F_CTRL_VQ) &&
+            virtq_setup(&v->ctrl, (uint16_t)(2u * max_pairs)) != NET_OK) {
+            return virtio_fail();
+        }
+        if (virtio_alloc_dma() != NET_OK) return virtio_fail();
+
+        outb(g_net.io_base + VIRTIO_IO_DEVICE_STATUS,
+             VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+        /* The device starts with one pair until told otherwise */
+        if (v->pairs > 1 &&
+            virtio_ctrl_command(VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                &v->pairs, sizeof(v->pairs)) != NET_OK) {
+            v->pairs = 1;
+        }
+        virtio_rx_kick();
+
+        g_net.rx_index = 0;
+        g_net.tx_index = 0;
+        virtio_update_link();
+        g_net.ready = 1;
+        net_setup_irq(dev->pci_irq);
         return NET_OK;
     }
 
@@ -1441,6 +3297,9 @@ static void dhcp_configure_from_state(void) {
     memcpy(g_net.gateway, g_net.dhcp.router, NET_IPV4_ADDR_LEN);
     memcpy(g_net.dhcp_server, g_net.dhcp.server_id, NET_IPV4_ADDR_LEN);
     g_net.dhcp_configured = 1;
+
+    /* Gratuitous ARP: announce the address so stale caches update */
+    (void)net_send_arp(ARP_OP_REQUEST, NULL, g_net.ipv4);
 }
 
 static void dhcp_parse_options(const uint8_t *opts, size_t len) {
@@ -1537,35 +3396,216 @@ static void net_handle_icmp(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
     }
 }
 
-static void net_handle_udp(const uint8_t *payload, size_t payload_len) {
+static struct net_udp_socket *udp_socket_find(uint16_t port) {
+    struct net_udp_socket *s = g_net.udp_hash[port & (NET_UDP_HASH_BUCKETS - 1u)];
+
+    while (s && s->port != port) s = s->hash_next;
+    return s;
+}
+
+static struct net_udp_socket *udp_socket_from_handle(int handle) {
+    if (handle <= 0 || handle > NET_UDP_MAX_SOCKETS) return NULL;
+    return g_net.udp[handle - 1];
+}
+
+static void udp_ring_write(struct net_udp_socket *s, const void *data, uint32_t len) {
+    uint32_t pos = (s->queue_head + s->queue_len) % NET_UDP_QUEUE_SIZE;
+    uint32_t first = NET_UDP_QUEUE_SIZE - pos;
+
+    if (first > len) first = len;
+    memcpy(s->queue + pos, data, first);
+    memcpy(s->queue, (const uint8_t *)data + first, len - first);
+    s->queue_len += len;
+}
+
+/* Copy len bytes from the front of the ring and drop skip bytes in total */
+static void udp_ring_read(struct net_udp_socket *s, void *out, uint32_t len, uint32_t skip) {
+    uint32_t first = NET_UDP_QUEUE_SIZE - s->queue_head;
+
+    if (first > len) first = len;
+    memcpy(out, s->queue + s->queue_head, first);
+    memcpy((uint8_t *)out + first, s->queue, len - first);
+    s->queue_head = (s->queue_head + skip) % NET_UDP_QUEUE_SIZE;
+    s->queue_len -= skip;
+}
+
+/* Queue a datagram for recvfrom(), dropping it if the ring is full */
+static void udp_socket_deliver(struct net_udp_socket *s,
+                               const uint8_t src_ip[NET_IPV4_ADDR_LEN],
+                               uint16_t src_port,
+                               const uint8_t *data,
+                               uint32_t len) {
+    struct net_udp_record rec;
+
+    if (sizeof(rec) + len > NET_UDP_QUEUE_SIZE - s->queue_len) {
+        s->dropped++;
+        return;
+    }
+    rec.len = (uint16_t)len;
+    rec.src_port = src_port;
+    memcpy(rec.src_ip, src_ip, NET_IPV4_ADDR_LEN);
+    udp_ring_write(s, &rec, sizeof(rec));
+    udp_ring_write(s, data, len);
+    wait_queue_wake_all(&s->waiters);
+    epoll_source_notify(&s->poll);
+}
+
+static void net_handle_udp(const struct net_ipv4_header *ip,
+                           const uint8_t *payload,
+                           size_t payload_len) {
     const struct net_udp_header *udp = (const struct net_udp_header *)payload;
+    struct net_udp_socket *s;
     size_t udp_len;
+    uint16_t dst_port;
 
     if (payload_len < sizeof(*udp)) return;
     udp_len = read_be16(&udp->length);
     if (udp_len < sizeof(*udp) || udp_len > payload_len) return;
+    if (read_be16(&udp->checksum) != 0 && !(g_net.rx_csum_valid & NET_RX_CSUM_L4) &&
+        net_l4_checksum(ip->src, ip->dst, IPV4_PROTO_UDP, payload, udp_len) != 0) {
+        g_net.rx_csum_errors++;
+        return;
+    }
 
-    if (read_be16(&udp->dst_port) == DHCP_CLIENT_PORT &&
+    dst_port = read_be16(&udp->dst_port);
+    if (dst_port == DHCP_CLIENT_PORT &&
         read_be16(&udp->src_port) == DHCP_SERVER_PORT) {
         net_handle_dhcp(payload + sizeof(*udp), udp_len - sizeof(*udp));
+        return;
+    }
+
+    s = udp_socket_find(dst_port);
+    if (s) {
+        udp_socket_deliver(s, ip->src, read_be16(&udp->src_port),
+                           payload + sizeof(*udp), (uint32_t)(udp_len - sizeof(*udp)));
     }
 }
 
-static void tcp_conn_update_ack(struct net_tcp_conn *conn, uint32_t ack_num) {
-    if (!conn || !tcp_conn_ack_valid(conn, ack_num)) return;
-    if (tcp_seq_after(ack_num, conn->snd_una)) {
-        conn->snd_una = ack_num;
+/*
+ * tcp_parse_syn_options - take MSS, window scale and SACK-permitted from
+ * the peer's SYN.  Scaling is used only if both sides offered it.
+ */
+static void tcp_parse_syn_options(struct net_tcp_conn *conn, const uint8_t *segment,
+                                  size_t header_len) {
+    size_t off = sizeof(struct net_tcp_header);
+
+    conn->mss = NET_TCP_DEFAULT_MSS;
+    conn->snd_wscale = 0;
+    conn->rcv_wscale = 0;
+    conn->sack_ok = 0;
+
+    while (off < header_len) {
+        uint8_t kind = segment[off];
+        uint8_t len;
+
+        if (kind == 0) break;
+        if (kind == NET_TCP_OPT_NOP) {
+            off++;
+            continue;
+        }
+        if (off + 1 >= header_len) break;
+        len = segment[off + 1];
+        if (len < 2 || off + len > header_len) break;
+
+        if (kind == NET_TCP_OPT_MSS && len == NET_TCP_OPT_MSS_LEN) {
+            uint32_t mss = read_be16(segment + off + 2);
+            if (mss > NET_TCP_MAX_MSS) mss = NET_TCP_MAX_MSS;
+            if (mss != 0) conn->mss = (uint16_t)mss;
+        } else if (kind == NET_TCP_OPT_WSCALE && len == 3) {
+            conn->snd_wscale = (segment[off + 2] > 14) ? 14 : segment[off + 2];
+            conn->rcv_wscale = NET_TCP_WSCALE;
+        } else if (kind == NET_TCP_OPT_SACK_PERM && len == 2) {
+            conn->sack_ok = 1;
+        }
+        off += len;
     }
+}
 
-    if (conn->state == NET_TCP_FIN_WAIT_1 && conn->snd_una == conn->snd_nxt) {
+static void tcp_conn_fin_acked(struct net_tcp_conn *conn) {
+    conn->fin_acked = 1;
+    if (conn->state == NET_TCP_FIN_WAIT_1) {
         conn->state = conn->remote_closed ? NET_TCP_CLOSED : NET_TCP_FIN_WAIT_2;
-    } else if (conn->state == NET_TCP_CLOSING && conn->snd_una == conn->snd_nxt) {
-        conn->state = NET_TCP_CLOSED;
-    } else if (conn->state == NET_TCP_LAST_ACK && conn->snd_una == conn->snd_nxt) {
+    } else if (conn->state == NET_TCP_CLOSING || conn->state == NET_TCP_LAST_ACK) {
         conn->state = NET_TCP_CLOSED;
     }
 }
 
+/*
+ * tcp_conn_handle_ack - advance snd_una and run NewReno (RFC 6582): slow
+ * start below ssthresh, one MSS per window above it, fast retransmit on
+ * the third duplicate ACK, and partial ACKs resending the next hole
+ * without leaving recovery.
+ */
+static void tcp_conn_handle_ack(struct net_tcp_conn *conn, uint32_t ack_num,
+                                uint32_t window, size_t data_len) {
+    uint32_t acked;
+
+    if (!tcp_conn_ack_valid(conn, ack_num)) return;
+    if (tcp_seq_after(ack_num, conn->snd_nxt)) conn->snd_nxt = ack_num;
+
+    acked = ack_num - conn->snd_una;
+    if (acked == 0) {
+        if (data_len == 0 && window == conn->snd_wnd && tcp_conn_flight(conn) > 0) {
+            conn->dup_acks++;
+            if (conn->in_recovery) {
+                conn->cwnd += conn->mss;
+            } else if (conn->dup_acks == NET_TCP_DUPACK_THRESHOLD) {
+                conn->ssthresh = tcp_half_flight(conn);
+                conn->recover = conn->snd_max;
+                tcp_retransmit_head(conn);
+                conn->cwnd = conn->ssthresh + NET_TCP_DUPACK_THRESHOLD * conn->mss;
+                conn->in_recovery = 1;
+            }
+        } else {
+            conn->dup_acks = 0;
+        }
+        conn->snd_wnd = window;
+        tcp_output(conn);
+        return;
+    }
+
+    if (acked > conn->tx_len) {
+        if (conn->fin_pending) tcp_conn_fin_acked(conn);
+        tcp_conn_tx_drop(conn, conn->tx_len);
+    } else {
+        tcp_conn_tx_drop(conn, acked);
+    }
+    conn->snd_una = ack_num;
+    conn->snd_wnd = window;
+    conn->dup_acks = 0;
+
+    if (conn->rtt_active && tcp_seq_after(ack_num, conn->rtt_seq)) {
+        conn->rtt_active = 0;
+        tcp_rtt_sample(conn, (uint32_t)(timer_get_uptime_ms() - conn->rtt_start_ms));
+    }
+
+    if (conn->in_recovery) {
+        if (!tcp_seq_before(ack_num, conn->recover)) {
+            conn->in_recovery = 0;
+            conn->cwnd = conn->ssthresh;
+        } else {
+            tcp_retransmit_head(conn);
+            conn->cwnd = (conn->cwnd > acked) ? conn->cwnd - acked : 0;
+            conn->cwnd += conn->mss;
+        }
+    } else if (conn->cwnd < conn->ssthresh) {
+        conn->cwnd += (acked < conn->mss) ? acked : conn->mss;
+    } else {
+        uint32_t inc = (conn->mss * conn->mss) / (conn->cwnd ? conn->cwnd : 1u);
+        conn->cwnd += inc ? inc : 1u;
+    }
+    if (conn->cwnd > NET_TCP_SEND_BUFFER_SIZE + 4u * conn->mss) {
+        conn->cwnd = NET_TCP_SEND_BUFFER_SIZE + 4u * conn->mss;
+    }
+
+    if (conn->snd_una == conn->snd_max) {
+        conn->rto_deadline_ms = 0;
+    } else {
+        tcp_arm_rto(conn);
+    }
+    tcp_output(conn);
+}
+
 static void tcp_conn_send_ack(struct net_tcp_conn *conn) {
     if (!conn) return;
     (void)net_send_tcp_segment(conn, TCP_FLAG_ACK, NULL, 0);
@@ -1581,12 +3621,86 @@ static void tcp_conn_handle_fin(struct net_tcp_conn *conn) {
     if (conn->state == NET_TCP_ESTABLISHED) {
         conn->state = NET_TCP_CLOSE_WAIT;
     } else if (conn->state == NET_TCP_FIN_WAIT_1) {
-        conn->state = (conn->snd_una == conn->snd_nxt) ? NET_TCP_CLOSED : NET_TCP_CLOSING;
+        conn->state = conn->fin_acked ? NET_TCP_CLOSED : NET_TCP_CLOSING;
     } else if (conn->state == NET_TCP_FIN_WAIT_2) {
         conn->state = NET_TCP_CLOSED;
     }
 }
 
+/*
+ * tcp_listener_syn - a SYN reached listener l: take a parked connection,
+ * enter SYN_RCVD and answer with a SYN-ACK.  With the backlog exhausted
+ * the SYN is dropped and the peer retries.
+ */
+static void tcp_listener_syn(struct net_tcp_listener *l,
+                             const uint8_t src_ip[NET_IPV4_ADDR_LEN],
+                             uint16_t src_port,
+                             uint16_t dst_port,
+                             uint32_t seq_num,
+                             const uint8_t *segment,
+                             size_t header_len) {
+    const struct net_tcp_header *tcp = (const struct net_tcp_header *)segment;
+    struct net_tcp_conn *conn = l->free;
+    uint64_t now = timer_get_uptime_ms();
+
+    if (!conn) {
+        g_net.tcp_syn_dropped++;
+        return;
+    }
+    l->free = conn->queue_next;
+    conn->queue_next = NULL;
+
+    conn->used = 1;
+    conn->owner_pid = l->owner_pid;
+    conn->local_port = dst_port;
+    conn->remote_port = src_port;
+    memcpy(conn->remote_ip, src_ip, NET_IPV4_ADDR_LEN);
+    conn->iss = tcp_initial_seq(dst_port, src_port);
+    conn->snd_una = conn->iss;
+    conn->snd_nxt = conn->iss + 1u;
+    conn->snd_max = conn->iss + 1u;
+    conn->rcv_nxt = seq_num + 1u;
+    tcp_parse_syn_options(conn, segment, header_len);
+    conn->snd_wnd = read_be16(&tcp->window);  /* Never scaled in a SYN */
+    conn->rto_ms = NET_TCP_RTO_INITIAL_MS;
+    conn->rx_epoch_ms = now;
+    conn->last_activity_ms = now;
+    conn->state = NET_TCP_SYN_RCVD;
+    tcp_conn_hash(conn);
+
+    conn->rtt_active = 1;
+    conn->rtt_start_ms = now;
+    (void)net_send_tcp_raw(conn, conn->iss, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+    tcp_arm_rto(conn);
+}
+
+/* The handshake of a passive open completed: queue conn for accept() */
+static void tcp_listener_established(struct net_tcp_conn *conn, uint32_t ack_num,
+                                     uint16_t window) {
+    struct net_tcp_listener *l = conn->listener;
+
+    conn->snd_una = ack_num;
+    conn->snd_wnd = (uint32_t)window << conn->snd_wscale;
+    conn->cwnd = tcp_initial_cwnd(conn->mss);
+    conn->ssthresh = NET_TCP_SSTHRESH_INITIAL;
+    conn->rto_deadline_ms = 0;
+    if (conn->rtt_active) {
+        conn->rtt_active = 0;
+        tcp_rtt_sample(conn, (uint32_t)(timer_get_uptime_ms() - conn->rtt_start_ms));
+    }
+    conn->state = NET_TCP_ESTABLISHED;
+
+    if (l->accept_tail) {
+        l->accept_tail->queue_next = conn;
+    } else {
+        l->accept_head = conn;
+    }
+    l->accept_tail = conn;
+    l->accept_count++;
+    wait_queue_wake_all(&l->waiters);
+    epoll_source_notify(&l->poll);
+}
+
 static void net_handle_tcp(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
                            const uint8_t *payload,
                            size_t payload_len) {
@@ -1613,11 +3727,24 @@ static void net_handle_tcp(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
     data_len = payload_len - header_len;
 
     conn = tcp_conn_find(src_ip, src_port, dst_port);
-    if (!conn) return;
+    if (!conn) {
+        struct net_tcp_listener *l = tcp_listener_find(dst_port);
+        if (l && (flags & (TCP_FLAG_SYN | TCP_FLAG_ACK | TCP_FLAG_RST)) == TCP_FLAG_SYN) {
+            tcp_listener_syn(l, src_ip, src_port, dst_port, seq_num, payload, header_len);
+        }
+        return;
+    }
 
     conn->last_activity_ms = timer_get_uptime_ms();
+    /* The owner only runs again after this segment has been processed */
+    wait_queue_wake_all(&conn->waiters);
+    epoll_source_notify(&conn->poll);
 
     if (flags & TCP_FLAG_RST) {
+        if (conn->state == NET_TCP_SYN_RCVD) {
+            tcp_conn_recycle(conn);
+            return;
+        }
         conn->reset = 1;
         conn->state = NET_TCP_RESET;
         conn->remote_closed = 1;
@@ -1634,26 +3761,37 @@ static void net_handle_tcp(const uint8_t src_ip[NET_IPV4_ADDR_LEN],
 
         conn->snd_una = ack_num;
         conn->rcv_nxt = seq_num + 1u;
+        tcp_parse_syn_options(conn, payload, header_len);
+        conn->snd_wnd = read_be16(&tcp->window);
+        conn->cwnd = tcp_initial_cwnd(conn->mss);
+        conn->ssthresh = NET_TCP_SSTHRESH_INITIAL;
+        if (conn->rtt_active) {
+            conn->rtt_active = 0;
+            tcp_rtt_sample(conn, (uint32_t)(timer_get_uptime_ms() - conn->rtt_start_ms));
+        }
         conn->state = NET_TCP_ESTABLISHED;
         tcp_conn_send_ack(conn);
         return;
     }
 
+    if (conn->state == NET_TCP_SYN_RCVD) {
+        if (flags & TCP_FLAG_SYN) {         /* Our SYN-ACK was lost */
+            (void)net_send_tcp_raw(conn, conn->iss, TCP_FLAG_SYN | TCP_FLAG_ACK, NULL, 0);
+            return;
+        }
+        if (!(flags & TCP_FLAG_ACK) || ack_num != conn->iss + 1u) return;
+        tcp_listener_established(conn, ack_num, read_be16(&tcp->window));
+    }
+
     if (flags & TCP_FLAG_ACK) {
-        tcp_conn_update_ack(conn, ack_num);
+        tcp_conn_handle_ack(conn, ack_num,
+                            (uint32_t)read_be16(&tcp->window) << conn->snd_wscale,
+                            data_len);
     }
 
     if (data_len > 0) {
-        if (seq_num == conn->rcv_nxt) {
-            if (tcp_conn_queue(conn, payload + header_len, data_len)) {
-                conn->rcv_nxt += (uint32_t)data_len;
-                tcp_conn_send_ack(conn);
-            } else {
-                tcp_conn_send_ack(conn);
-            }
-        } else {
-            tcp_conn_send_ack(conn);
-        }
+        tcp_conn_receive(conn, seq_num, payload + header_len, (uint32_t)data_len);
+        tcp_conn_send_ack(conn);
     }
 
     if (flags & TCP_FLAG_FIN) {
@@ -1679,34 +3817,56 @@ static void net_handle_ipv4(const uint8_t src_mac[NET_MAC_ADDR_LEN],
 
     total_len = read_be16(&ip->total_length);
     if (total_len < ihl || total_len > frame_len) return;
+    if (!(g_net.rx_csum_valid & NET_RX_CSUM_IP) && net_checksum16(ip, ihl) != 0) {
+        g_net.rx_csum_errors++;
+        return;
+    }
 
     memcpy(src_ip, ip->src, NET_IPV4_ADDR_LEN);
-    arp_cache_update(src_ip, src_mac);
+    arp_confirm(src_ip, src_mac);
 
     if (ip->protocol == IPV4_PROTO_ICMP) {
         net_handle_icmp(src_ip, ip, frame + ihl, total_len - ihl);
     } else if (ip->protocol == IPV4_PROTO_TCP) {
+        if (!(g_net.rx_csum_valid & NET_RX_CSUM_L4) &&
+            net_l4_checksum(ip->src, ip->dst, IPV4_PROTO_TCP,
+                            frame + ihl, total_len - ihl) != 0) {
+            g_net.rx_csum_errors++;
+            return;
+        }
         net_handle_tcp(src_ip, frame + ihl, total_len - ihl);
     } else if (ip->protocol == IPV4_PROTO_UDP) {
-        net_handle_udp(frame + ihl, total_len - ihl);
+        net_handle_udp(ip, frame + ihl, total_len - ihl);
     }
 }
 
 static void net_handle_arp(const uint8_t *frame, size_t frame_len) {
     const struct net_arp_packet *arp = (const struct net_arp_packet *)frame;
     uint16_t opcode;
+    int for_us;
 
     if (frame_len < sizeof(*arp)) return;
     if (read_be16(&arp->htype) != 1) return;
     if (read_be16(&arp->ptype) != ETH_TYPE_IPV4) return;
     if (arp->hlen != NET_MAC_ADDR_LEN || arp->plen != NET_IPV4_ADDR_LEN) return;
 
-    arp_cache_update(arp->spa, arp->sha);
     opcode = read_be16(&arp->oper);
 
-    if (opcode == ARP_OP_REQUEST &&
-        g_net.dhcp_configured &&
-        ip_equal(arp->tpa, g_net.ipv4)) {
+    if (g_net.dhcp_configured && ip_equal(arp->spa, g_net.ipv4)) {
+        if (memcmp(arp->sha, g_net.mac, NET_MAC_ADDR_LEN) != 0) g_net.arp_conflicts++;
+        return;
+    }
+
+    /*
+     * Requests for us and replies to us create entries.  Anything else,
+     * gratuitous announcements (sender and target address equal)
+     * included, only updates a neighbour we already know.  A zero sender
+     * is a host probing for its own address and teaches nothing.
+     */
+    for_us = g_net.dhcp_configured && ip_equal(arp->tpa, g_net.ipv4);
+    if (!ip_is_zero(arp->spa)) arp_learn(arp->spa, arp->sha, for_us);
+
+    if (opcode == ARP_OP_REQUEST && for_us) {
         (void)net_send_arp(ARP_OP_REPLY, arp->sha, arp->spa);
     }
 }
@@ -1723,59 +3883,334 @@ static void net_process_frame(uint8_t *buffer, size_t len) {
     }
 }
 
-void net_poll(void) {
-    if (!g_net.ready) return;
+/* Hand one received frame (virtio header already stripped) to the stack */
+static void virtio_rx_deliver(const struct virtio_net_hdr *hdr, uint8_t *frame, uint32_t len) {
+    /* NEEDS_CSUM frames come from the host itself, unchecksummed */
+    if (hdr->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM | VIRTIO_NET_HDR_F_DATA_VALID)) {
+        g_net.rx_csum_valid = NET_RX_CSUM_L4;
+    }
+    net_process_frame(frame, len);
+    g_net.rx_csum_valid = 0;
+    g_net.rx_packets++;
+    g_net.rx_bytes += len;
+}
 
-    if (g_net.backend == NET_BACKEND_E1000) {
-        g_net.link_up = (e1000_read32(E1000_REG_STATUS) & E1000_STATUS_LU) ? 1u : 0u;
+/*
+ * Frames the device spreads over several RX buffers are gathered here.
+ * Receive-side GSO is not negotiated, so a frame never outgrows one
+ * buffer's worth; anything larger is dropped.
+ */
+static uint8_t virtio_rx_merge_buf[NET_PACKET_BUFFER_SIZE];
+
+/*
+ * virtio_rx_merge - reassemble a frame that starts in first (len bytes,
+ * header included) and continues in the next buffers - 1 used buffers of
+ * the pair's RX queue.  The device publishes all of a frame's buffers
+ * together; any not yet visible are dropped as they arrive.
+ */
+static void virtio_rx_merge(uint32_t pair, const uint8_t *first, uint32_t len,
+                            uint16_t buffers) {
+    struct net_virtio_state *v = &g_net.virtio;
+    struct net_virtq *q = &v->rx[pair];
+    struct virtio_net_hdr hdr;
+    uint32_t total = 0;
+    int fits = 1;
+
+    memcpy(&hdr, first, sizeof(hdr));
+    if (len > v->hdr_len) {
+        total = len - v->hdr_len;
+        if (total > sizeof(virtio_rx_merge_buf)) fits = 0;
+        else memcpy(virtio_rx_merge_buf, first + v->hdr_len, total);
+    }
+
+    for (uint16_t b = 1; b < buffers; b++) {
+        uint32_t id, part;
+
+        if (!virtq_pop(q, &id, &part)) {
+            q->discard = (uint16_t)(buffers - b);
+            return;
+        }
+        if (id >= g_net.rx_count) continue;
+
+        if (fits && total + part <= sizeof(virtio_rx_merge_buf)) {
+            memcpy(virtio_rx_merge_buf + total,
+                   net_rx_buffer(pair * g_net.rx_count + id), part);
+            total += part;
+        } else {
+            fits = 0;
+        }
+        virtio_rx_post(pair, (uint16_t)id);
+    }
+    if (fits && total > 0) virtio_rx_deliver(&hdr, virtio_rx_merge_buf, total);
+}
+
+/*
+ * virtio_rx_one - take one received frame off the RX queues, visiting them
+ * round-robin from rx_index, and repost its buffers.  A frame merged
+ * across several buffers is reassembled first.  Returns 0 once all queues
+ * are empty.
+ */
+static int virtio_rx_one(void) {
+    struct net_virtio_state *v = &g_net.virtio;
+
+    for (uint32_t n = 0; n < v->pairs; n++) {
+        uint32_t pair = (g_net.rx_index + n) % v->pairs;
+        struct net_virtq *q = &v->rx[pair];
+        uint32_t id, len;
+
+        if (!virtq_pop(q, &id, &len)) continue;
+        g_net.rx_index = (pair + 1u) % v->pairs;
+        if (id >= g_net.rx_count) return 1;
+
+        if (q->discard) {
+            q->discard--;
+        } else {
+            uint8_t *buffer = net_rx_buffer(pair * g_net.rx_count + id);
+            const struct virtio_net_hdr *hdr = (const struct virtio_net_hdr *)buffer;
+            uint16_t buffers = (v->features & VIRTIO_NET_F_MRG_RXBUF) ? hdr->num_buffers : 1u;
+
+            if (buffers > 1) {
+                virtio_rx_merge(pair, buffer, len, buffers);
+            } else if (len > v->hdr_len) {
+                virtio_rx_deliver(hdr, buffer + v->hdr_len, len - v->hdr_len);
+            }
+        }
+        virtio_rx_post(pair, (uint16_t)id);
+        return 1;
+    }
+    return 0;
+}
 
-        while (g_net.rx_descs[g_net.rx_index].status & E1000_RX_STATUS_DD) {
-            struct e1000_rx_desc *desc = &g_net.rx_descs[g_net.rx_index];
-            uint8_t *buffer = (uint8_t *)g_net.rx_buffers[g_net.rx_index];
-            size_t len = desc->length;
+/* NET_RX_CSUM_* the e1000 vouches for, or -1 if it found a bad checksum */
+static int e1000_rx_csum(const struct e1000_rx_desc *desc) {
+    int valid = 0;
 
+    if (desc->status & E1000_RX_STATUS_IXSM) return 0;
+    if (desc->status & E1000_RX_STATUS_IPCS) {
+        if (desc->errors & E1000_RX_ERR_IPE) return -1;
+        valid |= NET_RX_CSUM_IP;
+    }
+    if (desc->status & E1000_RX_STATUS_TCPCS) {
+        if (desc->errors & E1000_RX_ERR_TCPE) return -1;
+        valid |= NET_RX_CSUM_L4;
+    }
+    return valid;
+}
+
+/* Take the frame at rx_index off the ring; returns 0 once the ring is empty */
+static int net_rx_one(void) {
+    if (g_net.backend == NET_BACKEND_E1000) {
+        struct e1000_rx_desc *desc = &g_net.rx_descs[g_net.rx_index];
+        uint8_t *buffer = net_rx_buffer(g_net.rx_index);
+        size_t len;
+        int csum;
+
+        if (!(desc->status & E1000_RX_STATUS_DD)) return 0;
+        len = desc->length;
+        csum = e1000_rx_csum(desc);
+        if (csum < 0) {
+            g_net.rx_csum_errors++;
+        } else {
+            g_net.rx_csum_valid = (uint8_t)csum;
             net_process_frame(buffer, len);
+            g_net.rx_csum_valid = 0;
+        }
+
+        g_net.rx_packets++;
+        g_net.rx_bytes += len;
+        desc->status = 0;
+        g_net.rx_index = net_ring_next(g_net.rx_index, g_net.rx_count);
+        return 1;
+    }
 
+    if (g_net.backend == NET_BACKEND_PCNET) {
+        size_t off = pcnet_ring_offset(g_net.rx_index);
+        uint8_t status = g_net.pcnet_rx_ring[off + 7];
+        uint16_t plen = 0;
+        uint8_t *buffer = net_rx_buffer(g_net.rx_index);
+
+        if (!pcnet_driver_owns(g_net.pcnet_rx_ring, g_net.rx_index)) return 0;
+        memcpy(&plen, g_net.pcnet_rx_ring + off + 8, sizeof(plen));
+        if ((status & PCNET_DESC_ERR) == 0 &&
+            (status & (PCNET_DESC_STP | PCNET_DESC_ENP)) ==
+            (PCNET_DESC_STP | PCNET_DESC_ENP)) {
+            size_t len = plen;
+            if (len > 4) len -= 4;
+            net_process_frame(buffer, len);
             g_net.rx_packets++;
             g_net.rx_bytes += len;
-            desc->status = 0;
-            e1000_write32(E1000_REG_RDT, g_net.rx_index);
-            g_net.rx_index = (g_net.rx_index + 1u) % NET_RX_DESC_COUNT;
         }
-        return;
+
+        memset(g_net.pcnet_rx_ring + off + 8, 0, 8);
+        g_net.pcnet_rx_ring[off + 7] = PCNET_DESC_OWN;
+        g_net.rx_index = net_ring_next(g_net.rx_index, g_net.rx_count);
+        return 1;
     }
 
-    if (g_net.backend == NET_BACKEND_PCNET) {
-        uint16_t csr0 = pcnet_read_csr(0);
-        g_net.link_up = (csr0 & (PCNET_CSR0_RXON | PCNET_CSR0_TXON)) ==
-                        (PCNET_CSR0_RXON | PCNET_CSR0_TXON);
+    if (g_net.backend == NET_BACKEND_VIRTIO) return virtio_rx_one();
 
-        while (pcnet_driver_owns(g_net.pcnet_rx_ring, g_net.rx_index)) {
-            size_t off = pcnet_ring_offset(g_net.rx_index);
-            uint8_t status = g_net.pcnet_rx_ring[off + 7];
-            uint16_t plen = 0;
-            uint8_t *buffer = (uint8_t *)g_net.rx_buffers[g_net.rx_index];
-
-            memcpy(&plen, g_net.pcnet_rx_ring + off + 8, sizeof(plen));
-            if ((status & PCNET_DESC_ERR) == 0 &&
-                (status & (PCNET_DESC_STP | PCNET_DESC_ENP)) ==
-                (PCNET_DESC_STP | PCNET_DESC_ENP)) {
-                size_t len = plen;
-                if (len > 4) len -= 4;
-                net_process_frame(buffer, len);
-                g_net.rx_packets++;
-                g_net.rx_bytes += len;
-            }
+    return 0;
+}
 
-            memset(g_net.pcnet_rx_ring + off + 8, 0, 8);
-            g_net.pcnet_rx_ring[off + 7] = PCNET_DESC_OWN;
-            g_net.rx_index = (g_net.rx_index + 1u) % NET_RX_DESC_COUNT;
+/*
+ * Virtio has no latched cause to re-fire: a frame used between the last
+ * pop and unmasking raises nothing, so look once more after unmasking
+ * and leave the rings scheduled for the next poll if one slipped in.
+ */
+static void net_rx_irq_enable(void) {
+    if (g_net.backend == NET_BACKEND_E1000) {
+        e1000_write32(E1000_REG_IMS, E1000_ICR_RX_BITS | E1000_ICR_LSC);
+    } else if (g_net.backend == NET_BACKEND_PCNET) {
+        pcnet_write_csr(3, PCNET_CSR3_DEFAULT | PCNET_CSR3_IDONM | PCNET_CSR3_TINTM);
+    } else if (g_net.backend == NET_BACKEND_VIRTIO) {
+        virtio_rx_irq_mask(0);
+        virtio_mb();
+        if (virtio_rx_pending()) {
+            virtio_rx_irq_mask(VIRTQ_AVAIL_F_NO_INTERRUPT);
+            g_net.rx_scheduled = 1;
         }
+    }
+}
+
+static void net_rx_irq_disable(void) {
+    if (g_net.backend == NET_BACKEND_E1000) {
+        e1000_write32(E1000_REG_IMC, E1000_ICR_RX_BITS);
+    } else if (g_net.backend == NET_BACKEND_PCNET) {
+        pcnet_write_csr(3, PCNET_CSR3_DEFAULT | PCNET_CSR3_IDONM | PCNET_CSR3_TINTM |
+                           PCNET_CSR3_RINTM);
+    } else if (g_net.backend == NET_BACKEND_VIRTIO) {
+        virtio_rx_irq_mask(VIRTQ_AVAIL_F_NO_INTERRUPT);
+    }
+}
 
+/*
+ * net_poll_rx - process at most NET_RX_BUDGET frames.  With interrupts in
+ * use the ring is only touched after an RX interrupt scheduled it, and
+ * the interrupt is re-armed once the ring is empty; a frame that lands
+ * in between leaves its cause latched, so re-arming fires it at once.
+ * A ring that outlasts the budget stays scheduled for the next poll,
+ * which keeps a flood from pinning the CPU inside one interrupt.
+ */
+static void net_poll_rx(void) {
+    int budget = NET_RX_BUDGET;
+
+    if (g_net.irq_enabled && !g_net.rx_scheduled) return;
+
+    if (g_net.backend == NET_BACKEND_E1000) {
+        g_net.link_up = (e1000_read32(E1000_REG_STATUS) & E1000_STATUS_LU) ? 1u : 0u;
+    } else if (g_net.backend == NET_BACKEND_PCNET && !g_net.irq_enabled) {
+        uint16_t csr0 = pcnet_read_csr(0);
+        g_net.link_up = (csr0 & (PCNET_CSR0_RXON | PCNET_CSR0_TXON)) ==
+                        (PCNET_CSR0_RXON | PCNET_CSR0_TXON);
         if (csr0 & PCNET_CSR0_ACK_BITS) {
             pcnet_write_csr(0, (uint16_t)(csr0 & PCNET_CSR0_ACK_BITS));
         }
+    } else if (g_net.backend == NET_BACKEND_VIRTIO && !g_net.irq_enabled) {
+        virtio_update_link();
+    }
+
+    while (budget > 0 && net_rx_one()) budget--;
+
+    /* Return the whole batch to the e1000 with one tail write */
+    if (budget < NET_RX_BUDGET && g_net.backend == NET_BACKEND_E1000) {
+        e1000_write32(E1000_REG_RDT, (g_net.rx_index + g_net.rx_count - 1u) % g_net.rx_count);
+    } else if (budget < NET_RX_BUDGET && g_net.backend == NET_BACKEND_VIRTIO) {
+        virtio_rx_kick();
+    }
+
+    if (budget == 0) {
+        g_net.rx_budget_exhausted++;
+        return;
+    }
+    if (g_net.irq_enabled) {
+        g_net.rx_scheduled = 0;
+        net_rx_irq_enable();
+    }
+}
+
+/*
+ * net_irq_handler - top half for the NIC's interrupt line.  Acknowledges
+ * the cause, masks further RX interrupts and schedules the ring, then
+ * runs one budgeted poll on the way out of the interrupt.
+ */
+static void net_irq_handler(void) {
+    if (!g_net.ready) return;
+
+    if (g_net.backend == NET_BACKEND_E1000) {
+        uint32_t icr = e1000_read32(E1000_REG_ICR);   /* Read clears */
+        if (!icr) return;                              /* Shared line */
+        if (icr & E1000_ICR_LSC) {
+            g_net.link_up = (e1000_read32(E1000_REG_STATUS) & E1000_STATUS_LU) ? 1u : 0u;
+        }
+        if (icr & E1000_ICR_RX_BITS) {
+            net_rx_irq_disable();
+            g_net.rx_scheduled = 1;
+        }
+    } else if (g_net.backend == NET_BACKEND_PCNET) {
+        uint16_t csr0 = pcnet_read_csr(0);
+        if (!(csr0 & PCNET_CSR0_INTR)) return;
+        pcnet_write_csr(0, (uint16_t)((csr0 & PCNET_CSR0_ACK_BITS) | PCNET_CSR0_IENA));
+        g_net.link_up = (csr0 & (PCNET_CSR0_RXON | PCNET_CSR0_TXON)) ==
+                        (PCNET_CSR0_RXON | PCNET_CSR0_TXON);
+        if (csr0 & PCNET_CSR0_RINT) {
+            net_rx_irq_disable();
+            g_net.rx_scheduled = 1;
+        }
+    } else if (g_net.backend == NET_BACKEND_VIRTIO) {
+        uint8_t isr = inb(g_net.io_base + VIRTIO_IO_ISR_STATUS);   /* Read clears */
+        if (!isr) return;
+        if (isr & VIRTIO_ISR_CONFIG) virtio_update_link();
+        if (isr & VIRTIO_ISR_QUEUE) {
+            net_rx_irq_disable();
+            g_net.rx_scheduled = 1;
+        }
     }
+
+    g_net.irq_count++;
+    net_poll();
+}
+
+/*
+ * net_setup_irq - route the NIC's PCI interrupt line to net_irq_handler.
+ * Without a usable line the driver stays in polled mode.
+ */
+static void net_setup_irq(uint8_t irq) {
+    g_net.irq = irq;
+    if (irq_register_handler(irq, net_irq_handler) != 0) return;
+
+    if (g_net.backend == NET_BACKEND_E1000) {
+        e1000_write32(E1000_REG_ITR, E1000_ITR_INTERVAL);
+        e1000_write32(E1000_REG_RDTR, E1000_RDTR_DELAY);
+        e1000_write32(E1000_REG_RADV, E1000_RADV_DELAY);
+        (void)e1000_read32(E1000_REG_ICR);
+    }
+
+    g_net.irq_enabled = 1;
+    g_net.rx_scheduled = 1;             /* Drain anything already queued */
+    net_rx_irq_enable();
+    if (g_net.backend == NET_BACKEND_PCNET) {
+        pcnet_write_csr(0, PCNET_CSR0_IENA);
+    }
+    pic_unmask_irq(irq);
+}
+
+/*
+ * net_poll - drain received frames and run TCP retransmission timers.
+ * Called from the timer and NIC interrupts and from process context;
+ * whoever finds the stack claimed skips the pass.  With NIC interrupts
+ * in use an idle ring is not touched.
+ */
+void net_poll(void) {
+    if (!g_net.ready) return;
+    if (g_net.tx_reserved) return;      /* Interrupted while filling a TX buffer */
+    if (!net_stack_enter()) return;
+
+    net_tx_batch_begin();
+    net_poll_rx();
+    tcp_run_timers();
+    arp_run_timers();
+    net_tx_batch_end();
+    net_stack_leave();
 }
 
 int net_is_available(void) {
@@ -1904,11 +4339,45 @@ int net_ping_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
     return NET_OK;
 }
 
+/* Send a reset for conn if the peer may still know it, then free it */
+static void tcp_conn_abort(struct net_tcp_conn *conn) {
+    if (conn->state != NET_TCP_CLOSED && conn->state != NET_TCP_RESET) {
+        (void)net_send_tcp_raw(conn, conn->snd_nxt, TCP_FLAG_RST | TCP_FLAG_ACK, NULL, 0);
+    }
+    tcp_conn_release(conn);
+}
+
+/*
+ * tcp_reap_orphans - free released connections that have closed, and
+ * reset those that outlived NET_TCP_ORPHAN_TIMEOUT_MS.  The heap is not
+ * usable from the receive path, so process-context TCP calls do this.
+ */
+static void tcp_reap_orphans(void) {
+    struct net_tcp_conn **link = &g_net.tcp_orphans;
+    uint64_t now = timer_get_uptime_ms();
+
+    while (*link) {
+        struct net_tcp_conn *conn = *link;
+
+        if (conn->state == NET_TCP_CLOSED || conn->state == NET_TCP_RESET) {
+            *link = conn->queue_next;
+            tcp_conn_release(conn);
+        } else if (now >= conn->orphan_deadline_ms && net_stack_enter()) {
+            *link = conn->queue_next;
+            tcp_conn_abort(conn);
+            net_stack_leave();
+        } else {
+            link = &conn->queue_next;
+        }
+    }
+}
+
 int net_tcp_connect_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
                          uint16_t port,
                          uint32_t timeout_ms) {
     struct net_tcp_conn *conn;
     struct process *proc = scheduler_current();
+    uint64_t start;
     uint64_t deadline;
     uint64_t resend_at = 0;
     uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
@@ -1918,144 +4387,210 @@ int net_tcp_connect_ipv4(const uint8_t addr[NET_IPV4_ADDR_LEN],
     if (!g_net.ready) return NET_ERR_UNAVAILABLE;
     if (!g_net.dhcp_configured) return NET_ERR_NOT_CONFIGURED;
 
-    local_port = tcp_pick_local_port();
+    tcp_reap_orphans();
+    local_port = tcp_pick_local_port(addr, port);
     if (local_port == 0) return NET_ERR_GENERIC;
 
     conn = tcp_conn_alloc();
     if (!conn) return NET_ERR_GENERIC;
+    if (!tcp_conn_install(conn)) {
+        tcp_conn_release(conn);
+        return NET_ERR_GENERIC;
+    }
+    conn->rx_epoch_ms = timer_get_uptime_ms();
 
     conn->owner_pid = proc ? proc->pid : 0;
     conn->local_port = local_port;
     conn->remote_port = port;
     memcpy(conn->remote_ip, addr, NET_IPV4_ADDR_LEN);
-    conn->iss = ((uint32_t)timer_get_uptime_ms() << 12) ^
-                ((uint32_t)local_port << 4) ^
-                port ^
-                g_net.next_ip_id;
-    if (conn->iss == 0) conn->iss = 0x4E554D31u;
+    conn->iss = tcp_initial_seq(local_port, port);
     conn->snd_una = conn->iss;
     conn->snd_nxt = conn->iss;
+    conn->snd_max = conn->iss;
+    conn->mss = NET_TCP_DEFAULT_MSS;
+    conn->rto_ms = NET_TCP_RTO_INITIAL_MS;
     conn->state = NET_TCP_SYN_SENT;
     conn->last_activity_ms = timer_get_uptime_ms();
+    tcp_conn_hash(conn);
 
-    deadline = timer_get_uptime_ms() + wait_ms;
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
     while (timer_get_uptime_ms() < deadline) {
         uint64_t now = timer_get_uptime_ms();
 
         if (conn->state == NET_TCP_ESTABLISHED) {
-            return (int)(conn - g_net.tcp) + 1;
+            return conn->handle;
         }
         if (conn->state == NET_TCP_RESET) {
             tcp_conn_release(conn);
             return NET_ERR_GENERIC;
         }
 
-        if (now >= resend_at) {
-            conn->snd_nxt = conn->snd_una;
-            if (net_send_tcp_segment(conn, TCP_FLAG_SYN, NULL, 0) != NET_OK) {
-                tcp_conn_release(conn);
-                return NET_ERR_GENERIC;
+        /* A lost SYN backs off like any retransmission and is never timed */
+        if (now >= resend_at && net_stack_enter()) {
+            if (conn->state == NET_TCP_SYN_SENT) {
+                conn->rtt_active = (resend_at == 0);
+                conn->rtt_start_ms = now;
+                conn->snd_nxt = conn->snd_una;
+                (void)net_send_tcp_segment(conn, TCP_FLAG_SYN, NULL, 0);
+                if (resend_at != 0 && conn->rto_ms < NET_TCP_RTO_MAX_MS) conn->rto_ms *= 2u;
+                resend_at = now + conn->rto_ms;
             }
-            resend_at = now + 250u;
+            net_stack_leave();
         }
 
         net_poll();
-        schedule();
+        if (conn->state != NET_TCP_SYN_SENT) continue;
+        tcp_conn_wait(conn, start, deadline);
     }
 
     tcp_conn_release(conn);
     return NET_ERR_TIMEOUT;
 }
 
+/*
+ * net_tcp_send - queue len bytes on the connection's send buffer and start
+ * transmitting.  Returns once everything is buffered; delivery continues
+ * from net_poll.  Blocks while the buffer is full and gives up after
+ * timeout_ms without progress, returning what was queued so far.
+ */
 ssize_t net_tcp_send(int handle, const void *buf, size_t len, uint32_t timeout_ms) {
     struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
     const uint8_t *bytes = (const uint8_t *)buf;
     size_t total_sent = 0;
     uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
+    uint64_t start;
+    uint64_t deadline;
 
     if (!conn || !buf) return NET_ERR_INVALID;
     if (conn->state != NET_TCP_ESTABLISHED) return NET_ERR_CLOSED;
     if (conn->reset) return NET_ERR_GENERIC;
 
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
     while (total_sent < len) {
-        size_t chunk = len - total_sent;
-        uint32_t expected_ack;
-        uint64_t deadline;
-        uint64_t resend_at = 0;
-
-        if (chunk > NET_TCP_TX_MSS) chunk = NET_TCP_TX_MSS;
-        expected_ack = conn->snd_una + (uint32_t)chunk;
-        deadline = timer_get_uptime_ms() + wait_ms;
-
-        while (timer_get_uptime_ms() < deadline) {
-            uint64_t now = timer_get_uptime_ms();
+        if (conn->reset) {
+            return total_sent ? (ssize_t)total_sent : NET_ERR_GENERIC;
+        }
+        if (conn->state != NET_TCP_ESTABLISHED && conn->state != NET_TCP_CLOSE_WAIT) {
+            return total_sent ? (ssize_t)total_sent : NET_ERR_CLOSED;
+        }
+        if (conn->remote_closed) {
+            return total_sent ? (ssize_t)total_sent : NET_ERR_CLOSED;
+        }
 
-            if (conn->reset) {
-                return total_sent ? (ssize_t)total_sent : NET_ERR_GENERIC;
-            }
-            if (conn->state != NET_TCP_ESTABLISHED && conn->state != NET_TCP_CLOSE_WAIT) {
-                return total_sent ? (ssize_t)total_sent : NET_ERR_CLOSED;
-            }
-            if (conn->remote_closed) {
-                return total_sent ? (ssize_t)total_sent : NET_ERR_CLOSED;
-            }
+        if (net_stack_enter()) {
+            size_t chunk = len - total_sent;
+            uint32_t space = tcp_conn_tx_space(conn);
 
-            if (now >= resend_at) {
-                conn->snd_nxt = conn->snd_una;
-                if (net_send_tcp_segment(conn, TCP_FLAG_ACK | TCP_FLAG_PSH,
-                                         bytes + total_sent, chunk) != NET_OK) {
-                    return total_sent ? (ssize_t)total_sent : NET_ERR_GENERIC;
-                }
-                resend_at = now + 300u;
+            if (chunk > space) chunk = space;
+            if (chunk > 0) {
+                tcp_conn_tx_append(conn, bytes + total_sent, (uint32_t)chunk);
+                total_sent += chunk;
+                start = timer_get_uptime_ms();
+                deadline = start + wait_ms;
             }
-
-            if (!tcp_seq_before(conn->snd_una, expected_ack)) break;
-
-            net_poll();
-            schedule();
+            tcp_output(conn);
+            net_stack_leave();
         }
+        if (total_sent == len) break;
 
-        if (tcp_seq_before(conn->snd_una, expected_ack)) {
+        if (timer_get_uptime_ms() >= deadline) {
             return total_sent ? (ssize_t)total_sent : NET_ERR_TIMEOUT;
         }
-
-        total_sent += chunk;
+        net_poll();
+        if (tcp_conn_tx_space(conn) > 0) continue;
+        tcp_conn_wait(conn, start, deadline);
     }
 
     return (ssize_t)total_sent;
 }
 
+/*
+ * tcp_conn_read - hand buffered bytes to the reader.  If the reader took
+ * at least half the ring within one RTT the window is what limits the
+ * transfer, so the ring doubles.  An ACK goes out once the window has
+ * opened by a useful amount (RFC 1122 receiver SWS avoidance).
+ */
+static size_t tcp_conn_read(struct net_tcp_conn *conn, uint8_t *out, size_t len) {
+    uint64_t now = timer_get_uptime_ms();
+    uint32_t epoch_ms = conn->srtt8 ? (conn->srtt8 >> 3) : NET_TCP_RTO_MIN_MS;
+    uint32_t edge;
+    uint32_t threshold;
+    size_t copied;
+
+    net_stack_claim();
+
+    copied = tcp_conn_dequeue(conn, out, len);
+    conn->rx_copied += (uint32_t)copied;
+    if (epoch_ms < NET_TCP_CLOCK_GRANULARITY_MS) epoch_ms = NET_TCP_CLOCK_GRANULARITY_MS;
+    if (now - conn->rx_epoch_ms >= epoch_ms) {
+        if (conn->rx_copied * 2u >= conn->rx_size) tcp_conn_rx_grow(conn);
+        conn->rx_copied = 0;
+        conn->rx_epoch_ms = now;
+    }
+
+    edge = conn->rcv_nxt + ((uint32_t)tcp_conn_rx_window(conn, 0) << conn->rcv_wscale);
+    threshold = conn->rx_size / 2u;
+    if (threshold > 2u * conn->mss) threshold = 2u * conn->mss;
+    if (!conn->remote_closed && tcp_seq_after(edge, conn->rcv_adv) &&
+        edge - conn->rcv_adv >= threshold) {
+        tcp_conn_send_ack(conn);
+    }
+
+    net_stack_leave();
+    return copied;
+}
+
 ssize_t net_tcp_recv(int handle, void *buf, size_t len, uint32_t timeout_ms) {
     struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
     uint8_t *out = (uint8_t *)buf;
     uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
+    uint64_t start;
     uint64_t deadline;
 
     if (!conn || !buf) return NET_ERR_INVALID;
 
-    if (tcp_conn_rx_len(conn) > 0) {
-        return (ssize_t)tcp_conn_dequeue(conn, out, len);
+    if (tcp_conn_rx_len(conn) > 0 || len == 0) {
+        return (ssize_t)tcp_conn_read(conn, out, len);
     }
     if (conn->reset) return NET_ERR_GENERIC;
     if (conn->remote_closed || conn->state == NET_TCP_CLOSED) return 0;
 
-    deadline = timer_get_uptime_ms() + wait_ms;
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
     while (timer_get_uptime_ms() < deadline) {
         net_poll();
         if (tcp_conn_rx_len(conn) > 0) {
-            return (ssize_t)tcp_conn_dequeue(conn, out, len);
+            return (ssize_t)tcp_conn_read(conn, out, len);
         }
         if (conn->reset) return NET_ERR_GENERIC;
         if (conn->remote_closed || conn->state == NET_TCP_CLOSED) return 0;
-        schedule();
+        tcp_conn_wait(conn, start, deadline);
     }
 
     return NET_ERR_TIMEOUT;
 }
 
+/* Queue our FIN; it follows whatever is still buffered and is retransmitted like data */
+static void tcp_conn_shutdown(struct net_tcp_conn *conn) {
+    net_stack_claim();
+
+    if (conn->state == NET_TCP_ESTABLISHED) {
+        conn->fin_pending = 1;
+        conn->state = NET_TCP_FIN_WAIT_1;
+    } else if (conn->state == NET_TCP_CLOSE_WAIT) {
+        conn->fin_pending = 1;
+        conn->state = NET_TCP_LAST_ACK;
+    }
+    tcp_output(conn);
+    net_stack_leave();
+}
+
 int net_tcp_close(int handle, uint32_t timeout_ms) {
     struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
     uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
+    uint64_t start;
     uint64_t deadline;
 
     if (!conn) return NET_ERR_INVALID;
@@ -2064,32 +4599,52 @@ int net_tcp_close(int handle, uint32_t timeout_ms) {
         tcp_conn_release(conn);
         return NET_OK;
     }
+    tcp_conn_shutdown(conn);
 
-    if (conn->state == NET_TCP_ESTABLISHED) {
-        if (net_send_tcp_segment(conn, TCP_FLAG_ACK | TCP_FLAG_FIN, NULL, 0) != NET_OK) {
-            return NET_ERR_GENERIC;
-        }
-        conn->state = NET_TCP_FIN_WAIT_1;
-    } else if (conn->state == NET_TCP_CLOSE_WAIT) {
-        if (net_send_tcp_segment(conn, TCP_FLAG_ACK | TCP_FLAG_FIN, NULL, 0) != NET_OK) {
-            return NET_ERR_GENERIC;
-        }
-        conn->state = NET_TCP_LAST_ACK;
-    }
-
-    deadline = timer_get_uptime_ms() + wait_ms;
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
     while (timer_get_uptime_ms() < deadline) {
         net_poll();
         if (conn->state == NET_TCP_CLOSED || conn->state == NET_TCP_RESET) {
             tcp_conn_release(conn);
             return NET_OK;
         }
-        schedule();
+        tcp_conn_wait(conn, start, deadline);
     }
 
     return NET_ERR_TIMEOUT;
 }
 
+/*
+ * net_tcp_release - close the connection without waiting for the peer.
+ * The handle is free on return; the connection lingers on the orphan
+ * list until its FIN exchange completes.
+ */
+int net_tcp_release(int handle) {
+    struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
+    uint64_t flags;
+
+    if (!conn) return NET_ERR_INVALID;
+
+    tcp_reap_orphans();
+    if (conn->state == NET_TCP_RESET || conn->state == NET_TCP_CLOSED) {
+        tcp_conn_release(conn);
+        return NET_OK;
+    }
+    tcp_conn_shutdown(conn);
+    epoll_source_detach(&conn->poll);
+
+    flags = net_irq_save();
+    g_net.tcp[handle - 1] = NULL;
+    conn->handle = 0;
+    net_irq_restore(flags);
+
+    conn->orphan_deadline_ms = timer_get_uptime_ms() + NET_TCP_ORPHAN_TIMEOUT_MS;
+    conn->queue_next = g_net.tcp_orphans;
+    g_net.tcp_orphans = conn;
+    return NET_OK;
+}
+
 int net_tcp_get_info(int handle, struct net_tcp_info *out) {
     struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
 
@@ -2102,11 +4657,343 @@ int net_tcp_get_info(int handle, struct net_tcp_info *out) {
     out->local_port = conn->local_port;
     out->remote_port = conn->remote_port;
     out->recv_ready = tcp_conn_rx_len(conn);
-    out->send_ready = NET_TCP_TX_MSS;
+    out->send_ready = tcp_conn_tx_space(conn);
     memcpy(out->remote_ip, conn->remote_ip, NET_IPV4_ADDR_LEN);
     return NET_OK;
 }
 
+/*
+ * net_tcp_poll - EPOLL_* readiness of a connection.  If source is not
+ * NULL it receives the object notified when that may change.
+ * Returns the mask or NET_ERR_INVALID.
+ */
+int net_tcp_poll(int handle, struct epoll_source **source) {
+    struct net_tcp_conn *conn = tcp_conn_from_handle(handle);
+    int mask = 0;
+
+    if (!conn) return NET_ERR_INVALID;
+    if (source) *source = &conn->poll;
+
+    if (conn->reset) return EPOLL_IN | EPOLL_ERR | EPOLL_HUP;
+    if (tcp_conn_rx_len(conn) || conn->remote_closed) mask |= EPOLL_IN;
+    if (conn->state == NET_TCP_CLOSED || (conn->remote_closed && conn->fin_pending)) {
+        mask |= EPOLL_HUP;
+    }
+    if ((conn->state == NET_TCP_ESTABLISHED || conn->state == NET_TCP_CLOSE_WAIT) &&
+        !conn->fin_pending && tcp_conn_tx_space(conn) > 0) {
+        mask |= EPOLL_OUT;
+    }
+    return mask;
+}
+
+/*
+ * net_tcp_listen - accept connections on port.  backlog connection
+ * objects (at most NET_TCP_BACKLOG_MAX) are allocated here so the
+ * receive path can answer SYNs without the heap; that many handshakes
+ * may be in progress or waiting for accept() at once.
+ * Returns a listener handle or a negative NET_ERR_*.
+ */
+int net_tcp_listen(uint16_t port, uint32_t backlog) {
+    struct process *proc = scheduler_current();
+    struct net_tcp_listener *l;
+    int slot = -1;
+    uint64_t flags;
+
+    if (port == 0) return NET_ERR_INVALID;
+    if (!g_net.ready) return NET_ERR_UNAVAILABLE;
+    if (tcp_listener_find(port)) return NET_ERR_INVALID;
+
+    tcp_reap_orphans();
+    for (int i = 0; i < NET_TCP_MAX_LISTENERS && slot < 0; i++) {
+        if (!g_net.tcp_listeners[i]) slot = i;
+    }
+    if (slot < 0) return NET_ERR_GENERIC;
+    if (backlog == 0) backlog = 1;
+    if (backlog > NET_TCP_BACKLOG_MAX) backlog = NET_TCP_BACKLOG_MAX;
+
+    l = (struct net_tcp_listener *)kzalloc(sizeof(*l));
+    if (!l) return NET_ERR_GENERIC;
+    l->port = port;
+    l->owner_pid = proc ? proc->pid : 0;
+    while (l->backlog < backlog) {
+        struct net_tcp_conn *conn = tcp_conn_alloc();
+        if (!conn) break;
+        conn->listener = l;
+        conn->queue_next = l->free;
+        l->free = conn;
+        l->backlog++;
+    }
+    if (!l->free) {
+        kfree(l);
+        return NET_ERR_GENERIC;
+    }
+
+    flags = net_irq_save();
+    g_net.tcp_listeners[slot] = l;
+    net_irq_restore(flags);
+    return slot + 1;
+}
+
+/*
+ * net_tcp_accept - take the oldest established connection off the
+ * listener's queue, waiting up to timeout_ms for one, and park a fresh
+ * connection object in its place.  Returns a connection handle or a
+ * negative NET_ERR_*.
+ */
+int net_tcp_accept(int listener, uint32_t timeout_ms) {
+    struct net_tcp_listener *l = tcp_listener_from_handle(listener);
+    struct process *proc = scheduler_current();
+    uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
+    uint64_t start;
+    uint64_t deadline;
+
+    if (!l) return NET_ERR_INVALID;
+
+    tcp_reap_orphans();
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
+    for (;;) {
+        struct net_tcp_conn *conn = NULL;
+        uint64_t flags = net_irq_save();
+
+        if (l->accept_head) {
+            conn = l->accept_head;
+            l->accept_head = conn->queue_next;
+            if (!l->accept_head) l->accept_tail = NULL;
+            l->accept_count--;
+            conn->queue_next = NULL;
+            conn->listener = NULL;
+        }
+        net_irq_restore(flags);
+
+        if (conn) {
+            struct net_tcp_conn *spare = tcp_conn_alloc();
+            if (spare) {
+                spare->listener = l;
+                flags = net_irq_save();
+                spare->queue_next = l->free;
+                l->free = spare;
+                net_irq_restore(flags);
+            }
+
+            conn->owner_pid = proc ? proc->pid : 0;
+            if (!tcp_conn_install(conn)) {
+                if (net_stack_enter()) {
+                    tcp_conn_abort(conn);
+                    net_stack_leave();
+                } else {
+                    tcp_conn_release(conn);
+                }
+                return NET_ERR_GENERIC;
+            }
+            return conn->handle;
+        }
+
+        if (timer_get_uptime_ms() >= deadline) return NET_ERR_TIMEOUT;
+        net_poll();
+        if (l->accept_head) continue;
+        net_wait_on(&l->waiters, start, deadline);
+    }
+}
+
+/*
+ * net_tcp_unlisten - stop listening on the listener's port.  Handshakes
+ * in progress and connections never accepted are reset.
+ */
+int net_tcp_unlisten(int listener) {
+    struct net_tcp_listener *l = tcp_listener_from_handle(listener);
+    struct net_tcp_conn *conn;
+    uint64_t flags;
+
+    if (!l) return NET_ERR_INVALID;
+
+    /* With the stack claimed no segment can move a connection meanwhile */
+    net_stack_claim();
+    flags = net_irq_save();
+    g_net.tcp_listeners[listener - 1] = NULL;
+    net_irq_restore(flags);
+
+    for (int b = 0; b < NET_TCP_HASH_BUCKETS; b++) {
+        struct net_tcp_conn *next;
+        for (conn = g_net.tcp_hash[b]; conn; conn = next) {
+            next = conn->hash_next;
+            if (conn->listener == l && conn->state == NET_TCP_SYN_RCVD) tcp_conn_abort(conn);
+        }
+    }
+    while ((conn = l->accept_head) != NULL) {
+        l->accept_head = conn->queue_next;
+        tcp_conn_abort(conn);
+    }
+    while ((conn = l->free) != NULL) {
+        l->free = conn->queue_next;
+        tcp_conn_release(conn);
+    }
+    net_stack_leave();
+
+    epoll_source_detach(&l->poll);
+    kfree(l);
+    return NET_OK;
+}
+
+/* net_tcp_listener_poll - EPOLL_IN while a connection waits for accept() */
+int net_tcp_listener_poll(int listener, struct epoll_source **source) {
+    struct net_tcp_listener *l = tcp_listener_from_handle(listener);
+
+    if (!l) return NET_ERR_INVALID;
+    if (source) *source = &l->poll;
+    return l->accept_count ? EPOLL_IN : 0;
+}
+
+static uint16_t udp_pick_local_port(void) {
+    uint16_t start = g_net.next_udp_port;
+    if (start < NET_UDP_EPHEMERAL_BASE) start = NET_UDP_EPHEMERAL_BASE;
+
+    for (uint32_t attempt = 0; attempt < 0x8000u; attempt++) {
+        uint16_t port = (uint16_t)(start + attempt);
+        if (port < NET_UDP_EPHEMERAL_BASE) port = (uint16_t)(NET_UDP_EPHEMERAL_BASE + attempt);
+
+        if (!udp_socket_find(port)) {
+            g_net.next_udp_port = (uint16_t)(port + 1u);
+            return port;
+        }
+    }
+    return 0;
+}
+
+/*
+ * net_udp_open - bind a datagram socket to port, or to a free ephemeral
+ * port when port is 0.  Returns a UDP handle or a negative NET_ERR_*.
+ */
+int net_udp_open(uint16_t port) {
+    struct net_udp_socket *s;
+    uint32_t b;
+    int slot = -1;
+    uint64_t flags;
+
+    if (!g_net.ready) return NET_ERR_UNAVAILABLE;
+    if (port == 0) {
+        port = udp_pick_local_port();
+        if (port == 0) return NET_ERR_GENERIC;
+    } else if (port == DHCP_CLIENT_PORT || udp_socket_find(port)) {
+        return NET_ERR_INVALID;
+    }
+
+    for (int i = 0; i < NET_UDP_MAX_SOCKETS && slot < 0; i++) {
+        if (!g_net.udp[i]) slot = i;
+    }
+    if (slot < 0) return NET_ERR_GENERIC;
+
+    s = (struct net_udp_socket *)kzalloc(sizeof(*s));
+    if (!s) return NET_ERR_GENERIC;
+    s->queue = (uint8_t *)kmalloc(NET_UDP_QUEUE_SIZE);
+    if (!s->queue) {
+        kfree(s);
+        return NET_ERR_GENERIC;
+    }
+    s->port = port;
+    s->handle = slot + 1;
+
+    b = port & (NET_UDP_HASH_BUCKETS - 1u);
+    flags = net_irq_save();
+    s->hash_next = g_net.udp_hash[b];
+    g_net.udp_hash[b] = s;
+    g_net.udp[slot] = s;
+    net_irq_restore(flags);
+    return s->handle;
+}
+
+int net_udp_close(int handle) {
+    struct net_udp_socket *s = udp_socket_from_handle(handle);
+    struct net_udp_socket **link;
+    uint64_t flags;
+
+    if (!s) return NET_ERR_INVALID;
+
+    flags = net_irq_save();
+    link = &g_net.udp_hash[s->port & (NET_UDP_HASH_BUCKETS - 1u)];
+    while (*link && *link != s) link = &(*link)->hash_next;
+    if (*link) *link = s->hash_next;
+    g_net.udp[handle - 1] = NULL;
+    net_irq_restore(flags);
+
+    epoll_source_detach(&s->poll);
+    kfree(s->queue);
+    kfree(s);
+    return NET_OK;
+}
+
+/* net_udp_poll - EPOLL_IN while a datagram is queued; sends never block */
+int net_udp_poll(int handle, struct epoll_source **source) {
+    struct net_udp_socket *s = udp_socket_from_handle(handle);
+
+    if (!s) return NET_ERR_INVALID;
+    if (source) *source = &s->poll;
+    return (s->queue_len ? EPOLL_IN : 0) | EPOLL_OUT;
+}
+
+ssize_t net_udp_sendto(int handle, const uint8_t addr[NET_IPV4_ADDR_LEN], uint16_t port,
+                       const void *buf, size_t len) {
+    struct net_udp_socket *s = udp_socket_from_handle(handle);
+    int rc;
+
+    if (!s || !addr || port == 0 || (!buf && len)) return NET_ERR_INVALID;
+    if (len > NET_MTU - sizeof(struct net_ipv4_header) - sizeof(struct net_udp_header)) {
+        return NET_ERR_INVALID;
+    }
+
+    rc = net_send_udp(addr, s->port, port, buf, len);
+    return (rc == NET_OK) ? (ssize_t)len : rc;
+}
+
+/*
+ * net_udp_recvfrom - take the oldest queued datagram, waiting up to
+ * timeout_ms for one.  A datagram longer than len is truncated and the
+ * rest discarded.  The sender is stored through addr and port when they
+ * are not NULL.  Returns the bytes copied or a negative NET_ERR_*.
+ */
+ssize_t net_udp_recvfrom(int handle, void *buf, size_t len,
+                         uint8_t addr[NET_IPV4_ADDR_LEN], uint16_t *port,
+                         uint32_t timeout_ms) {
+    struct net_udp_socket *s = udp_socket_from_handle(handle);
+    uint32_t wait_ms = timeout_ms ? timeout_ms : NET_TCP_DEFAULT_TIMEOUT;
+    uint8_t data[NET_MTU];
+    uint64_t start;
+    uint64_t deadline;
+
+    if (!s || (!buf && len)) return NET_ERR_INVALID;
+
+    start = timer_get_uptime_ms();
+    deadline = start + wait_ms;
+    for (;;) {
+        struct net_udp_record rec;
+        uint32_t copied = 0;
+        int have = 0;
+        uint64_t flags = net_irq_save();
+
+        /* Bounce through the stack so no user page is touched with IRQs off */
+        if (s->queue_len > 0) {
+            udp_ring_read(s, &rec, sizeof(rec), sizeof(rec));
+            copied = (rec.len < len) ? rec.len : (uint32_t)len;
+            if (copied > sizeof(data)) copied = sizeof(data);
+            udp_ring_read(s, data, copied, rec.len);
+            have = 1;
+        }
+        net_irq_restore(flags);
+
+        if (have) {
+            memcpy(buf, data, copied);
+            if (addr) memcpy(addr, rec.src_ip, NET_IPV4_ADDR_LEN);
+            if (port) *port = rec.src_port;
+            return (ssize_t)copied;
+        }
+
+        if (timer_get_uptime_ms() >= deadline) return NET_ERR_TIMEOUT;
+        net_poll();
+        if (s->queue_len > 0) continue;
+        net_wait_on(&s->waiters, start, deadline);
+    }
+}
+
 void net_print_status(void) {
     char ip_buf[16];
     char mask_buf[16];
@@ -2141,14 +5028,48 @@ void net_print_status(void) {
     print_dec(g_net.rx_packets);
     vga_writestring(" tx=");
     print_dec(g_net.tx_packets);
+    vga_writestring(" csum_errors=");
+    print_dec(g_net.rx_csum_errors);
+    vga_writestring(" tcp_conns=");
+    print_dec(g_net.tcp_count);
+    vga_writestring(" syn_drops=");
+    print_dec(g_net.tcp_syn_dropped);
+    if (g_net.irq_enabled) {
+        vga_writestring(" irq=");
+        print_dec(g_net.irq);
+        vga_writestring(" interrupts=");
+        print_dec(g_net.irq_count);
+        vga_writestring(" budget_hits=");
+        print_dec(g_net.rx_budget_exhausted);
+    } else {
+        vga_writestring(" polled");
+    }
+    if (g_net.backend == NET_BACKEND_VIRTIO) {
+        vga_writestring("\nNET: queues=");
+        print_dec(g_net.virtio.pairs);
+        vga_writestring(" csum=");
+        vga_writestring(g_net.tx_csum_offload ? "on" : "off");
+        vga_writestring(" tso=");
+        vga_writestring(g_net.tso_max ? "on" : "off");
+        vga_writestring(" mrg_rxbuf=");
+        vga_writestring((g_net.virtio.features & VIRTIO_NET_F_MRG_RXBUF) ? "on" : "off");
+    }
+    vga_writestring("\nNET: arp_entries=");
+    print_dec(g_net.arp_entries);
+    vga_writestring(" arp_drops=");
+    print_dec(g_net.arp_dropped);
+    vga_writestring(" arp_conflicts=");
+    print_dec(g_net.arp_conflicts);
     vga_writestring("\n");
 }
 
 void net_init(void) {
     memset(&g_net, 0, sizeof(g_net));
     g_net.next_tcp_port = NET_TCP_EPHEMERAL_BASE;
+    arp_init();
 
-    if (e1000_probe_device() != NET_OK &&
+    if (virtio_probe_device() != NET_OK &&
+        e1000_probe_device() != NET_OK &&
         pcnet_probe_device() != NET_OK) {
         net_print_virtualbox_pcnet_hint();
         vga_writestring("NET: No supported NIC detected\n");
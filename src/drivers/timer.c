@@ -8,6 +8,10 @@
  *   timer_init()            - configure PIT and reset counters
  *   timer_handler()         - called from IRQ 0; updates ticks and uptime
  *   timer_get_uptime_ms()   - milliseconds since init
+ *
+ * The RTC is read once, at init; the IRQ advances the calendar copy from
+ * that reading and the uptime, so it never waits on the CMOS update flag
+ * and syscalls never touch the CMOS ports themselves.
  */
 
 #include "drivers/timer.h"
@@ -15,6 +19,7 @@
 #include "drivers/rtc.h"
 #include "drivers/graphices/vga.h"
 #include "kernel/kernel.h"
+#include "kernel/vdso.h"
 
 #define NUMOS_MAX_TIMER_OBJECTS 32
 
@@ -42,10 +47,13 @@ static volatile uint64_t timer_ticks     = 0;               /* ticks since init
 static uint32_t          timer_frequency = TIMER_FREQ_100HZ; /* current Hz       */
 static struct timer_stats stats          = {0};              /* exported stats   */
 static struct numos_calendar_time wall_clock = {0};
-static uint64_t wall_clock_refresh_ms = 0;
+static uint64_t wall_base_secs;     /* Unix time of the last RTC reading */
+static uint64_t wall_base_ms;       /* Uptime when it was taken          */
 static int32_t next_timer_id = 1;
 static struct timer_object timer_objects[NUMOS_MAX_TIMER_OBJECTS];
 
+static void timer_advance_wall_clock(void);
+
 static struct timer_object *timer_find_slot(int owner_pid, int timer_id) {
     for (int i = 0; i < NUMOS_MAX_TIMER_OBJECTS; i++) {
         if (!timer_objects[i].used) continue;
@@ -111,7 +119,6 @@ void timer_init(uint32_t frequency) {
     stats.uptime_ms    = 0;
     memset(timer_objects, 0, sizeof(timer_objects));
     memset(&wall_clock, 0, sizeof(wall_clock));
-    wall_clock_refresh_ms = 0;
     next_timer_id = 1;
     timer_refresh_wall_clock();
 
@@ -129,13 +136,16 @@ void timer_init(uint32_t frequency) {
  * Advances the tick counter, recomputes uptime, and calls the user callback.
  */
 void timer_handler(void) {
+    uint64_t prev_seconds = stats.seconds;
+
     timer_ticks++;
     stats.ticks++;
 
     stats.uptime_ms = (timer_ticks * 1000) / timer_frequency;
     stats.seconds   = stats.uptime_ms / 1000;
+    if (stats.seconds != prev_seconds) timer_advance_wall_clock();
     net_poll();
-
+    vdso_update(timer_ticks);
 }
 
 /* =========================================================================
@@ -144,36 +154,86 @@ void timer_handler(void) {
 
 uint64_t timer_get_uptime_ms(void)       { return stats.uptime_ms;    }
 
+/* Days since 1970-01-01 of a proleptic Gregorian date (year >= 1970) */
+static uint64_t timer_days_from_civil(uint32_t y, uint32_t m, uint32_t d) {
+    y -= (m <= 2) ? 1u : 0u;
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (uint64_t)era * 146097 + doe - 719468;
+}
+
+static void timer_civil_from_days(uint64_t days, struct numos_calendar_time *out) {
+    uint64_t z   = days + 719468;
+    uint64_t era = z / 146097;
+    uint32_t doe = (uint32_t)(z - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp  = (5 * doy + 2) / 153;
+    uint32_t m   = (mp < 10) ? mp + 3 : mp - 9;
+
+    out->year    = (uint16_t)(yoe + era * 400 + (m <= 2 ? 1 : 0));
+    out->month   = (uint8_t)m;
+    out->day     = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    out->weekday = (uint8_t)((days + 4) % 7 + 1);   /* 1 = Sunday, as the RTC */
+}
+
+/*
+ * timer_advance_wall_clock - recompute the calendar copy from the last RTC
+ * reading plus the uptime since.  Pure arithmetic, so safe in the IRQ.
+ */
+static void timer_advance_wall_clock(void) {
+    if (!wall_clock.valid) return;
+
+    uint64_t now  = wall_base_secs + (stats.uptime_ms - wall_base_ms) / 1000;
+    uint64_t secs = now % 86400;
+
+    timer_civil_from_days(now / 86400, &wall_clock);
+    wall_clock.hour      = (uint8_t)(secs / 3600);
+    wall_clock.minute    = (uint8_t)(secs / 60 % 60);
+    wall_clock.second    = (uint8_t)(secs % 60);
+    wall_clock.uptime_ms = stats.uptime_ms;
+}
+
+/*
+ * timer_refresh_wall_clock - resynchronise the calendar with the RTC.  The
+ * read may spin on the RTC update flag, so call it from process context
+ * or init, never from an interrupt handler.
+ */
 void timer_refresh_wall_clock(void) {
     struct rtc_time rtc_now;
+    uint64_t flags;
+
     if (rtc_read_time(&rtc_now) != 0) return;
+    if (rtc_now.year < 1970 || rtc_now.month < 1 || rtc_now.month > 12 ||
+        rtc_now.day < 1 || rtc_now.day > 31) {
+        return;
+    }
+
+    uint64_t secs = timer_days_from_civil(rtc_now.year, rtc_now.month, rtc_now.day) * 86400 +
+                    (uint64_t)rtc_now.hour * 3600 + (uint64_t)rtc_now.minute * 60 +
+                    rtc_now.second;
 
-    wall_clock.year = rtc_now.year;
-    wall_clock.month = rtc_now.month;
-    wall_clock.day = rtc_now.day;
-    wall_clock.hour = rtc_now.hour;
-    wall_clock.minute = rtc_now.minute;
-    wall_clock.second = rtc_now.second;
-    wall_clock.weekday = rtc_now.weekday;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    wall_base_secs   = secs;
+    wall_base_ms     = stats.uptime_ms;
     wall_clock.valid = 1;
-    wall_clock.uptime_ms = timer_get_uptime_ms();
-    wall_clock_refresh_ms = wall_clock.uptime_ms;
+    timer_advance_wall_clock();
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
 }
 
 int timer_get_wall_clock(struct numos_calendar_time *out) {
-    if (!out) return -1;
+    uint64_t flags;
 
-    uint64_t now = timer_get_uptime_ms();
-    if (!wall_clock.valid ||
-        now >= wall_clock_refresh_ms + 1000) {
-        timer_refresh_wall_clock();
-    }
-
-    if (!wall_clock.valid) return -1;
+    if (!out) return -1;
 
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
     *out = wall_clock;
-    out->uptime_ms = now;
-    return 0;
+    out->uptime_ms = timer_get_uptime_ms();
+    __asm__ volatile("push %0; popfq" :: "r"(flags) : "memory", "cc");
+
+    return out->valid ? 0 : -1;
 }
 
 int timer_create_object(int owner_pid, uint64_t delay_ms,
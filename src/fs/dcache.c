@@ -0,0 +1,219 @@
+/*
+ * dcache.c - Directory entry cache
+ *
+ * Path resolution looks each component up here before touching the disk.
+ * A fixed pool of entries is chained into two hash tables: one keyed by
+ * (fs, parent, name) for lookups, and one keyed by the on-disk location so
+ * a back end can invalidate an entry after rewriting it without knowing
+ * its name.  When the pool is full, entries are recycled round-robin.
+ */
+
+#include "fs/dcache.h"
+#include "lib/string.h"
+
+struct dcache_entry {
+    uint32_t fs;
+    uint32_t parent;
+    uint32_t hash;
+    uint32_t loc_cluster;
+    uint32_t loc_index;
+    int      negative;
+    int      in_use;
+    char     name[DCACHE_NAME_MAX + 1];
+    uint8_t  data[DCACHE_DATA_MAX];
+    struct dcache_entry *name_next;
+    struct dcache_entry *loc_next;
+};
+
+static struct dcache_entry  entries[DCACHE_MAX_ENTRIES];
+static struct dcache_entry *name_buckets[DCACHE_BUCKETS];
+static struct dcache_entry *loc_buckets[DCACHE_BUCKETS];
+static uint32_t             next_victim;
+
+static char dcache_fold(char c) {
+    if (c >= 'a' && c <= 'z') return (char)(c - 32);
+    return c;
+}
+
+static uint32_t dcache_name_hash(uint32_t fs, uint32_t parent, const char *name) {
+    uint32_t h = 2166136261u;
+
+    h = (h ^ fs) * 16777619u;
+    h = (h ^ parent) * 16777619u;
+    for (const char *p = name; *p; p++) {
+        h = (h ^ (uint8_t)dcache_fold(*p)) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t dcache_loc_bucket(uint32_t fs, uint32_t cluster, uint32_t index) {
+    uint32_t h = (fs * 0x9E3779B1u) ^ (cluster * 0x85EBCA6Bu) ^ index;
+    return (h ^ (h >> 15)) % DCACHE_BUCKETS;
+}
+
+static int dcache_name_equal(const char *a, const char *b) {
+    while (*a && *b) {
+        if (dcache_fold(*a) != dcache_fold(*b)) return 0;
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static void dcache_unlink(struct dcache_entry *e) {
+    struct dcache_entry **link;
+
+    if (!e->in_use) return;
+
+    link = &name_buckets[e->hash % DCACHE_BUCKETS];
+    while (*link && *link != e) link = &(*link)->name_next;
+    if (*link) *link = e->name_next;
+
+    if (!e->negative) {
+        link = &loc_buckets[dcache_loc_bucket(e->fs, e->loc_cluster, e->loc_index)];
+        while (*link && *link != e) link = &(*link)->loc_next;
+        if (*link) *link = e->loc_next;
+    }
+
+    e->in_use = 0;
+}
+
+static struct dcache_entry *dcache_find(uint32_t fs, uint32_t parent,
+                                        const char *name, uint32_t hash) {
+    struct dcache_entry *e = name_buckets[hash % DCACHE_BUCKETS];
+
+    for (; e; e = e->name_next) {
+        if (e->hash == hash && e->fs == fs && e->parent == parent &&
+            dcache_name_equal(e->name, name)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct dcache_entry *dcache_alloc(void) {
+    for (uint32_t i = 0; i < DCACHE_MAX_ENTRIES; i++) {
+        struct dcache_entry *e = &entries[(next_victim + i) % DCACHE_MAX_ENTRIES];
+        if (!e->in_use) {
+            next_victim = (next_victim + i + 1) % DCACHE_MAX_ENTRIES;
+            return e;
+        }
+    }
+
+    struct dcache_entry *victim = &entries[next_victim];
+    next_victim = (next_victim + 1) % DCACHE_MAX_ENTRIES;
+    dcache_unlink(victim);
+    return victim;
+}
+
+static void dcache_store(uint32_t fs, uint32_t parent, const char *name,
+                         int negative, uint32_t loc_cluster, uint32_t loc_index,
+                         const void *data, size_t len) {
+    size_t name_len;
+    uint32_t hash;
+    struct dcache_entry *e;
+
+    if (!name) return;
+    name_len = strlen(name);
+    if (name_len == 0 || name_len > DCACHE_NAME_MAX) return;
+
+    hash = dcache_name_hash(fs, parent, name);
+    e = dcache_find(fs, parent, name, hash);
+    if (e) dcache_unlink(e);
+    else   e = dcache_alloc();
+
+    memset(e, 0, sizeof(*e));
+    e->fs          = fs;
+    e->parent      = parent;
+    e->hash        = hash;
+    e->negative    = negative;
+    e->loc_cluster = loc_cluster;
+    e->loc_index   = loc_index;
+    memcpy(e->name, name, name_len + 1);
+    if (data) {
+        if (len > DCACHE_DATA_MAX) len = DCACHE_DATA_MAX;
+        memcpy(e->data, data, len);
+    }
+    e->in_use = 1;
+
+    e->name_next = name_buckets[hash % DCACHE_BUCKETS];
+    name_buckets[hash % DCACHE_BUCKETS] = e;
+
+    if (!negative) {
+        uint32_t b = dcache_loc_bucket(fs, loc_cluster, loc_index);
+        e->loc_next = loc_buckets[b];
+        loc_buckets[b] = e;
+    }
+}
+
+void dcache_init(void) {
+    memset(entries, 0, sizeof(entries));
+    memset(name_buckets, 0, sizeof(name_buckets));
+    memset(loc_buckets, 0, sizeof(loc_buckets));
+    next_victim = 0;
+}
+
+/*
+ * dcache_lookup - look up name under parent.
+ * Returns DCACHE_HIT and fills out, DCACHE_NEGATIVE if the name is known
+ * not to exist, or DCACHE_MISS if the caller has to ask the disk.
+ */
+int dcache_lookup(uint32_t fs, uint32_t parent, const char *name,
+                  struct dcache_hit *out) {
+    struct dcache_entry *e;
+
+    if (!name || strlen(name) > DCACHE_NAME_MAX) return DCACHE_MISS;
+
+    e = dcache_find(fs, parent, name, dcache_name_hash(fs, parent, name));
+    if (!e) return DCACHE_MISS;
+    if (e->negative) return DCACHE_NEGATIVE;
+
+    if (out) {
+        out->loc_cluster = e->loc_cluster;
+        out->loc_index   = e->loc_index;
+        memcpy(out->data, e->data, sizeof(out->data));
+    }
+    return DCACHE_HIT;
+}
+
+void dcache_insert(uint32_t fs, uint32_t parent, const char *name,
+                   uint32_t loc_cluster, uint32_t loc_index,
+                   const void *data, size_t len) {
+    dcache_store(fs, parent, name, 0, loc_cluster, loc_index, data, len);
+}
+
+void dcache_insert_negative(uint32_t fs, uint32_t parent, const char *name) {
+    dcache_store(fs, parent, name, 1, 0, 0, NULL, 0);
+}
+
+void dcache_invalidate(uint32_t fs, uint32_t parent, const char *name) {
+    struct dcache_entry *e;
+
+    if (!name || strlen(name) > DCACHE_NAME_MAX) return;
+    e = dcache_find(fs, parent, name, dcache_name_hash(fs, parent, name));
+    if (e) dcache_unlink(e);
+}
+
+/*
+ * dcache_invalidate_location - drop every positive entry that points at the
+ * on-disk entry (loc_cluster, loc_index).  Used after the entry is rewritten.
+ */
+void dcache_invalidate_location(uint32_t fs, uint32_t loc_cluster,
+                                uint32_t loc_index) {
+    struct dcache_entry *e = loc_buckets[dcache_loc_bucket(fs, loc_cluster, loc_index)];
+
+    while (e) {
+        struct dcache_entry *next = e->loc_next;
+        if (e->fs == fs && e->loc_cluster == loc_cluster &&
+            e->loc_index == loc_index) {
+            dcache_unlink(e);
+        }
+        e = next;
+    }
+}
+
+void dcache_invalidate_fs(uint32_t fs) {
+    for (uint32_t i = 0; i < DCACHE_MAX_ENTRIES; i++) {
+        if (entries[i].in_use && entries[i].fs == fs) dcache_unlink(&entries[i]);
+    }
+}
@@ -7,11 +7,33 @@
  *
  * Key data flow for a read:
  *   fat32_open()        - locate the directory entry, fill a fat32_file slot
- *   fat32_read()        - walk the FAT cluster chain, copy data to the caller
+ *   fat32_read()        - map file offsets through the cached extent list,
+ *                         read whole runs straight into the caller's buffer
  *   fat32_close()       - release the file descriptor slot
  *
  * All sector I/O goes through fat32_read_sector(), which selects either the
  * ramdisk module or the ATA driver based on availability.
+ *
+ * The first FAT copy is loaded into g_fs.fat_cache at mount time together
+ * with a free-cluster bitmap, so chain walks and cluster allocation never
+ * touch the disk.  FAT updates are written through to every FAT copy and the
+ * FSInfo free count / next-free hint are kept current and written back when
+ * a file is closed.
+ *
+ * Path components are resolved through the shared dcache (fs/dcache.c), so
+ * repeated lookups, including lookups of names that do not exist, are
+ * answered from memory.  Rewriting a directory entry invalidates it there.
+ *
+ * VFAT long file names are read (with checksum and sequence validation) and
+ * written for names that do not fit 8.3.  The first time a directory is
+ * opened its entries are parsed once into a hashed name index holding both
+ * the long name and the short alias, so lookups, listings and alias
+ * generation never rescan LFN chains.
+ *
+ * Partial-cluster I/O goes through a per-file window of up to 64 KiB.
+ * Sequential readers grow the window (read-ahead) and small writes are
+ * coalesced into it and written back as whole clusters when the window
+ * moves or the file is closed (write-behind).
  *
  * Note: Per-cluster debug prints were removed from fat32_read_cluster().
  * They fired on every cluster read during ELF loading and flooded the
@@ -19,6 +41,7 @@
  */
 
 #include "fs/fat32.h"
+#include "fs/dcache.h"
 #include "drivers/ata.h"
 #include "drivers/ramdisk.h"
 #include "drivers/graphices/vga.h"
@@ -34,23 +57,43 @@ static struct fat32_fs g_fs = {0};          /* mounted filesystem state  */
 #define FAT32_NTRES_LOWER_BASE 0x08
 #define FAT32_NTRES_LOWER_EXT  0x10
 
-#define MAX_OPEN_FILES 16
-static struct fat32_file g_fd_table[MAX_OPEN_FILES] = {0}; /* open files  */
+#define FAT32_FD_INITIAL   16       /* Descriptor table size on first open */
+#define FAT32_STREAM_BYTES 65536    /* Per-file read-ahead/write-behind window */
+#define FAT32_SCAN_SECTORS 16       /* FAT sectors read per chunk when uncached */
+static struct fat32_file *g_fd_table;       /* open files, grown on demand */
+static int                g_fd_count;
 
 /* Working sector and cluster I/O buffers; aligned for DMA safety */
 static uint8_t sector_buffer[512]  __attribute__((aligned(16)));
 static uint8_t cluster_buffer[4096] __attribute__((aligned(16)));
 
-static struct fat32_dir_entry *find_entry_in_cluster(uint32_t cluster,
-                                                     char *formatted_name,
-                                                     int *entry_index);
+static int fat32_lookup_component(uint32_t dir_cluster,
+                                  const char *component,
+                                  struct fat32_dir_entry *out,
+                                  int *entry_index);
 static int fat32_raw_read_sector(uint32_t sector, void *buffer);
+static int fat32_raw_read_sectors(uint32_t sector, uint32_t count, void *buffer);
 static int fat32_raw_write_sector(uint32_t sector, const void *buffer);
+static int fat32_raw_write_sectors(uint32_t sector, uint32_t count,
+                                   const void *buffer);
 static int fat32_try_mount_at_lba(uint32_t start_lba);
 static int fat32_probe_mbr_partition_start(uint32_t *start_lba);
 static int fat32_probe_gpt_partition_start(uint32_t *start_lba);
 static uint8_t fat32_short_name_case_flags(const char *filename);
-static uint32_t fat32_count_free_clusters(void);
+struct fat32_dir_index;
+static struct fat32_dir_index *fat32_dir_index_get(uint32_t cluster);
+static void fat32_dir_index_drop(uint32_t cluster);
+static void fat32_dir_index_update_entry(uint32_t cluster, uint32_t entry_index,
+                                         const struct fat32_dir_entry *entry);
+static int fat32_dir_index_find(struct fat32_dir_index *idx, const char *name);
+static int fat32_dir_index_has_short(struct fat32_dir_index *idx,
+                                     const char *short_name);
+static int fat32_long_name_valid(const char *name);
+static int fat32_name_needs_lfn(const char *name);
+static int fat32_make_short_alias(struct fat32_dir_index *idx,
+                                  const char *name, char *short_name);
+static uint8_t fat32_lfn_checksum(const uint8_t *short_name);
+static uint32_t fat32_scan_fat(void);
 
 static uint16_t fat32_le16(const uint8_t *ptr) {
     return (uint16_t)ptr[0] | ((uint16_t)ptr[1] << 8);
@@ -114,11 +157,64 @@ static int fat32_raw_read_sector(uint32_t sector, void *buffer) {
     return ata_read_sectors(&ata_primary_master, sector, 1, buffer);
 }
 
+/*
+ * fat32_raw_read_sectors - read count consecutive sectors.  ATA transfers are
+ * issued as multi-sector commands so large runs cost one command per chunk.
+ */
+static int fat32_raw_read_sectors(uint32_t sector, uint32_t count, void *buffer) {
+    uint8_t *out = (uint8_t *)buffer;
+
+    if (ramdisk_available()) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (ramdisk_read_sector(sector + i, out + (i * 512)) != 0) return -1;
+        }
+        return 0;
+    }
+
+    while (count > 0) {
+        uint32_t chunk = count > 128 ? 128 : count;
+        if (ata_read_sectors(&ata_primary_master, sector, (uint8_t)chunk, out) != 0) {
+            return -1;
+        }
+        sector += chunk;
+        out    += chunk * 512;
+        count  -= chunk;
+    }
+    return 0;
+}
+
 static int fat32_raw_write_sector(uint32_t sector, const void *buffer) {
     if (ramdisk_available()) return ramdisk_write_sector(sector, buffer);
     return ata_write_sectors(&ata_primary_master, sector, 1, buffer);
 }
 
+/*
+ * fat32_raw_write_sectors - write count consecutive sectors, batching ATA
+ * transfers the same way as fat32_raw_read_sectors().
+ */
+static int fat32_raw_write_sectors(uint32_t sector, uint32_t count,
+                                   const void *buffer) {
+    const uint8_t *in = (const uint8_t *)buffer;
+
+    if (ramdisk_available()) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (ramdisk_write_sector(sector + i, in + (i * 512)) != 0) return -1;
+        }
+        return 0;
+    }
+
+    while (count > 0) {
+        uint32_t chunk = count > 128 ? 128 : count;
+        if (ata_write_sectors(&ata_primary_master, sector, (uint8_t)chunk, in) != 0) {
+            return -1;
+        }
+        sector += chunk;
+        in     += chunk * 512;
+        count  -= chunk;
+    }
+    return 0;
+}
+
 static int fat32_try_load_boot_sector(uint32_t sector_lba, uint8_t *boot_sector) {
     if (!boot_sector) return -1;
     if (fat32_raw_read_sector(sector_lba, boot_sector) != 0) return -1;
@@ -213,18 +309,6 @@ static int fat32_probe_gpt_partition_start(uint32_t *start_lba) {
     return -1;
 }
 
-static uint32_t fat32_count_free_clusters(void) {
-    uint32_t free_clusters = 0;
-
-    for (uint32_t cluster = 2; cluster < g_fs.total_clusters + 2; cluster++) {
-        uint32_t entry = fat32_read_fat_entry(cluster);
-        if (entry == FAT32_BAD_CLUSTER) return FAT32_FSINFO_UNKNOWN;
-        if (entry == FAT32_FREE_CLUSTER) free_clusters++;
-    }
-
-    return free_clusters;
-}
-
 /*
  * fat32_read_cluster - read one cluster (sectors_per_cluster sectors) into
  * buffer.  cluster must be >= 2 (clusters 0 and 1 are reserved).
@@ -269,6 +353,128 @@ int fat32_write_cluster(uint32_t cluster, const void *buffer) {
  * FAT table access
  * ======================================================================= */
 
+static void fat32_bitmap_set_free(uint32_t cluster, int is_free) {
+    uint64_t bit = 1ULL << (cluster & 63);
+    if (is_free) g_fs.free_bitmap[cluster >> 6] |= bit;
+    else         g_fs.free_bitmap[cluster >> 6] &= ~bit;
+}
+
+/*
+ * fat32_scan_fat - count the free clusters, marking each in the bitmap when
+ * there is one.  Without the in-memory FAT the table is streamed from disk
+ * in multi-sector chunks rather than read one entry at a time.
+ * Returns the count, or FAT32_FSINFO_UNKNOWN on a read error.
+ */
+static uint32_t fat32_scan_fat(void) {
+    uint32_t entries       = g_fs.total_clusters + 2;
+    uint32_t chunk_sectors = FAT32_SCAN_SECTORS;
+    uint32_t free_clusters = 0;
+    uint8_t *bounce        = NULL;
+    uint32_t span;
+
+    if (!g_fs.fat_cache) {
+        bounce = (uint8_t *)kmalloc((size_t)chunk_sectors * 512);
+        if (!bounce) {
+            bounce = sector_buffer;
+            chunk_sectors = 1;
+        }
+    }
+
+    for (uint32_t base = 0; base < entries; base += span) {
+        const uint32_t *table;
+
+        if (g_fs.fat_cache) {
+            table = (const uint32_t *)g_fs.fat_cache;
+            span  = entries;
+        } else {
+            uint32_t sectors = (entries - base + 127) / 128;
+            if (sectors > chunk_sectors) sectors = chunk_sectors;
+            if (fat32_read_sectors(g_fs.fat_start_sector + base / 128, sectors, bounce) != 0) {
+                free_clusters = FAT32_FSINFO_UNKNOWN;
+                break;
+            }
+            table = (const uint32_t *)bounce;
+            span  = sectors * 128;
+        }
+
+        for (uint32_t i = (base == 0) ? 2 : 0; i < span && base + i < entries; i++) {
+            if ((table[i] & 0x0FFFFFFF) != FAT32_FREE_CLUSTER) continue;
+            if (g_fs.free_bitmap) fat32_bitmap_set_free(base + i, 1);
+            free_clusters++;
+        }
+    }
+
+    if (bounce && bounce != sector_buffer) kfree(bounce);
+    return free_clusters;
+}
+
+/*
+ * fat32_load_fat - copy the first FAT into memory and build the free-cluster
+ * bitmap from it.  If the FAT does not fit in the heap the driver keeps
+ * working straight from disk, still using the bitmap when that fits.  The
+ * free count found here is kept current by fat32_write_fat_entry.
+ */
+static void fat32_load_fat(void) {
+    uint32_t entries     = g_fs.total_clusters + 2;
+    uint32_t fat_sectors = (entries * 4 + 511) / 512;
+    uint32_t words       = (entries + 63) / 64;
+
+    if (fat_sectors > g_fs.boot.fat_size_32) fat_sectors = g_fs.boot.fat_size_32;
+
+    g_fs.fat_cache = (uint8_t *)kmalloc((size_t)fat_sectors * 512);
+    if (g_fs.fat_cache &&
+        fat32_read_sectors(g_fs.fat_start_sector, fat_sectors, g_fs.fat_cache) != 0) {
+        kfree(g_fs.fat_cache);
+        g_fs.fat_cache = NULL;
+    }
+
+    g_fs.free_bitmap = (uint64_t *)kzalloc((size_t)words * sizeof(uint64_t));
+
+    uint32_t free_clusters = fat32_scan_fat();
+    if (free_clusters == FAT32_FSINFO_UNKNOWN) {
+        /* A partial bitmap would hand out clusters that are in use */
+        if (g_fs.free_bitmap) {
+            kfree(g_fs.free_bitmap);
+            g_fs.free_bitmap = NULL;
+        }
+        return;
+    }
+
+    /* The FAT is authoritative; repair a stale FSInfo count */
+    if (g_fs.fsinfo_valid && g_fs.fsinfo.free_clusters != free_clusters) {
+        g_fs.fsinfo_dirty = 1;
+    }
+    g_fs.fsinfo.free_clusters = free_clusters;
+}
+
+/*
+ * fat32_flush_fsinfo - write the in-memory FSInfo back if it changed.
+ */
+static int fat32_flush_fsinfo(void) {
+    if (!g_fs.fsinfo_dirty || !g_fs.fsinfo_valid) return 0;
+    if (fat32_write_sector(g_fs.boot.fs_info_sector, &g_fs.fsinfo) != 0) return -1;
+    g_fs.fsinfo_dirty = 0;
+    return 0;
+}
+
+/*
+ * fat32_read_sectors - read count consecutive partition-relative sectors.
+ */
+int fat32_read_sectors(uint32_t sector, uint32_t count, void *buffer) {
+    return fat32_raw_read_sectors(g_fs.partition_lba_start + sector, count, buffer);
+}
+
+/*
+ * fat32_write_sectors - write count consecutive partition-relative sectors.
+ */
+int fat32_write_sectors(uint32_t sector, uint32_t count, const void *buffer) {
+    return fat32_raw_write_sectors(g_fs.partition_lba_start + sector, count, buffer);
+}
+
+static uint32_t fat32_cluster_sector(uint32_t cluster) {
+    return g_fs.data_start_sector + (cluster - 2) * g_fs.boot.sectors_per_cluster;
+}
+
 /*
  * fat32_read_fat_entry - return the 28-bit FAT32 entry for cluster.
  * Returns FAT32_BAD_CLUSTER on I/O error or out-of-range cluster.
@@ -277,6 +483,10 @@ uint32_t fat32_read_fat_entry(uint32_t cluster) {
     if (cluster < 2 || cluster >= g_fs.total_clusters + 2) {
         return FAT32_BAD_CLUSTER;
     }
+
+    if (g_fs.fat_cache) {
+        return ((const uint32_t *)g_fs.fat_cache)[cluster] & 0x0FFFFFFF;
+    }
 
     uint32_t fat_offset   = cluster * 4;
     uint32_t fat_sector   = g_fs.fat_start_sector + (fat_offset / 512);
@@ -304,7 +514,8 @@ uint32_t fat32_next_cluster(uint32_t cluster) {
 
 /*
  * fat32_write_fat_entry - update the 28-bit FAT32 entry for cluster.
- * Writes to all FAT copies. Returns 0 on success, -1 on failure.
+ * Writes to all FAT copies and keeps the in-memory FAT, the free bitmap and
+ * the FSInfo free count in step. Returns 0 on success, -1 on failure.
  */
 static int fat32_write_fat_entry(uint32_t cluster, uint32_t value) {
     if (cluster < 2 || cluster >= g_fs.total_clusters + 2) return -1;
@@ -313,28 +524,76 @@ static int fat32_write_fat_entry(uint32_t cluster, uint32_t value) {
     uint32_t sector_offset = fat_offset / 512;
     uint32_t entry_offset = fat_offset % 512;
     uint32_t masked = value & 0x0FFFFFFF;
+    uint32_t old = fat32_read_fat_entry(cluster);
+
+    if (g_fs.fat_cache) {
+        uint32_t *slot = (uint32_t *)(g_fs.fat_cache + fat_offset);
+        *slot = (*slot & 0xF0000000) | masked;
+    }
 
     for (uint32_t fat = 0; fat < g_fs.boot.num_fats; fat++) {
         uint32_t fat_sector = g_fs.fat_start_sector +
                               (fat * g_fs.boot.fat_size_32) +
                               sector_offset;
-        if (fat32_read_sector(fat_sector, sector_buffer) != 0) return -1;
+        const uint8_t *src;
 
-        uint32_t current = *(uint32_t *)(sector_buffer + entry_offset);
-        current = (current & 0xF0000000) | masked;
-        *(uint32_t *)(sector_buffer + entry_offset) = current;
+        if (g_fs.fat_cache) {
+            src = g_fs.fat_cache + (sector_offset * 512);
+        } else {
+            if (fat32_read_sector(fat_sector, sector_buffer) != 0) return -1;
+
+            uint32_t current = *(uint32_t *)(sector_buffer + entry_offset);
+            current = (current & 0xF0000000) | masked;
+            *(uint32_t *)(sector_buffer + entry_offset) = current;
+            src = sector_buffer;
+        }
+
+        if (fat32_write_sector(fat_sector, src) != 0) return -1;
+    }
 
-        if (fat32_write_sector(fat_sector, sector_buffer) != 0) return -1;
+    int was_free = (old == FAT32_FREE_CLUSTER);
+    int is_free  = (masked == FAT32_FREE_CLUSTER);
+    if (old != FAT32_BAD_CLUSTER && was_free != is_free) {
+        if (g_fs.free_bitmap) fat32_bitmap_set_free(cluster, is_free);
+        if (g_fs.fsinfo.free_clusters != FAT32_FSINFO_UNKNOWN) {
+            if (is_free) g_fs.fsinfo.free_clusters++;
+            else         g_fs.fsinfo.free_clusters--;
+            g_fs.fsinfo_dirty = 1;
+        }
     }
     return 0;
 }
 
+/*
+ * fat32_find_free_cluster - return a free cluster at or after the FSInfo
+ * next-free hint, wrapping once.  Scans the bitmap a word at a time.
+ * Returns 0 if the volume is full.
+ */
 static uint32_t fat32_find_free_cluster(void) {
-    uint32_t start = 2;
-    uint32_t end = g_fs.total_clusters + 2;
+    uint32_t end  = g_fs.total_clusters + 2;
+    uint32_t hint = g_fs.fsinfo.next_free_cluster;
 
-    for (uint32_t c = start; c < end; c++) {
-        if (fat32_read_fat_entry(c) == FAT32_FREE_CLUSTER) return c;
+    if (hint < 2 || hint >= end) hint = 2;
+
+    if (!g_fs.free_bitmap) {
+        for (uint32_t c = hint; c < end; c++) {
+            if (fat32_read_fat_entry(c) == FAT32_FREE_CLUSTER) return c;
+        }
+        for (uint32_t c = 2; c < hint; c++) {
+            if (fat32_read_fat_entry(c) == FAT32_FREE_CLUSTER) return c;
+        }
+        return 0;
+    }
+
+    uint32_t words = (end + 63) / 64;
+    uint32_t w     = hint >> 6;
+    uint64_t mask  = ~0ULL << (hint & 63);
+
+    for (uint32_t n = 0; n <= words; n++) {
+        uint64_t bits = g_fs.free_bitmap[w] & mask;
+        if (bits) return (w << 6) + (uint32_t)__builtin_ctzll(bits);
+        mask = ~0ULL;
+        w = (w + 1 < words) ? w + 1 : 0;
     }
     return 0;
 }
@@ -343,6 +602,8 @@ static uint32_t fat32_alloc_cluster_raw(void) {
     uint32_t cluster = fat32_find_free_cluster();
     if (!cluster) return 0;
     if (fat32_write_fat_entry(cluster, FAT32_EOC_MAX) != 0) return 0;
+    g_fs.fsinfo.next_free_cluster = cluster + 1;
+    g_fs.fsinfo_dirty = 1;
     return cluster;
 }
 
@@ -358,33 +619,244 @@ static uint32_t fat32_alloc_cluster(void) {
     return cluster;
 }
 
-static uint32_t fat32_last_cluster(uint32_t first_cluster) {
-    if (first_cluster < 2) return 0;
-    uint32_t cluster = first_cluster;
-    uint32_t next = fat32_next_cluster(cluster);
-    while (next != 0) {
-        cluster = next;
-        next = fat32_next_cluster(cluster);
+/* =========================================================================
+ * Per-file cluster chain cache
+ * ======================================================================= */
+
+/*
+ * fat32_file_push_cluster - append cluster to the file's extent list,
+ * growing the current run when it is physically contiguous.
+ * Returns 0 on success, -1 if the list cannot grow.
+ */
+static int fat32_file_push_cluster(struct fat32_file *f, uint32_t cluster) {
+    if (f->extent_count > 0) {
+        struct fat32_extent *last = &f->extents[f->extent_count - 1];
+        if (last->disk_cluster + last->length == cluster) {
+            last->length++;
+            f->mapped_clusters++;
+            return 0;
+        }
+    }
+
+    if (f->extent_count == f->extent_cap) {
+        uint32_t new_cap = f->extent_cap ? f->extent_cap * 2 : 8;
+        struct fat32_extent *grown =
+            (struct fat32_extent *)kmalloc(sizeof(*grown) * new_cap);
+        if (!grown) return -1;
+        if (f->extents) {
+            memcpy(grown, f->extents, sizeof(*grown) * f->extent_count);
+            kfree(f->extents);
+        }
+        f->extents    = grown;
+        f->extent_cap = new_cap;
+    }
+
+    f->extents[f->extent_count].file_cluster = f->mapped_clusters;
+    f->extents[f->extent_count].disk_cluster = cluster;
+    f->extents[f->extent_count].length       = 1;
+    f->extent_count++;
+    f->mapped_clusters++;
+    return 0;
+}
+
+static uint32_t fat32_file_last_cluster(const struct fat32_file *f) {
+    if (f->extent_count == 0) return 0;
+    const struct fat32_extent *last = &f->extents[f->extent_count - 1];
+    return last->disk_cluster + last->length - 1;
+}
+
+/*
+ * fat32_file_map_to - extend the extent list until file cluster index is
+ * covered or the chain ends.  Pass 0xFFFFFFFF to map the whole chain.
+ * Returns 0 on success, -1 on allocation failure or a corrupt chain.
+ */
+static int fat32_file_map_to(struct fat32_file *f, uint32_t index) {
+    if (index < f->mapped_clusters) return 0;
+    if (f->chain_complete) {
+        /* Another descriptor on the file may have appended since */
+        uint32_t tail = fat32_file_last_cluster(f);
+        if (!tail || fat32_next_cluster(tail) == 0) return 0;
+        f->chain_complete = 0;
+    }
+
+    uint32_t cluster;
+    if (f->extent_count == 0) {
+        cluster = f->first_cluster;
+    } else {
+        const struct fat32_extent *last = &f->extents[f->extent_count - 1];
+        cluster = fat32_next_cluster(last->disk_cluster + last->length - 1);
+    }
+
+    while (cluster != 0 && f->mapped_clusters <= index) {
+        if (f->mapped_clusters > g_fs.total_clusters) return -1;  /* loop */
+        if (fat32_file_push_cluster(f, cluster) != 0) return -1;
+        cluster = fat32_next_cluster(cluster);
+    }
+
+    if (cluster == 0) f->chain_complete = 1;
+    return 0;
+}
+
+/*
+ * fat32_file_cluster_at - return the disk cluster holding file cluster index
+ * and, through run, how many clusters follow contiguously (including it).
+ * Sequential access hits the cached hint; random access binary-searches.
+ * Returns 0 if index lies past the end of the chain.
+ */
+static uint32_t fat32_file_cluster_at(struct fat32_file *f,
+                                      uint32_t index,
+                                      uint32_t *run) {
+    if (fat32_file_map_to(f, index) != 0) return 0;
+    if (index >= f->mapped_clusters) return 0;
+
+    uint32_t i = f->extent_hint;
+    if (i >= f->extent_count ||
+        index < f->extents[i].file_cluster ||
+        index >= f->extents[i].file_cluster + f->extents[i].length) {
+        if (i + 1 < f->extent_count &&
+            index >= f->extents[i + 1].file_cluster &&
+            index < f->extents[i + 1].file_cluster + f->extents[i + 1].length) {
+            i++;
+        } else {
+            uint32_t lo = 0;
+            uint32_t hi = f->extent_count;
+            while (hi - lo > 1) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (f->extents[mid].file_cluster <= index) lo = mid;
+                else hi = mid;
+            }
+            i = lo;
+        }
+        f->extent_hint = i;
+    }
+
+    const struct fat32_extent *ext = &f->extents[i];
+    uint32_t skip = index - ext->file_cluster;
+    if (run) *run = ext->length - skip;
+    return ext->disk_cluster + skip;
+}
+
+/* =========================================================================
+ * Directory slots
+ *
+ * A directory entry is named by its directory's first cluster and an index
+ * that runs on across the directory's cluster chain.
+ * ======================================================================= */
+
+/* FAT limits a directory to 65536 entries; one less keeps indices in 16 bits */
+#define FAT32_DIR_MAX_ENTRIES 0xFFFFu
+
+static uint32_t fat32_dir_per_cluster(void) {
+    return g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry);
+}
+
+/*
+ * fat32_dir_slot - find entry index of the directory at dir_cluster.
+ * Returns the cluster holding it and stores its slot in that cluster in
+ * *slot, or returns 0 if the chain ends first.
+ */
+static uint32_t fat32_dir_slot(uint32_t dir_cluster, uint32_t index, uint32_t *slot) {
+    uint32_t per     = fat32_dir_per_cluster();
+    uint32_t cluster = dir_cluster;
+
+    if (index >= FAT32_DIR_MAX_ENTRIES) return 0;
+    for (uint32_t skip = index / per; skip > 0 && cluster != 0; skip--) {
+        cluster = fat32_next_cluster(cluster);
     }
+    *slot = index % per;
     return cluster;
 }
 
+/*
+ * fat32_dir_write_slots - store count entries from src at index first
+ * onward, one read-modify-write per cluster they fall in.
+ * Returns 0 on success, -1 on I/O error or if the chain is too short.
+ */
+static int fat32_dir_write_slots(uint32_t dir_cluster, uint32_t first,
+                                 const struct fat32_dir_entry *src,
+                                 uint32_t count) {
+    uint32_t per = fat32_dir_per_cluster();
+    uint32_t slot;
+    uint32_t cluster = fat32_dir_slot(dir_cluster, first, &slot);
+
+    while (count > 0) {
+        if (cluster == 0) return -1;
+        if (fat32_read_cluster(cluster, cluster_buffer) != 0) return -1;
+
+        uint32_t n = per - slot;
+        if (n > count) n = count;
+        memcpy((struct fat32_dir_entry *)cluster_buffer + slot, src,
+               n * sizeof(*src));
+        if (fat32_write_cluster(cluster, cluster_buffer) != 0) return -1;
+
+        src   += n;
+        count -= n;
+        slot   = 0;
+        if (count > 0) cluster = fat32_next_cluster(cluster);
+    }
+    return 0;
+}
+
+/*
+ * fat32_dir_find_run - find needed consecutive free slots in the directory
+ * at dir_cluster.  When the chain has no such run, zeroed clusters are
+ * linked onto its end.  Returns the index of the first slot, or -1.
+ */
+static int fat32_dir_find_run(uint32_t dir_cluster, uint32_t needed) {
+    uint32_t per   = fat32_dir_per_cluster();
+    uint32_t total = 0;
+    uint32_t run   = 0;
+    uint32_t tail  = dir_cluster;
+
+    for (uint32_t c = dir_cluster; c != 0 && total < FAT32_DIR_MAX_ENTRIES;
+         c = fat32_next_cluster(c)) {
+        if (fat32_read_cluster(c, cluster_buffer) != 0) return -1;
+
+        const struct fat32_dir_entry *dir_entries =
+            (const struct fat32_dir_entry *)cluster_buffer;
+        for (uint32_t s = 0; s < per; s++) {
+            if (dir_entries[s].name[0] == 0x00 || dir_entries[s].name[0] == 0xE5) {
+                if (++run == needed && total + s + 1 <= FAT32_DIR_MAX_ENTRIES) {
+                    return (int)(total + s + 1 - needed);
+                }
+            } else {
+                run = 0;
+            }
+        }
+        tail   = c;
+        total += per;
+    }
+
+    /* Grow the chain; the trailing free run carries on into the new space */
+    while (run < needed) {
+        if (total - run + needed > FAT32_DIR_MAX_ENTRIES) return -1;
+
+        uint32_t c = fat32_alloc_cluster();
+        if (!c) return -1;
+        if (fat32_write_fat_entry(tail, c) != 0) return -1;
+        tail   = c;
+        total += per;
+        run   += per;
+    }
+    return (int)(total - run);
+}
+
 static int fat32_update_entry_cluster(uint32_t dir_cluster,
                                       uint32_t dir_index,
                                       uint32_t new_cluster) {
-    if (fat32_read_cluster(dir_cluster, cluster_buffer) != 0) return -1;
+    uint32_t slot;
+    uint32_t cluster = fat32_dir_slot(dir_cluster, dir_index, &slot);
 
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)cluster_buffer;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
+    if (cluster == 0) return -1;
+    if (fat32_read_cluster(cluster, cluster_buffer) != 0) return -1;
 
-    if ((int)dir_index < 0 || (int)dir_index >= entries_per_cluster) return -1;
+    struct fat32_dir_entry *entry = (struct fat32_dir_entry *)cluster_buffer + slot;
+    entry->first_cluster_low = (uint16_t)(new_cluster & 0xFFFF);
+    entry->first_cluster_high = (uint16_t)((new_cluster >> 16) & 0xFFFF);
 
-    dir_entries[dir_index].first_cluster_low = (uint16_t)(new_cluster & 0xFFFF);
-    dir_entries[dir_index].first_cluster_high = (uint16_t)((new_cluster >> 16) & 0xFFFF);
-
-    if (fat32_write_cluster(dir_cluster, cluster_buffer) != 0) return -1;
+    dcache_invalidate_location(DCACHE_FS_FAT32, dir_cluster, dir_index);
+    fat32_dir_index_update_entry(dir_cluster, dir_index, entry);
+    if (fat32_write_cluster(cluster, cluster_buffer) != 0) return -1;
     return 0;
 }
 
@@ -410,17 +882,16 @@ static int fat32_split_path(const char *path,
         if (*path == '/') {
             if (comp_len > 0) {
                 component[comp_len] = '\0';
-                char formatted_name[11];
-                if (fat32_format_name(component, formatted_name) != 0) return -1;
-
-                struct fat32_dir_entry *entry =
-                    find_entry_in_cluster(current_cluster, formatted_name, NULL);
-                if (!entry) return -1;
-                if (!(entry->attr & FAT32_ATTR_DIRECTORY)) return -1;
+                struct fat32_dir_entry entry;
+                if (fat32_lookup_component(current_cluster, component,
+                                           &entry, NULL) != 0) {
+                    return -1;
+                }
+                if (!(entry.attr & FAT32_ATTR_DIRECTORY)) return -1;
 
                 current_cluster =
-                    ((uint32_t)entry->first_cluster_high << 16) |
-                     entry->first_cluster_low;
+                    ((uint32_t)entry.first_cluster_high << 16) |
+                     entry.first_cluster_low;
                 if (parent_cluster) *parent_cluster = current_cluster;
                 comp_len = 0;
             }
@@ -451,41 +922,75 @@ static int fat32_create_file(const char *path) {
         return -1;
     }
 
-    char formatted_name[11];
-    if (fat32_format_name(name, formatted_name) != 0) return -1;
+    if (!fat32_long_name_valid(name)) return -1;
 
-    if (find_entry_in_cluster(parent_cluster, formatted_name, NULL)) {
+    struct fat32_dir_entry existing;
+    if (fat32_lookup_component(parent_cluster, name, &existing, NULL) == 0) {
         return -1;
     }
 
-    if (fat32_read_cluster(parent_cluster, cluster_buffer) != 0) return -1;
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)cluster_buffer;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
-
-    int free_index = -1;
-    for (int i = 0; i < entries_per_cluster; i++) {
-        if (dir_entries[i].name[0] == 0x00 || dir_entries[i].name[0] == 0xE5) {
-            free_index = i;
-            break;
-        }
+    struct fat32_dir_index *idx = fat32_dir_index_get(parent_cluster);
+    if (!idx) return -1;
+
+    /* Names that fit 8.3 (case included) need no LFN slots */
+    char    formatted_name[11];
+    uint8_t nt_reserved = 0;
+    int     lfn_slots   = 0;
+    if (!fat32_name_needs_lfn(name)) {
+        if (fat32_format_name(name, formatted_name) != 0) return -1;
+        nt_reserved = fat32_short_name_case_flags(name);
+    } else {
+        if (fat32_make_short_alias(idx, name, formatted_name) != 0) return -1;
+        lfn_slots = (int)((strlen(name) + FAT32_LFN_CHARS - 1) / FAT32_LFN_CHARS);
     }
+
+    /* The LFN slots and the short entry must be consecutive */
+    int needed     = lfn_slots + 1;
+    int free_index = fat32_dir_find_run(parent_cluster, (uint32_t)needed);
     if (free_index < 0) return -1;
 
     uint32_t first_cluster = fat32_alloc_cluster_raw();
     if (!first_cluster) return -1;
 
-    struct fat32_dir_entry *entry = &dir_entries[free_index];
+    struct fat32_dir_entry slots[FAT32_MAX_FILENAME / FAT32_LFN_CHARS + 2];
+    uint8_t checksum = fat32_lfn_checksum((const uint8_t *)formatted_name);
+    size_t  name_len = strlen(name);
+    for (int n = lfn_slots; n >= 1; n--) {
+        struct fat32_lfn_entry *lfn =
+            (struct fat32_lfn_entry *)&slots[lfn_slots - n];
+        uint16_t chars[FAT32_LFN_CHARS];
+
+        for (int c = 0; c < FAT32_LFN_CHARS; c++) {
+            size_t at = (size_t)(n - 1) * FAT32_LFN_CHARS + (size_t)c;
+            if (at < name_len)       chars[c] = (uint8_t)name[at];
+            else if (at == name_len) chars[c] = 0x0000;
+            else                     chars[c] = 0xFFFF;
+        }
+
+        memset(lfn, 0, sizeof(*lfn));
+        lfn->order    = (uint8_t)(n | (n == lfn_slots ? FAT32_LFN_LAST_ENTRY : 0));
+        lfn->attr     = FAT32_ATTR_LONG_NAME;
+        lfn->checksum = checksum;
+        for (int c = 0; c < 5; c++) lfn->name1[c] = chars[c];
+        for (int c = 0; c < 6; c++) lfn->name2[c] = chars[5 + c];
+        for (int c = 0; c < 2; c++) lfn->name3[c] = chars[11 + c];
+    }
+
+    struct fat32_dir_entry *entry = &slots[lfn_slots];
     memset(entry, 0, sizeof(struct fat32_dir_entry));
     memcpy(entry->name, formatted_name, 11);
     entry->attr = FAT32_ATTR_ARCHIVE;
-    entry->nt_reserved = fat32_short_name_case_flags(name);
+    entry->nt_reserved = nt_reserved;
     entry->first_cluster_low  = (uint16_t)(first_cluster & 0xFFFF);
     entry->first_cluster_high = (uint16_t)((first_cluster >> 16) & 0xFFFF);
     entry->file_size = 0;
 
-    if (fat32_write_cluster(parent_cluster, cluster_buffer) != 0) return -1;
+    dcache_invalidate(DCACHE_FS_FAT32, parent_cluster, name);
+    fat32_dir_index_drop(parent_cluster);
+    if (fat32_dir_write_slots(parent_cluster, (uint32_t)free_index,
+                              slots, (uint32_t)needed) != 0) {
+        return -1;
+    }
     if (fat32_zero_cluster(first_cluster) != 0) return -1;
 
     return 0;
@@ -591,130 +1096,664 @@ void fat32_parse_short_name(const uint8_t *short_name,
     long_name[pos] = '\0';
 }
 
-/* =========================================================================
- * Internal directory search helpers
- * ======================================================================= */
-
-/*
- * find_entry_in_cluster - scan one cluster's worth of directory entries for
- * a name matching formatted_name (11 bytes, 8.3 format).
- *
- * Returns a pointer to a static copy of the matching entry, or NULL if not
- * found.  The copy is overwritten on each call.
- */
-static struct fat32_dir_entry *find_entry_in_cluster(uint32_t cluster,
-                                                     char *formatted_name,
-                                                     int *entry_index) {
-    static struct fat32_dir_entry result;
-
-    if (fat32_read_cluster(cluster, cluster_buffer) != 0) return NULL;
-
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)cluster_buffer;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
-
-    for (int i = 0; i < entries_per_cluster; i++) {
-        struct fat32_dir_entry *entry = &dir_entries[i];
-
-        if (entry->name[0] == 0x00) break;           /* end of directory */
-        if (entry->name[0] == 0xE5) continue;         /* deleted entry    */
-        if (entry->attr == FAT32_ATTR_LONG_NAME) continue; /* LFN entry   */
-
-        if (memcmp(entry->name, formatted_name, 11) == 0) {
-            memcpy(&result, entry, sizeof(struct fat32_dir_entry));
-            if (entry_index) *entry_index = i;
-            return &result;
+/* =========================================================================
+ * Long file names
+ * ======================================================================= */
+
+/*
+ * fat32_lfn_checksum - checksum of an 11-byte short name, stored in every
+ * LFN slot that belongs to it.
+ */
+static uint8_t fat32_lfn_checksum(const uint8_t *short_name) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + short_name[i]);
+    }
+    return sum;
+}
+
+/*
+ * fat32_long_name_valid - accept names that can be stored as a VFAT long
+ * name by this driver: printable ASCII, no reserved characters, no trailing
+ * dot or space, and short enough for struct fat32_dirent.
+ */
+static int fat32_long_name_valid(const char *name) {
+    size_t len = strlen(name);
+
+    if (len == 0 || len >= FAT32_MAX_FILENAME) return 0;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+    if (name[len - 1] == '.' || name[len - 1] == ' ') return 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c < 0x20 || c > 0x7E) return 0;
+        if (c == '"' || c == '*' || c == '/' || c == ':' || c == '<' ||
+            c == '>' || c == '?' || c == '\\' || c == '|') {
+            return 0;
         }
-    }
-
-    return NULL;
-}
-
-/*
- * find_entry - traverse path components from the current (or root) directory,
- * returning a pointer to the final directory entry, or NULL if not found.
- *
- * If parent_cluster is non-NULL, it receives the cluster number of the
- * directory containing the returned entry.
- *
- * Paths beginning with '/' are resolved from the root cluster.
- * All other paths are resolved from g_fs.current_directory.
- */
-static struct fat32_dir_entry *find_entry(const char *path,
-                                          uint32_t   *parent_cluster,
-                                          int        *entry_index) {
-    char     formatted_name[11];
-    uint32_t current_cluster = g_fs.current_directory;
-
-    if (path[0] == '/') {
-        current_cluster = g_fs.boot.root_cluster;
-        path++;
-    }
-
-    if (parent_cluster) *parent_cluster = current_cluster;
-    if (path[0] == '\0') return NULL;
-
-    /* Walk each path component separated by '/' */
-    char component[256];
-    int  comp_len = 0;
-
-    while (*path) {
-        if (*path == '/') {
-            if (comp_len > 0) {
-                component[comp_len] = '\0';
-                if (fat32_format_name(component, formatted_name) != 0) return NULL;
-
-                struct fat32_dir_entry *entry =
-                    find_entry_in_cluster(current_cluster, formatted_name, NULL);
-                if (!entry) return NULL;
-                if (!(entry->attr & FAT32_ATTR_DIRECTORY)) return NULL;
-
-                if (parent_cluster) *parent_cluster = current_cluster;
-                current_cluster =
-                    ((uint32_t)entry->first_cluster_high << 16) |
-                     entry->first_cluster_low;
-                comp_len = 0;
-            }
-            path++;
-        } else {
-            if (comp_len < 255) component[comp_len++] = *path;
-            path++;
-        }
-    }
-
-    /* Resolve the final component */
-    if (comp_len > 0) {
-        component[comp_len] = '\0';
-        if (fat32_format_name(component, formatted_name) != 0) return NULL;
-        if (parent_cluster) *parent_cluster = current_cluster;
-        return find_entry_in_cluster(current_cluster, formatted_name, entry_index);
     }
+    return 1;
+}
 
-    return NULL;
+static int fat32_short_char_valid(char c) {
+    if (c <= ' ' || c > 0x7E) return 0;
+    return !(c == '+' || c == ',' || c == ';' || c == '=' ||
+             c == '[' || c == ']' || c == '.');
 }
-
-/* =========================================================================
- * Filesystem mount / unmount
- * ======================================================================= */
-
-/*
- * fat32_init - verify a disk is present and clear driver state.
- * Returns 0 on success, -1 if no ATA disk is detected.
- */
-int fat32_init(void) {
-    vga_writestring("FAT32: Initializing filesystem driver...\n");
-
-    memset(&g_fs,      0, sizeof(g_fs));
-    memset(g_fd_table, 0, sizeof(g_fd_table));
-
-    if (!ata_primary_master.exists && !ramdisk_available()) {
-        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
-        vga_writestring("FAT32: ERROR - No disk detected!\n");
-        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
-        return -1;
+
+/*
+ * fat32_name_needs_lfn - return 1 if name cannot be stored losslessly as an
+ * 8.3 short name plus the NT case flags.
+ */
+static int fat32_name_needs_lfn(const char *name) {
+    const char *dot      = strstr(name, ".");
+    int         name_len = dot ? (int)(dot - name) : (int)strlen(name);
+    int         ext_len  = dot ? (int)strlen(dot + 1) : 0;
+
+    if (name_len == 0 || name_len > 8 || ext_len > 3) return 1;
+    if (dot && strstr(dot + 1, ".")) return 1;
+
+    for (int i = 0; i < name_len; i++) {
+        if (!fat32_short_char_valid(name[i])) return 1;
     }
-
+    for (int i = 0; i < ext_len; i++) {
+        if (!fat32_short_char_valid(dot[1 + i])) return 1;
+    }
+
+    /* Mixed case in either part cannot be expressed by the case flags */
+    if (fat32_component_has_lowercase(name, name_len) &&
+        fat32_component_has_uppercase(name, name_len)) {
+        return 1;
+    }
+    if (ext_len > 0 &&
+        fat32_component_has_lowercase(dot + 1, ext_len) &&
+        fat32_component_has_uppercase(dot + 1, ext_len)) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * fat32_make_short_alias - build a unique BASE~N.EXT short name for a long
+ * name, checking candidates against the directory's name index.
+ * Returns 0 on success, -1 if no free alias exists.
+ */
+static int fat32_make_short_alias(struct fat32_dir_index *idx,
+                                  const char *name, char *short_name) {
+    char        base[8];
+    char        ext[3];
+    int         base_len = 0;
+    int         ext_len  = 0;
+    const char *last_dot = NULL;
+
+    for (const char *p = name; *p; p++) {
+        if (*p == '.') last_dot = p;
+    }
+    if (last_dot == name) last_dot = NULL;   /* ".profile" has no extension */
+
+    for (const char *p = name; *p && p != last_dot && base_len < 8; p++) {
+        char c = *p;
+        if (c == ' ' || c == '.') continue;
+        if (c >= 'a' && c <= 'z') c = (char)(c - 32);
+        base[base_len++] = fat32_short_char_valid(c) ? c : '_';
+    }
+    if (last_dot) {
+        for (const char *p = last_dot + 1; *p && ext_len < 3; p++) {
+            char c = *p;
+            if (c == ' ') continue;
+            if (c >= 'a' && c <= 'z') c = (char)(c - 32);
+            ext[ext_len++] = fat32_short_char_valid(c) ? c : '_';
+        }
+    }
+    if (base_len == 0) base[base_len++] = '_';
+
+    for (uint32_t n = 1; n < 1000000; n++) {
+        char tail[8];
+        int  tail_len = 0;
+        uint32_t v = n;
+        char digits[7];
+        int  nd = 0;
+
+        while (v) {
+            digits[nd++] = (char)('0' + (v % 10));
+            v /= 10;
+        }
+        tail[tail_len++] = '~';
+        while (nd) tail[tail_len++] = digits[--nd];
+
+        int keep = base_len;
+        if (keep > 8 - tail_len) keep = 8 - tail_len;
+
+        memset(short_name, ' ', 11);
+        memcpy(short_name, base, (size_t)keep);
+        memcpy(short_name + keep, tail, (size_t)tail_len);
+        memcpy(short_name + 8, ext, (size_t)ext_len);
+
+        if (!fat32_dir_index_has_short(idx, short_name)) return 0;
+    }
+    return -1;
+}
+
+/*
+ * LFN assembly while walking a directory.  fat32_lfn_feed() consumes LFN
+ * slots in on-disk order (highest sequence number first); fat32_lfn_take()
+ * is called for the short entry that follows and yields the long name only
+ * if the sequence was complete and the checksum matches the short name.
+ */
+struct fat32_lfn_state {
+    char    name[FAT32_MAX_FILENAME];
+    uint8_t checksum;
+    uint8_t next_order;             /* Sequence number expected next */
+    int     first_slot;             /* Slot index of the first LFN entry */
+    int     active;
+};
+
+static void fat32_lfn_reset(struct fat32_lfn_state *st) {
+    st->active     = 0;
+    st->next_order = 0;
+}
+
+static int fat32_lfn_feed(struct fat32_lfn_state *st,
+                          const struct fat32_dir_entry *entry,
+                          int slot) {
+    if (entry->attr != FAT32_ATTR_LONG_NAME) return 0;
+
+    const struct fat32_lfn_entry *lfn = (const struct fat32_lfn_entry *)entry;
+    uint8_t order = lfn->order & FAT32_LFN_ORDER_MASK;
+
+    if (lfn->order & FAT32_LFN_LAST_ENTRY) {
+        st->active     = 1;
+        st->checksum   = lfn->checksum;
+        st->first_slot = slot;
+        st->next_order = order;
+        memset(st->name, 0, sizeof(st->name));
+    }
+
+    if (!st->active || order == 0 || order != st->next_order ||
+        lfn->checksum != st->checksum) {
+        fat32_lfn_reset(st);
+        return 1;
+    }
+
+    uint16_t chars[FAT32_LFN_CHARS];
+    for (int c = 0; c < 5; c++) chars[c]      = lfn->name1[c];
+    for (int c = 0; c < 6; c++) chars[5 + c]  = lfn->name2[c];
+    for (int c = 0; c < 2; c++) chars[11 + c] = lfn->name3[c];
+
+    int base = (order - 1) * FAT32_LFN_CHARS;
+    for (int c = 0; c < FAT32_LFN_CHARS; c++) {
+        if (chars[c] == 0x0000 || chars[c] == 0xFFFF) break;
+        if (base + c >= FAT32_MAX_FILENAME - 1) break;
+        st->name[base + c] = (chars[c] < 0x80) ? (char)chars[c] : '?';
+    }
+
+    st->next_order = (uint8_t)(order - 1);
+    return 1;
+}
+
+static void fat32_lfn_take(struct fat32_lfn_state *st,
+                           const struct fat32_dir_entry *entry,
+                           int slot,
+                           char *name,
+                           int *first_slot) {
+    if (st->active && st->next_order == 0 && st->name[0] != '\0' &&
+        st->checksum == fat32_lfn_checksum(entry->name)) {
+        memcpy(name, st->name, FAT32_MAX_FILENAME);
+        if (first_slot) *first_slot = st->first_slot;
+    } else {
+        fat32_parse_short_name(entry->name, entry->nt_reserved, name);
+        if (first_slot) *first_slot = slot;
+    }
+    fat32_lfn_reset(st);
+}
+
+/* =========================================================================
+ * Directory name index
+ * ======================================================================= */
+
+#define FAT32_DIR_INDEX_SLOTS 16
+#define FAT32_INDEX_EMPTY     0xFFFF
+
+struct fat32_name_rec {
+    uint32_t hash;                  /* Hash of the folded display name */
+    uint32_t alias_hash;            /* Hash of the folded short alias */
+    uint32_t name_off;              /* Display name in the string pool */
+    uint32_t alias_off;             /* Short alias in the string pool */
+    uint16_t entry_index;           /* Slot of the short entry */
+    uint16_t first_slot;            /* First LFN slot, or entry_index */
+    struct fat32_dir_entry dirent;  /* Copy of the short entry */
+};
+
+struct fat32_dir_index {
+    uint32_t cluster;
+    int      in_use;
+    uint32_t count;
+    struct fat32_name_rec *recs;    /* In directory order */
+    uint16_t *buckets;              /* Open addressing, rec index per slot */
+    uint32_t bucket_mask;
+    char     *pool;
+    uint32_t pool_len;
+    uint32_t pool_cap;
+};
+
+static struct fat32_dir_index g_dir_index[FAT32_DIR_INDEX_SLOTS];
+static uint32_t               g_dir_index_victim;
+
+static char fat32_fold(char c) {
+    if (c >= 'a' && c <= 'z') return (char)(c - 32);
+    return c;
+}
+
+static uint32_t fat32_name_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p; p++) {
+        h = (h ^ (uint8_t)fat32_fold(*p)) * 16777619u;
+    }
+    return h;
+}
+
+static int fat32_name_equal(const char *a, const char *b) {
+    while (*a && *b) {
+        if (fat32_fold(*a) != fat32_fold(*b)) return 0;
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static void fat32_dir_index_free(struct fat32_dir_index *idx) {
+    if (idx->recs)    kfree(idx->recs);
+    if (idx->buckets) kfree(idx->buckets);
+    if (idx->pool)    kfree(idx->pool);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static int fat32_dir_index_add_string(struct fat32_dir_index *idx,
+                                      const char *s,
+                                      uint32_t *off) {
+    uint32_t len = (uint32_t)strlen(s) + 1;
+
+    if (idx->pool_len + len > idx->pool_cap) {
+        uint32_t new_cap = idx->pool_cap ? idx->pool_cap * 2 : 512;
+        while (new_cap < idx->pool_len + len) new_cap *= 2;
+        char *grown = (char *)kmalloc(new_cap);
+        if (!grown) return -1;
+        if (idx->pool) {
+            memcpy(grown, idx->pool, idx->pool_len);
+            kfree(idx->pool);
+        }
+        idx->pool     = grown;
+        idx->pool_cap = new_cap;
+    }
+
+    memcpy(idx->pool + idx->pool_len, s, len);
+    *off = idx->pool_len;
+    idx->pool_len += len;
+    return 0;
+}
+
+static void fat32_dir_index_insert(struct fat32_dir_index *idx,
+                                   uint32_t hash, uint16_t rec) {
+    uint32_t i = hash & idx->bucket_mask;
+    while (idx->buckets[i] != FAT32_INDEX_EMPTY) i = (i + 1) & idx->bucket_mask;
+    idx->buckets[i] = rec;
+}
+
+/* Double the record array once it is full */
+static int fat32_dir_index_grow(struct fat32_dir_index *idx, uint32_t *cap) {
+    uint32_t new_cap = *cap * 2;
+    struct fat32_name_rec *grown =
+        (struct fat32_name_rec *)kmalloc(sizeof(*grown) * (size_t)new_cap);
+    if (!grown) return -1;
+
+    memcpy(grown, idx->recs, sizeof(*grown) * (size_t)idx->count);
+    kfree(idx->recs);
+    idx->recs = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+/*
+ * fat32_dir_index_build - parse a directory's whole cluster chain into idx.
+ * Returns 0 on success, -1 on I/O or allocation failure.
+ */
+static int fat32_dir_index_build(struct fat32_dir_index *idx, uint32_t cluster) {
+    uint32_t per     = fat32_dir_per_cluster();
+    uint32_t rec_cap = per;
+    uint32_t base    = 0;
+    int      done    = 0;
+
+    idx->cluster = cluster;
+    idx->recs = (struct fat32_name_rec *)kmalloc(sizeof(struct fat32_name_rec) *
+                                                 (size_t)rec_cap);
+    if (!idx->recs) return -1;
+
+    struct fat32_lfn_state lfn;
+    char name[FAT32_MAX_FILENAME];
+    char alias[13];
+    fat32_lfn_reset(&lfn);
+
+    for (uint32_t c = cluster; c != 0 && !done; c = fat32_next_cluster(c)) {
+        if (fat32_read_cluster(c, cluster_buffer) != 0) return -1;
+
+        const struct fat32_dir_entry *dir_entries =
+            (const struct fat32_dir_entry *)cluster_buffer;
+
+        for (uint32_t s = 0; s < per; s++) {
+            const struct fat32_dir_entry *e = &dir_entries[s];
+            int i = (int)(base + s);
+
+            if (base + s >= FAT32_DIR_MAX_ENTRIES || e->name[0] == 0x00) {
+                done = 1;                                /* end of directory */
+                break;
+            }
+            if (e->name[0] == 0xE5) {                    /* deleted entry    */
+                fat32_lfn_reset(&lfn);
+                continue;
+            }
+            if (fat32_lfn_feed(&lfn, e, i)) continue;    /* LFN slot        */
+            if (e->attr & FAT32_ATTR_VOLUME_ID) {        /* volume label    */
+                fat32_lfn_reset(&lfn);
+                continue;
+            }
+
+            if (idx->count == rec_cap && fat32_dir_index_grow(idx, &rec_cap) != 0) {
+                return -1;
+            }
+            struct fat32_name_rec *rec = &idx->recs[idx->count];
+            int first_slot = i;
+
+            fat32_lfn_take(&lfn, e, i, name, &first_slot);
+            fat32_parse_short_name(e->name, e->nt_reserved, alias);
+
+            if (fat32_dir_index_add_string(idx, name, &rec->name_off) != 0 ||
+                fat32_dir_index_add_string(idx, alias, &rec->alias_off) != 0) {
+                return -1;
+            }
+            rec->hash        = fat32_name_hash(name);
+            rec->alias_hash  = fat32_name_hash(alias);
+            rec->entry_index = (uint16_t)i;
+            rec->first_slot  = (uint16_t)first_slot;
+            memcpy(&rec->dirent, e, sizeof(rec->dirent));
+            idx->count++;
+        }
+        base += per;
+    }
+
+    uint32_t buckets = 16;
+    while (buckets < idx->count * 4) buckets <<= 1;
+    idx->buckets = (uint16_t *)kmalloc(sizeof(uint16_t) * buckets);
+    if (!idx->buckets) return -1;
+    memset(idx->buckets, 0xFF, sizeof(uint16_t) * buckets);
+    idx->bucket_mask = buckets - 1;
+
+    for (uint32_t r = 0; r < idx->count; r++) {
+        struct fat32_name_rec *rec = &idx->recs[r];
+        fat32_dir_index_insert(idx, rec->hash, (uint16_t)r);
+        if (!fat32_name_equal(idx->pool + rec->name_off,
+                              idx->pool + rec->alias_off)) {
+            fat32_dir_index_insert(idx, rec->alias_hash, (uint16_t)r);
+        }
+    }
+
+    idx->in_use = 1;
+    return 0;
+}
+
+/*
+ * fat32_dir_index_get - return the name index for a directory cluster,
+ * building it on first use.  Returns NULL on failure.
+ */
+static struct fat32_dir_index *fat32_dir_index_get(uint32_t cluster) {
+    struct fat32_dir_index *slot = NULL;
+
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        if (g_dir_index[i].in_use && g_dir_index[i].cluster == cluster) {
+            return &g_dir_index[i];
+        }
+        if (!slot && !g_dir_index[i].in_use) slot = &g_dir_index[i];
+    }
+
+    if (!slot) {
+        slot = &g_dir_index[g_dir_index_victim];
+        g_dir_index_victim = (g_dir_index_victim + 1) % FAT32_DIR_INDEX_SLOTS;
+    }
+    fat32_dir_index_free(slot);
+
+    if (fat32_dir_index_build(slot, cluster) != 0) {
+        fat32_dir_index_free(slot);
+        return NULL;
+    }
+    return slot;
+}
+
+static void fat32_dir_index_drop(uint32_t cluster) {
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        if (g_dir_index[i].in_use && g_dir_index[i].cluster == cluster) {
+            fat32_dir_index_free(&g_dir_index[i]);
+        }
+    }
+}
+
+static void fat32_dir_index_drop_all(void) {
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        fat32_dir_index_free(&g_dir_index[i]);
+    }
+    g_dir_index_victim = 0;
+}
+
+/*
+ * fat32_dir_index_rec_at - binary-search the record for a short entry slot.
+ */
+static struct fat32_name_rec *fat32_dir_index_rec_at(struct fat32_dir_index *idx,
+                                                     uint32_t entry_index) {
+    uint32_t lo = 0;
+    uint32_t hi = idx->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (idx->recs[mid].entry_index == entry_index) return &idx->recs[mid];
+        if (idx->recs[mid].entry_index < entry_index) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+/*
+ * fat32_dir_index_update_entry - refresh the cached copy of a short entry
+ * after it was rewritten on disk.  Directories not indexed are ignored.
+ */
+static void fat32_dir_index_update_entry(uint32_t cluster, uint32_t entry_index,
+                                         const struct fat32_dir_entry *entry) {
+    for (int i = 0; i < FAT32_DIR_INDEX_SLOTS; i++) {
+        if (!g_dir_index[i].in_use || g_dir_index[i].cluster != cluster) continue;
+        struct fat32_name_rec *rec = fat32_dir_index_rec_at(&g_dir_index[i], entry_index);
+        if (rec) memcpy(&rec->dirent, entry, sizeof(rec->dirent));
+    }
+}
+
+/*
+ * fat32_dir_index_find - look name up by long name or short alias,
+ * case-insensitively.  Returns the record index or -1.
+ */
+static int fat32_dir_index_find(struct fat32_dir_index *idx, const char *name) {
+    uint32_t h = fat32_name_hash(name);
+
+    for (uint32_t i = h & idx->bucket_mask; ; i = (i + 1) & idx->bucket_mask) {
+        uint16_t r = idx->buckets[i];
+        if (r == FAT32_INDEX_EMPTY) return -1;
+
+        const struct fat32_name_rec *rec = &idx->recs[r];
+        if ((rec->hash == h &&
+             fat32_name_equal(idx->pool + rec->name_off, name)) ||
+            (rec->alias_hash == h &&
+             fat32_name_equal(idx->pool + rec->alias_off, name))) {
+            return (int)r;
+        }
+    }
+}
+
+static int fat32_dir_index_has_short(struct fat32_dir_index *idx,
+                                     const char *short_name) {
+    for (uint32_t r = 0; r < idx->count; r++) {
+        if (memcmp(idx->recs[r].dirent.name, short_name, 11) == 0) return 1;
+    }
+    return 0;
+}
+
+/*
+ * fat32_entry_name - copy the display name (long name when present) of the
+ * short entry at entry_index in dir_cluster.  Falls back to the short name.
+ */
+static void fat32_entry_name(uint32_t dir_cluster,
+                             int entry_index,
+                             const struct fat32_dir_entry *entry,
+                             char *name) {
+    struct fat32_dir_index *idx = fat32_dir_index_get(dir_cluster);
+    struct fat32_name_rec  *rec = NULL;
+
+    if (idx && entry_index >= 0) rec = fat32_dir_index_rec_at(idx, (uint32_t)entry_index);
+    if (rec) {
+        memcpy(name, idx->pool + rec->name_off,
+               strlen(idx->pool + rec->name_off) + 1);
+        return;
+    }
+    fat32_parse_short_name(entry->name, entry->nt_reserved, name);
+}
+
+/* =========================================================================
+ * Internal directory search helpers
+ * ======================================================================= */
+
+/*
+ * fat32_lookup_component - resolve one path component inside dir_cluster.
+ * The dcache is consulted first; on a miss the directory's name index is
+ * searched and the outcome, found or not, is recorded for next time.
+ * Returns 0 and fills out on success, -1 if not found or on error.
+ */
+static int fat32_lookup_component(uint32_t dir_cluster,
+                                  const char *component,
+                                  struct fat32_dir_entry *out,
+                                  int *entry_index) {
+    struct dcache_hit hit;
+
+    int cached = dcache_lookup(DCACHE_FS_FAT32, dir_cluster, component, &hit);
+    if (cached == DCACHE_NEGATIVE) return -1;
+    if (cached == DCACHE_HIT) {
+        memcpy(out, hit.data, sizeof(*out));
+        if (entry_index) *entry_index = (int)hit.loc_index;
+        return 0;
+    }
+
+    struct fat32_dir_index *idx = fat32_dir_index_get(dir_cluster);
+    if (!idx) return -1;
+
+    int r = fat32_dir_index_find(idx, component);
+    if (r < 0) {
+        dcache_insert_negative(DCACHE_FS_FAT32, dir_cluster, component);
+        return -1;
+    }
+
+    const struct fat32_name_rec *rec = &idx->recs[r];
+    memcpy(out, &rec->dirent, sizeof(*out));
+    dcache_insert(DCACHE_FS_FAT32, dir_cluster, component,
+                  dir_cluster, rec->entry_index, out, sizeof(*out));
+    if (entry_index) *entry_index = rec->entry_index;
+    return 0;
+}
+
+/*
+ * find_entry - traverse path components from the current (or root) directory
+ * and copy the final directory entry into out.
+ *
+ * If parent_cluster is non-NULL, it receives the cluster number of the
+ * directory containing the returned entry.
+ *
+ * Paths beginning with '/' are resolved from the root cluster.
+ * All other paths are resolved from g_fs.current_directory.
+ *
+ * Returns 0 on success, -1 if any component is missing.
+ */
+static int find_entry(const char             *path,
+                      struct fat32_dir_entry *out,
+                      uint32_t               *parent_cluster,
+                      int                    *entry_index) {
+    uint32_t current_cluster = g_fs.current_directory;
+
+    if (path[0] == '/') {
+        current_cluster = g_fs.boot.root_cluster;
+        path++;
+    }
+
+    if (parent_cluster) *parent_cluster = current_cluster;
+    if (path[0] == '\0') return -1;
+
+    /* Walk each path component separated by '/' */
+    char component[256];
+    int  comp_len = 0;
+
+    while (*path) {
+        if (*path == '/') {
+            if (comp_len > 0) {
+                component[comp_len] = '\0';
+
+                struct fat32_dir_entry entry;
+                if (fat32_lookup_component(current_cluster, component,
+                                           &entry, NULL) != 0) {
+                    return -1;
+                }
+                if (!(entry.attr & FAT32_ATTR_DIRECTORY)) return -1;
+
+                if (parent_cluster) *parent_cluster = current_cluster;
+                current_cluster =
+                    ((uint32_t)entry.first_cluster_high << 16) |
+                     entry.first_cluster_low;
+                comp_len = 0;
+            }
+            path++;
+        } else {
+            if (comp_len < 255) component[comp_len++] = *path;
+            path++;
+        }
+    }
+
+    /* Resolve the final component */
+    if (comp_len > 0) {
+        component[comp_len] = '\0';
+        if (parent_cluster) *parent_cluster = current_cluster;
+        return fat32_lookup_component(current_cluster, component,
+                                      out, entry_index);
+    }
+
+    return -1;
+}
+
+/* =========================================================================
+ * Filesystem mount / unmount
+ * ======================================================================= */
+
+/*
+ * fat32_init - verify a disk is present and clear driver state.
+ * Returns 0 on success, -1 if no ATA disk is detected.
+ */
+int fat32_init(void) {
+    vga_writestring("FAT32: Initializing filesystem driver...\n");
+
+    if (g_fs.fat_cache)   kfree(g_fs.fat_cache);
+    if (g_fs.free_bitmap) kfree(g_fs.free_bitmap);
+    fat32_dir_index_drop_all();
+    memset(&g_fs,      0, sizeof(g_fs));
+    if (g_fd_table) kfree(g_fd_table);
+    g_fd_table = NULL;
+    g_fd_count = 0;
+
+    if (!ata_primary_master.exists && !ramdisk_available()) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        vga_writestring("FAT32: ERROR - No disk detected!\n");
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return -1;
+    }
+
     vga_writestring("FAT32: Driver initialized\n");
     return 0;
 }
@@ -758,9 +1797,18 @@ int fat32_mount(void) {
                               g_fs.boot.bytes_per_sector;
 
     /* Read FSInfo if the boot sector points to a valid sector */
+    g_fs.fsinfo_valid = 0;
+    g_fs.fsinfo_dirty = 0;
     if (g_fs.boot.fs_info_sector != 0 &&
-        g_fs.boot.fs_info_sector != 0xFFFF) {
-        fat32_read_sector(g_fs.boot.fs_info_sector, &g_fs.fsinfo);
+        g_fs.boot.fs_info_sector != 0xFFFF &&
+        fat32_read_sector(g_fs.boot.fs_info_sector, &g_fs.fsinfo) == 0 &&
+        g_fs.fsinfo.lead_signature == FAT32_FSINFO_LEAD_SIG &&
+        g_fs.fsinfo.struct_signature == FAT32_FSINFO_STRUCT_SIG &&
+        g_fs.fsinfo.trail_signature == FAT32_FSINFO_TRAIL_SIG) {
+        g_fs.fsinfo_valid = 1;
+    } else {
+        g_fs.fsinfo.free_clusters = FAT32_FSINFO_UNKNOWN;
+        g_fs.fsinfo.next_free_cluster = FAT32_FSINFO_UNKNOWN;
     }
 
     if (g_fs.bytes_per_cluster > sizeof(cluster_buffer)) {
@@ -768,12 +1816,18 @@ int fat32_mount(void) {
         return -1;
     }
 
+    fat32_load_fat();
+
+    dcache_invalidate_fs(DCACHE_FS_FAT32);
+    fat32_dir_index_drop_all();
+
     g_fs.current_directory = g_fs.boot.root_cluster;
-    struct fat32_dir_entry *home = find_entry("/home", NULL, NULL);
-    if (home && (home->attr & FAT32_ATTR_DIRECTORY)) {
+    struct fat32_dir_entry home;
+    if (find_entry("/home", &home, NULL, NULL) == 0 &&
+        (home.attr & FAT32_ATTR_DIRECTORY)) {
         g_fs.current_directory =
-            ((uint32_t)home->first_cluster_high << 16) |
-             home->first_cluster_low;
+            ((uint32_t)home.first_cluster_high << 16) |
+             home.first_cluster_low;
     }
     g_fs.mounted           = 1;
 
@@ -798,23 +1852,270 @@ void fat32_set_current_directory(uint32_t cluster) {
  * File operations
  * ======================================================================= */
 
+static int fat32_update_entry_size(uint32_t dir_cluster,
+                                   uint32_t dir_index,
+                                   uint32_t new_size);
+
+/* =========================================================================
+ * Read-ahead and write-behind
+ * ======================================================================= */
+
+static uint32_t fat32_stream_max_clusters(void) {
+    uint32_t n = FAT32_STREAM_BYTES / g_fs.bytes_per_cluster;
+    return n ? n : 1;
+}
+
+static int fat32_range_overlaps(uint32_t first, uint32_t count,
+                                uint32_t lo, uint32_t hi) {
+    return first < hi && lo < first + count;
+}
+
+/* Whether g is another descriptor open on the same directory entry as f */
+static int fat32_same_file(const struct fat32_file *f, const struct fat32_file *g) {
+    return g != f && g->in_use &&
+           g->dir_cluster == f->dir_cluster && g->dir_index == f->dir_index;
+}
+
+/*
+ * fat32_stream_forget - f just wrote file clusters [first, end) to disk, so
+ * drop what other descriptors on the file cached of them.  Those windows
+ * are clean: fat32_file_claim() flushed them before f's access began.
+ */
+static void fat32_stream_forget(const struct fat32_file *f, uint32_t first, uint32_t end) {
+    for (int i = 0; i < g_fd_count; i++) {
+        struct fat32_file *g = &g_fd_table[i];
+        if (!fat32_same_file(f, g) || g->dirty_first != g->dirty_end) continue;
+        if (fat32_range_overlaps(g->stream_first, g->stream_count, first, end)) {
+            g->stream_count = 0;
+        }
+    }
+}
+
+/*
+ * fat32_stream_flush - write the dirty part of the window back, one
+ * multi-sector transfer per physically contiguous run.
+ * Returns 0 on success, -1 on I/O error.
+ */
+static int fat32_stream_flush(struct fat32_file *f) {
+    uint32_t bpc = g_fs.bytes_per_cluster;
+    uint32_t idx = f->dirty_first;
+
+    if (f->dirty_first != f->dirty_end) {
+        fat32_stream_forget(f, f->dirty_first, f->dirty_end);
+    }
+
+    while (idx < f->dirty_end) {
+        uint32_t run     = 0;
+        uint32_t cluster = fat32_file_cluster_at(f, idx, &run);
+        if (!cluster) return -1;
+        if (run > f->dirty_end - idx) run = f->dirty_end - idx;
+
+        if (fat32_write_sectors(fat32_cluster_sector(cluster),
+                                run * g_fs.boot.sectors_per_cluster,
+                                f->stream + (idx - f->stream_first) * bpc) != 0) {
+            f->dirty_first = idx;
+            return -1;
+        }
+        idx += run;
+    }
+
+    f->dirty_first = 0;
+    f->dirty_end   = 0;
+    return 0;
+}
+
+/*
+ * fat32_file_sync - write back buffered data and a deferred size change.
+ * Returns 0 on success, -1 on I/O error.
+ */
+static int fat32_file_sync(struct fat32_file *f) {
+    if (fat32_stream_flush(f) != 0) return -1;
+    if (f->size_dirty) {
+        if (fat32_update_entry_size(f->dir_cluster, f->dir_index, f->size) != 0) {
+            return -1;
+        }
+        f->size_dirty = 0;
+    }
+    return 0;
+}
+
+/*
+ * fat32_sync_entry - sync every descriptor open on the directory entry at
+ * (dir_cluster, dir_index), or on any entry of dir_cluster when dir_index
+ * is negative, so the on-disk entry and data are current.
+ * Returns 1 if something was written, 0 if nothing was pending, -1 on error.
+ */
+static int fat32_sync_entry(uint32_t dir_cluster, int dir_index) {
+    int synced = 0;
+
+    for (int i = 0; i < g_fd_count; i++) {
+        struct fat32_file *f = &g_fd_table[i];
+        if (!f->in_use || f->dir_cluster != dir_cluster) continue;
+        if (dir_index >= 0 && f->dir_index != (uint32_t)dir_index) continue;
+        if (!f->size_dirty && f->dirty_first == f->dirty_end) continue;
+        if (fat32_file_sync(f) != 0) return -1;
+        synced = 1;
+    }
+    return synced;
+}
+
+/*
+ * fat32_file_claim - bring f up to date before it is accessed.  Write-behind
+ * data lives in one descriptor's window, so other descriptors on the same
+ * file flush theirs (dropping what f cached of it), and f adopts a larger
+ * size or a first cluster they have not written to the entry yet.  At most
+ * one descriptor per file is therefore ever dirty.
+ * Returns 0 on success, -1 on I/O error.
+ */
+static int fat32_file_claim(struct fat32_file *f) {
+    for (int i = 0; i < g_fd_count; i++) {
+        struct fat32_file *g = &g_fd_table[i];
+        if (!fat32_same_file(f, g)) continue;
+
+        if (fat32_stream_flush(g) != 0) return -1;
+        if (g->size > f->size) f->size = g->size;
+        if (f->first_cluster == 0 && g->first_cluster != 0) {
+            f->first_cluster   = g->first_cluster;
+            f->current_cluster = g->first_cluster;
+            f->chain_complete  = 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * fat32_stream_fill - load the window with up to want clusters starting at
+ * file cluster first.  Clusters wholly past end of file are zero-filled
+ * instead of read, so appends never read back data they will overwrite.
+ * Returns 0 on success, -1 on allocation or I/O error.
+ */
+static int fat32_stream_fill(struct fat32_file *f, uint32_t first, uint32_t want) {
+    uint32_t bpc = g_fs.bytes_per_cluster;
+
+    if (fat32_stream_flush(f) != 0) return -1;
+    f->stream_count = 0;
+
+    if (!f->stream) {
+        f->stream = (uint8_t *)kmalloc(fat32_stream_max_clusters() * bpc);
+        if (!f->stream) return -1;
+    }
+
+    if (want == 0) want = 1;
+    if (want > fat32_stream_max_clusters()) want = fat32_stream_max_clusters();
+
+    uint32_t size_clusters = (f->size + bpc - 1) / bpc;
+    uint32_t count = 0;
+
+    while (count < want) {
+        uint32_t idx     = first + count;
+        uint32_t run     = 0;
+        uint32_t cluster = fat32_file_cluster_at(f, idx, &run);
+        uint8_t *dst     = f->stream + count * bpc;
+
+        if (!cluster) break;
+        if (run > want - count) run = want - count;
+
+        if (idx >= size_clusters) {
+            memset(dst, 0, run * bpc);
+        } else {
+            if (run > size_clusters - idx) run = size_clusters - idx;
+            if (fat32_read_sectors(fat32_cluster_sector(cluster),
+                                   run * g_fs.boot.sectors_per_cluster,
+                                   dst) != 0) {
+                return -1;
+            }
+        }
+        count += run;
+    }
+
+    if (count == 0) return -1;
+    f->stream_first = first;
+    f->stream_count = count;
+    return 0;
+}
+
+/*
+ * fat32_stream_at - return the window bytes for file cluster idx, loading
+ * the window with the current read-ahead size on a miss.
+ * Returns NULL on error.
+ */
+static uint8_t *fat32_stream_at(struct fat32_file *f, uint32_t idx) {
+    if (!f->stream || idx < f->stream_first ||
+        idx >= f->stream_first + f->stream_count) {
+        if (fat32_stream_fill(f, idx, f->ra_clusters) != 0) return NULL;
+    }
+    return f->stream + (idx - f->stream_first) * g_fs.bytes_per_cluster;
+}
+
+/*
+ * fat32_stream_access - adapt the read-ahead size to the access pattern:
+ * each access that continues where the last one stopped doubles the
+ * window, anything else falls back to a single cluster.
+ */
+static void fat32_stream_access(struct fat32_file *f, uint32_t pos) {
+    if (pos == f->seq_next) {
+        uint32_t max = fat32_stream_max_clusters();
+        f->ra_clusters = (f->ra_clusters < max / 2) ? f->ra_clusters * 2 : max;
+        if (f->ra_clusters == 0) f->ra_clusters = 1;
+    } else {
+        f->ra_clusters = 1;
+    }
+}
+
+static void fat32_stream_mark_dirty(struct fat32_file *f, uint32_t idx) {
+    if (f->dirty_first == f->dirty_end) {
+        f->dirty_first = idx;
+        f->dirty_end   = idx + 1;
+        return;
+    }
+    if (idx < f->dirty_first)  f->dirty_first = idx;
+    if (idx >= f->dirty_end)   f->dirty_end   = idx + 1;
+}
+
 static int fat32_update_entry_size(uint32_t dir_cluster,
                                    uint32_t dir_index,
                                    uint32_t new_size) {
-    if (fat32_read_cluster(dir_cluster, cluster_buffer) != 0) return -1;
+    uint32_t slot;
+    uint32_t cluster = fat32_dir_slot(dir_cluster, dir_index, &slot);
+
+    if (cluster == 0) return -1;
+    if (fat32_read_cluster(cluster, cluster_buffer) != 0) return -1;
 
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)cluster_buffer;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
+    struct fat32_dir_entry *entry = (struct fat32_dir_entry *)cluster_buffer + slot;
+    entry->file_size = new_size;
 
-    if ((int)dir_index < 0 || (int)dir_index >= entries_per_cluster) return -1;
-    dir_entries[dir_index].file_size = new_size;
+    dcache_invalidate_location(DCACHE_FS_FAT32, dir_cluster, dir_index);
+    fat32_dir_index_update_entry(dir_cluster, dir_index, entry);
 
-    if (fat32_write_cluster(dir_cluster, cluster_buffer) != 0) return -1;
+    if (fat32_write_cluster(cluster, cluster_buffer) != 0) return -1;
     return 0;
 }
 
+/*
+ * fat32_alloc_fd - return a free descriptor slot, doubling the table when
+ * every slot is taken.  Returns the slot index, or -1 if out of memory.
+ */
+static int fat32_alloc_fd(void) {
+    for (int i = 0; i < g_fd_count; i++) {
+        if (!g_fd_table[i].in_use) return i;
+    }
+
+    int count = g_fd_count ? g_fd_count * 2 : FAT32_FD_INITIAL;
+    struct fat32_file *table =
+        (struct fat32_file *)kzalloc(sizeof(*table) * (size_t)count);
+    if (!table) return -1;
+
+    if (g_fd_table) {
+        memcpy(table, g_fd_table, sizeof(*table) * (size_t)g_fd_count);
+        kfree(g_fd_table);
+    }
+
+    int fd = g_fd_count;
+    g_fd_table = table;
+    g_fd_count = count;
+    return fd;
+}
+
 /*
  * fat32_open - open the file at path for reading or writing.
  * Returns a non-negative file descriptor on success, -1 on failure.
@@ -824,32 +2125,34 @@ int fat32_open(const char *path, int flags) {
 
     uint32_t parent_cluster = 0;
     int      entry_index    = -1;
-    struct fat32_dir_entry *entry = find_entry(path, &parent_cluster, &entry_index);
-    if (!entry) {
-        if (flags & FAT32_O_CREAT) {
-            if (fat32_create_file(path) != 0) return -1;
-            entry_index = -1;
-            parent_cluster = 0;
-            entry = find_entry(path, &parent_cluster, &entry_index);
-        }
-        if (!entry) return -1;
+    struct fat32_dir_entry entry_buf;
+    struct fat32_dir_entry *entry = &entry_buf;
+    if (find_entry(path, entry, &parent_cluster, &entry_index) != 0) {
+        if (!(flags & FAT32_O_CREAT)) return -1;
+        if (fat32_create_file(path) != 0) return -1;
+        entry_index = -1;
+        parent_cluster = 0;
+        if (find_entry(path, entry, &parent_cluster, &entry_index) != 0) return -1;
     }
     if (entry_index < 0) return -1;
+
+    /* Another descriptor may still hold buffered writes for this file */
+    int synced = fat32_sync_entry(parent_cluster, entry_index);
+    if (synced < 0) return -1;
+    if (synced && find_entry(path, entry, &parent_cluster, &entry_index) != 0) {
+        return -1;
+    }
     if (entry->attr & FAT32_ATTR_DIRECTORY) return -1;  /* not a file */
     if ((flags & (FAT32_O_WRONLY | FAT32_O_RDWR)) &&
         (entry->attr & FAT32_ATTR_READ_ONLY)) return -1;
 
-    /* Find a free descriptor slot */
-    int fd = -1;
-    for (int i = 0; i < MAX_OPEN_FILES; i++) {
-        if (!g_fd_table[i].in_use) { fd = i; break; }
-    }
-    if (fd < 0) return -1;  /* no free slots */
+    int fd = fat32_alloc_fd();
+    if (fd < 0) return -1;
 
     uint32_t cluster = ((uint32_t)entry->first_cluster_high << 16) |
                         entry->first_cluster_low;
 
-    fat32_parse_short_name(entry->name, entry->nt_reserved, g_fd_table[fd].name);
+    fat32_entry_name(parent_cluster, entry_index, entry, g_fd_table[fd].name);
     g_fd_table[fd].first_cluster   = cluster;
     g_fd_table[fd].current_cluster = cluster;
     g_fd_table[fd].size            = entry->file_size;
@@ -859,20 +2162,26 @@ int fat32_open(const char *path, int flags) {
     g_fd_table[fd].attr            = entry->attr;
     g_fd_table[fd].flags           = flags;
     g_fd_table[fd].in_use          = 1;
+    g_fd_table[fd].ra_clusters     = 1;
+    g_fd_table[fd].seq_next        = 0;
 
-    uint32_t cap = 0;
-    uint32_t scan = cluster;
-    while (scan != 0) {
-        cap += g_fs.bytes_per_cluster;
-        scan = fat32_next_cluster(scan);
-    }
-    g_fd_table[fd].capacity = cap;
+    /* capacity is filled in once the chain has been mapped by a write */
+    g_fd_table[fd].capacity        = 0;
 
     if (flags & FAT32_O_APPEND) {
         g_fd_table[fd].position = g_fd_table[fd].size;
+        g_fd_table[fd].seq_next = g_fd_table[fd].size;
     }
 
     if (flags & FAT32_O_TRUNC) {
+        /* Truncation applies to the file, so every descriptor sees it */
+        for (int i = 0; i < g_fd_count; i++) {
+            struct fat32_file *g = &g_fd_table[i];
+            if (fat32_same_file(&g_fd_table[fd], g)) {
+                g->size       = 0;
+                g->size_dirty = 0;
+            }
+        }
         g_fd_table[fd].size = 0;
         g_fd_table[fd].position = 0;
         fat32_update_entry_size(parent_cluster, (uint32_t)entry_index, 0);
@@ -882,175 +2191,373 @@ int fat32_open(const char *path, int flags) {
 }
 
 /*
- * fat32_close - release an open file descriptor.
- * Returns 0 on success, -1 if fd is invalid or not open.
+ * fat32_close - write back buffered data and release an open descriptor.
+ * Returns 0 on success, -1 if fd is invalid or the write-back failed (the
+ * descriptor is released either way).
  */
 int fat32_close(int fd) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES) return -1;
+    if (fd < 0 || fd >= g_fd_count) return -1;
     if (!g_fd_table[fd].in_use) return -1;
+
+    int rc = fat32_file_sync(&g_fd_table[fd]);
+
+    if (g_fd_table[fd].extents) kfree(g_fd_table[fd].extents);
+    if (g_fd_table[fd].stream)  kfree(g_fd_table[fd].stream);
     memset(&g_fd_table[fd], 0, sizeof(struct fat32_file));
-    return 0;
+    fat32_flush_fsinfo();
+    return rc;
 }
 
-/*
- * fat32_read - read up to count bytes from an open file descriptor into buf.
- *
- * Walks the FAT cluster chain from the cluster containing the current file
- * position.  Each cluster is read into the static cluster_buffer and the
- * relevant portion is copied to the caller's buffer.
- *
- * Returns the number of bytes read, 0 at EOF, or -1 on error.
- */
+/*
+ * fat32_read - read up to count bytes from an open file descriptor into buf.
+ *
+ * File offsets are mapped through the descriptor's extent cache.  Whole
+ * clusters inside a contiguous run are read straight into the caller's
+ * buffer with one multi-sector transfer; partial clusters are served from
+ * the descriptor's window, which grows while the file is read sequentially.
+ *
+ * Returns the number of bytes read, 0 at EOF, or -1 on error.
+ */
 ssize_t fat32_read(int fd, void *buf, size_t count) {
-    if (!g_fs.mounted) return -1;
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !g_fd_table[fd].in_use) return -1;
-
-    uint8_t  *out      = (uint8_t *)buf;
-    uint32_t  pos      = g_fd_table[fd].position;
-    uint32_t  filesize = g_fd_table[fd].size;
-    uint32_t  bpc      = g_fs.bytes_per_cluster;
-    ssize_t   total    = 0;
-
-    if (pos >= filesize) return 0;  /* already at EOF */
-    if ((uint32_t)count > filesize - pos) count = filesize - pos;
-
-    /* Advance the cluster chain to the cluster containing pos */
-    uint32_t target_idx = pos / bpc;
-    uint32_t cluster    = g_fd_table[fd].first_cluster;
-
-    for (uint32_t i = 0; i < target_idx; i++) {
-        cluster = fat32_next_cluster(cluster);
-        if (cluster == 0) return -1;
-    }
-
-    uint32_t offset_in_cluster = pos % bpc;
-
-    while ((size_t)total < count) {
-        if (cluster == 0) break;
-
-        if (fat32_read_cluster(cluster, cluster_buffer) != 0) {
-            return (total > 0) ? total : -1;
-        }
-
-        uint32_t avail     = bpc - offset_in_cluster;
-        size_t   remaining = count - (size_t)total;
-        if (avail > (uint32_t)remaining) avail = (uint32_t)remaining;
-
-        memcpy(out + total, cluster_buffer + offset_in_cluster, avail);
-        total += (ssize_t)avail;
-
-        cluster            = fat32_next_cluster(cluster);
-        offset_in_cluster  = 0;
-    }
-
-    g_fd_table[fd].position = pos + (uint32_t)total;
+    if (!g_fs.mounted) return -1;
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+
+    struct fat32_file *f = &g_fd_table[fd];
+    if (fat32_file_claim(f) != 0) return -1;
+
+    uint8_t  *out      = (uint8_t *)buf;
+    uint32_t  pos      = f->position;
+    uint32_t  filesize = f->size;
+    uint32_t  bpc      = g_fs.bytes_per_cluster;
+    ssize_t   total    = 0;
+
+    if (pos >= filesize) return 0;  /* already at EOF */
+    if ((uint32_t)count > filesize - pos) count = filesize - pos;
+
+    fat32_stream_access(f, pos);
+
+    while ((size_t)total < count) {
+        uint32_t cur               = pos + (uint32_t)total;
+        uint32_t offset_in_cluster = cur % bpc;
+        uint32_t index             = cur / bpc;
+        uint32_t run               = 0;
+        uint32_t cluster           = fat32_file_cluster_at(f, index, &run);
+        size_t   remaining         = count - (size_t)total;
+
+        if (cluster == 0) {
+            if (total == 0) return -1;
+            break;
+        }
+
+        if (offset_in_cluster == 0 && remaining >= bpc) {
+            uint32_t whole = (uint32_t)(remaining / bpc);
+            if (whole > run) whole = run;
+            if (fat32_range_overlaps(index, whole, f->dirty_first, f->dirty_end) &&
+                fat32_stream_flush(f) != 0) {
+                return (total > 0) ? total : -1;
+            }
+            if (fat32_read_sectors(fat32_cluster_sector(cluster),
+                                   whole * g_fs.boot.sectors_per_cluster,
+                                   out + total) != 0) {
+                return (total > 0) ? total : -1;
+            }
+            total += (ssize_t)(whole * bpc);
+            continue;
+        }
+
+        uint8_t *window = fat32_stream_at(f, index);
+        if (!window) return (total > 0) ? total : -1;
+
+        uint32_t avail = bpc - offset_in_cluster;
+        if (avail > (uint32_t)remaining) avail = (uint32_t)remaining;
+
+        memcpy(out + total, window + offset_in_cluster, avail);
+        total += (ssize_t)avail;
+    }
+
+    f->position = pos + (uint32_t)total;
+    f->seq_next = f->position;
     return total;
 }
 
 /*
  * fat32_write - write up to count bytes to an open file descriptor from buf.
  *
- * Writes are limited to the file's allocated cluster chain. If the write
- * extends the file, the directory entry size is updated.
+ * The chain is extended as needed, appending new clusters to the cached
+ * extent list so the tail is always known.  Whole clusters are written
+ * directly from the caller's buffer in contiguous runs.  Partial clusters
+ * are copied into the descriptor's window and written back later as whole
+ * clusters; a size change is likewise deferred until the window is synced.
  *
  * Returns the number of bytes written, or -1 on error.
  */
-ssize_t fat32_write(int fd, const void *buf, size_t count) {
-    if (!g_fs.mounted) return -1;
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !g_fd_table[fd].in_use) return -1;
-    if (!(g_fd_table[fd].flags & (FAT32_O_WRONLY | FAT32_O_RDWR))) return -1;
-    if (!buf) return -1;
-    if (!count) return 0;
-
-    const uint8_t *in = (const uint8_t *)buf;
-    uint32_t pos      = g_fd_table[fd].position;
-    uint32_t bpc      = g_fs.bytes_per_cluster;
-    ssize_t  total    = 0;
+/*
+ * fat32_file_extend - grow f's cluster chain so it covers end_pos bytes.
+ * Data is about to be written from pos onward, so clusters in that range
+ * are taken unzeroed; only clusters lying wholly in a gap before pos are
+ * cleared on disk.  Returns 0 on success, -1 on error.
+ */
+static int fat32_file_extend(struct fat32_file *f, uint32_t pos, uint32_t end_pos) {
+    uint32_t bpc = g_fs.bytes_per_cluster;
+
+    if (f->first_cluster == 0) {
+        /* Another descriptor may have given the empty file its first cluster */
+        uint32_t slot;
+        uint32_t dir = fat32_dir_slot(f->dir_cluster, f->dir_index, &slot);
+        if (dir == 0 || fat32_read_cluster(dir, cluster_buffer) != 0) return -1;
+        const struct fat32_dir_entry *entry =
+            (const struct fat32_dir_entry *)cluster_buffer + slot;
+        uint32_t first = ((uint32_t)entry->first_cluster_high << 16) |
+                         entry->first_cluster_low;
+        if (first != 0) {
+            f->first_cluster   = first;
+            f->current_cluster = first;
+            f->chain_complete  = 0;
+        }
+    }
 
-    uint32_t first_cluster = g_fd_table[fd].first_cluster;
-    if (first_cluster == 0) {
+    if (f->first_cluster == 0) {
         uint32_t new_cluster = fat32_alloc_cluster();
         if (!new_cluster) return -1;
-        if (fat32_update_entry_cluster(g_fd_table[fd].dir_cluster,
-                                       g_fd_table[fd].dir_index,
+        if (fat32_update_entry_cluster(f->dir_cluster,
+                                       f->dir_index,
                                        new_cluster) != 0) {
             return -1;
         }
-        g_fd_table[fd].first_cluster = new_cluster;
-        g_fd_table[fd].current_cluster = new_cluster;
-        g_fd_table[fd].capacity = bpc;
-        first_cluster = new_cluster;
+        f->first_cluster   = new_cluster;
+        f->current_cluster = new_cluster;
+        if (fat32_file_push_cluster(f, new_cluster) != 0) return -1;
+        f->chain_complete  = 1;
     }
 
-    uint32_t end_pos = pos + (uint32_t)count;
-    if (end_pos < pos) return -1;
+    if (fat32_file_map_to(f, 0xFFFFFFFFu) != 0) return -1;
+    f->capacity = f->mapped_clusters * bpc;
 
-    uint32_t cap = g_fd_table[fd].capacity;
+    uint32_t cap = f->capacity;
     if (end_pos > cap) {
         uint32_t extra = end_pos - cap;
         uint32_t add_clusters = (extra + bpc - 1) / bpc;
-        uint32_t last = fat32_last_cluster(first_cluster);
+        uint32_t last = fat32_file_last_cluster(f);
         if (!last) return -1;
 
         for (uint32_t i = 0; i < add_clusters; i++) {
-            uint32_t new_cluster = fat32_alloc_cluster();
+            uint32_t index = f->mapped_clusters;
+            uint32_t new_cluster = ((index + 1) * bpc <= pos)
+                                       ? fat32_alloc_cluster()
+                                       : fat32_alloc_cluster_raw();
             if (!new_cluster) return -1;
             if (fat32_write_fat_entry(last, new_cluster) != 0) return -1;
+            if (fat32_file_push_cluster(f, new_cluster) != 0) return -1;
             last = new_cluster;
         }
 
-        g_fd_table[fd].capacity = cap + (add_clusters * bpc);
-        cap = g_fd_table[fd].capacity;
+        f->capacity = f->mapped_clusters * bpc;
     }
+    return 0;
+}
 
-    uint32_t target_idx = pos / bpc;
-    uint32_t cluster    = first_cluster;
+/*
+ * fat32_file_zero_gap - clear bytes [from, to) of clusters the file already
+ * owns.  A write past end of file leaves that range as a hole, and clusters
+ * kept across O_TRUNC or the tail of the last cluster still hold old data.
+ * Partial clusters go through the window; whole ones are cleared on disk.
+ * Returns 0 on success, -1 on error.
+ */
+static int fat32_file_zero_gap(struct fat32_file *f, uint32_t from, uint32_t to) {
+    uint32_t bpc = g_fs.bytes_per_cluster;
 
-    for (uint32_t i = 0; i < target_idx; i++) {
-        cluster = fat32_next_cluster(cluster);
-        if (cluster == 0) return -1;
+    if (fat32_file_map_to(f, 0xFFFFFFFFu) != 0) return -1;
+    if (to > f->mapped_clusters * bpc) to = f->mapped_clusters * bpc;
+
+    while (from < to) {
+        uint32_t index  = from / bpc;
+        uint32_t offset = from % bpc;
+        uint32_t len    = bpc - offset;
+        int in_window   = f->stream && index >= f->stream_first &&
+                          index < f->stream_first + f->stream_count;
+
+        if (len > to - from) len = to - from;
+
+        if (len == bpc && !in_window) {
+            fat32_stream_forget(f, index, index + 1);
+            if (fat32_zero_cluster(fat32_file_cluster_at(f, index, NULL)) != 0) return -1;
+        } else {
+            uint8_t *window = fat32_stream_at(f, index);
+            if (!window) return -1;
+            memset(window + offset, 0, len);
+            fat32_stream_mark_dirty(f, index);
+        }
+        from += len;
     }
+    return 0;
+}
+
+/*
+ * fat32_reserve - allocate the clusters for a write of len bytes at offset
+ * in one pass, ahead of the data.  The file size is unchanged until the
+ * data is written.  Returns 0 on success, -1 on error.
+ */
+int fat32_reserve(int fd, uint32_t offset, uint32_t len) {
+    if (!g_fs.mounted) return -1;
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+    if (!(g_fd_table[fd].flags & (FAT32_O_WRONLY | FAT32_O_RDWR))) return -1;
+    if (len == 0) return 0;
+
+    uint32_t end_pos = offset + len;
+    if (end_pos < offset) return -1;
+    return fat32_file_extend(&g_fd_table[fd], offset, end_pos);
+}
+
+ssize_t fat32_write(int fd, const void *buf, size_t count) {
+    if (!g_fs.mounted) return -1;
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+    if (!(g_fd_table[fd].flags & (FAT32_O_WRONLY | FAT32_O_RDWR))) return -1;
+    if (!buf) return -1;
+    if (!count) return 0;
+
+    struct fat32_file *f = &g_fd_table[fd];
+    if (fat32_file_claim(f) != 0) return -1;
+
+    const uint8_t *in = (const uint8_t *)buf;
+    uint32_t pos      = f->position;
+    uint32_t bpc      = g_fs.bytes_per_cluster;
+    ssize_t  total    = 0;
+
+    uint32_t end_pos = pos + (uint32_t)count;
+    if (end_pos < pos) return -1;
+    /* Clusters the extend adds for the gap come back zeroed already */
+    if (pos > f->size && fat32_file_zero_gap(f, f->size, pos) != 0) return -1;
+    if (fat32_file_extend(f, pos, end_pos) != 0) return -1;
 
-    uint32_t offset_in_cluster = pos % bpc;
+    fat32_stream_access(f, pos);
 
     while ((size_t)total < count) {
+        uint32_t cur               = pos + (uint32_t)total;
+        uint32_t offset_in_cluster = cur % bpc;
+        uint32_t index             = cur / bpc;
+        uint32_t run               = 0;
+        uint32_t cluster           = fat32_file_cluster_at(f, index, &run);
+        size_t   remaining         = count - (size_t)total;
+
         if (cluster == 0) break;
 
-        if (fat32_read_cluster(cluster, cluster_buffer) != 0) {
-            return (total > 0) ? total : -1;
+        if (offset_in_cluster == 0 && remaining >= bpc) {
+            uint32_t whole = (uint32_t)(remaining / bpc);
+            if (whole > run) whole = run;
+            if (fat32_range_overlaps(index, whole, f->stream_first,
+                                     f->stream_first + f->stream_count)) {
+                if (fat32_stream_flush(f) != 0) {
+                    return (total > 0) ? total : -1;
+                }
+                f->stream_count = 0;
+            }
+            fat32_stream_forget(f, index, index + whole);
+            if (fat32_write_sectors(fat32_cluster_sector(cluster),
+                                    whole * g_fs.boot.sectors_per_cluster,
+                                    in + total) != 0) {
+                return (total > 0) ? total : -1;
+            }
+            total += (ssize_t)(whole * bpc);
+            continue;
         }
 
-        uint32_t avail     = bpc - offset_in_cluster;
-        size_t   remaining = count - (size_t)total;
-        if (avail > (uint32_t)remaining) avail = (uint32_t)remaining;
+        uint8_t *window = fat32_stream_at(f, index);
+        if (!window) return (total > 0) ? total : -1;
 
-        memcpy(cluster_buffer + offset_in_cluster, in + total, avail);
-        if (fat32_write_cluster(cluster, cluster_buffer) != 0) {
-            return (total > 0) ? total : -1;
-        }
+        uint32_t avail = bpc - offset_in_cluster;
+        if (avail > (uint32_t)remaining) avail = (uint32_t)remaining;
 
+        memcpy(window + offset_in_cluster, in + total, avail);
+        fat32_stream_mark_dirty(f, index);
         total += (ssize_t)avail;
-        cluster = fat32_next_cluster(cluster);
-        offset_in_cluster = 0;
     }
 
-    g_fd_table[fd].position = pos + (uint32_t)total;
-
-    uint32_t new_size = g_fd_table[fd].size;
-    if (g_fd_table[fd].position > new_size) new_size = g_fd_table[fd].position;
+    f->position = pos + (uint32_t)total;
+    f->seq_next = f->position;
 
-    if (new_size != g_fd_table[fd].size) {
-        if (fat32_update_entry_size(g_fd_table[fd].dir_cluster,
-                                    g_fd_table[fd].dir_index,
-                                    new_size) != 0) {
-            return -1;
-        }
-        g_fd_table[fd].size = new_size;
+    if (f->position > f->size) {
+        f->size       = f->position;
+        f->size_dirty = 1;
     }
 
     return total;
 }
-
+
+/*
+ * fat32_pread - read from offset without moving the descriptor's position.
+ * Returns the number of bytes read, 0 at EOF, or -1 on error.
+ */
+ssize_t fat32_pread(int fd, void *buf, size_t count, uint32_t offset) {
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+
+    uint32_t saved = g_fd_table[fd].position;
+    g_fd_table[fd].position = offset;
+    ssize_t n = fat32_read(fd, buf, count);
+    g_fd_table[fd].position = saved;
+    return n;
+}
+
+/*
+ * fat32_pwrite - write at offset without moving the descriptor's position.
+ * Returns the number of bytes written, or -1 on error.
+ */
+ssize_t fat32_pwrite(int fd, const void *buf, size_t count, uint32_t offset) {
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+
+    uint32_t saved = g_fd_table[fd].position;
+    g_fd_table[fd].position = offset;
+    ssize_t n = fat32_write(fd, buf, count);
+    g_fd_table[fd].position = saved;
+    return n;
+}
+
+/*
+ * fat32_seek - move the descriptor's position.  whence is one of
+ * FAT32_SEEK_SET, FAT32_SEEK_CUR or FAT32_SEEK_END.  Seeking past end of
+ * file is allowed; a later write fills the gap with zeros (see
+ * fat32_file_zero_gap).
+ * Returns the new position, or -1 on error.
+ */
+int64_t fat32_seek(int fd, int64_t offset, int whence) {
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+
+    struct fat32_file *f = &g_fd_table[fd];
+    int64_t base;
+
+    if (whence == FAT32_SEEK_END && fat32_file_claim(f) != 0) return -1;
+    switch (whence) {
+        case FAT32_SEEK_SET: base = 0;                    break;
+        case FAT32_SEEK_CUR: base = (int64_t)f->position; break;
+        case FAT32_SEEK_END: base = (int64_t)f->size;     break;
+        default: return -1;
+    }
+
+    int64_t target = base + offset;
+    if (target < 0 || target > (int64_t)0xFFFFFFFFu) return -1;
+
+    f->position = (uint32_t)target;
+    return target;
+}
+
+/*
+ * fat32_fstat - fill in a fat32_dirent for an open descriptor, including
+ * buffered size changes that have not reached the directory entry yet.
+ * Returns 0 on success, -1 if fd is invalid.
+ */
+int fat32_fstat(int fd, struct fat32_dirent *stat) {
+    if (fd < 0 || fd >= g_fd_count || !g_fd_table[fd].in_use) return -1;
+    if (!stat) return -1;
+
+    struct fat32_file *f = &g_fd_table[fd];
+    if (fat32_file_claim(f) != 0) return -1;
+
+    memcpy(stat->name, f->name, sizeof(stat->name));
+    stat->size    = f->size;
+    stat->attr    = f->attr;
+    stat->cluster = f->first_cluster;
+    return 0;
+}
+
 /*
  * fat32_stat - fill in a fat32_dirent for the file or directory at path.
  * Returns 0 on success, -1 if not found.
@@ -1058,14 +2565,22 @@ ssize_t fat32_write(int fd, const void *buf, size_t count) {
 int fat32_stat(const char *path, struct fat32_dirent *stat) {
     if (!g_fs.mounted) return -1;
 
-    struct fat32_dir_entry *entry = find_entry(path, NULL, NULL);
-    if (!entry) return -1;
+    struct fat32_dir_entry entry;
+    uint32_t parent_cluster = 0;
+    int      entry_index    = -1;
+    if (find_entry(path, &entry, &parent_cluster, &entry_index) != 0) return -1;
+
+    int synced = fat32_sync_entry(parent_cluster, entry_index);
+    if (synced < 0) return -1;
+    if (synced && find_entry(path, &entry, &parent_cluster, &entry_index) != 0) {
+        return -1;
+    }
 
-    fat32_parse_short_name(entry->name, entry->nt_reserved, stat->name);
-    stat->size    = entry->file_size;
-    stat->attr    = entry->attr;
-    stat->cluster = ((uint32_t)entry->first_cluster_high << 16) |
-                     entry->first_cluster_low;
+    fat32_entry_name(parent_cluster, entry_index, &entry, stat->name);
+    stat->size    = entry.file_size;
+    stat->attr    = entry.attr;
+    stat->cluster = ((uint32_t)entry.first_cluster_high << 16) |
+                     entry.first_cluster_low;
     return 0;
 }
 
@@ -1082,53 +2597,79 @@ int fat32_chdir(const char *path) {
         return 0;
     }
 
-    struct fat32_dir_entry *entry = find_entry(path, NULL, NULL);
-    if (!entry) return -1;
-    if (!(entry->attr & FAT32_ATTR_DIRECTORY)) return -1;
+    struct fat32_dir_entry entry;
+    if (find_entry(path, &entry, NULL, NULL) != 0) return -1;
+    if (!(entry.attr & FAT32_ATTR_DIRECTORY)) return -1;
 
     g_fs.current_directory =
-        ((uint32_t)entry->first_cluster_high << 16) | entry->first_cluster_low;
+        ((uint32_t)entry.first_cluster_high << 16) | entry.first_cluster_low;
     return 0;
 }
 
+/*
+ * fat32_dir_read - fill entries with up to max_entries entries of the
+ * directory at cluster, served from its name index, starting at directory
+ * slot *cursor.  *cursor is left just past the last entry returned, so the
+ * position stays valid when other entries are created.  Long names are
+ * reported when present.  Skips deleted, LFN, and dot entries.
+ * Returns the number of entries filled (0 at the end), or -1 on error.
+ */
+static int fat32_dir_read(uint32_t cluster, uint32_t *cursor,
+                          struct fat32_dirent *entries, int max_entries) {
+    if (fat32_sync_entry(cluster, -1) < 0) return -1;
+
+    struct fat32_dir_index *idx = fat32_dir_index_get(cluster);
+    if (!idx) return -1;
+
+    /* Records are sorted by slot; find the first one at or after *cursor */
+    uint32_t lo = 0;
+    uint32_t hi = idx->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (idx->recs[mid].entry_index < *cursor) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int count = 0;
+
+    for (uint32_t i = lo; i < idx->count && count < max_entries; i++) {
+        const struct fat32_name_rec *rec = &idx->recs[i];
+        const struct fat32_dir_entry *e = &rec->dirent;
+
+        *cursor = (uint32_t)rec->entry_index + 1;
+        if (e->name[0] == '.') continue;                 /* . and ..        */
+
+        strncpy(entries[count].name, idx->pool + rec->name_off,
+                FAT32_MAX_FILENAME - 1);
+        entries[count].name[FAT32_MAX_FILENAME - 1] = '\0';
+        entries[count].size    = e->file_size;
+        entries[count].attr    = e->attr;
+        entries[count].cluster = ((uint32_t)e->first_cluster_high << 16) |
+                                  e->first_cluster_low;
+        count++;
+    }
+
+    return count;
+}
+
 /*
  * fat32_readdir - fill entries with up to max_entries directory entries from
- * the current directory cluster.
- * Skips deleted, LFN, and dot entries.
- * Returns the number of entries filled, or -1 on error.
- */
-int fat32_readdir(struct fat32_dirent *entries, int max_entries) {
-    if (!g_fs.mounted) return -1;
-
-    if (fat32_read_cluster(g_fs.current_directory, cluster_buffer) != 0) {
-        return -1;
-    }
-
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)cluster_buffer;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
-    int count = 0;
-
-    for (int i = 0; i < entries_per_cluster && count < max_entries; i++) {
-        struct fat32_dir_entry *e = &dir_entries[i];
-
-        if (e->name[0] == 0x00) break;                  /* end of directory */
-        if (e->name[0] == 0xE5) continue;                /* deleted         */
-        if (e->attr == FAT32_ATTR_LONG_NAME) continue;   /* LFN             */
-        if (e->name[0] == '.') continue;                 /* . and ..        */
-
-        fat32_parse_short_name(e->name, e->nt_reserved, entries[count].name);
-        entries[count].size    = e->file_size;
-        entries[count].attr    = e->attr;
-        entries[count].cluster = ((uint32_t)e->first_cluster_high << 16) |
-                                  e->first_cluster_low;
-        count++;
-    }
-
-    return count;
-}
-
+ * the current directory.  Returns the number of entries filled, or -1.
+ */
+int fat32_readdir(struct fat32_dirent *entries, int max_entries) {
+    uint32_t cursor = 0;
+    return fat32_readdir_at(&cursor, entries, max_entries);
+}
+
+/*
+ * fat32_readdir_at - resumable fat32_readdir.  Start with *cursor at 0 and
+ * pass it back unchanged to continue; a return of 0 means the end.
+ */
+int fat32_readdir_at(uint32_t *cursor, struct fat32_dirent *entries, int max_entries) {
+    if (!g_fs.mounted || !cursor) return -1;
+    return fat32_dir_read(g_fs.current_directory, cursor, entries, max_entries);
+}
+
 /*
  * fat32_list_directory - print the contents of path (or the current directory
  * if path is empty) to the VGA console.
@@ -1199,40 +2740,18 @@ static void fat32_list_cluster_recursive(uint32_t cluster,
                                          int max_depth) {
     if (!g_fs.mounted) return;
     if (depth > max_depth) return;
-    if (fat32_read_cluster(cluster, cluster_buffer) != 0) {
-        fat32_print_indent(depth);
-        vga_writestring("[ERR] ");
-        vga_writestring(path);
-        vga_writestring("\n");
-        return;
-    }
-
-    uint8_t *dir_copy = (uint8_t *)kmalloc(g_fs.bytes_per_cluster);
-    if (!dir_copy) {
-        fat32_print_indent(depth);
-        vga_writestring("[ERR] out of memory\n");
-        return;
-    }
-    memcpy(dir_copy, cluster_buffer, g_fs.bytes_per_cluster);
-
-    struct fat32_dir_entry *dir_entries =
-        (struct fat32_dir_entry *)dir_copy;
-    int entries_per_cluster =
-        (int)(g_fs.bytes_per_cluster / sizeof(struct fat32_dir_entry));
-
-    for (int i = 0; i < entries_per_cluster; i++) {
-        struct fat32_dir_entry *e = &dir_entries[i];
 
-        if (e->name[0] == 0x00) break;                /* end of directory */
-        if (e->name[0] == 0xE5) continue;             /* deleted         */
-        if (e->attr == FAT32_ATTR_LONG_NAME) continue;/* LFN             */
-        if (e->name[0] == '.') continue;              /* . and ..        */
-
-        char name[FAT32_MAX_FILENAME];
-        fat32_parse_short_name(e->name, e->nt_reserved, name);
+    /*
+     * Entries come from the directory's name index one at a time, copied
+     * out before recursing, since visiting children may evict the index.
+     */
+    struct fat32_dirent ent;
+    uint32_t cursor = 0;
+    int got;
 
+    while ((got = fat32_dir_read(cluster, &cursor, &ent, 1)) == 1) {
         fat32_print_indent(depth);
-        int is_dir = (e->attr & FAT32_ATTR_DIRECTORY) ? 1 : 0;
+        int is_dir = (ent.attr & FAT32_ATTR_DIRECTORY) ? 1 : 0;
 
         if (is_dir) {
             vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -1241,11 +2760,11 @@ static void fat32_list_cluster_recursive(uint32_t cluster,
             vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
             vga_writestring("[FILE] ");
         }
-        vga_writestring(name);
+        vga_writestring(ent.name);
 
         if (!is_dir) {
             vga_writestring(" (");
-            print_dec(e->file_size);
+            print_dec(ent.size);
             vga_writestring(" bytes)");
         }
         vga_writestring("\n");
@@ -1255,7 +2774,7 @@ static void fat32_list_cluster_recursive(uint32_t cluster,
             char child_path[FAT32_MAX_PATH];
             size_t pos = 0;
             size_t base_len = strlen(path);
-            size_t name_len = strlen(name);
+            size_t name_len = strlen(ent.name);
 
             if (base_len == 1 && path[0] == '/') {
                 child_path[pos++] = '/';
@@ -1268,23 +2787,26 @@ static void fat32_list_cluster_recursive(uint32_t cluster,
             }
 
             if (pos + name_len < sizeof(child_path)) {
-                memcpy(child_path + pos, name, name_len);
+                memcpy(child_path + pos, ent.name, name_len);
                 pos += name_len;
                 child_path[pos] = '\0';
             } else {
                 child_path[pos ? pos - 1 : 0] = '\0';
             }
 
-            uint32_t child_cluster =
-                ((uint32_t)e->first_cluster_high << 16) |
-                 e->first_cluster_low;
-            fat32_list_cluster_recursive(child_cluster,
+            fat32_list_cluster_recursive(ent.cluster,
                                          child_path,
                                          depth + 1,
                                          max_depth);
         }
     }
-    kfree(dir_copy);
+
+    if (got < 0) {
+        fat32_print_indent(depth);
+        vga_writestring("[ERR] ");
+        vga_writestring(path);
+        vga_writestring("\n");
+    }
 }
 
 void fat32_list_directory_recursive(const char *path) {
@@ -1297,18 +2819,18 @@ void fat32_list_directory_recursive(const char *path) {
     uint32_t start_cluster = g_fs.boot.root_cluster;
 
     if (!(start_path[0] == '/' && start_path[1] == '\0')) {
-        struct fat32_dir_entry *entry = find_entry(start_path, NULL, NULL);
-        if (!entry) {
+        struct fat32_dir_entry entry;
+        if (find_entry(start_path, &entry, NULL, NULL) != 0) {
             vga_writestring("Directory not found\n");
             return;
         }
-        if (!(entry->attr & FAT32_ATTR_DIRECTORY)) {
+        if (!(entry.attr & FAT32_ATTR_DIRECTORY)) {
             vga_writestring("Not a directory\n");
             return;
         }
         start_cluster =
-            ((uint32_t)entry->first_cluster_high << 16) |
-             entry->first_cluster_low;
+            ((uint32_t)entry.first_cluster_high << 16) |
+             entry.first_cluster_low;
     }
 
     vga_writestring("\nRecursive directory listing:\n");
@@ -1332,7 +2854,7 @@ void fat32_list_directory_recursive(const char *path) {
 uint32_t fat32_get_free_clusters(void) {
     if (g_fs.fsinfo.free_clusters == FAT32_FSINFO_UNKNOWN ||
         g_fs.fsinfo.free_clusters > g_fs.total_clusters) {
-        g_fs.fsinfo.free_clusters = fat32_count_free_clusters();
+        g_fs.fsinfo.free_clusters = fat32_scan_fat();
     }
 
     return g_fs.fsinfo.free_clusters;
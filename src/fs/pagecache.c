@@ -0,0 +1,191 @@
+/*
+ * pagecache.c - Shared file page cache
+ *
+ * A fixed pool of slots, each owning one physical frame once it has been
+ * used.  Slots are chained into two hash tables: one keyed by
+ * (mount, file, page index) for faults, and one keyed by frame address so
+ * an unmap can drop its reference knowing only the physical page.  Frames
+ * are taken from the PMM on first use and recycled inside the pool rather
+ * than returned, since the PMM cannot reuse freed frames yet.
+ */
+
+#include "fs/pagecache.h"
+#include "fs/vfs.h"
+#include "cpu/paging.h"
+#include "lib/string.h"
+
+struct pagecache_slot {
+    uint32_t mount;
+    uint32_t file;
+    uint32_t index;
+    uint32_t refs;                      /* Mappings pinning this page */
+    uint64_t phys;                      /* 0 until a frame is attached */
+    int      hashed;                    /* Reachable by key */
+    struct pagecache_slot *key_next;
+    struct pagecache_slot *phys_next;
+};
+
+static struct pagecache_slot  slots[PAGECACHE_MAX_PAGES];
+static struct pagecache_slot *key_buckets[PAGECACHE_BUCKETS];
+static struct pagecache_slot *phys_buckets[PAGECACHE_BUCKETS];
+static uint32_t               next_victim;
+static uint32_t               cached_pages;
+
+static uint32_t pagecache_key_bucket(uint32_t mount, uint32_t file, uint32_t index) {
+    uint32_t h = (mount * 0x9E3779B1u) ^ (file * 0x85EBCA6Bu) ^ (index * 0xC2B2AE35u);
+    return (h ^ (h >> 15)) % PAGECACHE_BUCKETS;
+}
+
+static uint32_t pagecache_phys_bucket(uint64_t phys) {
+    return (uint32_t)(phys / PAGECACHE_PAGE_SIZE) % PAGECACHE_BUCKETS;
+}
+
+static struct pagecache_slot *pagecache_find(uint32_t mount, uint32_t file, uint32_t index) {
+    struct pagecache_slot *s = key_buckets[pagecache_key_bucket(mount, file, index)];
+
+    for (; s; s = s->key_next) {
+        if (s->mount == mount && s->file == file && s->index == index) return s;
+    }
+    return NULL;
+}
+
+static void pagecache_unhash(struct pagecache_slot *slot) {
+    struct pagecache_slot **link =
+        &key_buckets[pagecache_key_bucket(slot->mount, slot->file, slot->index)];
+
+    while (*link && *link != slot) link = &(*link)->key_next;
+    if (*link) *link = slot->key_next;
+
+    slot->key_next = NULL;
+    slot->hashed = 0;
+    cached_pages--;
+}
+
+/*
+ * pagecache_alloc_slot - find a slot nobody has pinned, evicting its old
+ * page if it was still cached, and make sure it owns a frame.
+ * Returns NULL when every slot is pinned or the PMM is exhausted.
+ */
+static struct pagecache_slot *pagecache_alloc_slot(void) {
+    for (uint32_t i = 0; i < PAGECACHE_MAX_PAGES; i++) {
+        struct pagecache_slot *slot = &slots[(next_victim + i) % PAGECACHE_MAX_PAGES];
+        if (slot->refs) continue;
+
+        if (!slot->phys) {
+            slot->phys = pmm_alloc_frame();
+            if (!slot->phys) return NULL;
+
+            uint32_t b = pagecache_phys_bucket(slot->phys);
+            slot->phys_next = phys_buckets[b];
+            phys_buckets[b] = slot;
+        }
+
+        if (slot->hashed) pagecache_unhash(slot);
+        next_victim = (next_victim + i + 1) % PAGECACHE_MAX_PAGES;
+        return slot;
+    }
+    return NULL;
+}
+
+void pagecache_init(void) {
+    memset(slots, 0, sizeof(slots));
+    memset(key_buckets, 0, sizeof(key_buckets));
+    memset(phys_buckets, 0, sizeof(phys_buckets));
+    next_victim = 0;
+    cached_pages = 0;
+}
+
+/*
+ * pagecache_get - return the frame holding page index of a file, reading
+ * it through vfs_fd on a miss, and take a reference on it.  Bytes past
+ * end of file read back as zeros.
+ * Returns the physical address, or 0 on failure.
+ */
+uint64_t pagecache_get(int vfs_fd, uint32_t mount, uint32_t file, uint32_t index) {
+    struct pagecache_slot *slot = pagecache_find(mount, file, index);
+    if (slot) {
+        slot->refs++;
+        return slot->phys;
+    }
+
+    slot = pagecache_alloc_slot();
+    if (!slot) return 0;
+
+    uint8_t *page = (uint8_t *)(uintptr_t)slot->phys;
+    ssize_t n = vfs_pread(vfs_fd, page, PAGECACHE_PAGE_SIZE,
+                          index * PAGECACHE_PAGE_SIZE);
+    if (n < 0) return 0;
+    if (n < PAGECACHE_PAGE_SIZE) {
+        memset(page + n, 0, PAGECACHE_PAGE_SIZE - (size_t)n);
+    }
+
+    uint32_t b = pagecache_key_bucket(mount, file, index);
+    slot->mount    = mount;
+    slot->file     = file;
+    slot->index    = index;
+    slot->refs     = 1;
+    slot->hashed   = 1;
+    slot->key_next = key_buckets[b];
+    key_buckets[b] = slot;
+    cached_pages++;
+    return slot->phys;
+}
+
+/*
+ * pagecache_put - drop a reference taken by pagecache_get.  The page stays
+ * cached until its slot is recycled.
+ */
+void pagecache_put(uint64_t phys) {
+    struct pagecache_slot *s = phys_buckets[pagecache_phys_bucket(phys)];
+
+    for (; s; s = s->phys_next) {
+        if (s->phys == phys) {
+            if (s->refs) s->refs--;
+            return;
+        }
+    }
+}
+
+/*
+ * pagecache_update - copy bytes just written at offset into any cached
+ * pages they overlap, so existing mappings observe the write.
+ */
+void pagecache_update(uint32_t mount, uint32_t file, uint32_t offset,
+                      const void *buf, size_t len) {
+    const uint8_t *src = (const uint8_t *)buf;
+
+    while (len > 0) {
+        uint32_t index  = offset / PAGECACHE_PAGE_SIZE;
+        uint32_t in_pg  = offset % PAGECACHE_PAGE_SIZE;
+        size_t   chunk  = PAGECACHE_PAGE_SIZE - in_pg;
+        if (chunk > len) chunk = len;
+
+        struct pagecache_slot *slot = pagecache_find(mount, file, index);
+        if (slot) {
+            memcpy((uint8_t *)(uintptr_t)slot->phys + in_pg, src, chunk);
+        }
+
+        src    += chunk;
+        offset += (uint32_t)chunk;
+        len    -= chunk;
+    }
+}
+
+/*
+ * pagecache_invalidate_file - forget every cached page of a file.  Pages
+ * still mapped keep their frames until the last mapping goes away, but a
+ * new fault reads fresh data.
+ */
+void pagecache_invalidate_file(uint32_t mount, uint32_t file) {
+    if (cached_pages == 0) return;
+
+    for (uint32_t i = 0; i < PAGECACHE_MAX_PAGES; i++) {
+        if (slots[i].hashed && slots[i].mount == mount && slots[i].file == file) {
+            pagecache_unhash(&slots[i]);
+        }
+    }
+}
+
+uint32_t pagecache_cached_pages(void) {
+    return cached_pages;
+}
@@ -0,0 +1,511 @@
+/*
+ * tmpfs.c - In-memory filesystem
+ *
+ * Nodes form a tree rooted at the mount point.  A directory hashes its
+ * children by name into a power-of-two bucket array that is rehashed when
+ * the load factor reaches one, and also links them in creation order so
+ * listings are stable.  A file is a table of page pointers; pages are
+ * allocated when first written and a NULL slot reads back as zeros.
+ */
+
+#include "fs/tmpfs.h"
+#include "fs/fat32.h"
+#include "cpu/heap.h"
+#include "lib/string.h"
+
+#define TMPFS_MIN_BUCKETS 16
+
+struct tmpfs_node {
+    char     *name;
+    uint32_t  hash;
+    uint32_t  ino;                      /* Stable identity for the page cache */
+    uint8_t   type;                     /* VFS_NODE_FILE or VFS_NODE_DIRECTORY */
+    struct tmpfs_node *parent;
+    struct tmpfs_node *hash_next;       /* Bucket chain in the parent */
+    struct tmpfs_node *sibling;         /* Creation order in the parent */
+
+    /* Directories */
+    struct tmpfs_node **buckets;
+    uint32_t bucket_mask;
+    uint32_t child_count;
+    struct tmpfs_node *first_child;
+    struct tmpfs_node *last_child;
+
+    /* Files */
+    uint8_t **pages;
+    uint32_t page_slots;                /* Slots covering the file size */
+    uint32_t page_cap;
+    uint32_t size;
+};
+
+struct tmpfs_handle {
+    struct tmpfs_node *node;
+    uint32_t position;
+    int      flags;
+    int      in_use;
+};
+
+static struct tmpfs_node   tmpfs_root;
+static struct tmpfs_handle *handles;     /* Grown on demand */
+static int                  handle_count;
+static uint32_t            pages_in_use;
+static uint32_t            next_ino;
+
+/* =========================================================================
+ * Directories
+ * ======================================================================= */
+
+static uint32_t tmpfs_hash(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static struct tmpfs_node *tmpfs_dir_find(const struct tmpfs_node *dir,
+                                         const char *name,
+                                         size_t len) {
+    if (!dir->buckets) return NULL;
+
+    uint32_t h = tmpfs_hash(name, len);
+    for (struct tmpfs_node *n = dir->buckets[h & dir->bucket_mask]; n; n = n->hash_next) {
+        if (n->hash == h && strlen(n->name) == len && memcmp(n->name, name, len) == 0) {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * tmpfs_dir_grow - make room for one more child, doubling the bucket
+ * array and rehashing once the load factor would exceed one.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int tmpfs_dir_grow(struct tmpfs_node *dir) {
+    uint32_t buckets = dir->buckets ? dir->bucket_mask + 1 : 0;
+    if (dir->child_count < buckets) return 0;
+
+    uint32_t new_count = buckets ? buckets * 2 : TMPFS_MIN_BUCKETS;
+    struct tmpfs_node **table =
+        (struct tmpfs_node **)kzalloc(sizeof(*table) * new_count);
+    if (!table) return -1;
+
+    for (struct tmpfs_node *n = dir->first_child; n; n = n->sibling) {
+        uint32_t b = n->hash & (new_count - 1);
+        n->hash_next = table[b];
+        table[b] = n;
+    }
+
+    if (dir->buckets) kfree(dir->buckets);
+    dir->buckets = table;
+    dir->bucket_mask = new_count - 1;
+    return 0;
+}
+
+static struct tmpfs_node *tmpfs_dir_add(struct tmpfs_node *dir,
+                                        const char *name,
+                                        size_t len,
+                                        uint8_t type) {
+    if (len == 0 || len >= VFS_NAME_MAX) return NULL;
+    if (tmpfs_dir_grow(dir) != 0) return NULL;
+
+    struct tmpfs_node *node = (struct tmpfs_node *)kzalloc(sizeof(*node));
+    if (!node) return NULL;
+
+    node->name = (char *)kmalloc(len + 1);
+    if (!node->name) {
+        kfree(node);
+        return NULL;
+    }
+    memcpy(node->name, name, len);
+    node->name[len] = '\0';
+    node->hash   = tmpfs_hash(name, len);
+    node->ino    = next_ino++;
+    node->type   = type;
+    node->parent = dir;
+
+    uint32_t b = node->hash & dir->bucket_mask;
+    node->hash_next = dir->buckets[b];
+    dir->buckets[b] = node;
+
+    if (dir->last_child) dir->last_child->sibling = node;
+    else dir->first_child = node;
+    dir->last_child = node;
+    dir->child_count++;
+    return node;
+}
+
+/*
+ * tmpfs_next_component - advance *path past the next path component and
+ * return it through name/len.  "." components are skipped.
+ * Returns 1 if a component was found, 0 at the end of the path.
+ */
+static int tmpfs_next_component(const char **path, const char **name, size_t *len) {
+    const char *p = *path;
+
+    for (;;) {
+        while (*p == '/') p++;
+        if (*p == '\0') {
+            *path = p;
+            return 0;
+        }
+
+        const char *start = p;
+        while (*p && *p != '/') p++;
+
+        if (p - start == 1 && start[0] == '.') continue;
+        *name = start;
+        *len  = (size_t)(p - start);
+        *path = p;
+        return 1;
+    }
+}
+
+static int tmpfs_path_has_more(const char *path) {
+    const char *name;
+    size_t len;
+    return tmpfs_next_component(&path, &name, &len);
+}
+
+/*
+ * tmpfs_walk - resolve path.  On success returns the node; when the last
+ * component is missing but its parent exists, returns NULL and sets
+ * *parent, *leaf and *leaf_len so the caller can create it.
+ */
+static struct tmpfs_node *tmpfs_walk(const char *path,
+                                     struct tmpfs_node **parent,
+                                     const char **leaf,
+                                     size_t *leaf_len) {
+    struct tmpfs_node *node = &tmpfs_root;
+    const char *name;
+    size_t len;
+
+    if (parent) *parent = NULL;
+    if (!path) return NULL;
+
+    while (tmpfs_next_component(&path, &name, &len)) {
+        if (len == 2 && name[0] == '.' && name[1] == '.') {
+            if (node->parent) node = node->parent;
+            continue;
+        }
+        if (node->type != VFS_NODE_DIRECTORY) return NULL;
+
+        struct tmpfs_node *child = tmpfs_dir_find(node, name, len);
+        if (!child) {
+            if (parent && !tmpfs_path_has_more(path)) {
+                *parent   = node;
+                *leaf     = name;
+                *leaf_len = len;
+            }
+            return NULL;
+        }
+        node = child;
+    }
+    return node;
+}
+
+/* =========================================================================
+ * File pages
+ * ======================================================================= */
+
+/*
+ * tmpfs_file_reserve - make the page table cover slots entries, doubling
+ * its capacity so a stream of appends costs O(1) amortized.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int tmpfs_file_reserve(struct tmpfs_node *file, uint32_t slots) {
+    if (slots > file->page_cap) {
+        uint32_t cap = file->page_cap ? file->page_cap : 4;
+        while (cap < slots) cap *= 2;
+
+        uint8_t **table = (uint8_t **)kzalloc(sizeof(*table) * cap);
+        if (!table) return -1;
+        if (file->pages) {
+            memcpy(table, file->pages, sizeof(*table) * file->page_slots);
+            kfree(file->pages);
+        }
+        file->pages    = table;
+        file->page_cap = cap;
+    }
+
+    if (slots > file->page_slots) file->page_slots = slots;
+    return 0;
+}
+
+static void tmpfs_file_truncate(struct tmpfs_node *file) {
+    for (uint32_t i = 0; i < file->page_slots; i++) {
+        if (file->pages[i]) {
+            kfree(file->pages[i]);
+            file->pages[i] = NULL;
+            pages_in_use--;
+        }
+    }
+    file->page_slots = 0;
+    file->size = 0;
+}
+
+static uint8_t *tmpfs_file_page(struct tmpfs_node *file, uint32_t index) {
+    if (file->pages[index]) return file->pages[index];
+    if (pages_in_use >= TMPFS_MAX_PAGES) return NULL;
+
+    uint8_t *page = (uint8_t *)kzalloc(TMPFS_PAGE_SIZE);
+    if (!page) return NULL;
+    file->pages[index] = page;
+    pages_in_use++;
+    return page;
+}
+
+static int tmpfs_alloc_handle(void) {
+    for (int i = 0; i < handle_count; i++) {
+        if (!handles[i].in_use) return i;
+    }
+
+    int count = handle_count ? handle_count * 2 : TMPFS_INITIAL_HANDLES;
+    struct tmpfs_handle *table =
+        (struct tmpfs_handle *)kzalloc(sizeof(*table) * (size_t)count);
+    if (!table) return -1;
+
+    if (handles) {
+        memcpy(table, handles, sizeof(*table) * (size_t)handle_count);
+        kfree(handles);
+    }
+
+    int handle = handle_count;
+    handles = table;
+    handle_count = count;
+    return handle;
+}
+
+/* =========================================================================
+ * Public interface
+ * ======================================================================= */
+
+int tmpfs_init(void) {
+    memset(&tmpfs_root, 0, sizeof(tmpfs_root));
+    if (handles) kfree(handles);
+    handles = NULL;
+    handle_count = 0;
+    tmpfs_root.name = "/";
+    tmpfs_root.type = VFS_NODE_DIRECTORY;
+    tmpfs_root.ino  = 1;
+    pages_in_use = 0;
+    next_ino = 2;
+    return 0;
+}
+
+/*
+ * tmpfs_open - open or create the file at path.
+ * Returns a handle on success, -1 on failure.
+ */
+int tmpfs_open(const char *path, int flags) {
+    struct tmpfs_node *parent = NULL;
+    const char *leaf = NULL;
+    size_t leaf_len = 0;
+
+    struct tmpfs_node *node = tmpfs_walk(path, &parent, &leaf, &leaf_len);
+    if (!node) {
+        if (!(flags & FAT32_O_CREAT) || !parent) return -1;
+        node = tmpfs_dir_add(parent, leaf, leaf_len, VFS_NODE_FILE);
+        if (!node) return -1;
+    }
+    if (node->type != VFS_NODE_FILE) return -1;
+
+    int handle = tmpfs_alloc_handle();
+    if (handle < 0) return -1;
+
+    if (flags & FAT32_O_TRUNC) tmpfs_file_truncate(node);
+
+    handles[handle].node     = node;
+    handles[handle].flags    = flags;
+    handles[handle].position = (flags & FAT32_O_APPEND) ? node->size : 0;
+    handles[handle].in_use   = 1;
+    return handle;
+}
+
+int tmpfs_close(int handle) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use) return -1;
+    memset(&handles[handle], 0, sizeof(handles[handle]));
+    return 0;
+}
+
+ssize_t tmpfs_read(int handle, void *buf, size_t count) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use || !buf) return -1;
+
+    struct tmpfs_handle *h = &handles[handle];
+    struct tmpfs_node   *file = h->node;
+    uint8_t *out = (uint8_t *)buf;
+    size_t   total = 0;
+
+    if (h->position >= file->size) return 0;
+    if (count > file->size - h->position) count = file->size - h->position;
+
+    while (total < count) {
+        uint32_t pos    = h->position + (uint32_t)total;
+        uint32_t offset = pos % TMPFS_PAGE_SIZE;
+        uint32_t chunk  = TMPFS_PAGE_SIZE - offset;
+        if (chunk > count - total) chunk = (uint32_t)(count - total);
+
+        const uint8_t *page = file->pages[pos / TMPFS_PAGE_SIZE];
+        if (page) memcpy(out + total, page + offset, chunk);
+        else memset(out + total, 0, chunk);
+        total += chunk;
+    }
+
+    h->position += (uint32_t)total;
+    return (ssize_t)total;
+}
+
+ssize_t tmpfs_write(int handle, const void *buf, size_t count) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use || !buf) return -1;
+    if (!(handles[handle].flags & (FAT32_O_WRONLY | FAT32_O_RDWR))) return -1;
+    if (!count) return 0;
+
+    struct tmpfs_handle *h = &handles[handle];
+    struct tmpfs_node   *file = h->node;
+    const uint8_t *in = (const uint8_t *)buf;
+    size_t total = 0;
+
+    uint32_t end = h->position + (uint32_t)count;
+    if (end < h->position) return -1;
+    if (tmpfs_file_reserve(file, (end + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE) != 0) {
+        return -1;
+    }
+
+    while (total < count) {
+        uint32_t pos    = h->position + (uint32_t)total;
+        uint32_t offset = pos % TMPFS_PAGE_SIZE;
+        uint32_t chunk  = TMPFS_PAGE_SIZE - offset;
+        if (chunk > count - total) chunk = (uint32_t)(count - total);
+
+        uint8_t *page = tmpfs_file_page(file, pos / TMPFS_PAGE_SIZE);
+        if (!page) break;
+        memcpy(page + offset, in + total, chunk);
+        total += chunk;
+    }
+
+    h->position += (uint32_t)total;
+    if (h->position > file->size) file->size = h->position;
+    return total ? (ssize_t)total : -1;
+}
+
+ssize_t tmpfs_pread(int handle, void *buf, size_t count, uint32_t offset) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use) return -1;
+
+    uint32_t saved = handles[handle].position;
+    handles[handle].position = offset;
+    ssize_t n = tmpfs_read(handle, buf, count);
+    handles[handle].position = saved;
+    return n;
+}
+
+ssize_t tmpfs_pwrite(int handle, const void *buf, size_t count, uint32_t offset) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use) return -1;
+
+    uint32_t saved = handles[handle].position;
+    handles[handle].position = offset;
+    ssize_t n = tmpfs_write(handle, buf, count);
+    handles[handle].position = saved;
+    return n;
+}
+
+int64_t tmpfs_seek(int handle, int64_t offset, int whence) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use) return -1;
+
+    struct tmpfs_handle *h = &handles[handle];
+    int64_t base;
+
+    switch (whence) {
+        case FAT32_SEEK_SET: base = 0;                      break;
+        case FAT32_SEEK_CUR: base = (int64_t)h->position;   break;
+        case FAT32_SEEK_END: base = (int64_t)h->node->size; break;
+        default: return -1;
+    }
+
+    int64_t target = base + offset;
+    if (target < 0 || target > (int64_t)0xFFFFFFFFu) return -1;
+
+    h->position = (uint32_t)target;
+    return target;
+}
+
+static void tmpfs_fill_stat(const struct tmpfs_node *node, struct vfs_stat *st) {
+    memset(st, 0, sizeof(*st));
+    strncpy(st->name, node->name, sizeof(st->name) - 1);
+    st->size    = node->size;
+    st->type    = node->type;
+    st->attr    = (node->type == VFS_NODE_DIRECTORY) ? FAT32_ATTR_DIRECTORY
+                                                     : FAT32_ATTR_ARCHIVE;
+    st->fs_data = node->ino;
+}
+
+int tmpfs_fstat(int handle, struct vfs_stat *st) {
+    if (handle < 0 || handle >= handle_count) return -1;
+    if (!handles[handle].in_use || !st) return -1;
+
+    tmpfs_fill_stat(handles[handle].node, st);
+    return 0;
+}
+
+int tmpfs_stat(const char *path, struct vfs_stat *st) {
+    struct tmpfs_node *node = tmpfs_walk(path, NULL, NULL, NULL);
+    if (!node) return -1;
+    if (!st) return 0;
+
+    tmpfs_fill_stat(node, st);
+    return 0;
+}
+
+int tmpfs_listdir(const char *path, struct vfs_dirent *entries, int max_entries) {
+    uint32_t cursor = 0;
+    return tmpfs_readdir(path, &cursor, entries, max_entries);
+}
+
+/*
+ * tmpfs_readdir - list children of path in creation order, starting at
+ * ordinal *cursor, and advance *cursor past the entries returned.
+ * Returns the number of entries filled (0 at the end), or -1 on error.
+ */
+int tmpfs_readdir(const char *path, uint32_t *cursor,
+                  struct vfs_dirent *entries, int max_entries) {
+    if (!cursor || !entries || max_entries <= 0) return -1;
+
+    struct tmpfs_node *dir = tmpfs_walk(path, NULL, NULL, NULL);
+    if (!dir || dir->type != VFS_NODE_DIRECTORY) return -1;
+
+    struct tmpfs_node *n = dir->first_child;
+    for (uint32_t skip = *cursor; n && skip > 0; skip--) n = n->sibling;
+
+    int count = 0;
+    for (; n && count < max_entries; n = n->sibling) {
+        memset(&entries[count], 0, sizeof(entries[count]));
+        strncpy(entries[count].name, n->name, sizeof(entries[count].name) - 1);
+        entries[count].size = n->size;
+        entries[count].type = n->type;
+        entries[count].attr = (n->type == VFS_NODE_DIRECTORY) ? FAT32_ATTR_DIRECTORY
+                                                              : FAT32_ATTR_ARCHIVE;
+        entries[count].fs_data = n->ino;
+        count++;
+    }
+    *cursor += (uint32_t)count;
+    return count;
+}
+
+/*
+ * tmpfs_mkdir - create a directory whose parent already exists.
+ * Returns 0 on success, -1 if it exists or the parent is missing.
+ */
+int tmpfs_mkdir(const char *path) {
+    struct tmpfs_node *parent = NULL;
+    const char *leaf = NULL;
+    size_t leaf_len = 0;
+
+    if (tmpfs_walk(path, &parent, &leaf, &leaf_len) || !parent) return -1;
+    return tmpfs_dir_add(parent, leaf, leaf_len, VFS_NODE_DIRECTORY) ? 0 : -1;
+}
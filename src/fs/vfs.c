@@ -1,6 +1,9 @@
 #include "fs/vfs.h"
 
+#include "fs/dcache.h"
 #include "fs/fat32.h"
+#include "fs/pagecache.h"
+#include "fs/tmpfs.h"
 #include "cpu/heap.h"
 #include "lib/string.h"
 
@@ -15,10 +18,19 @@ struct vfs_file {
     struct vfs_mount *mount;
     int               backend_handle;
     int               in_use;
+    int               open;             /* Not yet vfs_close'd */
+    int               map_refs;         /* Memory mappings using this file */
 };
 
+#define VFS_COPY_CHUNK  65536   /* Bounce buffer for vfs_copy_range */
+
+/* vfs_readdir cursors with this bit set have moved on to the mount points */
+#define VFS_CURSOR_MOUNTS (1ull << 32)
+
 static struct vfs_mount mounts[VFS_MAX_MOUNTS];
-static struct vfs_file  open_files[VFS_MAX_OPEN_FILES];
+static struct vfs_mount specials[VFS_MAX_SPECIAL];   /* Never reached by path */
+static struct vfs_file *open_files;      /* Grown on demand */
+static int              open_count;
 
 static int path_prefix_match(const char *mount_point, const char *path) {
     size_t mount_len;
@@ -85,11 +97,28 @@ static struct vfs_mount *find_mount_for_path(const char *path) {
     return best;
 }
 
+/*
+ * alloc_open_slot - return a free open-file slot, doubling the table when
+ * every slot is taken.  Returns the slot index, or -1 if out of memory.
+ */
 static int alloc_open_slot(void) {
-    for (int i = 0; i < VFS_MAX_OPEN_FILES; i++) {
+    for (int i = 0; i < open_count; i++) {
         if (!open_files[i].in_use) return i;
     }
-    return -1;
+
+    int count = open_count ? open_count * 2 : VFS_INITIAL_OPEN_FILES;
+    struct vfs_file *table = (struct vfs_file *)kzalloc(sizeof(*table) * (size_t)count);
+    if (!table) return -1;
+
+    if (open_files) {
+        memcpy(table, open_files, sizeof(*table) * (size_t)open_count);
+        kfree(open_files);
+    }
+
+    int slot = open_count;
+    open_files = table;
+    open_count = count;
+    return slot;
 }
 
 static int fat32_vfs_stat(const char *path, struct vfs_stat *st) {
@@ -108,14 +137,30 @@ static int fat32_vfs_stat(const char *path, struct vfs_stat *st) {
     return 0;
 }
 
-static int fat32_vfs_listdir(const char *path,
+static int fat32_vfs_fstat(int handle, struct vfs_stat *st) {
+    struct fat32_dirent dent;
+
+    if (fat32_fstat(handle, &dent) != 0) return -1;
+
+    memset(st, 0, sizeof(*st));
+    strncpy(st->name, dent.name, sizeof(st->name) - 1);
+    st->size = dent.size;
+    st->attr = dent.attr;
+    st->type = (dent.attr & FAT32_ATTR_DIRECTORY) ? VFS_NODE_DIRECTORY
+                                                  : VFS_NODE_FILE;
+    st->fs_data = dent.cluster;
+    return 0;
+}
+
+static int fat32_vfs_readdir(const char *path,
+                             uint32_t *cursor,
                              struct vfs_dirent *entries,
                              int max_entries) {
     struct fat32_dirent *tmp;
     uint32_t saved_dir;
     int count;
 
-    if (!entries || max_entries <= 0) return -1;
+    if (!cursor || !entries || max_entries <= 0) return -1;
 
     tmp = (struct fat32_dirent *)kmalloc(sizeof(*tmp) * (size_t)max_entries);
     if (!tmp) return -1;
@@ -136,7 +181,7 @@ static int fat32_vfs_listdir(const char *path,
         }
     }
 
-    count = fat32_readdir(tmp, max_entries);
+    count = fat32_readdir_at(cursor, tmp, max_entries);
     fat32_set_current_directory(saved_dir);
     if (count < 0) {
         kfree(tmp);
@@ -157,6 +202,13 @@ static int fat32_vfs_listdir(const char *path,
     return count;
 }
 
+static int fat32_vfs_listdir(const char *path,
+                             struct vfs_dirent *entries,
+                             int max_entries) {
+    uint32_t cursor = 0;
+    return fat32_vfs_readdir(path, &cursor, entries, max_entries);
+}
+
 static int register_mount(const char *name,
                           const char *mount_point,
                           const struct vfs_ops *ops) {
@@ -179,7 +231,11 @@ static int register_mount(const char *name,
 
 int vfs_init(void) {
     memset(mounts, 0, sizeof(mounts));
-    memset(open_files, 0, sizeof(open_files));
+    if (open_files) kfree(open_files);
+    open_files = NULL;
+    open_count = 0;
+    dcache_init();
+    pagecache_init();
     return 0;
 }
 
@@ -191,11 +247,132 @@ int vfs_register_fat32_root(void) {
         .write = fat32_write,
         .stat = fat32_vfs_stat,
         .listdir = fat32_vfs_listdir,
+        .pread = fat32_pread,
+        .pwrite = fat32_pwrite,
+        .seek = fat32_seek,
+        .fstat = fat32_vfs_fstat,
+        .reserve = fat32_reserve,
+        .readdir = fat32_vfs_readdir,
     };
 
     return register_mount("fat32", "/", &fat32_ops);
 }
 
+int vfs_register_tmpfs(const char *mount_point) {
+    const struct vfs_ops tmpfs_ops = {
+        .open = tmpfs_open,
+        .close = tmpfs_close,
+        .read = tmpfs_read,
+        .write = tmpfs_write,
+        .stat = tmpfs_stat,
+        .listdir = tmpfs_listdir,
+        .pread = tmpfs_pread,
+        .pwrite = tmpfs_pwrite,
+        .seek = tmpfs_seek,
+        .fstat = tmpfs_fstat,
+        .readdir = tmpfs_readdir,
+    };
+
+    if (tmpfs_init() != 0) return -1;
+    return register_mount("tmpfs", mount_point, &tmpfs_ops);
+}
+
+/*
+ * vfs_register_special - add a file type that has no path, whose objects
+ * are created by their subsystem and handed out with vfs_open_special.
+ * Only ops that make sense for a stream (read, write, close) need to be
+ * set.  Returns the type id, or -1 if the table is full.
+ */
+int vfs_register_special(const char *name, const struct vfs_ops *ops) {
+    if (!name || !ops) return -1;
+
+    for (int i = 0; i < VFS_MAX_SPECIAL; i++) {
+        if (!specials[i].active) {
+            memset(&specials[i], 0, sizeof(specials[i]));
+            specials[i].name = name;
+            specials[i].ops = *ops;
+            specials[i].active = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * vfs_open_special - wrap the subsystem object handle in an open file of
+ * the given special type.  Returns the VFS fd, or -1 on failure; the
+ * handle is not closed on failure.
+ */
+int vfs_open_special(int type, int handle) {
+    if (type < 0 || type >= VFS_MAX_SPECIAL || !specials[type].active) return -1;
+
+    int slot = alloc_open_slot();
+    if (slot < 0) return -1;
+
+    open_files[slot].mount = &specials[type];
+    open_files[slot].backend_handle = handle;
+    open_files[slot].in_use = 1;
+    open_files[slot].open = 1;
+    return slot;
+}
+
+/*
+ * vfs_special_handle - the subsystem handle behind fd if it is open on a
+ * special file of the given type, else -1.
+ */
+int vfs_special_handle(int fd, int type) {
+    if (type < 0 || type >= VFS_MAX_SPECIAL) return -1;
+    if (fd < 0 || fd >= open_count || !open_files[fd].in_use) return -1;
+    if (open_files[fd].mount != &specials[type] || !open_files[fd].open) return -1;
+    return open_files[fd].backend_handle;
+}
+
+/*
+ * root_mount_name - name under "/" of mount i, or NULL if it is inactive,
+ * the root itself, or nested deeper.
+ */
+static const char *root_mount_name(int i) {
+    const char *name = mounts[i].mount_point + 1;
+
+    if (!mounts[i].active || mounts[i].mount_point[0] != '/') return NULL;
+    if (*name == '\0') return NULL;
+    for (const char *p = name; *p; p++) {
+        if (*p == '/') return NULL;         /* nested mount point */
+    }
+    return name;
+}
+
+static void fill_mount_dirent(struct vfs_dirent *entry, const char *name) {
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    entry->type = VFS_NODE_DIRECTORY;
+    entry->attr = FAT32_ATTR_DIRECTORY;
+}
+
+/*
+ * append_mount_points - add mounts that sit directly below the root to a
+ * root listing, so /tmp shows up even though FAT32 has no such directory.
+ */
+static int append_mount_points(struct vfs_dirent *entries,
+                               int count,
+                               int max_entries) {
+    for (int i = 0; i < VFS_MAX_MOUNTS && count < max_entries; i++) {
+        const char *name = root_mount_name(i);
+        int skip = 0;
+
+        if (!name) continue;
+
+        for (int j = 0; j < count && !skip; j++) {
+            if (strcmp(entries[j].name, name) == 0) skip = 1;
+        }
+        if (skip) continue;
+
+        fill_mount_dirent(&entries[count], name);
+        count++;
+    }
+    return count;
+}
+
 int vfs_open(const char *path, int flags) {
     struct vfs_mount *mount;
     char local_path[VFS_PATH_MAX];
@@ -210,6 +387,14 @@ int vfs_open(const char *path, int flags) {
         return -1;
     }
 
+    /* Truncation discards the old contents; cached pages must not outlive it */
+    if ((flags & FAT32_O_TRUNC) && pagecache_cached_pages() > 0 && mount->ops.stat) {
+        struct vfs_stat old;
+        if (mount->ops.stat(local_path, &old) == 0) {
+            pagecache_invalidate_file((uint32_t)(mount - mounts), old.fs_data);
+        }
+    }
+
     backend_handle = mount->ops.open(local_path, flags);
     if (backend_handle < 0) return -1;
 
@@ -222,34 +407,212 @@ int vfs_open(const char *path, int flags) {
     open_files[slot].mount = mount;
     open_files[slot].backend_handle = backend_handle;
     open_files[slot].in_use = 1;
+    open_files[slot].open = 1;
     return slot;
 }
 
-int vfs_close(int fd) {
-    if (fd < 0 || fd >= VFS_MAX_OPEN_FILES || !open_files[fd].in_use) return -1;
-    if (!open_files[fd].mount || !open_files[fd].mount->ops.close) return -1;
+static struct vfs_file *vfs_file_get(int fd) {
+    if (fd < 0 || fd >= open_count || !open_files[fd].in_use) return NULL;
+    if (!open_files[fd].mount) return NULL;
+    return &open_files[fd];
+}
 
-    int rc = open_files[fd].mount->ops.close(open_files[fd].backend_handle);
-    memset(&open_files[fd], 0, sizeof(open_files[fd]));
+static int vfs_release(struct vfs_file *file) {
+    int rc = -1;
+
+    if (file->mount->ops.close) {
+        rc = file->mount->ops.close(file->backend_handle);
+    }
+    memset(file, 0, sizeof(*file));
     return rc;
 }
 
+/*
+ * vfs_close - close fd.  Each open file belongs to exactly one descriptor;
+ * the back end file stays open only while a memory mapping still uses it.
+ */
+int vfs_close(int fd) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open) return -1;
+    if (!file->mount->ops.close) return -1;
+
+    file->open = 0;
+    if (file->map_refs > 0) return 0;
+    return vfs_release(file);
+}
+
 ssize_t vfs_read(int fd, void *buf, size_t count) {
-    if (fd < 0 || fd >= VFS_MAX_OPEN_FILES || !open_files[fd].in_use) return -1;
-    if (!open_files[fd].mount || !open_files[fd].mount->ops.read) return -1;
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open || !file->mount->ops.read) return -1;
 
-    return open_files[fd].mount->ops.read(open_files[fd].backend_handle,
-                                          buf,
-                                          count);
+    return file->mount->ops.read(file->backend_handle, buf, count);
+}
+
+/*
+ * vfs_poll - current EPOLL_* readiness of fd, and through source the
+ * object to watch for changes.  Only special files can be polled.
+ * Returns the mask, or -1 if fd cannot be polled.
+ */
+int vfs_poll(int fd, struct epoll_source **source) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open || !file->mount->ops.poll) return -1;
+
+    return file->mount->ops.poll(file->backend_handle, source);
+}
+
+/* Keep cached pages of fd's file in step with n bytes just written at pos. */
+static void vfs_write_notify(int fd, uint32_t pos, const void *buf, ssize_t n) {
+    uint32_t mount_id, file_id;
+
+    if (vfs_file_id(fd, &mount_id, &file_id) == 0) {
+        pagecache_update(mount_id, file_id, pos, buf, (size_t)n);
+    }
 }
 
 ssize_t vfs_write(int fd, const void *buf, size_t count) {
-    if (fd < 0 || fd >= VFS_MAX_OPEN_FILES || !open_files[fd].in_use) return -1;
-    if (!open_files[fd].mount || !open_files[fd].mount->ops.write) return -1;
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open || !file->mount->ops.write) return -1;
+
+    /* Only pay for the position lookup when some file has cached pages */
+    int64_t pos = -1;
+    if (pagecache_cached_pages() > 0 && file->mount->ops.seek) {
+        pos = file->mount->ops.seek(file->backend_handle, 0, VFS_SEEK_CUR);
+    }
+
+    ssize_t n = file->mount->ops.write(file->backend_handle, buf, count);
+    if (n > 0 && pos >= 0) vfs_write_notify(fd, (uint32_t)pos, buf, n);
+    return n;
+}
+
+ssize_t vfs_pread(int fd, void *buf, size_t count, uint32_t offset) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->mount->ops.pread) return -1;
+
+    return file->mount->ops.pread(file->backend_handle, buf, count, offset);
+}
+
+ssize_t vfs_pwrite(int fd, const void *buf, size_t count, uint32_t offset) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open || !file->mount->ops.pwrite) return -1;
+
+    ssize_t n = file->mount->ops.pwrite(file->backend_handle, buf, count, offset);
+    if (n > 0 && pagecache_cached_pages() > 0) vfs_write_notify(fd, offset, buf, n);
+    return n;
+}
+
+int64_t vfs_seek(int fd, int64_t offset, int whence) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open || !file->mount->ops.seek) return -1;
+
+    return file->mount->ops.seek(file->backend_handle, offset, whence);
+}
+
+/*
+ * vfs_copy_range - copy up to len bytes from in_fd to out_fd inside the
+ * kernel.  An offset of -1 means "at the file position", which is then
+ * advanced; an explicit offset leaves the position alone.  The
+ * destination's space is reserved up front so the back end can allocate
+ * it in one pass.  Returns the number of bytes copied, 0 at end of input,
+ * or -1 if nothing could be copied.
+ */
+ssize_t vfs_copy_range(int in_fd, int64_t in_off, int out_fd, int64_t out_off,
+                       size_t len) {
+    struct vfs_file *in  = vfs_file_get(in_fd);
+    struct vfs_file *out = vfs_file_get(out_fd);
+    struct vfs_stat st;
+
+    if (!in || !out || !in->open || !out->open) return -1;
+    if (len == 0) return 0;
+
+    int64_t in_pos  = (in_off  >= 0) ? in_off  : vfs_seek(in_fd, 0, VFS_SEEK_CUR);
+    int64_t out_pos = (out_off >= 0) ? out_off : vfs_seek(out_fd, 0, VFS_SEEK_CUR);
+    if (in_pos < 0 || out_pos < 0) return -1;
+    if (in_pos > 0xFFFFFFFFll || out_pos > 0xFFFFFFFFll) return -1;
+    if (vfs_fstat(in_fd, &st) != 0) return -1;
+
+    if ((int64_t)st.size <= in_pos) return 0;
+    if (len > (size_t)((int64_t)st.size - in_pos)) {
+        len = (size_t)((int64_t)st.size - in_pos);
+    }
+    if ((uint64_t)out_pos + len > 0xFFFFFFFFull) return -1;
+
+    if (out->mount->ops.reserve &&
+        out->mount->ops.reserve(out->backend_handle, (uint32_t)out_pos,
+                                (uint32_t)len) != 0) {
+        return -1;
+    }
+
+    uint8_t *buf = (uint8_t *)kmalloc(VFS_COPY_CHUNK);
+    if (!buf) return -1;
+
+    size_t total = 0;
+    while (total < len) {
+        size_t chunk = len - total;
+        if (chunk > VFS_COPY_CHUNK) chunk = VFS_COPY_CHUNK;
+
+        ssize_t got = vfs_pread(in_fd, buf, chunk, (uint32_t)in_pos);
+        if (got <= 0) break;
+
+        ssize_t put = vfs_pwrite(out_fd, buf, (size_t)got, (uint32_t)out_pos);
+        if (put <= 0) break;
+
+        total   += (size_t)put;
+        in_pos  += put;
+        out_pos += put;
+        if (put < got) break;
+    }
+    kfree(buf);
+
+    if (in_off  < 0) vfs_seek(in_fd, in_pos, VFS_SEEK_SET);
+    if (out_off < 0) vfs_seek(out_fd, out_pos, VFS_SEEK_SET);
+    return (total > 0) ? (ssize_t)total : -1;
+}
+
+int vfs_fstat(int fd, struct vfs_stat *st) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !st || !file->mount->ops.fstat) return -1;
 
-    return open_files[fd].mount->ops.write(open_files[fd].backend_handle,
-                                           buf,
-                                           count);
+    return file->mount->ops.fstat(file->backend_handle, st);
+}
+
+/*
+ * vfs_file_id - identify the file behind fd for the page cache: the mount
+ * slot plus the back end's stable file id (vfs_stat.fs_data).
+ * Returns 0 on success, -1 if fd is invalid.
+ */
+int vfs_file_id(int fd, uint32_t *mount_id, uint32_t *file_id) {
+    struct vfs_file *file = vfs_file_get(fd);
+    struct vfs_stat st;
+
+    if (!file) return -1;
+    /* Special files have no mount slot to name */
+    for (int i = 0; i < VFS_MAX_SPECIAL; i++) {
+        if (file->mount == &specials[i]) return -1;
+    }
+    if (vfs_fstat(fd, &st) != 0) return -1;
+    if (mount_id) *mount_id = (uint32_t)(open_files[fd].mount - mounts);
+    if (file_id)  *file_id  = st.fs_data;
+    return 0;
+}
+
+/*
+ * vfs_map_ref / vfs_map_unref - keep fd's back end file open while a
+ * memory mapping needs it to fill pages, even after vfs_close.
+ */
+int vfs_map_ref(int fd) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || !file->open) return -1;
+
+    file->map_refs++;
+    return 0;
+}
+
+void vfs_map_unref(int fd) {
+    struct vfs_file *file = vfs_file_get(fd);
+    if (!file || file->map_refs <= 0) return;
+
+    file->map_refs--;
+    if (file->map_refs == 0 && !file->open) vfs_release(file);
 }
 
 int vfs_stat(const char *path, struct vfs_stat *st) {
@@ -285,5 +648,64 @@ int vfs_listdir(const char *path, struct vfs_dirent *entries, int max_entries) {
         return -1;
     }
 
-    return mount->ops.listdir(local_path, entries, max_entries);
+    int count = mount->ops.listdir(local_path, entries, max_entries);
+    if (count >= 0 && path[0] == '/' && path[1] == '\0') {
+        count = append_mount_points(entries, count, max_entries);
+    }
+    return count;
+}
+
+/*
+ * vfs_readdir - resumable directory listing.  Start with *cursor at 0 and
+ * pass it back unchanged to continue.  Listing "/" ends with the mount
+ * points below it, after the root file system's own entries.
+ * Returns the number of entries filled (0 at the end), or -1 on error.
+ */
+int vfs_readdir(const char *path, uint64_t *cursor,
+                struct vfs_dirent *entries, int max_entries) {
+    struct vfs_mount *mount;
+    char local_path[VFS_PATH_MAX];
+    int is_root = (path && path[0] == '/' && path[1] == '\0');
+    int count = 0;
+
+    if (!cursor || !entries || max_entries <= 0) return -1;
+
+    if (!path || path[0] == '\0') {
+        mount = find_mount_for_path("/");
+        local_path[0] = '\0';
+    } else {
+        mount = find_mount_for_path(path);
+        if (mount && translate_path(mount, path, local_path, sizeof(local_path)) != 0) {
+            return -1;
+        }
+    }
+    if (!mount || !mount->ops.readdir) return -1;
+
+    if (!(*cursor & VFS_CURSOR_MOUNTS)) {
+        uint32_t pos = (uint32_t)*cursor;
+
+        count = mount->ops.readdir(local_path, &pos, entries, max_entries);
+        if (count < 0) return -1;
+        *cursor = pos;
+        if (count > 0 || !is_root) return count;
+        *cursor = VFS_CURSOR_MOUNTS;
+    }
+
+    for (int i = (int)(*cursor & 0xFFFFFFFFu); i < VFS_MAX_MOUNTS && count < max_entries; i++) {
+        const char *name = root_mount_name(i);
+        *cursor = VFS_CURSOR_MOUNTS | (uint64_t)(i + 1);
+
+        if (!name) continue;
+
+        /* Skip mounts shadowing a real directory already listed */
+        char real[VFS_PATH_MAX];
+        real[0] = '/';
+        strncpy(real + 1, name, sizeof(real) - 2);
+        real[sizeof(real) - 1] = '\0';
+        if (mount->ops.stat && mount->ops.stat(real, NULL) == 0) continue;
+
+        fill_mount_dirent(&entries[count], name);
+        count++;
+    }
+    return count;
 }
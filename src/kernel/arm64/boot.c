@@ -255,6 +255,9 @@ void arm64_boot_main(uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3)
             fat32_mount() == 0 &&
             vfs_register_fat32_root() == 0) {
             banner_text_line("Storage: ", "ramdisk FAT32 mounted");
+            if (vfs_register_tmpfs("/tmp") == 0) {
+                banner_text_line("Scratch: ", "tmpfs mounted at /tmp");
+            }
             fat32_list_directory("/");
             probe_init_elf(init_path);
             int init_rc = arm64_run_init_program(init_path, "");
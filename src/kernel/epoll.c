@@ -0,0 +1,427 @@
+/*
+ * epoll.c - Readiness multiplexing
+ *
+ * An instance is a VFS special file holding its registrations.  Each
+ * registration of a socket, TCP handle or the keyboard is linked on the
+ * watched source; a notify from the source (often an IRQ) appends it to
+ * the instance's ready list and wakes the instance's waiters, which then
+ * poll just the queued entries.  Registrations whose target goes away are
+ * marked dead and dropped the next time they would be reported.
+ */
+
+#include "kernel/epoll.h"
+#include "kernel/syscall.h"
+#include "kernel/scheduler.h"
+#include "kernel/waitqueue.h"
+#include "drivers/keyboard.h"
+#include "drivers/network.h"
+#include "drivers/timer.h"
+#include "fs/vfs.h"
+#include "cpu/heap.h"
+#include "lib/string.h"
+
+#define EPOLL_INITIAL_SLOTS 8
+
+struct epoll;
+
+struct epoll_item {
+    struct epoll        *ep;
+    struct epoll_source *source;        /* NULL for timers and dead entries */
+    struct epoll_item   *source_next;   /* Source's watcher list */
+    struct epoll_item   *next;          /* Instance's registrations */
+    struct epoll_item   *timer_next;    /* Instance's timer registrations */
+    struct epoll_item   *ready_next;
+    uint8_t  kind;
+    uint8_t  queued;                    /* On the ready list */
+    uint8_t  dead;                      /* Target gone; never reported */
+    int      id;                        /* fd, timer id or TCP handle */
+    int      vfs_fd;                    /* File behind an fd registration */
+    int      owner;                     /* Thread group owning a timer */
+    uint32_t events;
+    uint64_t data;
+    uint64_t timer_seen;                /* Deadline last reported */
+};
+
+struct epoll {
+    struct epoll_item *items;
+    struct epoll_item *timers;
+    struct epoll_item *ready_head;
+    struct epoll_item *ready_tail;
+    uint32_t           ready_count;
+    struct wait_queue  waiters;
+};
+
+static struct epoll **instances;        /* Grown on demand */
+static int            instance_slots;
+static int            epoll_vfs_type = -1;
+
+static uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static void irq_restore(uint64_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" ::: "memory");
+}
+
+/* Append item to its ready list unless it is already there.  IRQs off. */
+static void epoll_queue_locked(struct epoll_item *item) {
+    struct epoll *ep = item->ep;
+
+    if (item->queued) return;
+    item->queued = 1;
+    item->ready_next = NULL;
+    if (ep->ready_tail) {
+        ep->ready_tail->ready_next = item;
+    } else {
+        ep->ready_head = item;
+    }
+    ep->ready_tail = item;
+    ep->ready_count++;
+}
+
+static void epoll_queue(struct epoll_item *item) {
+    uint64_t flags = irq_save();
+    epoll_queue_locked(item);
+    irq_restore(flags);
+}
+
+/*
+ * epoll_source_notify - source's readiness may have changed: queue every
+ * registration watching it and wake their instances.  Safe from IRQ
+ * context.
+ */
+void epoll_source_notify(struct epoll_source *source) {
+    if (!source || !source->watchers) return;
+
+    uint64_t flags = irq_save();
+    for (struct epoll_item *item = source->watchers; item; item = item->source_next) {
+        epoll_queue_locked(item);
+        wait_queue_wake_all(&item->ep->waiters);
+    }
+    irq_restore(flags);
+}
+
+/*
+ * epoll_source_detach - source is going away.  Registrations on it are
+ * marked dead; each is queued once so epoll_wait() drops it promptly.
+ */
+void epoll_source_detach(struct epoll_source *source) {
+    if (!source || !source->watchers) return;
+
+    uint64_t flags = irq_save();
+    struct epoll_item *item = source->watchers;
+    source->watchers = NULL;
+    while (item) {
+        struct epoll_item *next = item->source_next;
+        item->source = NULL;
+        item->source_next = NULL;
+        item->dead = 1;
+        epoll_queue_locked(item);
+        item = next;
+    }
+    irq_restore(flags);
+}
+
+/* Current readiness of a non-timer registration, or negative if it is gone */
+static int epoll_item_poll(struct epoll_item *item, struct epoll_source **source) {
+    if (item->kind == EPOLL_KIND_TCP) return net_tcp_poll(item->id, source);
+    if (item->id == 0) return keyboard_poll(source);
+    return vfs_poll(item->vfs_fd, source);
+}
+
+static void epoll_item_free(struct epoll *ep, struct epoll_item *item) {
+    struct epoll_item **link;
+    uint64_t flags = irq_save();
+
+    if (item->source) {
+        link = &item->source->watchers;
+        while (*link && *link != item) link = &(*link)->source_next;
+        if (*link) *link = item->source_next;
+    }
+    if (item->queued) {
+        struct epoll_item *prev = NULL;
+        for (link = &ep->ready_head; *link && *link != item; link = &(*link)->ready_next) {
+            prev = *link;
+        }
+        if (*link) *link = item->ready_next;
+        if (ep->ready_tail == item) ep->ready_tail = prev;
+        ep->ready_count--;
+    }
+    irq_restore(flags);
+
+    for (link = &ep->items; *link && *link != item; link = &(*link)->next) {}
+    if (*link) *link = item->next;
+    if (item->kind == EPOLL_KIND_TIMER) {
+        for (link = &ep->timers; *link && *link != item; link = &(*link)->timer_next) {}
+        if (*link) *link = item->timer_next;
+    }
+    kfree(item);
+}
+
+static struct epoll_item *epoll_find(struct epoll *ep, int kind, int id) {
+    for (struct epoll_item *item = ep->items; item; item = item->next) {
+        if (item->kind == kind && item->id == id) return item;
+    }
+    return NULL;
+}
+
+/*
+ * epoll_collect_timers - report due timers into out[*n...].  A
+ * level-triggered timer stays due until SYS_TIMER_WAIT consumes its
+ * deadline; an edge-triggered one is reported once per deadline.
+ * Returns the earliest deadline still to come, or 0 if none.
+ */
+static uint64_t epoll_collect_timers(struct epoll *ep, struct numos_epoll_event *out,
+                                     int max_events, int *n) {
+    uint64_t now = timer_get_uptime_ms();
+    uint64_t next = 0;
+
+    for (struct epoll_item *item = ep->timers; item && *n < max_events; item = item->timer_next) {
+        uint64_t deadline;
+
+        if (item->dead) continue;
+        if (timer_prepare_wait_object(item->owner, item->id, &deadline) != 0) {
+            item->dead = 1;
+            continue;
+        }
+        if (deadline > now) {
+            if (!next || deadline < next) next = deadline;
+            continue;
+        }
+        if ((item->events & EPOLL_ET) && deadline == item->timer_seen) continue;
+
+        item->timer_seen = deadline;
+        if (!(item->events & EPOLL_IN)) continue;
+        out[*n].events = EPOLL_IN;
+        out[*n].reserved = 0;
+        out[*n].data = item->data;
+        (*n)++;
+    }
+    return next;
+}
+
+/*
+ * epoll_collect_ready - poll each entry queued on the ready list once.
+ * Entries still ready go back on the tail unless edge-triggered.
+ * Returns the new number of events in out.
+ */
+static int epoll_collect_ready(struct epoll *ep, struct numos_epoll_event *out,
+                               int max_events, int n) {
+    uint32_t budget = ep->ready_count;
+
+    while (n < max_events && budget-- > 0) {
+        uint64_t flags = irq_save();
+        struct epoll_item *item = ep->ready_head;
+        if (!item) {
+            irq_restore(flags);
+            break;
+        }
+        ep->ready_head = item->ready_next;
+        if (!ep->ready_head) ep->ready_tail = NULL;
+        item->ready_next = NULL;
+        item->queued = 0;
+        ep->ready_count--;
+        irq_restore(flags);
+
+        if (item->dead) continue;
+
+        int mask = epoll_item_poll(item, NULL);
+        if (mask < 0) {
+            item->dead = 1;
+            continue;
+        }
+        mask &= (int)(item->events | EPOLL_ERR | EPOLL_HUP) & ~(int)EPOLL_ET;
+        if (!mask) continue;
+
+        out[n].events = (uint32_t)mask;
+        out[n].reserved = 0;
+        out[n].data = item->data;
+        n++;
+        if (!(item->events & EPOLL_ET)) epoll_queue(item);
+    }
+    return n;
+}
+
+static struct epoll *epoll_from_slot(int slot) {
+    if (slot < 0 || slot >= instance_slots) return NULL;
+    return instances[slot];
+}
+
+static struct epoll *epoll_get(int vfs_fd) {
+    if (epoll_vfs_type < 0) return NULL;
+    return epoll_from_slot(vfs_special_handle(vfs_fd, epoll_vfs_type));
+}
+
+static int epoll_vfs_close(int slot) {
+    struct epoll *ep = epoll_from_slot(slot);
+    if (!ep) return -1;
+
+    while (ep->items) epoll_item_free(ep, ep->items);
+    instances[slot] = NULL;
+    kfree(ep);
+    return 0;
+}
+
+/* Return a free instance slot, doubling the table when full, or -1 */
+static int epoll_alloc_slot(void) {
+    for (int i = 0; i < instance_slots; i++) {
+        if (!instances[i]) return i;
+    }
+
+    int count = instance_slots ? instance_slots * 2 : EPOLL_INITIAL_SLOTS;
+    struct epoll **table = (struct epoll **)kzalloc(sizeof(*table) * (size_t)count);
+    if (!table) return -1;
+
+    if (instances) {
+        memcpy(table, instances, sizeof(*table) * (size_t)instance_slots);
+        kfree(instances);
+    }
+
+    int slot = instance_slots;
+    instances = table;
+    instance_slots = count;
+    return slot;
+}
+
+/*
+ * epoll_create - make an empty instance.  Returns its VFS fd or a
+ * negative errno.
+ */
+int epoll_create(void) {
+    if (epoll_vfs_type < 0) {
+        const struct vfs_ops epoll_ops = {
+            .close = epoll_vfs_close,
+        };
+
+        epoll_vfs_type = vfs_register_special("epoll", &epoll_ops);
+        if (epoll_vfs_type < 0) return SYSCALL_ENOMEM;
+    }
+
+    int slot = epoll_alloc_slot();
+    if (slot < 0) return SYSCALL_ENOMEM;
+
+    struct epoll *ep = (struct epoll *)kzalloc(sizeof(*ep));
+    if (!ep) return SYSCALL_ENOMEM;
+
+    int vfs_fd = vfs_open_special(epoll_vfs_type, slot);
+    if (vfs_fd < 0) {
+        kfree(ep);
+        return SYSCALL_ENOMEM;
+    }
+    instances[slot] = ep;
+    return vfs_fd;
+}
+
+/*
+ * epoll_ctl - add, change or remove the registration of (kind, id).  For
+ * EPOLL_KIND_FD, vfs_fd is the file behind descriptor id (unused for the
+ * keyboard, id 0).  Returns 0 or a negative errno.
+ */
+int epoll_ctl(int ep_vfs_fd, int op, int kind, int id, int vfs_fd,
+              uint32_t events, uint64_t data) {
+    struct epoll *ep = epoll_get(ep_vfs_fd);
+    struct process *cur = scheduler_current();
+
+    if (!ep) return SYSCALL_EINVAL;
+    if (kind < EPOLL_KIND_FD || kind > EPOLL_KIND_TCP) return SYSCALL_EINVAL;
+
+    struct epoll_item *item = epoll_find(ep, kind, id);
+    if (item && item->dead) {
+        /* The old target was closed; its id may name something new now */
+        epoll_item_free(ep, item);
+        item = NULL;
+    }
+
+    if (op == EPOLL_CTL_DEL) {
+        if (!item) return SYSCALL_ENOENT;
+        epoll_item_free(ep, item);
+        return 0;
+    }
+    if (op == EPOLL_CTL_MOD) {
+        if (!item) return SYSCALL_ENOENT;
+        item->events = events;
+        item->data = data;
+        item->timer_seen = 0;
+        if (kind != EPOLL_KIND_TIMER) epoll_queue(item);
+        return 0;
+    }
+    if (op != EPOLL_CTL_ADD) return SYSCALL_EINVAL;
+    if (item) return SYSCALL_EEXIST;
+
+    item = (struct epoll_item *)kzalloc(sizeof(*item));
+    if (!item) return SYSCALL_ENOMEM;
+    item->ep = ep;
+    item->kind = (uint8_t)kind;
+    item->id = id;
+    item->vfs_fd = vfs_fd;
+    item->owner = cur ? ((cur->group_id > 0) ? cur->group_id : cur->pid) : 0;
+    item->events = events;
+    item->data = data;
+
+    if (kind == EPOLL_KIND_TIMER) {
+        uint64_t deadline;
+
+        if (timer_prepare_wait_object(item->owner, id, &deadline) != 0) {
+            kfree(item);
+            return SYSCALL_EINVAL;
+        }
+        item->timer_next = ep->timers;
+        ep->timers = item;
+    } else {
+        struct epoll_source *source = NULL;
+
+        if (epoll_item_poll(item, &source) < 0 || !source) {
+            kfree(item);
+            return SYSCALL_EINVAL;
+        }
+        uint64_t flags = irq_save();
+        item->source = source;
+        item->source_next = source->watchers;
+        source->watchers = item;
+        irq_restore(flags);
+
+        /* It may be ready already; the first wait finds out */
+        epoll_queue(item);
+    }
+
+    item->next = ep->items;
+    ep->items = item;
+    return 0;
+}
+
+/*
+ * epoll_wait - wait until a registration is ready and report up to
+ * max_events of them.  timeout_ms < 0 waits forever, 0 only polls.
+ * Returns the number of events, 0 on timeout, or a negative errno.
+ */
+int epoll_wait(int ep_vfs_fd, struct numos_epoll_event *out, int max_events,
+               int64_t timeout_ms) {
+    struct epoll *ep = epoll_get(ep_vfs_fd);
+    uint64_t deadline = 0;
+
+    if (!ep) return SYSCALL_EINVAL;
+    if (!out || max_events <= 0) return SYSCALL_EINVAL;
+    if (timeout_ms > 0) deadline = timer_get_uptime_ms() + (uint64_t)timeout_ms;
+
+    for (;;) {
+        int n = 0;
+        uint64_t wake = epoll_collect_timers(ep, out, max_events, &n);
+
+        n = epoll_collect_ready(ep, out, max_events, n);
+        if (n > 0 || timeout_ms == 0) return n;
+
+        if (deadline) {
+            if (timer_get_uptime_ms() >= deadline) return 0;
+            if (!wake || wake > deadline) wake = deadline;
+        }
+
+        __asm__ volatile("cli");
+        if (ep->ready_head) {
+            __asm__ volatile("sti");
+            continue;
+        }
+        (void)wait_queue_sleep_until(&ep->waiters, wake);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * fdtable.c - Per-process file descriptor tables
+ *
+ * A table is a flat array of VFS fds indexed by descriptor minus
+ * FD_TABLE_FIRST.  Allocation returns the lowest free descriptor, as
+ * POSIX requires; next_free lets it skip the dense prefix without a
+ * scan from zero on every open.
+ */
+
+#include "kernel/fdtable.h"
+#include "fs/vfs.h"
+#include "cpu/heap.h"
+#include "lib/string.h"
+
+static int fd_table_grow(struct fd_table *table) {
+    int count = table->count ? table->count * 2 : FD_TABLE_INITIAL;
+    int *files = (int *)kmalloc(sizeof(*files) * (size_t)count);
+    if (!files) return -1;
+
+    for (int i = 0; i < count; i++) {
+        files[i] = (i < table->count) ? table->files[i] : -1;
+    }
+
+    if (table->files) kfree(table->files);
+    table->files = files;
+    table->count = count;
+    return 0;
+}
+
+struct fd_table *fd_table_create(void) {
+    return (struct fd_table *)kzalloc(sizeof(struct fd_table));
+}
+
+/*
+ * fd_table_destroy - close every descriptor left in table and free it.
+ */
+void fd_table_destroy(struct fd_table *table) {
+    if (!table) return;
+
+    for (int i = 0; i < table->count; i++) {
+        if (table->files[i] >= 0) vfs_close(table->files[i]);
+    }
+    if (table->files) kfree(table->files);
+    kfree(table);
+}
+
+/*
+ * fd_install - bind vfs_fd to the lowest free descriptor.  The table takes
+ * over closing it.  Returns the descriptor, or -1 if the table
+ * could not grow.
+ */
+int fd_install(struct fd_table *table, int vfs_fd) {
+    if (!table || vfs_fd < 0) return -1;
+
+    int slot = table->next_free;
+    while (slot < table->count && table->files[slot] >= 0) slot++;
+    if (slot >= table->count && fd_table_grow(table) != 0) return -1;
+
+    table->files[slot] = vfs_fd;
+    table->next_free = slot + 1;
+    return slot + FD_TABLE_FIRST;
+}
+
+/*
+ * fd_lookup - return the VFS fd behind descriptor fd, or -1 if it is not
+ * open in this table.
+ */
+int fd_lookup(const struct fd_table *table, int fd) {
+    int slot = fd - FD_TABLE_FIRST;
+
+    if (!table || slot < 0 || slot >= table->count) return -1;
+    return table->files[slot];
+}
+
+/*
+ * fd_remove - unbind descriptor fd and hand its VFS fd back to the caller,
+ * which becomes responsible for closing it.  Returns -1 if fd is not open.
+ */
+int fd_remove(struct fd_table *table, int fd) {
+    int vfs_fd = fd_lookup(table, fd);
+    if (vfs_fd < 0) return -1;
+
+    int slot = fd - FD_TABLE_FIRST;
+    table->files[slot] = -1;
+    if (slot < table->next_free) table->next_free = slot;
+    return vfs_fd;
+}
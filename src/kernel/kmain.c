@@ -15,6 +15,7 @@
 #include "kernel/scheduler.h"
 #include "kernel/process.h"
 #include "kernel/elf_loader.h"
+#include "kernel/vdso.h"
 #include "kernel/multiboot2.h"
 #include "drivers/graphices/graphics.h"
 #include "drivers/graphices/vga.h"
@@ -341,6 +342,81 @@ static int boot_use_compact_fb_log(void) {
     return hv && hv->id == HYPERVISOR_VIRTUALBOX;
 }
 
+/*
+ * Truncate a file that owns several clusters, then write past a hole: the
+ * hole must read back as zeros, not as the clusters' old contents.
+ */
+static int check_fat32_truncate_hole(void) {
+    static const char path[] = "/run/hole.tst";
+    const uint32_t len  = 16384;
+    const uint32_t hole = 12288;
+    uint8_t *buf = (uint8_t *)kmalloc(len);
+    int ok = 0;
+    int fd;
+
+    if (!buf) return -1;
+    memset(buf, 0xAA, len);
+
+    fd = fat32_open(path, FAT32_O_WRONLY | FAT32_O_CREAT | FAT32_O_TRUNC);
+    if (fd < 0) {
+        kfree(buf);
+        return -1;
+    }
+    ok = fat32_write(fd, buf, len) == (ssize_t)len;
+    fat32_close(fd);
+
+    fd = ok ? fat32_open(path, FAT32_O_WRONLY | FAT32_O_TRUNC) : -1;
+    if (fd >= 0) {
+        ok = fat32_seek(fd, hole, FAT32_SEEK_SET) == hole &&
+             fat32_write(fd, "Z", 1) == 1;
+        fat32_close(fd);
+    } else {
+        ok = 0;
+    }
+
+    fd = ok ? fat32_open(path, FAT32_O_RDONLY) : -1;
+    if (fd >= 0) {
+        ok = fat32_read(fd, buf, len) == (ssize_t)(hole + 1) && buf[hole] == 'Z';
+        for (uint32_t i = 0; ok && i < hole; i++) {
+            if (buf[i] != 0) ok = 0;
+        }
+        fat32_close(fd);
+    } else {
+        ok = 0;
+    }
+
+    kfree(buf);
+    return ok;
+}
+
+/*
+ * Two descriptors on one file: bytes one writes (still in its write-behind
+ * window) must be visible to the other, including over a window the
+ * reader already filled.
+ */
+static int check_fat32_shared_writes(void) {
+    static const char path[] = "/run/share.tst";
+    char got[4] = {0};
+    int ok;
+
+    int wfd = fat32_open(path, FAT32_O_RDWR | FAT32_O_CREAT | FAT32_O_TRUNC);
+    if (wfd < 0) return -1;
+    int rfd = fat32_open(path, FAT32_O_RDONLY);
+    if (rfd < 0) {
+        fat32_close(wfd);
+        return -1;
+    }
+
+    ok = fat32_write(wfd, "abc", 3) == 3 &&
+         fat32_pread(rfd, got, 3, 0) == 3 && memcmp(got, "abc", 3) == 0;
+    ok = ok && fat32_pwrite(wfd, "d", 1, 1) == 1 &&
+         fat32_pread(rfd, got, 3, 0) == 3 && memcmp(got, "adc", 3) == 0;
+
+    fat32_close(rfd);
+    fat32_close(wfd);
+    return ok;
+}
+
 static void test_filesystem(void) {
     vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
     vga_writestring("\n  === Filesystem Test ===\n");
@@ -348,6 +424,34 @@ static void test_filesystem(void) {
     fat32_print_info();
     vga_putchar('\n');
     fat32_list_directory("/");
+
+    vga_writestring("  O_TRUNC hole reads zeros... ");
+    int hole_ok = check_fat32_truncate_hole();
+    if (hole_ok > 0) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+        vga_writestring("[PASS]\n");
+    } else if (hole_ok < 0) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+        vga_writestring("[SKIP] /run not writable\n");
+    } else {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        vga_writestring("[FAIL]\n");
+    }
+    vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+
+    vga_writestring("  Second descriptor sees buffered writes... ");
+    int share_ok = check_fat32_shared_writes();
+    if (share_ok > 0) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+        vga_writestring("[PASS]\n");
+    } else if (share_ok < 0) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+        vga_writestring("[SKIP] /run not writable\n");
+    } else {
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        vga_writestring("[FAIL]\n");
+    }
+    vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
 }
 
 static void test_syscalls(void) {
@@ -717,6 +821,7 @@ void kernel_init(uint64_t mb2_info_phys) {
     boot_section("TIMERS & INPUT", VGA_COLOR_CYAN);
     vga_writestring("  Programming PIT channel 0...\n");
     timer_init(100);
+    vdso_init(100);
     boot_ok(6, 12, VGA_COLOR_CYAN, "PIT  100 Hz system timer");
 
     vga_writestring("  Enabling keyboard & timer IRQs...\n");
@@ -799,6 +904,9 @@ void kernel_init(uint64_t mb2_info_phys) {
         vga_writestring("  FAT32: MOUNT FAILED\n");
         vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
     }
+    if (vfs_register_tmpfs("/tmp") == 0) {
+        vga_writestring("  TMPFS: Mounted at /tmp\n");
+    }
 
     boot_done();
 }
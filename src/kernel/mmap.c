@@ -0,0 +1,172 @@
+/*
+ * mmap.c - File-backed memory mappings
+ *
+ * Regions are kept sorted by address in the owning vm space so placement
+ * is a single first-fit walk.  Faults inside a region resolve to a page
+ * cache frame that is mapped user-readable; unmapping drops the page
+ * reference but never frees the frame, which belongs to the cache.
+ */
+
+#include "kernel/mmap.h"
+#include "kernel/scheduler.h"
+#include "fs/pagecache.h"
+#include "fs/vfs.h"
+#include "cpu/heap.h"
+#include "cpu/paging.h"
+
+static void mmap_unmap_pages(uint64_t start, uint64_t end) {
+    for (uint64_t page = start; page < end; page += PAGE_SIZE) {
+        if (!paging_is_mapped(page)) continue;
+
+        uint64_t phys = paging_get_physical_address(page);
+        paging_unmap_page_keep_frame(page);
+        pagecache_put(paging_align_down(phys, PAGE_SIZE));
+    }
+}
+
+static void mmap_free_region(struct mmap_region *region) {
+    vfs_map_unref(region->vfs_fd);
+    kfree(region);
+}
+
+/*
+ * mmap_create - reserve length bytes of the mmap window for the file open
+ * on vfs_fd starting at offset (page aligned).  No page is mapped yet.
+ * Returns 0 and the chosen address on success, -1 on failure.
+ */
+int mmap_create(struct process_vm_space *vm, uint64_t length, int vfs_fd,
+                uint64_t offset, uint64_t *out_addr) {
+    uint32_t mount, file;
+
+    if (!vm || !out_addr || length == 0) return -1;
+    if (offset & (PAGE_SIZE - 1)) return -1;
+    if (offset / PAGE_SIZE > 0xFFFFFFFFu) return -1;
+
+    length = paging_align_up(length, PAGE_SIZE);
+    if (length > MMAP_LIMIT - MMAP_BASE) return -1;
+
+    /* A file without an id (an empty FAT32 file) cannot be cached */
+    if (vfs_file_id(vfs_fd, &mount, &file) != 0 || file == 0) return -1;
+
+    struct mmap_region **link = &vm->mmap_regions;
+    uint64_t start = MMAP_BASE;
+    while (*link && (*link)->start - start < length) {
+        start = (*link)->end;
+        link = &(*link)->next;
+    }
+    if (start + length > MMAP_LIMIT) return -1;
+
+    struct mmap_region *region = (struct mmap_region *)kmalloc(sizeof(*region));
+    if (!region) return -1;
+    if (vfs_map_ref(vfs_fd) != 0) {
+        kfree(region);
+        return -1;
+    }
+
+    region->start  = start;
+    region->end    = start + length;
+    region->mount  = mount;
+    region->file   = file;
+    region->pgoff  = (uint32_t)(offset / PAGE_SIZE);
+    region->vfs_fd = vfs_fd;
+    region->next   = *link;
+    *link = region;
+
+    *out_addr = start;
+    return 0;
+}
+
+/*
+ * mmap_remove - unmap [addr, addr + length), trimming or splitting any
+ * region it overlaps.  Ranges with no mapping are ignored.
+ * Returns 0 on success, -1 on a bad range or allocation failure.
+ */
+int mmap_remove(struct process_vm_space *vm, uint64_t addr, uint64_t length) {
+    if (!vm || length == 0 || (addr & (PAGE_SIZE - 1))) return -1;
+
+    uint64_t end = addr + paging_align_up(length, PAGE_SIZE);
+    if (end < addr) return -1;
+
+    struct mmap_region **link = &vm->mmap_regions;
+    while (*link) {
+        struct mmap_region *r = *link;
+
+        if (r->end <= addr || r->start >= end) {
+            link = &r->next;
+            continue;
+        }
+
+        uint64_t cut_start = (addr > r->start) ? addr : r->start;
+        uint64_t cut_end   = (end < r->end) ? end : r->end;
+        mmap_unmap_pages(cut_start, cut_end);
+
+        if (cut_start == r->start && cut_end == r->end) {
+            *link = r->next;
+            mmap_free_region(r);
+            continue;
+        }
+
+        if (cut_start > r->start && cut_end < r->end) {
+            struct mmap_region *tail = (struct mmap_region *)kmalloc(sizeof(*tail));
+            if (!tail || vfs_map_ref(r->vfs_fd) != 0) {
+                if (tail) kfree(tail);
+                return -1;
+            }
+            *tail = *r;
+            tail->start = cut_end;
+            tail->pgoff = r->pgoff + (uint32_t)((cut_end - r->start) / PAGE_SIZE);
+            r->end  = cut_start;
+            r->next = tail;
+            link = &tail->next;
+            continue;
+        }
+
+        if (cut_start == r->start) {
+            r->pgoff += (uint32_t)((cut_end - r->start) / PAGE_SIZE);
+            r->start  = cut_end;
+        } else {
+            r->end = cut_start;
+        }
+        link = &r->next;
+    }
+    return 0;
+}
+
+/*
+ * mmap_handle_fault - resolve a not-present fault at fault_addr if it
+ * falls inside a mapping.  Returns 1 if handled, 0 otherwise.
+ */
+int mmap_handle_fault(struct process_vm_space *vm, uint64_t fault_addr) {
+    if (!vm) return 0;
+
+    struct mmap_region *r = vm->mmap_regions;
+    while (r && fault_addr >= r->end) r = r->next;
+    if (!r || fault_addr < r->start) return 0;
+
+    uint64_t page  = paging_align_down(fault_addr, PAGE_SIZE);
+    uint32_t index = r->pgoff + (uint32_t)((page - r->start) / PAGE_SIZE);
+
+    uint64_t phys = pagecache_get(r->vfs_fd, r->mount, r->file, index);
+    if (!phys) return 0;
+
+    if (paging_map_page(page, phys, PAGE_PRESENT | PAGE_USER) != 0) {
+        pagecache_put(phys);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * mmap_release_all - tear down every mapping of vm.  The caller must have
+ * vm's page tables active.
+ */
+void mmap_release_all(struct process_vm_space *vm) {
+    if (!vm) return;
+
+    while (vm->mmap_regions) {
+        struct mmap_region *r = vm->mmap_regions;
+        vm->mmap_regions = r->next;
+        mmap_unmap_pages(r->start, r->end);
+        mmap_free_region(r);
+    }
+}
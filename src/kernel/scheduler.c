@@ -25,6 +25,9 @@
 #include "kernel/scheduler.h"
 #include "kernel/kernel.h"
 #include "kernel/elf_loader.h"
+#include "kernel/fdtable.h"
+#include "kernel/mmap.h"
+#include "kernel/vdso.h"
 #include "drivers/graphices/vga.h"
 #include "drivers/timer.h"
 #include "cpu/fpu.h"
@@ -153,9 +156,16 @@ static void idle_loop(void) {
  * Internal run-queue helpers
  * ======================================================================= */
 
-/* alloc_process - find and zero a free slot in process_table. */
+/*
+ * alloc_process - find and zero a free slot in process_table.  Zombies
+ * whose parent has exited are reclaimed here, since nobody will reap them.
+ */
 static struct process *alloc_process(void) {
     for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (process_table[i].state == PROC_ZOMBIE &&
+            (process_table[i].flags & PROC_FLAG_DETACHED)) {
+            free_process(&process_table[i]);
+        }
         if (process_table[i].state == PROC_UNUSED) {
             memset(&process_table[i], 0, sizeof(struct process));
             return &process_table[i];
@@ -226,6 +236,27 @@ static void copy_name(char *dst, const char *src, size_t cap) {
     dst[i] = '\0';
 }
 
+/*
+ * wake_expired - make every blocked process whose wake_at_ms has passed
+ * READY.  Wait-queue sleepers are unlinked and see a timeout.  Runs with
+ * interrupts disabled, from schedule() or the timer IRQ.
+ */
+static void wake_expired(uint64_t now) {
+    if (!run_queue_head) return;
+
+    struct process *p = run_queue_head;
+    do {
+        if (p->state == PROC_BLOCKED && p->wake_at_ms != 0 &&
+            now >= p->wake_at_ms) {
+            if (p->wait_queue) wait_queue_remove(p->wait_queue, p);
+            p->state        = PROC_READY;
+            p->block_reason = PROC_BLOCK_NONE;
+            p->wake_at_ms   = 0;
+        }
+        p = p->next;
+    } while (p != run_queue_head);
+}
+
 /*
  * pick_next - choose the next READY process to run.
  *
@@ -236,20 +267,10 @@ static void copy_name(char *dst, const char *src, size_t cap) {
 static struct process *pick_next(void) {
     if (!run_queue_head) return idle_proc;
 
-    uint64_t now = timer_get_uptime_ms();
-
-    /* Unblock sleeping processes */
-    struct process *p = run_queue_head;
-    do {
-        if (p->state == PROC_BLOCKED && p->wake_at_ms != 0 &&
-            now >= p->wake_at_ms) {
-            p->state      = PROC_READY;
-            p->wake_at_ms = 0;
-        }
-        p = p->next;
-    } while (p != run_queue_head);
+    wake_expired(timer_get_uptime_ms());
 
     /* Find next READY process after current_proc */
+    struct process *p;
     struct process *start = current_proc ? current_proc->next : run_queue_head;
     if (!start) start = run_queue_head;
 
@@ -308,6 +329,7 @@ static int release_vm_space(struct process *proc) {
             paging_set_active_pml4((struct page_table *)(uintptr_t)vm->cr3);
             paging_switch_to(vm->cr3);
         }
+        mmap_release_all(vm);
         if (vm->load_end > vm->load_base) {
             elf_unload(vm->load_base, vm->load_end, 0, 0);
         }
@@ -315,6 +337,7 @@ static int release_vm_space(struct process *proc) {
             paging_set_active_pml4(old_pml4);
             paging_switch_to(old_cr3);
         }
+        fd_table_destroy(vm->fds);
         kfree(vm);
         return 1;
     }
@@ -560,6 +583,8 @@ struct process *process_create_user(const char *name,
         return NULL;
     }
     proc->group_id        = proc->pid;
+    proc->parent_pid      = (current_proc && current_proc->user_entry)
+                                ? current_proc->group_id : 0;
     proc->state           = PROC_READY;
     proc->ticks_remaining = SCHED_TICKS_PER_SLICE;
     proc->created_at_ms   = timer_get_uptime_ms();
@@ -761,6 +786,31 @@ int process_configure_image(struct process *proc,
     return 0;
 }
 
+/*
+ * notify_exit - tell the rest of the system that proc has become a zombie.
+ * A group leader's children are detached, and anyone joining it or
+ * sleeping in waitpid on it or its parent is woken to recheck.
+ */
+static void notify_exit(struct process *proc) {
+    if (proc->pid == proc->group_id) {
+        for (int i = 0; i < MAX_PROCESSES; i++) {
+            struct process *p = &process_table[i];
+            if (p->state != PROC_UNUSED && p != proc &&
+                p->parent_pid == proc->group_id) {
+                p->parent_pid = 0;
+                p->flags |= PROC_FLAG_DETACHED;
+            }
+        }
+        wait_queue_wake_all(&proc->child_exit);
+    }
+    wait_queue_wake_all(&proc->exit_waiters);
+
+    if (proc->parent_pid) {
+        struct process *parent = scheduler_find_process(proc->parent_pid);
+        if (parent) wait_queue_wake_all(&parent->child_exit);
+    }
+}
+
 /*
  * process_mark_zombie - transition proc to ZOMBIE, dequeue it, and free its
  * virtual address space.  Called from sys_exit() and the exception handler.
@@ -786,6 +836,7 @@ void process_mark_zombie(struct process *proc, int exit_code) {
     }
 
     release_vm_space(proc);
+    notify_exit(proc);
 }
 
 /*
@@ -844,14 +895,69 @@ void process_exit_value(uint64_t exit_value) {
     while (1) __asm__ volatile("hlt");  /* unreachable */
 }
 
+/*
+ * process_wait_child - reap an exited child spawned by the caller's thread
+ * group.  The caller sleeps on the group leader's child_exit queue, which
+ * process_mark_zombie() wakes whenever a child exits.
+ */
+int process_wait_child(int pid, int *exit_code, int nohang) {
+    struct process *self = current_proc;
+    if (!self || self == idle_proc) return -1;
+
+    int group = self->group_id;
+    struct process *leader =
+        (self->pid == group) ? self : scheduler_find_process(group);
+    if (!leader) return -1;
+
+    for (;;) {
+        struct process *zombie = NULL;
+        int found = 0;
+
+        __asm__ volatile("cli");
+        for (int i = 0; i < MAX_PROCESSES; i++) {
+            struct process *p = &process_table[i];
+            if (p->state == PROC_UNUSED || p->parent_pid != group) continue;
+            if (pid > 0 && p->pid != pid) continue;
+
+            found = 1;
+            if (p->state == PROC_ZOMBIE) {
+                zombie = p;
+                break;
+            }
+        }
+
+        if (!found) {
+            __asm__ volatile("sti");
+            return -1;
+        }
+
+        if (zombie) {
+            int child = zombie->pid;
+            if (exit_code) *exit_code = zombie->exit_code;
+            dequeue(zombie);
+            free_process(zombie);
+            __asm__ volatile("sti");
+            return child;
+        }
+
+        if (nohang) {
+            __asm__ volatile("sti");
+            return 0;
+        }
+
+        wait_queue_sleep(&leader->child_exit);
+    }
+}
+
 /*
  * process_sleep_until - block the calling process until uptime_ms >= wake_ms.
  */
 void process_sleep_until(uint64_t wake_ms) {
     __asm__ volatile("cli");
     if (current_proc && current_proc != idle_proc) {
-        current_proc->state      = PROC_BLOCKED;
-        current_proc->wake_at_ms = wake_ms;
+        current_proc->state        = PROC_BLOCKED;
+        current_proc->block_reason = PROC_BLOCK_SLEEP;
+        current_proc->wake_at_ms   = wake_ms;
         dequeue(current_proc);
         enqueue(current_proc);  /* re-enqueue as BLOCKED so pick_next can see it */
     }
@@ -911,19 +1017,8 @@ void scheduler_tick(void) {
     current_proc->total_ticks++;
     stats.total_ticks++;
 
-    /* Unblock sleeping processes that are due */
-    uint64_t now = timer_get_uptime_ms();
-    if (run_queue_head) {
-        struct process *p = run_queue_head;
-        do {
-            if (p->state == PROC_BLOCKED && p->wake_at_ms != 0 &&
-                now >= p->wake_at_ms) {
-                p->state      = PROC_READY;
-                p->wake_at_ms = 0;
-            }
-            p = p->next;
-        } while (p != run_queue_head);
-    }
+    /* Unblock sleeping processes and wait-queue timeouts that are due */
+    wake_expired(timer_get_uptime_ms());
 
     /* Time slice accounting.
      *
@@ -954,7 +1049,8 @@ int scheduler_handle_user_page_fault(uint64_t fault_addr) {
     uint64_t page_addr = paging_align_down(fault_addr, PAGE_SIZE);
     uint64_t stack_top_page = paging_align_up(proc->user_stack_top + 8, PAGE_SIZE);
     if (page_addr < proc->user_stack_bottom || page_addr >= stack_top_page) {
-        return 0;
+        if (vdso_handle_fault(fault_addr)) return 1;
+        return mmap_handle_fault(proc->vm_space, fault_addr);
     }
 
     uint64_t phys = pmm_alloc_frame();
@@ -0,0 +1,366 @@
+/*
+ * socket.c - BSD-style sockets
+ *
+ * Each socket wraps one handle of the network stack: a TCP connection, a
+ * TCP listener or a UDP socket.  Socket objects are kept in a table of
+ * pointers that doubles when full; the slot index is the backend handle
+ * of the socket's VFS file.  Network calls give up after a timeout, so
+ * the blocking calls here retry until something else comes back.
+ */
+
+#include "kernel/socket.h"
+#include "kernel/syscall.h"
+#include "drivers/network.h"
+#include "fs/vfs.h"
+#include "cpu/heap.h"
+#include "lib/string.h"
+
+#define SOCKET_INITIAL_SLOTS 16
+#define SOCKET_WAIT_MS       5000   /* Per network call, retried while blocking */
+
+enum socket_state {
+    SOCKET_IDLE = 0,
+    SOCKET_BOUND,                   /* Port chosen; a UDP socket is open */
+    SOCKET_LISTENING,
+    SOCKET_CONNECTED,
+};
+
+struct socket {
+    uint8_t  type;
+    uint8_t  state;
+    uint8_t  peer_set;              /* Datagram socket has a default peer */
+    uint8_t  reserved;
+    uint16_t port;                  /* Local port given to bind() */
+    uint16_t peer_port;
+    uint8_t  peer_ip[NET_IPV4_ADDR_LEN];
+    int      handle;                /* Connection, listener or UDP handle */
+};
+
+static struct socket **sockets;     /* Grown on demand */
+static int             socket_slots;
+static int             socket_vfs_type = -1;
+
+/*
+ * socket_errno - translate a NET_ERR_* code into the SYSCALL_E* value a
+ * network syscall returns.
+ */
+int socket_errno(int rc) {
+    switch (rc) {
+    case NET_ERR_UNAVAILABLE:
+    case NET_ERR_NOT_CONFIGURED: return SYSCALL_ENETDOWN;
+    case NET_ERR_TIMEOUT:        return SYSCALL_ETIMEDOUT;
+    case NET_ERR_INVALID:        return SYSCALL_EINVAL;
+    case NET_ERR_CLOSED:         return SYSCALL_ENOTCONN;
+    default:                     return SYSCALL_ECONNRESET;
+    }
+}
+
+/*
+ * socket_alloc_slot - return a free slot, doubling the table when every
+ * slot is taken.  Returns the slot index, or -1 if out of memory.
+ */
+static int socket_alloc_slot(void) {
+    for (int i = 0; i < socket_slots; i++) {
+        if (!sockets[i]) return i;
+    }
+
+    int count = socket_slots ? socket_slots * 2 : SOCKET_INITIAL_SLOTS;
+    struct socket **table = (struct socket **)kzalloc(sizeof(*table) * (size_t)count);
+    if (!table) return -1;
+
+    if (sockets) {
+        memcpy(table, sockets, sizeof(*table) * (size_t)socket_slots);
+        kfree(sockets);
+    }
+
+    int slot = socket_slots;
+    sockets = table;
+    socket_slots = count;
+    return slot;
+}
+
+static struct socket *socket_from_slot(int slot) {
+    if (slot < 0 || slot >= socket_slots) return NULL;
+    return sockets[slot];
+}
+
+static struct socket *socket_get(int vfs_fd) {
+    if (socket_vfs_type < 0) return NULL;
+    return socket_from_slot(vfs_special_handle(vfs_fd, socket_vfs_type));
+}
+
+/* Give a datagram socket its UDP port; port 0 picks an ephemeral one */
+static int socket_dgram_bind(struct socket *s, uint16_t port) {
+    int handle = net_udp_open(port);
+
+    if (handle == NET_ERR_INVALID) return SYSCALL_EADDRINUSE;
+    if (handle < 0) return socket_errno(handle);
+    s->handle = handle;
+    s->port = port;
+    s->state = SOCKET_BOUND;
+    return 0;
+}
+
+static ssize_t socket_send(struct socket *s, const void *buf, size_t len,
+                           const uint8_t ip[NET_IPV4_ADDR_LEN], uint16_t port) {
+    if (s->type == SOCKET_STREAM) {
+        if (s->state != SOCKET_CONNECTED) return SYSCALL_ENOTCONN;
+
+        for (;;) {
+            ssize_t n = net_tcp_send(s->handle, buf, len, SOCKET_WAIT_MS);
+            if (n != NET_ERR_TIMEOUT) return (n < 0) ? socket_errno((int)n) : n;
+        }
+    }
+
+    if (!ip) {
+        if (!s->peer_set) return SYSCALL_ENOTCONN;
+        ip = s->peer_ip;
+        port = s->peer_port;
+    }
+    if (s->state == SOCKET_IDLE) {
+        int rc = socket_dgram_bind(s, 0);
+        if (rc < 0) return rc;
+    }
+
+    ssize_t n = net_udp_sendto(s->handle, ip, port, buf, len);
+    return (n < 0) ? socket_errno((int)n) : n;
+}
+
+static ssize_t socket_recv(struct socket *s, void *buf, size_t len,
+                           uint8_t ip[NET_IPV4_ADDR_LEN], uint16_t *port) {
+    if (s->type == SOCKET_STREAM) {
+        struct net_tcp_info info;
+
+        if (s->state != SOCKET_CONNECTED) return SYSCALL_ENOTCONN;
+        for (;;) {
+            ssize_t n = net_tcp_recv(s->handle, buf, len, SOCKET_WAIT_MS);
+            if (n == NET_ERR_TIMEOUT) continue;
+            if (n < 0) return socket_errno((int)n);
+
+            if ((ip || port) && net_tcp_get_info(s->handle, &info) == NET_OK) {
+                if (ip) memcpy(ip, info.remote_ip, NET_IPV4_ADDR_LEN);
+                if (port) *port = info.remote_port;
+            }
+            return n;
+        }
+    }
+
+    if (s->state != SOCKET_BOUND) return SYSCALL_EINVAL;
+    for (;;) {
+        ssize_t n = net_udp_recvfrom(s->handle, buf, len, ip, port, SOCKET_WAIT_MS);
+        if (n != NET_ERR_TIMEOUT) return (n < 0) ? socket_errno((int)n) : n;
+    }
+}
+
+static ssize_t socket_vfs_read(int slot, void *buf, size_t count) {
+    struct socket *s = socket_from_slot(slot);
+    return s ? socket_recv(s, buf, count, NULL, NULL) : -1;
+}
+
+static ssize_t socket_vfs_write(int slot, const void *buf, size_t count) {
+    struct socket *s = socket_from_slot(slot);
+    return s ? socket_send(s, buf, count, NULL, 0) : -1;
+}
+
+static int socket_vfs_poll(int slot, struct epoll_source **source) {
+    struct socket *s = socket_from_slot(slot);
+    int mask = -1;
+
+    if (!s) return -1;
+    if (s->state == SOCKET_CONNECTED) mask = net_tcp_poll(s->handle, source);
+    if (s->state == SOCKET_LISTENING) mask = net_tcp_listener_poll(s->handle, source);
+    if (s->type == SOCKET_DGRAM && s->state == SOCKET_BOUND) {
+        mask = net_udp_poll(s->handle, source);
+    }
+    return (mask < 0) ? -1 : mask;
+}
+
+/*
+ * socket_vfs_close - the last descriptor went away.  A connection is
+ * handed to the stack to finish its FIN exchange in the background, so
+ * closing (or exiting) never waits on the peer.
+ */
+static int socket_vfs_close(int slot) {
+    struct socket *s = socket_from_slot(slot);
+    if (!s) return -1;
+
+    if (s->type == SOCKET_STREAM) {
+        if (s->state == SOCKET_CONNECTED) (void)net_tcp_release(s->handle);
+        if (s->state == SOCKET_LISTENING) (void)net_tcp_unlisten(s->handle);
+    } else if (s->state == SOCKET_BOUND) {
+        (void)net_udp_close(s->handle);
+    }
+
+    sockets[slot] = NULL;
+    kfree(s);
+    return 0;
+}
+
+/*
+ * socket_open - wrap a new socket object in a VFS file.  Returns the VFS
+ * fd or a negative errno; s is freed on failure.
+ */
+static int socket_open(struct socket *s) {
+    if (socket_vfs_type < 0) {
+        const struct vfs_ops socket_ops = {
+            .close = socket_vfs_close,
+            .read = socket_vfs_read,
+            .write = socket_vfs_write,
+            .poll = socket_vfs_poll,
+        };
+
+        socket_vfs_type = vfs_register_special("socket", &socket_ops);
+        if (socket_vfs_type < 0) {
+            kfree(s);
+            return SYSCALL_ENOMEM;
+        }
+    }
+
+    int slot = socket_alloc_slot();
+    if (slot < 0) {
+        kfree(s);
+        return SYSCALL_ENOMEM;
+    }
+
+    int vfs_fd = vfs_open_special(socket_vfs_type, slot);
+    if (vfs_fd < 0) {
+        kfree(s);
+        return SYSCALL_ENOMEM;
+    }
+    sockets[slot] = s;
+    return vfs_fd;
+}
+
+int socket_create(int type) {
+    if (type != SOCKET_STREAM && type != SOCKET_DGRAM) return SYSCALL_EINVAL;
+
+    struct socket *s = (struct socket *)kzalloc(sizeof(*s));
+    if (!s) return SYSCALL_ENOMEM;
+    s->type = (uint8_t)type;
+    return socket_open(s);
+}
+
+/*
+ * socket_bind - choose the local port.  A datagram socket starts
+ * receiving at once; a stream socket only records the port for listen().
+ */
+int socket_bind(int vfs_fd, uint16_t port) {
+    struct socket *s = socket_get(vfs_fd);
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    if (s->state != SOCKET_IDLE) return SYSCALL_EINVAL;
+
+    if (s->type == SOCKET_DGRAM) return socket_dgram_bind(s, port);
+    if (port == 0) return SYSCALL_EINVAL;
+    s->port = port;
+    s->state = SOCKET_BOUND;
+    return 0;
+}
+
+int socket_listen(int vfs_fd, int backlog) {
+    struct socket *s = socket_get(vfs_fd);
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    if (s->type != SOCKET_STREAM || s->state != SOCKET_BOUND) return SYSCALL_EINVAL;
+    if (backlog <= 0) backlog = SOCKET_BACKLOG_DEFAULT;
+
+    int handle = net_tcp_listen(s->port, (uint32_t)backlog);
+    if (handle == NET_ERR_INVALID) return SYSCALL_EADDRINUSE;
+    if (handle == NET_ERR_GENERIC) return SYSCALL_ENOMEM;
+    if (handle < 0) return socket_errno(handle);
+    s->handle = handle;
+    s->state = SOCKET_LISTENING;
+    return 0;
+}
+
+/*
+ * socket_accept - wait for an incoming connection and return a new
+ * socket's VFS fd for it, storing the peer's address if asked.
+ */
+int socket_accept(int vfs_fd, uint8_t peer_ip[NET_IPV4_ADDR_LEN], uint16_t *peer_port) {
+    struct socket *s = socket_get(vfs_fd);
+    struct net_tcp_info info;
+    int handle;
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    if (s->state != SOCKET_LISTENING) return SYSCALL_EINVAL;
+
+    memset(&info, 0, sizeof(info));
+    do {
+        handle = net_tcp_accept(s->handle, SOCKET_WAIT_MS);
+    } while (handle == NET_ERR_TIMEOUT);
+    if (handle < 0) return (handle == NET_ERR_GENERIC) ? SYSCALL_ENOMEM : socket_errno(handle);
+
+    if (net_tcp_get_info(handle, &info) == NET_OK) {
+        if (peer_ip) memcpy(peer_ip, info.remote_ip, NET_IPV4_ADDR_LEN);
+        if (peer_port) *peer_port = info.remote_port;
+    }
+
+    struct socket *conn = (struct socket *)kzalloc(sizeof(*conn));
+    if (!conn) {
+        (void)net_tcp_release(handle);
+        return SYSCALL_ENOMEM;
+    }
+    conn->type = SOCKET_STREAM;
+    conn->state = SOCKET_CONNECTED;
+    conn->port = info.local_port;
+    conn->handle = handle;
+
+    int rc = socket_open(conn);
+    if (rc < 0) (void)net_tcp_release(handle);
+    return rc;
+}
+
+/*
+ * socket_connect - open a TCP connection, or set the default peer of a
+ * datagram socket (binding it to an ephemeral port if needed).
+ */
+int socket_connect(int vfs_fd, const uint8_t ip[NET_IPV4_ADDR_LEN], uint16_t port) {
+    struct socket *s = socket_get(vfs_fd);
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    if (port == 0) return SYSCALL_EINVAL;
+
+    if (s->type == SOCKET_DGRAM) {
+        if (s->state == SOCKET_IDLE) {
+            int rc = socket_dgram_bind(s, 0);
+            if (rc < 0) return rc;
+        }
+        memcpy(s->peer_ip, ip, NET_IPV4_ADDR_LEN);
+        s->peer_port = port;
+        s->peer_set = 1;
+        return 0;
+    }
+
+    if (s->state != SOCKET_IDLE && s->state != SOCKET_BOUND) return SYSCALL_EINVAL;
+    int handle = net_tcp_connect_ipv4(ip, port, 0);
+    if (handle < 0) return (handle == NET_ERR_GENERIC) ? SYSCALL_ECONNRESET : socket_errno(handle);
+    s->handle = handle;
+    s->state = SOCKET_CONNECTED;
+    return 0;
+}
+
+/*
+ * socket_sendto - send on a connected socket (ip NULL) or, for datagram
+ * sockets, to ip:port.  Returns the bytes sent or a negative errno.
+ */
+ssize_t socket_sendto(int vfs_fd, const void *buf, size_t len,
+                      const uint8_t ip[NET_IPV4_ADDR_LEN], uint16_t port) {
+    struct socket *s = socket_get(vfs_fd);
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    if (ip && s->type == SOCKET_DGRAM && port == 0) return SYSCALL_EINVAL;
+    return socket_send(s, buf, len, ip, port);
+}
+
+/*
+ * socket_recvfrom - receive into buf, storing the sender when ip or port
+ * is not NULL.  A stream socket returns 0 once the peer has closed.
+ */
+ssize_t socket_recvfrom(int vfs_fd, void *buf, size_t len,
+                        uint8_t ip[NET_IPV4_ADDR_LEN], uint16_t *port) {
+    struct socket *s = socket_get(vfs_fd);
+
+    if (!s) return SYSCALL_ENOTSOCK;
+    return socket_recv(s, buf, len, ip, port);
+}
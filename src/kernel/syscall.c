@@ -14,6 +14,11 @@
 #include "kernel/config.h"
 #include "kernel/sysinfo.h"
 #include "kernel/elf_loader.h"
+#include "kernel/fdtable.h"
+#include "kernel/mmap.h"
+#include "kernel/uaccess.h"
+#include "kernel/socket.h"
+#include "kernel/epoll.h"
 #include "drivers/graphices/vga.h"
 #include "drivers/keyboard.h"
 #include "drivers/timer.h"
@@ -46,13 +51,35 @@ extern void syscall_entry(void);
 static struct syscall_stats stats;
 static int syscall_initialised = 0;
 
-static int is_user_range(const void *ptr, size_t len) {
-    uint64_t addr = (uint64_t)(uintptr_t)ptr;
-    if (addr >= KERNEL_VIRTUAL_BASE) return 0;
-    if (len == 0) return 1;
-    if (addr + len < addr) return 0;
-    if (addr + len >= KERNEL_VIRTUAL_BASE) return 0;
-    return 1;
+/*
+ * copy_user_path - copy a NUL-terminated user string into a kernel buffer.
+ * Returns 0, SYSCALL_EFAULT on a bad pointer or SYSCALL_EINVAL if it does
+ * not fit.
+ */
+static int64_t copy_user_path(char *dst, size_t cap, const char *src) {
+    long n = strncpy_from_user(dst, src, cap);
+    if (n < 0) return SYSCALL_EFAULT;
+    if ((size_t)n >= cap) return SYSCALL_EINVAL;
+    return 0;
+}
+
+/*
+ * current_fds - the calling process's descriptor table, created on first
+ * use when create is set.  Returns NULL for kernel threads.
+ */
+static struct fd_table *current_fds(int create) {
+    struct process *proc = scheduler_current();
+    if (!proc || !proc->vm_space) return NULL;
+
+    if (!proc->vm_space->fds && create) {
+        proc->vm_space->fds = fd_table_create();
+    }
+    return proc->vm_space->fds;
+}
+
+/* Translate a user descriptor (>= 3) into the VFS fd it refers to. */
+static int user_vfs_fd(int fd) {
+    return fd_lookup(current_fds(0), fd);
 }
 
 static inline void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b,
@@ -150,9 +177,9 @@ int64_t sys_write(int fd, const void *buf, size_t count) {
         return (int64_t)count;
     }
 
-    /* Reserve 0,1,2 for stdin/stdout/stderr. VFS file descriptors start at 3. */
-    if (fd < 3) return SYSCALL_EBADF;
-    int vfs_fd = fd - 3;
+    /* Reserve 0,1,2 for stdin/stdout/stderr. Table descriptors start at 3. */
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
     ssize_t n  = vfs_write(vfs_fd, buf, count);
     if (n < 0) return SYSCALL_EBADF;
     return (int64_t)n;
@@ -167,36 +194,199 @@ int64_t sys_read(int fd, void *buf, size_t count) {
         return sys_input(buf, count);
     }
 
-    /* Reserve 1,2 for stdout/stderr. VFS file descriptors start at 3. */
-    if (fd < 3) return SYSCALL_EBADF;
+    /* Reserve 1,2 for stdout/stderr. Table descriptors start at 3. */
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
 
-    int vfs_fd = fd - 3;
     ssize_t n  = vfs_read(vfs_fd, buf, count);
     if (n < 0) return SYSCALL_EBADF;
     return (int64_t)n;
 }
 
+/*
+ * sys_lseek - reposition a file descriptor.  The console descriptors
+ * cannot seek.  Returns the new offset or a negative errno.
+ */
+int64_t sys_lseek(int fd, int64_t offset, int whence) {
+    if (fd < FD_TABLE_FIRST) return SYSCALL_ESPIPE;
+
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    if (whence != VFS_SEEK_SET && whence != VFS_SEEK_CUR && whence != VFS_SEEK_END) {
+        return SYSCALL_EINVAL;
+    }
+
+    int64_t pos = vfs_seek(vfs_fd, offset, whence);
+    return (pos < 0) ? SYSCALL_EINVAL : pos;
+}
+
+int64_t sys_pread(int fd, void *buf, size_t count, uint64_t offset) {
+    if (!buf)   return SYSCALL_EFAULT;
+    if (!count) return 0;
+    if (!user_access_ok(buf, count)) return SYSCALL_EFAULT;
+    if (fd < FD_TABLE_FIRST) return SYSCALL_ESPIPE;
+    if (offset > 0xFFFFFFFFull) return SYSCALL_EINVAL;
+
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+
+    ssize_t n = vfs_pread(vfs_fd, buf, count, (uint32_t)offset);
+    if (n < 0) return SYSCALL_EBADF;
+    return (int64_t)n;
+}
+
+int64_t sys_pwrite(int fd, const void *buf, size_t count, uint64_t offset) {
+    if (!buf)   return SYSCALL_EFAULT;
+    if (!count) return 0;
+    if (!user_access_ok(buf, count)) return SYSCALL_EFAULT;
+    if (fd < FD_TABLE_FIRST) return SYSCALL_ESPIPE;
+    if (offset > 0xFFFFFFFFull) return SYSCALL_EINVAL;
+
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+
+    ssize_t n = vfs_pwrite(vfs_fd, buf, count, (uint32_t)offset);
+    if (n < 0) return SYSCALL_EBADF;
+    return (int64_t)n;
+}
+
+/*
+ * sys_readv / sys_writev - scatter/gather I/O.  Segments are transferred
+ * in order and the call stops at the first short transfer.  Returns the
+ * total byte count, or a negative errno if nothing was transferred.
+ * Each iovec is copied in once, so user memory cannot change it between
+ * the length check and the transfer.
+ */
+int64_t sys_readv(int fd, const struct numos_iovec *iov, int iovcnt) {
+    if (iovcnt < 0 || iovcnt > NUMOS_IOV_MAX) return SYSCALL_EINVAL;
+    if (!iov || !user_access_ok(iov, sizeof(*iov) * (size_t)iovcnt)) return SYSCALL_EFAULT;
+
+    int64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        struct numos_iovec seg;
+        if (copy_from_user(&seg, &iov[i], sizeof(seg)) != 0) {
+            return total ? total : SYSCALL_EFAULT;
+        }
+        if (seg.iov_len == 0) continue;
+        if (!user_access_ok(seg.iov_base, (size_t)seg.iov_len)) {
+            return total ? total : SYSCALL_EFAULT;
+        }
+
+        int64_t n = sys_read(fd, seg.iov_base, (size_t)seg.iov_len);
+        if (n < 0) return total ? total : n;
+        total += n;
+        if ((uint64_t)n < seg.iov_len) break;
+    }
+    return total;
+}
+
+int64_t sys_writev(int fd, const struct numos_iovec *iov, int iovcnt) {
+    if (iovcnt < 0 || iovcnt > NUMOS_IOV_MAX) return SYSCALL_EINVAL;
+    if (!iov || !user_access_ok(iov, sizeof(*iov) * (size_t)iovcnt)) return SYSCALL_EFAULT;
+
+    int64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        struct numos_iovec seg;
+        if (copy_from_user(&seg, &iov[i], sizeof(seg)) != 0) {
+            return total ? total : SYSCALL_EFAULT;
+        }
+        if (seg.iov_len == 0) continue;
+        if (!user_access_ok(seg.iov_base, (size_t)seg.iov_len)) {
+            return total ? total : SYSCALL_EFAULT;
+        }
+
+        int64_t n = sys_write(fd, seg.iov_base, (size_t)seg.iov_len);
+        if (n < 0) return total ? total : n;
+        total += n;
+        if ((uint64_t)n < seg.iov_len) break;
+    }
+    return total;
+}
+
+/*
+ * sys_copy_file_range - copy between two open files without a user
+ * buffer.  A NULL offset pointer copies at (and advances) the file
+ * position; otherwise *off is used and updated instead.  Returns the
+ * bytes copied, 0 at end of input, or a negative errno.
+ */
+int64_t sys_copy_file_range(int fd_in, int64_t *off_in, int fd_out,
+                            int64_t *off_out, size_t len, uint32_t flags) {
+    int64_t in_off = -1;
+    int64_t out_off = -1;
+
+    if (flags != 0) return SYSCALL_EINVAL;
+    if (fd_in < FD_TABLE_FIRST || fd_out < FD_TABLE_FIRST) return SYSCALL_EBADF;
+
+    int in_vfs  = user_vfs_fd(fd_in);
+    int out_vfs = user_vfs_fd(fd_out);
+    if (in_vfs < 0 || out_vfs < 0) return SYSCALL_EBADF;
+
+    if (off_in) {
+        if (copy_from_user(&in_off, off_in, sizeof(in_off)) != 0) return SYSCALL_EFAULT;
+        if (in_off < 0) return SYSCALL_EINVAL;
+    }
+    if (off_out) {
+        if (copy_from_user(&out_off, off_out, sizeof(out_off)) != 0) return SYSCALL_EFAULT;
+        if (out_off < 0) return SYSCALL_EINVAL;
+    }
+    if (len == 0) return 0;
+
+    ssize_t n = vfs_copy_range(in_vfs, in_off, out_vfs, out_off, len);
+    if (n < 0) return SYSCALL_EINVAL;
+
+    in_off  += n;
+    out_off += n;
+    if (off_in && copy_to_user(off_in, &in_off, sizeof(in_off)) != 0) {
+        return SYSCALL_EFAULT;
+    }
+    if (off_out && copy_to_user(off_out, &out_off, sizeof(out_off)) != 0) {
+        return SYSCALL_EFAULT;
+    }
+    return (int64_t)n;
+}
+
 int64_t sys_open(const char *path, int flags, int mode) {
     (void)mode;
+    char kpath[256];
     if (!path) return SYSCALL_EFAULT;
+    int64_t rc = copy_user_path(kpath, sizeof(kpath), path);
+    if (rc != 0) return rc;
 
-    int vfs_fd = vfs_open(path, flags);
+    struct fd_table *fds = current_fds(1);
+    if (!fds) return SYSCALL_ENOMEM;
+
+    int vfs_fd = vfs_open(kpath, flags);
     if (vfs_fd < 0) return SYSCALL_EINVAL;
-    return (int64_t)(vfs_fd + 3);
+
+    int fd = fd_install(fds, vfs_fd);
+    if (fd < 0) {
+        vfs_close(vfs_fd);
+        return SYSCALL_ENOMEM;
+    }
+    return (int64_t)fd;
 }
 
-int64_t sys_exec(const char *path) {
-    if (!path) return SYSCALL_EFAULT;
+static void unload_child_image(uint64_t child_cr3,
+                               const struct elf_load_result *result) {
+    uint64_t stack_top_page = paging_align_up(result->stack_top, PAGE_SIZE);
+    struct page_table *saved = paging_get_active_pml4();
+    uint64_t saved_cr3 = paging_get_current_cr3();
+    __asm__ volatile("cli");
+    paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
+    paging_switch_to(child_cr3);
+    elf_unload(result->load_base, result->load_end, result->stack_bottom,
+               stack_top_page);
+    paging_set_active_pml4(saved);
+    paging_switch_to(saved_cr3);
+    __asm__ volatile("sti");
+}
 
-    char kpath[256];
-    size_t i = 0;
-    for (; i < sizeof(kpath) - 1; i++) {
-        if (!is_user_range(path + i, 1)) return SYSCALL_EFAULT;
-        char c = path[i];
-        kpath[i] = c;
-        if (c == 0) break;
-    }
-    if (i >= sizeof(kpath) - 1) return SYSCALL_EINVAL;
+/*
+ * spawn_image - load the ELF at kpath into a fresh address space and make
+ * it runnable as a child of the caller.  kcmd, if given, becomes its
+ * command line.  Returns the child pid or a negative errno.
+ */
+static int64_t spawn_image(const char *kpath, const char *kcmd) {
     if (kpath[0] == 0) return SYSCALL_EINVAL;
 
     uint64_t child_cr3 = paging_create_user_pml4();
@@ -217,129 +407,137 @@ int64_t sys_exec(const char *path) {
     struct process *proc = process_spawn(kpath, result.entry,
                                          result.stack_top, result.stack_bottom);
     if (!proc) {
-        uint64_t stack_top_page = paging_align_up(result.stack_top, PAGE_SIZE);
-        struct page_table *saved = paging_get_active_pml4();
-        uint64_t old_cr3 = paging_get_current_cr3();
-        __asm__ volatile("cli");
-        paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
-        paging_switch_to(child_cr3);
-        elf_unload(result.load_base, result.load_end, result.stack_bottom, stack_top_page);
-        paging_set_active_pml4(saved);
-        paging_switch_to(old_cr3);
-        __asm__ volatile("sti");
+        unload_child_image(child_cr3, &result);
         return SYSCALL_ENOMEM;
     }
 
     if (process_configure_image(proc, &result, child_cr3) != 0) {
-        uint64_t stack_top_page = paging_align_up(result.stack_top, PAGE_SIZE);
-        uint64_t saved_cr3 = paging_get_current_cr3();
-        struct page_table *saved = paging_get_active_pml4();
-        __asm__ volatile("cli");
-        paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
-        paging_switch_to(child_cr3);
-        elf_unload(result.load_base, result.load_end, result.stack_bottom, stack_top_page);
-        paging_set_active_pml4(saved);
-        paging_switch_to(saved_cr3);
-        __asm__ volatile("sti");
+        unload_child_image(child_cr3, &result);
         process_discard(proc);
         return SYSCALL_ENOMEM;
     }
 
-    while (proc->state != PROC_ZOMBIE && proc->state != PROC_UNUSED) {
-        schedule();
+    if (kcmd) {
+        strncpy(proc->cmdline, kcmd, PROCESS_CMDLINE_LEN);
+        proc->cmdline[PROCESS_CMDLINE_LEN - 1] = '\0';
     }
+    return proc->pid;
+}
 
-    int exit_code = proc->exit_code;
-    process_reap(proc);
+/* Run a child to completion; returns its exit code or a negative errno */
+static int64_t spawn_and_wait(const char *kpath, const char *kcmd) {
+    int64_t pid = spawn_image(kpath, kcmd);
+    if (pid < 0) return pid;
+
+    int exit_code = 0;
+    if (process_wait_child((int)pid, &exit_code, 0) != (int)pid) {
+        return SYSCALL_ECHILD;
+    }
     return exit_code;
 }
 
+int64_t sys_exec(const char *path) {
+    if (!path) return SYSCALL_EFAULT;
+
+    char kpath[256];
+    int64_t rc = copy_user_path(kpath, sizeof(kpath), path);
+    if (rc != 0) return rc;
+    return spawn_and_wait(kpath, NULL);
+}
+
 int64_t sys_exec_argv(const char *path, const char *cmdline) {
     if (!path || !cmdline) return SYSCALL_EFAULT;
 
     char kpath[256];
-    size_t i = 0;
-    for (; i < sizeof(kpath) - 1; i++) {
-        if (!is_user_range(path + i, 1)) return SYSCALL_EFAULT;
-        char c = path[i];
-        kpath[i] = c;
-        if (c == 0) break;
-    }
-    if (i >= sizeof(kpath) - 1) return SYSCALL_EINVAL;
-    if (kpath[0] == 0) return SYSCALL_EINVAL;
-
     char kcmd[256];
-    i = 0;
-    for (; i < sizeof(kcmd) - 1; i++) {
-        if (!is_user_range(cmdline + i, 1)) return SYSCALL_EFAULT;
-        char c = cmdline[i];
-        kcmd[i] = c;
-        if (c == 0) break;
-    }
-    if (i >= sizeof(kcmd) - 1) return SYSCALL_EINVAL;
-
-    uint64_t child_cr3 = paging_create_user_pml4();
-    if (!child_cr3) return SYSCALL_ENOMEM;
+    int64_t rc = copy_user_path(kpath, sizeof(kpath), path);
+    if (rc != 0) return rc;
+    rc = copy_user_path(kcmd, sizeof(kcmd), cmdline);
+    if (rc != 0) return rc;
+    return spawn_and_wait(kpath, kcmd);
+}
 
-    struct elf_load_result result;
-    struct page_table *saved_pml4 = paging_get_active_pml4();
-    uint64_t saved_cr3 = paging_get_current_cr3();
-    __asm__ volatile("cli");
-    paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
-    paging_switch_to(child_cr3);
-    int rc = elf_load_from_file(kpath, &result);
-    paging_set_active_pml4(saved_pml4);
-    paging_switch_to(saved_cr3);
-    __asm__ volatile("sti");
-    if (rc != ELF_OK) return SYSCALL_EINVAL;
+/*
+ * sys_spawn - start a program without waiting for it.  cmdline may be NULL.
+ * Returns the child pid, to be collected later with sys_waitpid.
+ */
+int64_t sys_spawn(const char *path, const char *cmdline) {
+    if (!path) return SYSCALL_EFAULT;
 
-    struct process *proc = process_spawn(kpath, result.entry,
-                                         result.stack_top, result.stack_bottom);
-    if (!proc) {
-        uint64_t stack_top_page = paging_align_up(result.stack_top, PAGE_SIZE);
-        struct page_table *saved = paging_get_active_pml4();
-        uint64_t old_cr3 = paging_get_current_cr3();
-        __asm__ volatile("cli");
-        paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
-        paging_switch_to(child_cr3);
-        elf_unload(result.load_base, result.load_end, result.stack_bottom, stack_top_page);
-        paging_set_active_pml4(saved);
-        paging_switch_to(old_cr3);
-        __asm__ volatile("sti");
-        return SYSCALL_ENOMEM;
+    char kpath[256];
+    char kcmd[256];
+    int64_t rc = copy_user_path(kpath, sizeof(kpath), path);
+    if (rc != 0) return rc;
+    if (cmdline) {
+        rc = copy_user_path(kcmd, sizeof(kcmd), cmdline);
+        if (rc != 0) return rc;
     }
+    return spawn_image(kpath, cmdline ? kcmd : NULL);
+}
 
-    if (process_configure_image(proc, &result, child_cr3) != 0) {
-        uint64_t stack_top_page = paging_align_up(result.stack_top, PAGE_SIZE);
-        uint64_t saved_cr3 = paging_get_current_cr3();
-        struct page_table *saved = paging_get_active_pml4();
-        __asm__ volatile("cli");
-        paging_set_active_pml4((struct page_table *)(uintptr_t)child_cr3);
-        paging_switch_to(child_cr3);
-        elf_unload(result.load_base, result.load_end, result.stack_bottom, stack_top_page);
-        paging_set_active_pml4(saved);
-        paging_switch_to(saved_cr3);
-        __asm__ volatile("sti");
-        process_discard(proc);
-        return SYSCALL_ENOMEM;
+/*
+ * sys_waitpid - reap a child started by this process.  pid > 0 selects one
+ * child and -1 any child; WNOHANG returns 0 instead of blocking while the
+ * child is still running.  The exit code is stored in *status if given.
+ */
+int64_t sys_waitpid(int pid, int *status, int options) {
+    if (status && !user_access_ok(status, sizeof(*status))) return SYSCALL_EFAULT;
+    if (pid == 0 || pid < -1) return SYSCALL_EINVAL;
+    if (options & ~WAIT_WNOHANG) return SYSCALL_EINVAL;
+
+    int exit_code = 0;
+    int child = process_wait_child(pid, &exit_code, options & WAIT_WNOHANG);
+    if (child < 0) return SYSCALL_ECHILD;
+    if (child > 0 && status &&
+        copy_to_user(status, &exit_code, sizeof(exit_code)) != 0) {
+        return SYSCALL_EFAULT;
     }
+    return child;
+}
 
-    strncpy(proc->cmdline, kcmd, PROCESS_CMDLINE_LEN);
-    proc->cmdline[PROCESS_CMDLINE_LEN - 1] = '\0';
+int64_t sys_close(int fd) {
+    int vfs_fd = fd_remove(current_fds(0), fd);
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    return (vfs_close(vfs_fd) == 0) ? 0 : SYSCALL_EBADF;
+}
 
-    while (proc->state != PROC_ZOMBIE && proc->state != PROC_UNUSED) {
-        schedule();
+/*
+ * sys_mmap - map an open file read-only.  The address hint is ignored and
+ * the kernel picks the placement; MAP_SHARED and MAP_PRIVATE behave the
+ * same since mappings cannot be written.
+ */
+int64_t sys_mmap(uint64_t addr, size_t length, int prot, int flags,
+                 int fd, uint64_t offset) {
+    struct process *proc = scheduler_current();
+    struct vfs_stat st;
+    uint64_t start;
+
+    (void)addr;
+    if (!proc || !proc->vm_space) return SYSCALL_EINVAL;
+    if (length == 0 || (offset & (PAGE_SIZE - 1))) return SYSCALL_EINVAL;
+    if (prot & (MMAP_PROT_WRITE | MMAP_PROT_EXEC)) return SYSCALL_EINVAL;
+    if (flags & (MMAP_FIXED | MMAP_ANONYMOUS)) return SYSCALL_EINVAL;
+    if ((flags & (MMAP_SHARED | MMAP_PRIVATE)) == 0 ||
+        (flags & (MMAP_SHARED | MMAP_PRIVATE)) == (MMAP_SHARED | MMAP_PRIVATE)) {
+        return SYSCALL_EINVAL;
     }
 
-    int exit_code = proc->exit_code;
-    process_reap(proc);
-    return exit_code;
+    int vfs_fd = user_vfs_fd(fd);
+    if (vfs_fd < 0 || vfs_fstat(vfs_fd, &st) != 0) return SYSCALL_EBADF;
+    if (st.type != VFS_NODE_FILE) return SYSCALL_EINVAL;
+
+    if (mmap_create(proc->vm_space, length, vfs_fd, offset, &start) != 0) {
+        return SYSCALL_ENOMEM;
+    }
+    return (int64_t)start;
 }
 
-int64_t sys_close(int fd) {
-    if (fd < 3) return SYSCALL_EBADF;
-    int vfs_fd = fd - 3;
-    return (vfs_close(vfs_fd) == 0) ? 0 : SYSCALL_EBADF;
+int64_t sys_munmap(uint64_t addr, size_t length) {
+    struct process *proc = scheduler_current();
+
+    if (!proc || !proc->vm_space) return SYSCALL_EINVAL;
+    if (!user_access_ok((const void *)(uintptr_t)addr, length)) return SYSCALL_EINVAL;
+    return (mmap_remove(proc->vm_space, addr, length) == 0) ? 0 : SYSCALL_EINVAL;
 }
 
 int64_t sys_exit(int status) {
@@ -364,7 +562,7 @@ int64_t sys_uptime_ms(void) {
 
 int64_t sys_sysinfo(struct sysinfo *info) {
     if (!info) return SYSCALL_EFAULT;
-    if (!is_user_range(info, sizeof(struct sysinfo))) return SYSCALL_EFAULT;
+    if (!user_access_ok(info, sizeof(struct sysinfo))) return SYSCALL_EFAULT;
 
     struct sysinfo out;
     memset(&out, 0, sizeof(out));
@@ -400,14 +598,14 @@ int64_t sys_sysinfo(struct sysinfo *info) {
 
     strncpy(out.version, NUMOS_VERSION, NUMOS_SYSINFO_VERSION_LEN - 1);
 
-    memcpy(info, &out, sizeof(out));
+    if (copy_to_user(info, &out, sizeof(out)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
 int64_t sys_hwinfo(struct hwinfo *info, size_t len) {
     if (!info) return SYSCALL_EFAULT;
     if (len < sizeof(struct hwinfo)) return SYSCALL_EINVAL;
-    if (!is_user_range(info, len)) return SYSCALL_EFAULT;
+    if (!user_access_ok(info, len)) return SYSCALL_EFAULT;
 
     struct hwinfo out;
     memset(&out, 0, sizeof(out));
@@ -454,7 +652,7 @@ int64_t sys_hwinfo(struct hwinfo *info, size_t len) {
         copy_str(out.machine, "baremetal", sizeof(out.machine));
     }
 
-    memcpy(info, &out, sizeof(out));
+    if (copy_to_user(info, &out, sizeof(out)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -472,18 +670,20 @@ int64_t sys_puts(const char *str) {
 
 int64_t sys_get_cmdline(char *buf, size_t len) {
     if (!buf) return SYSCALL_EFAULT;
-    if (!is_user_range(buf, len)) return SYSCALL_EFAULT;
+    if (!user_access_ok(buf, len)) return SYSCALL_EFAULT;
     if (len == 0) return 0;
 
     struct process *p = scheduler_current();
     if (!p) return SYSCALL_EINVAL;
 
+    char kcmd[PROCESS_CMDLINE_LEN];
     size_t n = 0;
-    while (n + 1 < len && p->cmdline[n]) {
-        buf[n] = p->cmdline[n];
+    while (n + 1 < len && n + 1 < sizeof(kcmd) && p->cmdline[n]) {
+        kcmd[n] = p->cmdline[n];
         n++;
     }
-    buf[n] = '\0';
+    kcmd[n] = '\0';
+    if (copy_to_user(buf, kcmd, n + 1) != 0) return SYSCALL_EFAULT;
     return (int64_t)n;
 }
 
@@ -494,48 +694,138 @@ int64_t sys_listdir(const char *path, struct fat32_dirent *entries, int max_entr
     if (max_entries <= 0) return SYSCALL_EINVAL;
 
     size_t total = sizeof(struct fat32_dirent) * (size_t)max_entries;
-    if (!is_user_range(entries, total)) return SYSCALL_EFAULT;
-
-    tmp = (struct vfs_dirent *)kmalloc(sizeof(*tmp) * (size_t)max_entries);
-    if (!tmp) return SYSCALL_ENOMEM;
+    if (!user_access_ok(entries, total)) return SYSCALL_EFAULT;
 
     char kpath[256];
     kpath[0] = '\0';
     if (path) {
-        size_t i = 0;
-        for (; i < sizeof(kpath) - 1; i++) {
-            if (!is_user_range(path + i, 1)) {
-                kfree(tmp);
-                return SYSCALL_EFAULT;
-            }
-            char c = path[i];
-            kpath[i] = c;
-            if (c == 0) break;
-        }
-        if (i >= sizeof(kpath) - 1) {
-            kfree(tmp);
-            return SYSCALL_EINVAL;
-        }
+        int64_t rc = copy_user_path(kpath, sizeof(kpath), path);
+        if (rc != 0) return rc;
+    }
+
+    tmp = (struct vfs_dirent *)kmalloc(sizeof(*tmp) * (size_t)max_entries);
+    if (!tmp) return SYSCALL_ENOMEM;
+    struct fat32_dirent *out = (struct fat32_dirent *)kmalloc(total);
+    if (!out) {
+        kfree(tmp);
+        return SYSCALL_ENOMEM;
     }
 
     int count = vfs_listdir((path && kpath[0] != '\0') ? kpath : NULL,
                             tmp,
                             max_entries);
     if (count < 0) {
+        kfree(out);
         kfree(tmp);
         return SYSCALL_EINVAL;
     }
 
     for (int i = 0; i < count; i++) {
-        memset(&entries[i], 0, sizeof(entries[i]));
-        strncpy(entries[i].name, tmp[i].name, sizeof(entries[i].name) - 1);
-        entries[i].size = tmp[i].size;
-        entries[i].attr = tmp[i].attr;
-        entries[i].cluster = tmp[i].fs_data;
+        memset(&out[i], 0, sizeof(out[i]));
+        strncpy(out[i].name, tmp[i].name, sizeof(out[i].name) - 1);
+        out[i].size = tmp[i].size;
+        out[i].attr = tmp[i].attr;
+        out[i].cluster = tmp[i].fs_data;
     }
 
+    int64_t rc = (int64_t)count;
+    if (copy_to_user(entries, out, sizeof(*out) * (size_t)count) != 0) {
+        rc = SYSCALL_EFAULT;
+    }
+    kfree(out);
     kfree(tmp);
-    return (int64_t)count;
+    return rc;
+}
+
+#define GETDENTS_BATCH       16
+#define GETDENTS_MAX_RECLEN  ((sizeof(struct numos_dirent) + VFS_NAME_MAX + 1 + 7) & ~(size_t)7)
+
+/*
+ * sys_getdents - pack directory records for path into buf, resuming at
+ * *cursor (0 to start) and storing the resume point back.  Entries are
+ * fetched in batches that are sure to fit, then singly near the end of the
+ * buffer, so the cursor never skips an entry that did not fit.  Each batch
+ * is packed in a kernel buffer and copied out in one copy_to_user.
+ * Returns the bytes written, 0 at the end of the directory, or a negative
+ * errno (EINVAL if buf cannot hold even one record).
+ */
+int64_t sys_getdents(const char *path, void *buf, size_t len, uint64_t *cursor) {
+    char kpath[256];
+
+    uint64_t pos;
+
+    if (!buf || !cursor) return SYSCALL_EFAULT;
+    if (!user_access_ok(buf, len)) return SYSCALL_EFAULT;
+    if (copy_from_user(&pos, cursor, sizeof(pos)) != 0) return SYSCALL_EFAULT;
+
+    kpath[0] = '\0';
+    if (path) {
+        int64_t prc = copy_user_path(kpath, sizeof(kpath), path);
+        if (prc != 0) return prc;
+    }
+
+    struct vfs_dirent *batch =
+        (struct vfs_dirent *)kmalloc(sizeof(*batch) * GETDENTS_BATCH);
+    if (!batch) return SYSCALL_ENOMEM;
+    uint8_t *stage = (uint8_t *)kmalloc(GETDENTS_MAX_RECLEN * GETDENTS_BATCH);
+    if (!stage) {
+        kfree(batch);
+        return SYSCALL_ENOMEM;
+    }
+
+    uint8_t *out = (uint8_t *)buf;
+    size_t   used = 0;
+    int      full = 0;
+    int64_t  rc = 0;
+
+    while (!full && len - used >= sizeof(struct numos_dirent)) {
+        size_t want = (len - used) / GETDENTS_MAX_RECLEN;
+        if (want > GETDENTS_BATCH) want = GETDENTS_BATCH;
+        if (want == 0) want = 1;
+
+        uint64_t next = pos;
+        int got = vfs_readdir(kpath[0] ? kpath : NULL, &next, batch, (int)want);
+        if (got < 0) {
+            if (used == 0) rc = SYSCALL_EINVAL;
+            break;
+        }
+        if (got == 0) break;
+
+        size_t packed = 0;
+        for (int i = 0; i < got; i++) {
+            size_t name_len = strlen(batch[i].name);
+            size_t reclen = (sizeof(struct numos_dirent) + name_len + 1 + 7) & ~(size_t)7;
+
+            /* Only a single-entry fetch can overflow; leave it for next time */
+            if (used + packed + reclen > len) {
+                full = 1;
+                break;
+            }
+
+            struct numos_dirent *rec = (struct numos_dirent *)(stage + packed);
+            memset(rec, 0, reclen);
+            rec->d_size   = batch[i].size;
+            rec->d_reclen = (uint16_t)reclen;
+            rec->d_type   = batch[i].type;
+            rec->d_attr   = batch[i].attr;
+            memcpy(rec->d_name, batch[i].name, name_len + 1);
+            packed += reclen;
+        }
+        if (packed && copy_to_user(out + used, stage, packed) != 0) {
+            rc = SYSCALL_EFAULT;
+            break;
+        }
+        used += packed;
+        if (!full) pos = next;
+    }
+
+    kfree(stage);
+    kfree(batch);
+    if (rc < 0) return rc;
+    if (full && used == 0) return SYSCALL_EINVAL;
+
+    if (copy_to_user(cursor, &pos, sizeof(pos)) != 0) return SYSCALL_EFAULT;
+    return (int64_t)used;
 }
 
 int64_t sys_input(void *buf, size_t count) {
@@ -544,9 +834,13 @@ int64_t sys_input(void *buf, size_t count) {
 
     char  *p   = (char *)buf;
     size_t got = 0;
+    if (!user_access_ok(buf, count)) return SYSCALL_EFAULT;
     while (got < count) {
         char c = keyboard_getchar_buffered();
-        p[got++] = c;
+        if (copy_to_user(p + got, &c, 1) != 0) {
+            return got ? (int64_t)got : SYSCALL_EFAULT;
+        }
+        got++;
         if (c == '\n') break;
     }
     return (int64_t)got;
@@ -554,11 +848,11 @@ int64_t sys_input(void *buf, size_t count) {
 
 int64_t sys_input_peek(char *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, 1)) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, 1)) return SYSCALL_EFAULT;
     char c = 0;
     int got = keyboard_try_getchar(&c);
     if (!got) return 0;
-    *out = c;
+    if (copy_to_user(out, &c, 1) != 0) return SYSCALL_EFAULT;
     return 1;
 }
 
@@ -568,12 +862,14 @@ int64_t sys_proclist(struct proc_info *out, size_t max) {
     if (max > MAX_PROCESSES) max = MAX_PROCESSES;
 
     size_t total = sizeof(struct proc_info) * max;
-    if (!is_user_range(out, total)) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, total)) return SYSCALL_EFAULT;
 
     struct proc_info tmp[MAX_PROCESSES];
     int count = scheduler_list_processes(tmp, (int)max);
     if (count < 0) return SYSCALL_EINVAL;
-    memcpy(out, tmp, (size_t)count * sizeof(struct proc_info));
+    if (copy_to_user(out, tmp, (size_t)count * sizeof(struct proc_info)) != 0) {
+        return SYSCALL_EFAULT;
+    }
     return count;
 }
 
@@ -584,11 +880,11 @@ int64_t sys_yield(void) {
 
 int64_t sys_time_read(struct numos_calendar_time *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct numos_calendar_time now;
     if (timer_get_wall_clock(&now) != 0) return SYSCALL_EINVAL;
-    memcpy(out, &now, sizeof(now));
+    if (copy_to_user(out, &now, sizeof(now)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -626,7 +922,7 @@ int64_t sys_timer_wait(int timer_id) {
 
 int64_t sys_timer_info(int timer_id, struct numos_timer_info *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct process *cur = scheduler_current();
     if (!cur) return SYSCALL_EINVAL;
@@ -637,7 +933,7 @@ int64_t sys_timer_info(int timer_id, struct numos_timer_info *out) {
         return SYSCALL_EINVAL;
     }
 
-    memcpy(out, &info, sizeof(info));
+    if (copy_to_user(out, &info, sizeof(info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -698,14 +994,27 @@ int64_t sys_fb_info(uint64_t field) {
 
 /*
  * sys_fb_write — write a buffer of chars to the framebuffer console.
- * When FB is not active, falls through to VGA.
+ * When FB is not active, falls through to VGA.  The text is copied in
+ * through a small kernel buffer.
  */
 int64_t sys_fb_write(const char *buf, size_t len) {
+    char   chunk[256];
+    size_t done = 0;
+
     if (!buf) return SYSCALL_EFAULT;
-    if (fb_is_available()) {
-        fb_con_write(buf, len);
-    } else {
-        vga_write(buf, len);
+    if (!user_access_ok(buf, len)) return SYSCALL_EFAULT;
+    while (done < len) {
+        size_t n = len - done;
+        if (n > sizeof(chunk)) n = sizeof(chunk);
+        if (copy_from_user(chunk, buf + done, n) != 0) {
+            return done ? (int64_t)done : SYSCALL_EFAULT;
+        }
+        if (fb_is_available()) {
+            fb_con_write(chunk, n);
+        } else {
+            vga_write(chunk, n);
+        }
+        done += n;
     }
     return (int64_t)len;
 }
@@ -752,7 +1061,7 @@ int64_t sys_con_scroll(void) {
 
 int64_t sys_disk_info(struct numos_disk_info *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct numos_disk_info info;
     memset(&info, 0, sizeof(info));
@@ -762,14 +1071,14 @@ int64_t sys_disk_info(struct numos_disk_info *out) {
     info.sector_count = ata_primary_master.sectors;
     copy_str(info.model, ata_primary_master.model, sizeof(info.model));
 
-    memcpy(out, &info, sizeof(info));
+    if (copy_to_user(out, &info, sizeof(info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
 int64_t sys_disk_read(uint64_t lba, void *buf, uint32_t sector_count) {
     if (!buf) return SYSCALL_EFAULT;
     if (!sector_count) return 0;
-    if (!is_user_range(buf, (size_t)sector_count * 512u)) return SYSCALL_EFAULT;
+    if (!user_access_ok(buf, (size_t)sector_count * 512u)) return SYSCALL_EFAULT;
     if (!ata_primary_master.exists) return SYSCALL_EINVAL;
     if (sector_count > 255u) return SYSCALL_EINVAL;
     if (lba >= ata_primary_master.sectors) return SYSCALL_EINVAL;
@@ -782,7 +1091,7 @@ int64_t sys_disk_read(uint64_t lba, void *buf, uint32_t sector_count) {
 int64_t sys_disk_write(uint64_t lba, const void *buf, uint32_t sector_count) {
     if (!buf) return SYSCALL_EFAULT;
     if (!sector_count) return 0;
-    if (!is_user_range(buf, (size_t)sector_count * 512u)) return SYSCALL_EFAULT;
+    if (!user_access_ok(buf, (size_t)sector_count * 512u)) return SYSCALL_EFAULT;
     if (!ata_primary_master.exists) return SYSCALL_EINVAL;
     if (sector_count > 255u) return SYSCALL_EINVAL;
     if (lba >= ata_primary_master.sectors) return SYSCALL_EINVAL;
@@ -798,7 +1107,7 @@ int64_t sys_usb_controller_count(void) {
 
 int64_t sys_usb_controller_info(int index, struct numos_usb_controller_info *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct usb_controller_info info;
     if (usb_get_controller_info(index, &info) != 0) return SYSCALL_EINVAL;
@@ -806,14 +1115,14 @@ int64_t sys_usb_controller_info(int index, struct numos_usb_controller_info *out
     struct numos_usb_controller_info user_info;
     memset(&user_info, 0, sizeof(user_info));
     memcpy(&user_info, &info, sizeof(user_info));
-    memcpy(out, &user_info, sizeof(user_info));
+    if (copy_to_user(out, &user_info, sizeof(user_info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
 int64_t sys_usb_port_info(int controller_index, int port_index,
                           struct numos_usb_port_info *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct usb_port_info info;
     if (usb_get_port_info(controller_index, port_index, &info) != 0) {
@@ -823,13 +1132,13 @@ int64_t sys_usb_port_info(int controller_index, int port_index,
     struct numos_usb_port_info user_info;
     memset(&user_info, 0, sizeof(user_info));
     memcpy(&user_info, &info, sizeof(user_info));
-    memcpy(out, &user_info, sizeof(user_info));
+    if (copy_to_user(out, &user_info, sizeof(user_info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
 int64_t sys_thread_create(void *start, void *arg, void *trampoline) {
     if (!start || !trampoline) return SYSCALL_EFAULT;
-    if (!is_user_range(start, 1) || !is_user_range(trampoline, 1)) {
+    if (!user_access_ok(start, 1) || !user_access_ok(trampoline, 1)) {
         return SYSCALL_EFAULT;
     }
 
@@ -846,7 +1155,7 @@ int64_t sys_thread_create(void *start, void *arg, void *trampoline) {
 }
 
 int64_t sys_thread_join(int tid, uint64_t *out_value) {
-    if (out_value && !is_user_range(out_value, sizeof(*out_value))) {
+    if (out_value && !user_access_ok(out_value, sizeof(*out_value))) {
         return SYSCALL_EFAULT;
     }
 
@@ -858,15 +1167,25 @@ int64_t sys_thread_join(int tid, uint64_t *out_value) {
     if (!target) return SYSCALL_EINVAL;
     if (target->group_id != cur->group_id) return SYSCALL_EINVAL;
 
-    while (target->state != PROC_ZOMBIE && target->state != PROC_UNUSED) {
-        schedule();
+    /* process_mark_zombie() wakes exit_waiters; recheck since another
+     * joiner may have reaped the thread first. */
+    for (;;) {
+        __asm__ volatile("cli");
         target = scheduler_find_process(tid);
-        if (!target) return SYSCALL_EINVAL;
+        if (!target || target->group_id != cur->group_id) {
+            __asm__ volatile("sti");
+            return SYSCALL_EINVAL;
+        }
+        if (target->state == PROC_ZOMBIE) break;
+        wait_queue_sleep(&target->exit_waiters);
     }
+    __asm__ volatile("sti");
 
-    if (target->state == PROC_UNUSED) return 0;
-    if (out_value) *out_value = target->thread_exit_value;
+    uint64_t value = target->thread_exit_value;
     process_reap(target);
+    if (out_value && copy_to_user(out_value, &value, sizeof(value)) != 0) {
+        return SYSCALL_EFAULT;
+    }
     return 0;
 }
 
@@ -883,7 +1202,7 @@ int64_t sys_thread_self(void) {
 
 int64_t sys_net_info(struct numos_net_info *out) {
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     struct net_info info;
     if (net_get_info(&info) != 0) return SYSCALL_EINVAL;
@@ -891,7 +1210,7 @@ int64_t sys_net_info(struct numos_net_info *out) {
     struct numos_net_info user_info;
     memset(&user_info, 0, sizeof(user_info));
     memcpy(&user_info, &info, sizeof(user_info));
-    memcpy(out, &user_info, sizeof(user_info));
+    if (copy_to_user(out, &user_info, sizeof(user_info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -902,11 +1221,11 @@ int64_t sys_net_dhcp(uint32_t timeout_ms) {
 int64_t sys_net_ping(const uint8_t *ipv4, uint32_t timeout_ms,
                      struct numos_net_ping_result *out) {
     if (!ipv4 || !out) return SYSCALL_EFAULT;
-    if (!is_user_range(ipv4, 4)) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(ipv4, 4)) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
 
     uint8_t addr[4];
-    memcpy(addr, ipv4, sizeof(addr));
+    if (copy_from_user(addr, ipv4, sizeof(addr)) != 0) return SYSCALL_EFAULT;
 
     struct net_ping_result result;
     if (net_ping_ipv4(addr, timeout_ms, &result) != 0) return SYSCALL_EINVAL;
@@ -914,7 +1233,7 @@ int64_t sys_net_ping(const uint8_t *ipv4, uint32_t timeout_ms,
     struct numos_net_ping_result user_result;
     memset(&user_result, 0, sizeof(user_result));
     memcpy(&user_result, &result, sizeof(user_result));
-    memcpy(out, &user_result, sizeof(user_result));
+    if (copy_to_user(out, &user_result, sizeof(user_result)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -922,20 +1241,20 @@ int64_t sys_net_tcp_connect(const uint8_t *ipv4, uint16_t port, uint32_t timeout
     uint8_t addr[4];
 
     if (!ipv4) return SYSCALL_EFAULT;
-    if (!is_user_range(ipv4, sizeof(addr))) return SYSCALL_EFAULT;
-    memcpy(addr, ipv4, sizeof(addr));
+    if (!user_access_ok(ipv4, sizeof(addr))) return SYSCALL_EFAULT;
+    if (copy_from_user(addr, ipv4, sizeof(addr)) != 0) return SYSCALL_EFAULT;
     return net_tcp_connect_ipv4(addr, port, timeout_ms);
 }
 
 int64_t sys_net_tcp_send(int handle, const void *buf, size_t len, uint32_t timeout_ms) {
     if (!buf) return SYSCALL_EFAULT;
-    if (len && !is_user_range(buf, len)) return SYSCALL_EFAULT;
+    if (len && !user_access_ok(buf, len)) return SYSCALL_EFAULT;
     return net_tcp_send(handle, buf, len, timeout_ms);
 }
 
 int64_t sys_net_tcp_recv(int handle, void *buf, size_t len, uint32_t timeout_ms) {
     if (!buf) return SYSCALL_EFAULT;
-    if (len && !is_user_range(buf, len)) return SYSCALL_EFAULT;
+    if (len && !user_access_ok(buf, len)) return SYSCALL_EFAULT;
     return net_tcp_recv(handle, buf, len, timeout_ms);
 }
 
@@ -948,15 +1267,164 @@ int64_t sys_net_tcp_info(int handle, struct numos_net_tcp_info *out) {
     struct numos_net_tcp_info user_info;
 
     if (!out) return SYSCALL_EFAULT;
-    if (!is_user_range(out, sizeof(*out))) return SYSCALL_EFAULT;
+    if (!user_access_ok(out, sizeof(*out))) return SYSCALL_EFAULT;
     if (net_tcp_get_info(handle, &info) != 0) return SYSCALL_EINVAL;
 
     memset(&user_info, 0, sizeof(user_info));
     memcpy(&user_info, &info, sizeof(user_info));
-    memcpy(out, &user_info, sizeof(user_info));
+    if (copy_to_user(out, &user_info, sizeof(user_info)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
+/*
+ * install_special - give a new socket or epoll instance a descriptor in
+ * the calling process, closing it again if the table is full.
+ */
+static int64_t install_special(int vfs_fd) {
+    if (vfs_fd < 0) return vfs_fd;
+
+    int fd = fd_install(current_fds(1), vfs_fd);
+    if (fd < 0) {
+        vfs_close(vfs_fd);
+        return SYSCALL_ENOMEM;
+    }
+    return (int64_t)fd;
+}
+
+static int64_t copy_sockaddr_from_user(struct numos_sockaddr_in *dst,
+                                       const struct numos_sockaddr_in *src) {
+    if (!src || !user_access_ok(src, sizeof(*src))) return SYSCALL_EFAULT;
+    if (copy_from_user(dst, src, sizeof(*dst)) != 0) return SYSCALL_EFAULT;
+    return 0;
+}
+
+int64_t sys_socket(int type) {
+    return install_special(socket_create(type));
+}
+
+int64_t sys_bind(int fd, const struct numos_sockaddr_in *addr) {
+    struct numos_sockaddr_in a;
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    int64_t rc = copy_sockaddr_from_user(&a, addr);
+    if (rc != 0) return rc;
+    return socket_bind(vfs_fd, a.port);
+}
+
+int64_t sys_listen(int fd, int backlog) {
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    return socket_listen(vfs_fd, backlog);
+}
+
+int64_t sys_accept(int fd, struct numos_sockaddr_in *peer) {
+    struct numos_sockaddr_in a;
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    if (peer && !user_access_ok(peer, sizeof(*peer))) return SYSCALL_EFAULT;
+
+    memset(&a, 0, sizeof(a));
+    int64_t newfd = install_special(socket_accept(vfs_fd, a.addr, &a.port));
+    if (newfd >= 0 && peer && copy_to_user(peer, &a, sizeof(a)) != 0) {
+        /* The caller never learns the descriptor, so do not leak it */
+        vfs_close(fd_remove(current_fds(0), (int)newfd));
+        return SYSCALL_EFAULT;
+    }
+    return newfd;
+}
+
+int64_t sys_connect(int fd, const struct numos_sockaddr_in *addr) {
+    struct numos_sockaddr_in a;
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    int64_t rc = copy_sockaddr_from_user(&a, addr);
+    if (rc != 0) return rc;
+    return socket_connect(vfs_fd, a.addr, a.port);
+}
+
+int64_t sys_sendto(int fd, const void *buf, size_t len,
+                   const struct numos_sockaddr_in *addr) {
+    struct numos_sockaddr_in a;
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    if (!buf || (len && !user_access_ok(buf, len))) return SYSCALL_EFAULT;
+    if (!addr) return socket_sendto(vfs_fd, buf, len, NULL, 0);
+
+    int64_t rc = copy_sockaddr_from_user(&a, addr);
+    if (rc != 0) return rc;
+    return socket_sendto(vfs_fd, buf, len, a.addr, a.port);
+}
+
+int64_t sys_recvfrom(int fd, void *buf, size_t len, struct numos_sockaddr_in *from) {
+    struct numos_sockaddr_in a;
+    int vfs_fd = user_vfs_fd(fd);
+
+    if (vfs_fd < 0) return SYSCALL_EBADF;
+    if (!buf || (len && !user_access_ok(buf, len))) return SYSCALL_EFAULT;
+    if (from && !user_access_ok(from, sizeof(*from))) return SYSCALL_EFAULT;
+
+    memset(&a, 0, sizeof(a));
+    int64_t n = socket_recvfrom(vfs_fd, buf, len, a.addr, &a.port);
+    if (n >= 0 && from && copy_to_user(from, &a, sizeof(a)) != 0) return SYSCALL_EFAULT;
+    return n;
+}
+
+int64_t sys_epoll_create(void) {
+    return install_special(epoll_create());
+}
+
+int64_t sys_epoll_ctl(int epfd, int op, int kind, int id,
+                      const struct numos_epoll_event *event) {
+    struct numos_epoll_event ev;
+    int ep_vfs_fd = user_vfs_fd(epfd);
+    int vfs_fd = -1;
+
+    if (ep_vfs_fd < 0) return SYSCALL_EBADF;
+    if (kind == EPOLL_KIND_FD && id != FD_STDIN) {
+        vfs_fd = user_vfs_fd(id);
+        if (vfs_fd < 0) return SYSCALL_EBADF;
+        if (vfs_fd == ep_vfs_fd) return SYSCALL_EINVAL;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    if (op != EPOLL_CTL_DEL) {
+        if (!event || !user_access_ok(event, sizeof(*event))) return SYSCALL_EFAULT;
+        if (copy_from_user(&ev, event, sizeof(ev)) != 0) return SYSCALL_EFAULT;
+    }
+    return epoll_ctl(ep_vfs_fd, op, kind, id, vfs_fd, ev.events, ev.data);
+}
+
+/*
+ * sys_epoll_wait - events are gathered in a kernel buffer and copied out
+ * once, so the wait never touches user memory with interrupts off.
+ */
+int64_t sys_epoll_wait(int epfd, struct numos_epoll_event *events, int max_events,
+                       int64_t timeout_ms) {
+    int ep_vfs_fd = user_vfs_fd(epfd);
+
+    if (ep_vfs_fd < 0) return SYSCALL_EBADF;
+    if (max_events <= 0) return SYSCALL_EINVAL;
+    if (max_events > EPOLL_MAX_EVENTS) max_events = EPOLL_MAX_EVENTS;
+
+    size_t bytes = sizeof(*events) * (size_t)max_events;
+    if (!events || !user_access_ok(events, bytes)) return SYSCALL_EFAULT;
+
+    struct numos_epoll_event *buf = (struct numos_epoll_event *)kmalloc(bytes);
+    if (!buf) return SYSCALL_ENOMEM;
+
+    int n = epoll_wait(ep_vfs_fd, buf, max_events, timeout_ms);
+    if (n > 0 && copy_to_user(events, buf, sizeof(*buf) * (size_t)n) != 0) {
+        n = SYSCALL_EFAULT;
+    }
+    kfree(buf);
+    return n;
+}
+
 int64_t sys_net_tls_probe(const uint8_t *ipv4,
                           uint16_t port,
                           const char *server_name,
@@ -969,18 +1437,16 @@ int64_t sys_net_tls_probe(const uint8_t *ipv4,
     struct numos_net_tls_result user_result;
 
     if (!ipv4 || !server_name || !out) return SYSCALL_EFAULT;
-    if (!is_user_range(ipv4, sizeof(addr)) ||
-        !is_user_range(server_name, 1) ||
-        !is_user_range(out, sizeof(*out))) {
+    if (!user_access_ok(ipv4, sizeof(addr)) ||
+        !user_access_ok(server_name, 1) ||
+        !user_access_ok(out, sizeof(*out))) {
         return SYSCALL_EFAULT;
     }
 
-    memcpy(addr, ipv4, sizeof(addr));
-    size_t i = 0;
-    for (; i + 1 < sizeof(server_name_copy); i++) {
-        if (!is_user_range(server_name + i, 1)) return SYSCALL_EFAULT;
-        server_name_copy[i] = server_name[i];
-        if (server_name_copy[i] == 0) break;
+    if (copy_from_user(addr, ipv4, sizeof(addr)) != 0) return SYSCALL_EFAULT;
+    if (strncpy_from_user(server_name_copy, server_name,
+                          sizeof(server_name_copy)) < 0) {
+        return SYSCALL_EFAULT;
     }
     server_name_copy[sizeof(server_name_copy) - 1] = '\0';
 
@@ -990,7 +1456,7 @@ int64_t sys_net_tls_probe(const uint8_t *ipv4,
 
     memset(&user_result, 0, sizeof(user_result));
     memcpy(&user_result, &result, sizeof(user_result));
-    memcpy(out, &user_result, sizeof(user_result));
+    if (copy_to_user(out, &user_result, sizeof(user_result)) != 0) return SYSCALL_EFAULT;
     return 0;
 }
 
@@ -1003,27 +1469,286 @@ int64_t sys_net_http_get(const struct numos_net_http_request *request,
     ssize_t rc;
 
     if (!request || !buf || !out) return SYSCALL_EFAULT;
-    if (!is_user_range(request, sizeof(*request)) ||
-        !is_user_range(buf, len) ||
-        !is_user_range(out, sizeof(*out))) {
+    if (!user_access_ok(request, sizeof(*request)) ||
+        !user_access_ok(buf, len) ||
+        !user_access_ok(out, sizeof(*out))) {
         return SYSCALL_EFAULT;
     }
 
-    memcpy(&kernel_request, request, sizeof(kernel_request));
+    if (copy_from_user(&kernel_request, request, sizeof(kernel_request)) != 0) {
+        return SYSCALL_EFAULT;
+    }
     rc = net_http_get_ipv4(&kernel_request, buf, len, &kernel_result);
     if (rc < 0) return SYSCALL_EINVAL;
 
     struct numos_net_http_result user_result;
     memset(&user_result, 0, sizeof(user_result));
     memcpy(&user_result, &kernel_result, sizeof(user_result));
-    memcpy(out, &user_result, sizeof(user_result));
+    if (copy_to_user(out, &user_result, sizeof(user_result)) != 0) return SYSCALL_EFAULT;
     return rc;
 }
 
+struct http_fetch_file {
+    int      vfs_fd;
+    uint64_t written;
+};
+
+/* Only a successful body reaches the file; redirects and errors are drained */
+static int http_fetch_write(void *ctx, const struct net_http_result *result,
+                            const void *data, size_t len) {
+    struct http_fetch_file *file = (struct http_fetch_file *)ctx;
+    const uint8_t *src = (const uint8_t *)data;
+
+    if (result->status_code < 200 || result->status_code >= 300) return 0;
+    while (len > 0) {
+        ssize_t n = vfs_write(file->vfs_fd, src, len);
+        if (n <= 0) return NET_ERR_GENERIC;
+        src += n;
+        len -= (size_t)n;
+        file->written += (uint64_t)n;
+    }
+    return 0;
+}
+
+int64_t sys_net_http_fetch(const struct numos_net_http_request *request,
+                           int fd,
+                           struct numos_net_http_result *out) {
+    struct net_http_request kernel_request;
+    struct net_http_result kernel_result;
+    struct http_fetch_file file;
+    ssize_t rc;
+
+    if (!request || !out) return SYSCALL_EFAULT;
+    if (!user_access_ok(request, sizeof(*request)) ||
+        !user_access_ok(out, sizeof(*out))) {
+        return SYSCALL_EFAULT;
+    }
+    if (copy_from_user(&kernel_request, request, sizeof(kernel_request)) != 0) {
+        return SYSCALL_EFAULT;
+    }
+
+    file.vfs_fd = user_vfs_fd(fd);
+    file.written = 0;
+    if (file.vfs_fd < 0) return SYSCALL_EBADF;
+
+    rc = net_http_fetch_ipv4(&kernel_request, http_fetch_write, &file, &kernel_result);
+    if (rc < 0) return socket_errno((int)rc);
+    kernel_result.bytes_received = (uint32_t)file.written;
+
+    struct numos_net_http_result user_result;
+    memset(&user_result, 0, sizeof(user_result));
+    memcpy(&user_result, &kernel_result, sizeof(user_result));
+    if (copy_to_user(out, &user_result, sizeof(user_result)) != 0) return SYSCALL_EFAULT;
+    return (int64_t)file.written;
+}
+
 /* =========================================================================
  * Dispatcher
  * ======================================================================= */
 
+/*
+ * Each entry adapts the saved argument registers (rdi, rsi, rdx, r10, r8,
+ * r9) to one handler.  The table is indexed directly by syscall number so
+ * dispatch is a bounds check and an indirect call; empty slots are ENOSYS.
+ */
+#define SYSCALL_WRAP(name, call) \
+    static int64_t sc_##name(struct syscall_regs *regs) { (void)regs; return call; }
+
+SYSCALL_WRAP(read,       sys_read((int)regs->rdi, (void *)regs->rsi, (size_t)regs->rdx))
+SYSCALL_WRAP(lseek,      sys_lseek((int)regs->rdi, (int64_t)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(pread,      sys_pread((int)regs->rdi, (void *)regs->rsi, (size_t)regs->rdx, regs->r10))
+SYSCALL_WRAP(pwrite,     sys_pwrite((int)regs->rdi, (const void *)regs->rsi, (size_t)regs->rdx, regs->r10))
+SYSCALL_WRAP(readv,      sys_readv((int)regs->rdi, (const struct numos_iovec *)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(writev,     sys_writev((int)regs->rdi, (const struct numos_iovec *)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(input,      sys_input((void *)regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(input_peek, sys_input_peek((char *)regs->rdi))
+SYSCALL_WRAP(yield,      sys_yield())
+SYSCALL_WRAP(write,      sys_write((int)regs->rdi, (const void *)regs->rsi, (size_t)regs->rdx))
+SYSCALL_WRAP(open,       sys_open((const char *)regs->rdi, (int)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(exec,       sys_exec((const char *)regs->rdi))
+SYSCALL_WRAP(exec_argv,  sys_exec_argv((const char *)regs->rdi, (const char *)regs->rsi))
+SYSCALL_WRAP(spawn,      sys_spawn((const char *)regs->rdi, (const char *)regs->rsi))
+SYSCALL_WRAP(waitpid,    sys_waitpid((int)regs->rdi, (int *)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(close,      sys_close((int)regs->rdi))
+SYSCALL_WRAP(mmap,       sys_mmap(regs->rdi, (size_t)regs->rsi, (int)regs->rdx,
+                                  (int)regs->r10, (int)regs->r8, regs->r9))
+SYSCALL_WRAP(munmap,     sys_munmap(regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(exit,       sys_exit((int)regs->rdi))
+SYSCALL_WRAP(getpid,     sys_getpid())
+SYSCALL_WRAP(sleep_ms,   sys_sleep_ms(regs->rdi))
+SYSCALL_WRAP(uptime_ms,  sys_uptime_ms())
+SYSCALL_WRAP(sysinfo,    sys_sysinfo((struct sysinfo *)regs->rdi))
+SYSCALL_WRAP(hwinfo,     sys_hwinfo((struct hwinfo *)regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(puts,       sys_puts((const char *)regs->rdi))
+SYSCALL_WRAP(get_cmdline, sys_get_cmdline((char *)regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(listdir,    sys_listdir((const char *)regs->rdi,
+                                     (struct fat32_dirent *)regs->rsi, (int)regs->rdx))
+SYSCALL_WRAP(getdents,   sys_getdents((const char *)regs->rdi, (void *)regs->rsi,
+                                      (size_t)regs->rdx, (uint64_t *)regs->r10))
+SYSCALL_WRAP(proclist,   sys_proclist((struct proc_info *)regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(time_read,  sys_time_read((struct numos_calendar_time *)regs->rdi))
+SYSCALL_WRAP(timer_create, sys_timer_create(regs->rdi, regs->rsi, (uint32_t)regs->rdx))
+SYSCALL_WRAP(timer_wait,   sys_timer_wait((int)regs->rdi))
+SYSCALL_WRAP(timer_info,   sys_timer_info((int)regs->rdi, (struct numos_timer_info *)regs->rsi))
+SYSCALL_WRAP(timer_cancel, sys_timer_cancel((int)regs->rdi))
+SYSCALL_WRAP(con_scroll, sys_con_scroll())
+SYSCALL_WRAP(disk_info,  sys_disk_info((struct numos_disk_info *)regs->rdi))
+SYSCALL_WRAP(disk_read,  sys_disk_read(regs->rdi, (void *)regs->rsi, (uint32_t)regs->rdx))
+SYSCALL_WRAP(disk_write, sys_disk_write(regs->rdi, (const void *)regs->rsi, (uint32_t)regs->rdx))
+SYSCALL_WRAP(usb_controller_count, sys_usb_controller_count())
+SYSCALL_WRAP(usb_controller_info,
+             sys_usb_controller_info((int)regs->rdi,
+                                     (struct numos_usb_controller_info *)regs->rsi))
+SYSCALL_WRAP(usb_port_info,
+             sys_usb_port_info((int)regs->rdi, (int)regs->rsi,
+                               (struct numos_usb_port_info *)regs->rdx))
+SYSCALL_WRAP(thread_create, sys_thread_create((void *)regs->rdi, (void *)regs->rsi,
+                                              (void *)regs->rdx))
+SYSCALL_WRAP(thread_join,   sys_thread_join((int)regs->rdi, (uint64_t *)regs->rsi))
+SYSCALL_WRAP(thread_exit,   sys_thread_exit(regs->rdi))
+SYSCALL_WRAP(thread_self,   sys_thread_self())
+SYSCALL_WRAP(net_info,   sys_net_info((struct numos_net_info *)regs->rdi))
+SYSCALL_WRAP(net_dhcp,   sys_net_dhcp((uint32_t)regs->rdi))
+SYSCALL_WRAP(net_ping,   sys_net_ping((const uint8_t *)regs->rdi, (uint32_t)regs->rsi,
+                                      (struct numos_net_ping_result *)regs->rdx))
+SYSCALL_WRAP(net_tcp_connect,
+             sys_net_tcp_connect((const uint8_t *)regs->rdi, (uint16_t)regs->rsi,
+                                 (uint32_t)regs->rdx))
+SYSCALL_WRAP(net_tcp_send,
+             sys_net_tcp_send((int)regs->rdi, (const void *)regs->rsi,
+                              (size_t)regs->rdx, (uint32_t)regs->r10))
+SYSCALL_WRAP(net_tcp_recv,
+             sys_net_tcp_recv((int)regs->rdi, (void *)regs->rsi,
+                              (size_t)regs->rdx, (uint32_t)regs->r10))
+SYSCALL_WRAP(net_tcp_close, sys_net_tcp_close((int)regs->rdi, (uint32_t)regs->rsi))
+SYSCALL_WRAP(net_tcp_info,
+             sys_net_tcp_info((int)regs->rdi, (struct numos_net_tcp_info *)regs->rsi))
+SYSCALL_WRAP(socket,   sys_socket((int)regs->rdi))
+SYSCALL_WRAP(bind,     sys_bind((int)regs->rdi, (const struct numos_sockaddr_in *)regs->rsi))
+SYSCALL_WRAP(listen,   sys_listen((int)regs->rdi, (int)regs->rsi))
+SYSCALL_WRAP(accept,   sys_accept((int)regs->rdi, (struct numos_sockaddr_in *)regs->rsi))
+SYSCALL_WRAP(connect,  sys_connect((int)regs->rdi, (const struct numos_sockaddr_in *)regs->rsi))
+SYSCALL_WRAP(sendto,   sys_sendto((int)regs->rdi, (const void *)regs->rsi, (size_t)regs->rdx,
+                                  (const struct numos_sockaddr_in *)regs->r10))
+SYSCALL_WRAP(recvfrom, sys_recvfrom((int)regs->rdi, (void *)regs->rsi, (size_t)regs->rdx,
+                                    (struct numos_sockaddr_in *)regs->r10))
+SYSCALL_WRAP(epoll_create, sys_epoll_create())
+SYSCALL_WRAP(epoll_ctl,    sys_epoll_ctl((int)regs->rdi, (int)regs->rsi, (int)regs->rdx,
+                                         (int)regs->r10,
+                                         (const struct numos_epoll_event *)regs->r8))
+SYSCALL_WRAP(epoll_wait,   sys_epoll_wait((int)regs->rdi, (struct numos_epoll_event *)regs->rsi,
+                                          (int)regs->rdx, (int64_t)regs->r10))
+SYSCALL_WRAP(net_tls_probe,
+             sys_net_tls_probe((const uint8_t *)regs->rdi, (uint16_t)regs->rsi,
+                               (const char *)regs->rdx, (uint32_t)regs->r10,
+                               (uint32_t)regs->r8,
+                               (struct numos_net_tls_result *)regs->r9))
+SYSCALL_WRAP(net_http_get,
+             sys_net_http_get((const struct numos_net_http_request *)regs->rdi,
+                              (void *)regs->rsi, (size_t)regs->rdx,
+                              (struct numos_net_http_result *)regs->r10))
+SYSCALL_WRAP(net_http_fetch,
+             sys_net_http_fetch((const struct numos_net_http_request *)regs->rdi,
+                                (int)regs->rsi,
+                                (struct numos_net_http_result *)regs->rdx))
+SYSCALL_WRAP(copy_file_range,
+             sys_copy_file_range((int)regs->rdi, (int64_t *)regs->rsi,
+                                 (int)regs->rdx, (int64_t *)regs->r10,
+                                 (size_t)regs->r8, (uint32_t)regs->r9))
+SYSCALL_WRAP(poweroff,    sys_poweroff())
+SYSCALL_WRAP(fb_info,     sys_fb_info(regs->rdi))
+SYSCALL_WRAP(fb_write,    sys_fb_write((const char *)regs->rdi, (size_t)regs->rsi))
+SYSCALL_WRAP(fb_clear,    sys_fb_clear())
+SYSCALL_WRAP(fb_setcolor, sys_fb_setcolor((uint32_t)regs->rdi, (uint32_t)regs->rsi))
+SYSCALL_WRAP(fb_setpixel, sys_fb_setpixel((int)regs->rdi, (int)regs->rsi, (uint32_t)regs->rdx))
+SYSCALL_WRAP(fb_fillrect, sys_fb_fillrect((int)regs->rdi, (int)regs->rsi,
+                                          (int)regs->rdx, (int)regs->r10,
+                                          (uint32_t)regs->r8))
+SYSCALL_WRAP(reboot,      sys_reboot())
+
+struct syscall_desc {
+    int64_t   (*fn)(struct syscall_regs *regs);
+    const char *name;
+};
+
+static const struct syscall_desc syscall_table[SYSCALL_MAX] = {
+    [SYS_READ]                 = { sc_read,                 "read" },
+    [SYS_LSEEK]                = { sc_lseek,                "lseek" },
+    [SYS_PREAD64]              = { sc_pread,                "pread" },
+    [SYS_PWRITE64]             = { sc_pwrite,               "pwrite" },
+    [SYS_READV]                = { sc_readv,                "readv" },
+    [SYS_WRITEV]               = { sc_writev,               "writev" },
+    [SYS_INPUT]                = { sc_input,                "input" },
+    [SYS_INPUT_PEEK]           = { sc_input_peek,           "input_peek" },
+    [SYS_YIELD]                = { sc_yield,                "yield" },
+    [SYS_WRITE]                = { sc_write,                "write" },
+    [SYS_OPEN]                 = { sc_open,                 "open" },
+    [SYS_EXEC]                 = { sc_exec,                 "exec" },
+    [SYS_EXEC_ARGV]            = { sc_exec_argv,            "exec_argv" },
+    [SYS_SPAWN]                = { sc_spawn,                "spawn" },
+    [SYS_WAITPID]              = { sc_waitpid,              "waitpid" },
+    [SYS_CLOSE]                = { sc_close,                "close" },
+    [SYS_MMAP]                 = { sc_mmap,                 "mmap" },
+    [SYS_MUNMAP]               = { sc_munmap,               "munmap" },
+    [SYS_EXIT]                 = { sc_exit,                 "exit" },
+    [SYS_GETPID]               = { sc_getpid,               "getpid" },
+    [SYS_SLEEP_MS]             = { sc_sleep_ms,             "sleep_ms" },
+    [SYS_UPTIME_MS]            = { sc_uptime_ms,            "uptime_ms" },
+    [SYS_SYSINFO]              = { sc_sysinfo,              "sysinfo" },
+    [SYS_HWINFO]               = { sc_hwinfo,               "hwinfo" },
+    [SYS_PUTS]                 = { sc_puts,                 "puts" },
+    [SYS_GET_CMDLINE]          = { sc_get_cmdline,          "get_cmdline" },
+    [SYS_LISTDIR]              = { sc_listdir,              "listdir" },
+    [SYS_GETDENTS]             = { sc_getdents,             "getdents" },
+    [SYS_PROCLIST]             = { sc_proclist,             "proclist" },
+    [SYS_TIME_READ]            = { sc_time_read,            "time_read" },
+    [SYS_TIMER_CREATE]         = { sc_timer_create,         "timer_create" },
+    [SYS_TIMER_WAIT]           = { sc_timer_wait,           "timer_wait" },
+    [SYS_TIMER_INFO]           = { sc_timer_info,           "timer_info" },
+    [SYS_TIMER_CANCEL]         = { sc_timer_cancel,         "timer_cancel" },
+    [SYS_CON_SCROLL]           = { sc_con_scroll,           "con_scroll" },
+    [SYS_DISK_INFO]            = { sc_disk_info,            "disk_info" },
+    [SYS_DISK_READ]            = { sc_disk_read,            "disk_read" },
+    [SYS_DISK_WRITE]           = { sc_disk_write,           "disk_write" },
+    [SYS_USB_CONTROLLER_COUNT] = { sc_usb_controller_count, "usb_controller_count" },
+    [SYS_USB_CONTROLLER_INFO]  = { sc_usb_controller_info,  "usb_controller_info" },
+    [SYS_USB_PORT_INFO]        = { sc_usb_port_info,        "usb_port_info" },
+    [SYS_THREAD_CREATE]        = { sc_thread_create,        "thread_create" },
+    [SYS_THREAD_JOIN]          = { sc_thread_join,          "thread_join" },
+    [SYS_THREAD_EXIT]          = { sc_thread_exit,          "thread_exit" },
+    [SYS_THREAD_SELF]          = { sc_thread_self,          "thread_self" },
+    [SYS_NET_INFO]             = { sc_net_info,             "net_info" },
+    [SYS_NET_DHCP]             = { sc_net_dhcp,             "net_dhcp" },
+    [SYS_NET_PING]             = { sc_net_ping,             "net_ping" },
+    [SYS_NET_TCP_CONNECT]      = { sc_net_tcp_connect,      "net_tcp_connect" },
+    [SYS_NET_TCP_SEND]         = { sc_net_tcp_send,         "net_tcp_send" },
+    [SYS_NET_TCP_RECV]         = { sc_net_tcp_recv,         "net_tcp_recv" },
+    [SYS_NET_TCP_CLOSE]        = { sc_net_tcp_close,        "net_tcp_close" },
+    [SYS_NET_TCP_INFO]         = { sc_net_tcp_info,         "net_tcp_info" },
+    [SYS_NET_TLS_PROBE]        = { sc_net_tls_probe,        "net_tls_probe" },
+    [SYS_SOCKET]               = { sc_socket,               "socket" },
+    [SYS_BIND]                 = { sc_bind,                 "bind" },
+    [SYS_LISTEN]               = { sc_listen,               "listen" },
+    [SYS_ACCEPT]               = { sc_accept,               "accept" },
+    [SYS_CONNECT]              = { sc_connect,              "connect" },
+    [SYS_SENDTO]               = { sc_sendto,               "sendto" },
+    [SYS_RECVFROM]             = { sc_recvfrom,             "recvfrom" },
+    [SYS_EPOLL_CREATE]         = { sc_epoll_create,         "epoll_create" },
+    [SYS_EPOLL_CTL]            = { sc_epoll_ctl,            "epoll_ctl" },
+    [SYS_EPOLL_WAIT]           = { sc_epoll_wait,           "epoll_wait" },
+    [SYS_NET_HTTP_FETCH]       = { sc_net_http_fetch,       "net_http_fetch" },
+    [SYS_NET_HTTP_GET]         = { sc_net_http_get,         "net_http_get" },
+    [SYS_COPY_FILE_RANGE]      = { sc_copy_file_range,      "copy_file_range" },
+    [SYS_POWEROFF]             = { sc_poweroff,             "poweroff" },
+    [SYS_FB_INFO]              = { sc_fb_info,              "fb_info" },
+    [SYS_FB_WRITE]             = { sc_fb_write,             "fb_write" },
+    [SYS_FB_CLEAR]             = { sc_fb_clear,             "fb_clear" },
+    [SYS_FB_SETCOLOR]          = { sc_fb_setcolor,          "fb_setcolor" },
+    [SYS_FB_SETPIXEL]          = { sc_fb_setpixel,          "fb_setpixel" },
+    [SYS_FB_FILLRECT]          = { sc_fb_fillrect,          "fb_fillrect" },
+    [SYS_REBOOT]               = { sc_reboot,               "reboot" },
+};
+
 int64_t syscall_dispatch(struct syscall_regs *regs) {
     uint64_t nr  = regs->rax;
     int64_t  ret = SYSCALL_ENOSYS;
@@ -1034,200 +1759,10 @@ int64_t syscall_dispatch(struct syscall_regs *regs) {
 
     __asm__ volatile("sti");
 
-    switch ((int)nr) {
-        case SYS_READ:
-            ret = sys_read((int)regs->rdi, (void*)regs->rsi, (size_t)regs->rdx);
-            break;
-        case SYS_INPUT:
-            ret = sys_input((void*)regs->rdi, (size_t)regs->rsi);
-            break;
-        case SYS_INPUT_PEEK:
-            ret = sys_input_peek((char*)regs->rdi);
-            break;
-        case SYS_YIELD:
-            ret = sys_yield();
-            break;
-        case SYS_WRITE:
-            ret = sys_write((int)regs->rdi, (const void*)regs->rsi, (size_t)regs->rdx);
-            break;
-        case SYS_OPEN:
-            ret = sys_open((const char*)regs->rdi, (int)regs->rsi, (int)regs->rdx);
-            break;
-        case SYS_EXEC:
-            ret = sys_exec((const char*)regs->rdi);
-            break;
-        case SYS_EXEC_ARGV:
-            ret = sys_exec_argv((const char*)regs->rdi, (const char*)regs->rsi);
-            break;
-        case SYS_CLOSE:
-            ret = sys_close((int)regs->rdi);
-            break;
-        case SYS_EXIT:
-            ret = sys_exit((int)regs->rdi);
-            break;
-        case SYS_GETPID:
-            ret = sys_getpid();
-            break;
-        case SYS_SLEEP_MS:
-            ret = sys_sleep_ms(regs->rdi);
-            break;
-        case SYS_UPTIME_MS:
-            ret = sys_uptime_ms();
-            break;
-        case SYS_SYSINFO:
-            ret = sys_sysinfo((struct sysinfo *)regs->rdi);
-            break;
-        case SYS_HWINFO:
-            ret = sys_hwinfo((struct hwinfo *)regs->rdi, (size_t)regs->rsi);
-            break;
-        case SYS_PUTS:
-            ret = sys_puts((const char*)regs->rdi);
-            break;
-        case SYS_GET_CMDLINE:
-            ret = sys_get_cmdline((char*)regs->rdi, (size_t)regs->rsi);
-            break;
-        case SYS_LISTDIR:
-            ret = sys_listdir((const char*)regs->rdi,
-                              (struct fat32_dirent *)regs->rsi,
-                              (int)regs->rdx);
-            break;
-        case SYS_PROCLIST:
-            ret = sys_proclist((struct proc_info *)regs->rdi, (size_t)regs->rsi);
-            break;
-        case SYS_TIME_READ:
-            ret = sys_time_read((struct numos_calendar_time *)regs->rdi);
-            break;
-        case SYS_TIMER_CREATE:
-            ret = sys_timer_create(regs->rdi, regs->rsi, (uint32_t)regs->rdx);
-            break;
-        case SYS_TIMER_WAIT:
-            ret = sys_timer_wait((int)regs->rdi);
-            break;
-        case SYS_TIMER_INFO:
-            ret = sys_timer_info((int)regs->rdi,
-                                 (struct numos_timer_info *)regs->rsi);
-            break;
-        case SYS_TIMER_CANCEL:
-            ret = sys_timer_cancel((int)regs->rdi);
-            break;
-        case SYS_CON_SCROLL:
-            ret = sys_con_scroll();
-            break;
-        case SYS_DISK_INFO:
-            ret = sys_disk_info((struct numos_disk_info *)regs->rdi);
-            break;
-        case SYS_DISK_READ:
-            ret = sys_disk_read(regs->rdi, (void *)regs->rsi, (uint32_t)regs->rdx);
-            break;
-        case SYS_DISK_WRITE:
-            ret = sys_disk_write(regs->rdi, (const void *)regs->rsi, (uint32_t)regs->rdx);
-            break;
-        case SYS_USB_CONTROLLER_COUNT:
-            ret = sys_usb_controller_count();
-            break;
-        case SYS_USB_CONTROLLER_INFO:
-            ret = sys_usb_controller_info((int)regs->rdi,
-                                          (struct numos_usb_controller_info *)regs->rsi);
-            break;
-        case SYS_USB_PORT_INFO:
-            ret = sys_usb_port_info((int)regs->rdi, (int)regs->rsi,
-                                    (struct numos_usb_port_info *)regs->rdx);
-            break;
-        case SYS_THREAD_CREATE:
-            ret = sys_thread_create((void *)regs->rdi, (void *)regs->rsi,
-                                    (void *)regs->rdx);
-            break;
-        case SYS_THREAD_JOIN:
-            ret = sys_thread_join((int)regs->rdi, (uint64_t *)regs->rsi);
-            break;
-        case SYS_THREAD_EXIT:
-            ret = sys_thread_exit(regs->rdi);
-            break;
-        case SYS_THREAD_SELF:
-            ret = sys_thread_self();
-            break;
-        case SYS_NET_INFO:
-            ret = sys_net_info((struct numos_net_info *)regs->rdi);
-            break;
-        case SYS_NET_DHCP:
-            ret = sys_net_dhcp((uint32_t)regs->rdi);
-            break;
-        case SYS_NET_PING:
-            ret = sys_net_ping((const uint8_t *)regs->rdi,
-                               (uint32_t)regs->rsi,
-                               (struct numos_net_ping_result *)regs->rdx);
-            break;
-        case SYS_NET_TCP_CONNECT:
-            ret = sys_net_tcp_connect((const uint8_t *)regs->rdi,
-                                      (uint16_t)regs->rsi,
-                                      (uint32_t)regs->rdx);
-            break;
-        case SYS_NET_TCP_SEND:
-            ret = sys_net_tcp_send((int)regs->rdi,
-                                   (const void *)regs->rsi,
-                                   (size_t)regs->rdx,
-                                   (uint32_t)regs->r10);
-            break;
-        case SYS_NET_TCP_RECV:
-            ret = sys_net_tcp_recv((int)regs->rdi,
-                                   (void *)regs->rsi,
-                                   (size_t)regs->rdx,
-                                   (uint32_t)regs->r10);
-            break;
-        case SYS_NET_TCP_CLOSE:
-            ret = sys_net_tcp_close((int)regs->rdi, (uint32_t)regs->rsi);
-            break;
-        case SYS_NET_TCP_INFO:
-            ret = sys_net_tcp_info((int)regs->rdi,
-                                   (struct numos_net_tcp_info *)regs->rsi);
-            break;
-        case SYS_NET_TLS_PROBE:
-            ret = sys_net_tls_probe((const uint8_t *)regs->rdi,
-                                    (uint16_t)regs->rsi,
-                                    (const char *)regs->rdx,
-                                    (uint32_t)regs->r10,
-                                    (uint32_t)regs->r8,
-                                    (struct numos_net_tls_result *)regs->r9);
-            break;
-        case SYS_NET_HTTP_GET:
-            ret = sys_net_http_get((const struct numos_net_http_request *)regs->rdi,
-                                   (void *)regs->rsi,
-                                   (size_t)regs->rdx,
-                                   (struct numos_net_http_result *)regs->r10);
-            break;
-        case SYS_POWEROFF:
-            ret = sys_poweroff();
-            break;
-
-        /* Framebuffer syscalls */
-        case SYS_FB_INFO:
-            ret = sys_fb_info(regs->rdi);
-            break;
-        case SYS_FB_WRITE:
-            ret = sys_fb_write((const char*)regs->rdi, (size_t)regs->rsi);
-            break;
-        case SYS_FB_CLEAR:
-            ret = sys_fb_clear();
-            break;
-        case SYS_FB_SETCOLOR:
-            ret = sys_fb_setcolor((uint32_t)regs->rdi, (uint32_t)regs->rsi);
-            break;
-        case SYS_FB_SETPIXEL:
-            ret = sys_fb_setpixel((int)regs->rdi, (int)regs->rsi, (uint32_t)regs->rdx);
-            break;
-        case SYS_FB_FILLRECT:
-            ret = sys_fb_fillrect((int)regs->rdi, (int)regs->rsi,
-                                  (int)regs->rdx, (int)regs->r10,
-                                  (uint32_t)regs->r8);
-            break;
-        case SYS_REBOOT:
-            ret = sys_reboot();
-            break;
-
-        default:
-            stats.errors++;
-            ret = SYSCALL_ENOSYS;
-            break;
+    if (nr < SYSCALL_MAX && syscall_table[nr].fn) {
+        ret = syscall_table[nr].fn(regs);
+    } else {
+        stats.errors++;
     }
 
     __asm__ volatile("cli");
@@ -1240,69 +1775,13 @@ int64_t syscall_dispatch(struct syscall_regs *regs) {
  * ======================================================================= */
 
 void syscall_print_stats(void) {
-    static const char *names[SYSCALL_MAX];
-    for (int i = 0; i < SYSCALL_MAX; i++) names[i] = NULL;
-    names[SYS_READ]      = "read";
-    names[SYS_INPUT]     = "input";
-    names[SYS_INPUT_PEEK]= "input_peek";
-    names[SYS_YIELD]     = "yield";
-    names[SYS_WRITE]     = "write";
-    names[SYS_OPEN]      = "open";
-    names[SYS_EXEC]      = "exec";
-    names[SYS_EXEC_ARGV] = "exec_argv";
-    names[SYS_CLOSE]     = "close";
-    names[SYS_EXIT]      = "exit";
-    names[SYS_GETPID]    = "getpid";
-    names[SYS_SLEEP_MS]  = "sleep_ms";
-    names[SYS_UPTIME_MS] = "uptime_ms";
-    names[SYS_SYSINFO]   = "sysinfo";
-    names[SYS_HWINFO]    = "hwinfo";
-    names[SYS_PUTS]      = "puts";
-    names[SYS_GET_CMDLINE] = "get_cmdline";
-    names[SYS_LISTDIR]     = "listdir";
-    names[SYS_PROCLIST]    = "proclist";
-    names[SYS_TIME_READ]   = "time_read";
-    names[SYS_TIMER_CREATE]= "timer_create";
-    names[SYS_TIMER_WAIT]  = "timer_wait";
-    names[SYS_TIMER_INFO]  = "timer_info";
-    names[SYS_TIMER_CANCEL]= "timer_cancel";
-    names[SYS_CON_SCROLL]  = "con_scroll";
-    names[SYS_DISK_INFO]   = "disk_info";
-    names[SYS_DISK_READ]   = "disk_read";
-    names[SYS_DISK_WRITE]  = "disk_write";
-    names[SYS_USB_CONTROLLER_COUNT] = "usb_controller_count";
-    names[SYS_USB_CONTROLLER_INFO]  = "usb_controller_info";
-    names[SYS_USB_PORT_INFO]        = "usb_port_info";
-    names[SYS_THREAD_CREATE]        = "thread_create";
-    names[SYS_THREAD_JOIN]          = "thread_join";
-    names[SYS_THREAD_EXIT]          = "thread_exit";
-    names[SYS_THREAD_SELF]          = "thread_self";
-    names[SYS_NET_INFO]             = "net_info";
-    names[SYS_NET_DHCP]             = "net_dhcp";
-    names[SYS_NET_PING]             = "net_ping";
-    names[SYS_NET_TCP_CONNECT]      = "net_tcp_connect";
-    names[SYS_NET_TCP_SEND]         = "net_tcp_send";
-    names[SYS_NET_TCP_RECV]         = "net_tcp_recv";
-    names[SYS_NET_TCP_CLOSE]        = "net_tcp_close";
-    names[SYS_NET_TCP_INFO]         = "net_tcp_info";
-    names[SYS_NET_TLS_PROBE]        = "net_tls_probe";
-    names[SYS_NET_HTTP_GET]         = "net_http_get";
-    names[SYS_POWEROFF]             = "poweroff";
-    names[SYS_REBOOT]    = "reboot";
-    names[SYS_FB_INFO]   = "fb_info";
-    names[SYS_FB_WRITE]  = "fb_write";
-    names[SYS_FB_CLEAR]  = "fb_clear";
-    names[SYS_FB_SETCOLOR]= "fb_setcolor";
-    names[SYS_FB_SETPIXEL]= "fb_setpixel";
-    names[SYS_FB_FILLRECT]= "fb_fillrect";
-
     vga_writestring("\nSyscall Statistics:\n");
     vga_writestring("  Total: "); print_dec(stats.total_calls);
     vga_writestring("  Errors: "); print_dec(stats.errors); vga_writestring("\n");
     for (int i = 0; i < SYSCALL_MAX; i++) {
         if (!stats.calls_per_number[i]) continue;
         vga_writestring("  ["); print_dec((uint64_t)i); vga_writestring("] ");
-        vga_writestring(names[i] ? names[i] : "?");
+        vga_writestring(syscall_table[i].name ? syscall_table[i].name : "?");
         vga_writestring(": "); print_dec(stats.calls_per_number[i]);
         vga_writestring("\n");
     }
@@ -0,0 +1,162 @@
+/*
+ * uaccess.c - Checked copies between kernel and user memory
+ *
+ * Bulk copies use rep movsq for the 8-byte body and rep movsb for the
+ * tail; the kernel is built without SSE, and fast-string microcode moves
+ * whole cache lines for large counts anyway.  Strings are read one
+ * aligned word at a time, which never crosses a page the string does not
+ * reach.  Every instruction that touches user memory has an __ex_table
+ * entry pointing at a fixup that makes the helper fail.
+ */
+
+#include "kernel/uaccess.h"
+#include "lib/string.h"
+
+extern const struct uaccess_extable_entry __ex_table_start[];
+extern const struct uaccess_extable_entry __ex_table_end[];
+
+#define UACCESS_EXTABLE(insn, fixup)                  \
+    ".pushsection __ex_table, \"a\"\n\t"              \
+    ".balign 8\n\t"                                   \
+    ".quad " #insn ", " #fixup "\n\t"                 \
+    ".popsection\n\t"
+
+#define ONES  0x0101010101010101UL
+#define HIGHS 0x8080808080808080UL
+
+int user_access_ok(const void *ptr, size_t len) {
+    uint64_t addr = (uint64_t)(uintptr_t)ptr;
+
+    if (addr >= USER_ADDR_LIMIT) return 0;
+    if (len == 0) return 1;
+    if (addr + len < addr) return 0;
+    return addr + len <= USER_ADDR_LIMIT;
+}
+
+static int uaccess_copy(void *dst, const void *src, size_t len) {
+    size_t words = len / 8;
+    size_t tail  = len % 8;
+    int err = 0;
+
+    __asm__ volatile(
+        "1:  rep movsq\n\t"
+        "    mov %[tail], %%rcx\n\t"
+        "2:  rep movsb\n\t"
+        "    jmp 4f\n\t"
+        "3:  mov $-1, %[err]\n\t"
+        "4:\n\t"
+        UACCESS_EXTABLE(1b, 3b)
+        UACCESS_EXTABLE(2b, 3b)
+        : [err] "+r"(err), "+D"(dst), "+S"(src), "+c"(words)
+        : [tail] "r"(tail)
+        : "memory");
+    return err;
+}
+
+/* Load one byte or word of user memory; returns -1 if it faulted */
+static int uaccess_load8(const void *src, uint8_t *out) {
+    uint64_t v = 0;
+    int err = 0;
+
+    __asm__ volatile(
+        "1:  movzbq (%[src]), %[v]\n\t"
+        "    jmp 3f\n\t"
+        "2:  mov $-1, %[err]\n\t"
+        "3:\n\t"
+        UACCESS_EXTABLE(1b, 2b)
+        : [err] "+r"(err), [v] "+r"(v)
+        : [src] "r"(src)
+        : "memory");
+    *out = (uint8_t)v;
+    return err;
+}
+
+static int uaccess_load64(const void *src, uint64_t *out) {
+    uint64_t v = 0;
+    int err = 0;
+
+    __asm__ volatile(
+        "1:  movq (%[src]), %[v]\n\t"
+        "    jmp 3f\n\t"
+        "2:  mov $-1, %[err]\n\t"
+        "3:\n\t"
+        UACCESS_EXTABLE(1b, 2b)
+        : [err] "+r"(err), [v] "+r"(v)
+        : [src] "r"(src)
+        : "memory");
+    *out = v;
+    return err;
+}
+
+/*
+ * copy_from_user / copy_to_user - copy len bytes across the boundary.
+ * Returns 0, or -1 if the user range is invalid or not mapped.
+ */
+int copy_from_user(void *dst, const void *user_src, size_t len) {
+    if (!user_access_ok(user_src, len)) return -1;
+    if (len == 0) return 0;
+    return uaccess_copy(dst, user_src, len);
+}
+
+int copy_to_user(void *user_dst, const void *src, size_t len) {
+    if (!user_access_ok(user_dst, len)) return -1;
+    if (len == 0) return 0;
+    return uaccess_copy(user_dst, src, len);
+}
+
+/*
+ * strncpy_from_user - copy a NUL-terminated user string of at most
+ * cap - 1 characters into dst.  Returns the string length, cap if no NUL
+ * was found within cap bytes (dst is then not terminated), or -1 on a
+ * bad pointer.
+ */
+long strncpy_from_user(char *dst, const char *user_src, size_t cap) {
+    const uint8_t *src = (const uint8_t *)user_src;
+    size_t n = 0;
+
+    if (cap == 0) return 0;
+    if ((uint64_t)(uintptr_t)src >= USER_ADDR_LIMIT) return -1;
+    if (cap > USER_ADDR_LIMIT - (uint64_t)(uintptr_t)src) {
+        cap = USER_ADDR_LIMIT - (uint64_t)(uintptr_t)src;
+    }
+
+    /* Bytes up to the first word boundary */
+    while (n < cap && ((uintptr_t)(src + n) & 7)) {
+        uint8_t c;
+        if (uaccess_load8(src + n, &c) != 0) return -1;
+        dst[n] = (char)c;
+        if (c == 0) return (long)n;
+        n++;
+    }
+
+    /* Aligned words until one contains a zero byte */
+    while (cap - n >= 8) {
+        uint64_t w;
+        if (uaccess_load64(src + n, &w) != 0) return -1;
+        if ((w - ONES) & ~w & HIGHS) break;
+        memcpy(dst + n, &w, 8);
+        n += 8;
+    }
+
+    while (n < cap) {
+        uint8_t c;
+        if (uaccess_load8(src + n, &c) != 0) return -1;
+        dst[n] = (char)c;
+        if (c == 0) return (long)n;
+        n++;
+    }
+    return (long)cap;
+}
+
+int uaccess_fixup(uint64_t *rip) {
+    if (!rip) return 0;
+
+    for (const struct uaccess_extable_entry *e = __ex_table_start;
+         e < __ex_table_end; e++) {
+        if (e->insn == *rip) {
+            *rip = e->fixup;
+            return 1;
+        }
+    }
+    return 0;
+}
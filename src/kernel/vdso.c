@@ -0,0 +1,103 @@
+/*
+ * vdso.c - Shared read-only kernel data page
+ *
+ * The page is a PMM frame reached through the identity map, so the timer
+ * IRQ writes it directly.  User mappings are created lazily from the
+ * page-fault path and never torn down with the image, since the frame is
+ * shared by every address space.  The TSC rate is measured against the
+ * first VDSO_CALIBRATE_MS of PIT ticks rather than with a boot-time spin.
+ */
+
+#include "kernel/vdso.h"
+#include "kernel/scheduler.h"
+#include "cpu/paging.h"
+#include "lib/string.h"
+
+#define VDSO_CALIBRATE_MS 500
+
+static struct numos_vdso_data *vdso_page;
+static uint64_t calib_tsc_start;
+static uint64_t calib_tick_start;
+static int      calib_started;
+
+static inline uint64_t vdso_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void vdso_init(uint32_t tick_hz) {
+    uint64_t phys = pmm_alloc_frame();
+    if (!phys) return;
+
+    vdso_page = (struct numos_vdso_data *)(uintptr_t)phys;
+    memset(vdso_page, 0, PAGE_SIZE);
+    vdso_page->magic   = VDSO_MAGIC;
+    vdso_page->version = VDSO_VERSION;
+    vdso_page->tick_hz = tick_hz;
+    timer_get_wall_clock(&vdso_page->wall_clock);
+    calib_started = 0;
+}
+
+/* Derive the TSC rate once enough ticks have elapsed since the first one */
+static void vdso_calibrate(uint64_t tsc, uint64_t ticks) {
+    uint32_t hz = vdso_page->tick_hz;
+
+    if (!calib_started) {
+        calib_tsc_start  = tsc;
+        calib_tick_start = ticks;
+        calib_started    = 1;
+        return;
+    }
+
+    uint64_t elapsed = ticks - calib_tick_start;
+    if (!hz || elapsed * 1000 < (uint64_t)VDSO_CALIBRATE_MS * hz) return;
+
+    uint64_t khz = ((tsc - calib_tsc_start) * hz) / (elapsed * 1000);
+    if (khz < 1000) return;             /* Implausible: keep tick resolution */
+
+    vdso_page->tsc_khz        = khz;
+    vdso_page->tsc_to_ns_mult = (1000000ULL << 32) / khz;
+    vdso_page->tsc_per_tick   = (khz * 1000) / hz;
+}
+
+/*
+ * vdso_update - publish the state of tick number ticks.  Called from the
+ * timer IRQ with interrupts disabled, so there is exactly one writer.
+ */
+void vdso_update(uint64_t ticks) {
+    struct numos_vdso_data *vd = vdso_page;
+    if (!vd) return;
+
+    uint64_t tsc    = vdso_rdtsc();
+    uint64_t uptime = timer_get_uptime_ms();
+    struct sched_stats ss;
+    scheduler_get_stats(&ss);
+
+    vd->seq++;
+    __asm__ volatile("" ::: "memory");
+
+    if (!vd->tsc_to_ns_mult) vdso_calibrate(tsc, ticks);
+    vd->ticks       = ticks;
+    vd->uptime_ms   = uptime;
+    vd->tsc_at_tick = tsc;
+    timer_get_wall_clock(&vd->wall_clock);
+    vd->processes_active  = ss.active_processes;
+    vd->processes_created = ss.processes_created;
+    vd->context_switches  = ss.context_switches;
+
+    __asm__ volatile("" ::: "memory");
+    vd->seq++;
+}
+
+/*
+ * vdso_handle_fault - map the data page read-only when a process first
+ * touches VDSO_DATA_ADDR.  Returns 1 if handled, 0 otherwise.
+ */
+int vdso_handle_fault(uint64_t fault_addr) {
+    if (!vdso_page) return 0;
+    if (paging_align_down(fault_addr, PAGE_SIZE) != VDSO_DATA_ADDR) return 0;
+
+    return paging_map_page(VDSO_DATA_ADDR, (uint64_t)(uintptr_t)vdso_page,
+                           PAGE_PRESENT | PAGE_USER) == 0;
+}
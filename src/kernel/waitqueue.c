@@ -0,0 +1,142 @@
+/*
+ * waitqueue.c - Blocking on events
+ *
+ * Queued processes stay on the run queue in the BLOCKED state with reason
+ * PROC_BLOCK_WAIT, so pick_next() skips them until a waker flips them back
+ * to READY or their deadline passes.  The queue itself is threaded through
+ * process->wait_next, and process->wait_queue records which queue a
+ * sleeper is on so a timeout can unlink it.
+ */
+
+#include "kernel/waitqueue.h"
+#include "kernel/scheduler.h"
+
+static uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static void irq_restore(uint64_t flags) {
+    if (flags & 0x200) __asm__ volatile("sti" ::: "memory");
+}
+
+void wait_queue_init(struct wait_queue *wq) {
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+/*
+ * wait_queue_remove - unlink proc from wq if it is still queued there.
+ * Call with interrupts disabled.
+ */
+void wait_queue_remove(struct wait_queue *wq, struct process *proc) {
+    struct process *prev = NULL;
+    struct process *p = wq->head;
+
+    while (p && p != proc) {
+        prev = p;
+        p = p->wait_next;
+    }
+    if (!p) return;
+
+    if (prev) {
+        prev->wait_next = p->wait_next;
+    } else {
+        wq->head = p->wait_next;
+    }
+    if (wq->tail == p) wq->tail = prev;
+
+    p->wait_next  = NULL;
+    p->wait_queue = NULL;
+}
+
+/*
+ * wait_queue_sleep_until - block the caller on wq until it is woken or
+ * uptime reaches deadline_ms (0 = no deadline).  Call with interrupts
+ * disabled, right after finding the awaited condition false; interrupts
+ * are enabled again on return.  Outside a process (early boot, idle) this
+ * just halts until the next interrupt.
+ * Returns 0 if woken, -1 if the deadline passed.
+ */
+int wait_queue_sleep_until(struct wait_queue *wq, uint64_t deadline_ms) {
+    struct process *self = scheduler_current();
+
+    if (!self || self == scheduler_get_idle()) {
+        __asm__ volatile("sti; hlt" ::: "memory");
+        return 0;
+    }
+
+    self->wait_next    = NULL;
+    self->wait_queue   = wq;
+    self->wait_result  = -1;
+    self->block_reason = PROC_BLOCK_WAIT;
+    self->state        = PROC_BLOCKED;
+    self->wake_at_ms   = deadline_ms;
+    if (wq->tail) {
+        wq->tail->wait_next = self;
+    } else {
+        wq->head = self;
+    }
+    wq->tail = self;
+
+    __asm__ volatile("sti");
+    schedule();
+
+    __asm__ volatile("cli");
+    if (self->wait_queue) wait_queue_remove(self->wait_queue, self);
+    self->block_reason = PROC_BLOCK_NONE;
+    self->wake_at_ms   = 0;
+    /* Woken before schedule() ran: pick_next() handed the CPU straight back */
+    if (self->state == PROC_READY) self->state = PROC_RUNNING;
+    __asm__ volatile("sti");
+
+    return self->wait_result;
+}
+
+void wait_queue_sleep(struct wait_queue *wq) {
+    (void)wait_queue_sleep_until(wq, 0);
+}
+
+static void wake_process(struct process *p) {
+    p->wait_next   = NULL;
+    p->wait_queue  = NULL;
+    p->wait_result = 0;
+    if (p->state == PROC_BLOCKED) p->state = PROC_READY;
+}
+
+/*
+ * wait_queue_wake_one - make the longest waiting process on wq runnable.
+ * Safe from IRQ context.
+ */
+void wait_queue_wake_one(struct wait_queue *wq) {
+    uint64_t flags = irq_save();
+
+    struct process *p = wq->head;
+    if (p) {
+        wq->head = p->wait_next;
+        if (!wq->head) wq->tail = NULL;
+        wake_process(p);
+    }
+
+    irq_restore(flags);
+}
+
+/*
+ * wait_queue_wake_all - make every process sleeping on wq runnable.
+ * Safe from IRQ context.
+ */
+void wait_queue_wake_all(struct wait_queue *wq) {
+    uint64_t flags = irq_save();
+
+    struct process *p = wq->head;
+    wq->head = NULL;
+    wq->tail = NULL;
+    while (p) {
+        struct process *next = p->wait_next;
+        wake_process(p);
+        p = next;
+    }
+
+    irq_restore(flags);
+}
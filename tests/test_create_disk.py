@@ -19,8 +19,8 @@ class CreateDiskTest(unittest.TestCase):
     """Keep the image builder behavior stable while the implementation evolves."""
 
     def test_load_staged_files_keeps_fat_compatible_entries(self):
-        # The builder only supports FAT 8.3 names, so non-compliant files
-        # should be skipped without disturbing the deterministic sort order.
+        # Long names are kept for LFN entries, while names FAT cannot store
+        # are skipped without disturbing the deterministic sort order.
         with tempfile.TemporaryDirectory() as tmp:
             stage_dir = pathlib.Path(tmp)
             (stage_dir / "test.ocl").write_text(
@@ -31,16 +31,48 @@ class CreateDiskTest(unittest.TestCase):
                 encoding="utf-8",
             )
             (stage_dir / "readme.txt").write_text("hello\n", encoding="utf-8")
-            (stage_dir / "too-long-name.ocl").write_text("skip\n", encoding="utf-8")
+            (stage_dir / "too-long-name.ocl").write_text("keep\n", encoding="utf-8")
+            (stage_dir / "bad.").write_text("skip\n", encoding="utf-8")
             (stage_dir / "nested").mkdir()
 
             files = create_disk.load_staged_files(str(stage_dir))
 
-        self.assertEqual([item["name"] for item in files], ["readme.txt", "test.ocl"])
-        self.assertEqual([item["short_name"] for item in files], ["README  TXT", "TEST    OCL"])
-        self.assertEqual([item["nt_reserved"] for item in files], [0x18, 0x18])
+        self.assertEqual([item["name"] for item in files], ["readme.txt", "test.ocl", "too-long-name.ocl"])
+        self.assertEqual([item["short_name"] for item in files], ["README  TXT", "TEST    OCL", None])
+        self.assertEqual([item["nt_reserved"] for item in files], [0x18, 0x18, 0])
         self.assertEqual(files[1]["data"], b"func int main() {\n    Let x:Int = 1 + 2;\n    return x;\n}\n")
 
+    def test_create_home_directory_writes_long_name_entries(self):
+        # Long names need LFN slots in front of a unique ~N short alias whose
+        # checksum matches, or the kernel falls back to the alias.
+        home_files = [
+            create_disk.create_file_record("too-long-name.ocl", b"a"),
+            create_disk.create_file_record("too-long-other.ocl", b"b"),
+        ]
+        for cluster_num, record in enumerate(home_files, start=20):
+            record["cluster"] = cluster_num
+
+        cluster = create_disk.create_home_directory(home_files)
+
+        self.assertEqual(cluster[64], 0x42)
+        self.assertEqual(cluster[64 + 11], create_disk.LFN_ATTR)
+        self.assertEqual(cluster[96], 0x01)
+        self.assertEqual(cluster[128:139], b"TOO-LO~1OCL")
+        self.assertEqual(cluster[64 + 13], create_disk.fat_lfn_checksum("TOO-LO~1OCL"))
+        self.assertEqual(cluster[160], 0x42)
+        self.assertEqual(cluster[224:235], b"TOO-LO~2OCL")
+        self.assertEqual(cluster[64 + 1:64 + 11].decode("utf-16-le"), ".ocl\x00")
+        self.assertEqual(cluster[96 + 1:96 + 11].decode("utf-16-le"), "too-l")
+
+    def test_fat_needs_long_name_detects_non_83_names(self):
+        # Lower-case or upper-case 8.3 names stay short; mixed case, extra
+        # dots, and reserved short-name characters need LFN slots.
+        self.assertFalse(create_disk.fat_needs_long_name("readme.txt"))
+        self.assertFalse(create_disk.fat_needs_long_name("OS.TXT"))
+        self.assertTrue(create_disk.fat_needs_long_name("Readme.txt"))
+        self.assertTrue(create_disk.fat_needs_long_name("a.tar.gz"))
+        self.assertTrue(create_disk.fat_needs_long_name("a+b.txt"))
+
     def test_create_home_directory_writes_staged_file_entry(self):
         # Home directory entries need to preserve FAT case flags so names
         # render the same way after boot.
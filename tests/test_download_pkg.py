@@ -103,9 +103,9 @@ class DownloadPkgTest(unittest.TestCase):
 
     def test_download_package_rejects_non_fat_source_name(self):
         with tempfile.TemporaryDirectory() as tmp, mock.patch.object(
-            download_pkg, "download_bytes", return_value=b"name OCLDEV\ncopy TOOLONG99.BIN /bin/TOOLONG99.BIN\n"
+            download_pkg, "download_bytes", return_value=b"name OCLDEV\ncopy BAD?NAME.BIN /bin/BADNAME.BIN\n"
         ):
-            with self.assertRaisesRegex(ValueError, "FAT 8.3"):
+            with self.assertRaisesRegex(ValueError, "FAT long file name"):
                 download_pkg.download_package(
                     package_url="https://packages.example.com/OCLDEV.PKG",
                     staging_dir=tmp,
@@ -48,6 +48,14 @@ FAT_EOC = 0x0FFFFFFF
 FAT32_NTRES_LOWER_BASE = 0x08
 FAT32_NTRES_LOWER_EXT = 0x10
 
+# VFAT long file name slots.
+LFN_ATTR = 0x0F
+LFN_LAST_ENTRY = 0x40
+LFN_CHARS_PER_ENTRY = 13
+FAT_MAX_LONG_NAME = 254
+FAT_LONG_NAME_RESERVED = set('"*/:<>?\\|')
+FAT_SHORT_NAME_RESERVED = set(' +,;=[].')
+
 PREINSTALLED_BIN_NAMES = {
     "connect.elf",
     "date.elf",
@@ -246,12 +254,87 @@ def fat_short_name_case_flags(filename):
     return flags
 
 
+def fat_long_name_valid(filename):
+    """Return True when a host filename can be stored as a FAT long name."""
+    if not filename or len(filename) > FAT_MAX_LONG_NAME:
+        return False
+    if filename in (".", "..") or filename[-1] in ". ":
+        return False
+    return all(0x20 <= ord(ch) <= 0x7E and ch not in FAT_LONG_NAME_RESERVED for ch in filename)
+
+
+def fat_needs_long_name(filename):
+    """Return True when a name cannot be stored as 8.3 plus case flags."""
+    if fat_format_name(filename) is None or filename.count(".") > 1:
+        return True
+    if filename.startswith("."):
+        return True
+    if any(ch in FAT_SHORT_NAME_RESERVED for ch in filename.replace(".", "", 1)):
+        return True
+    name, ext = os.path.splitext(filename)
+    ext = ext[1:] if ext.startswith(".") else ext
+    for part in (name, ext):
+        if any(ch.islower() for ch in part) and any(ch.isupper() for ch in part):
+            return True
+    return False
+
+
+def fat_short_alias(filename, taken):
+    """Generate a unique BASE~N.EXT short alias for a long file name."""
+    def clean(text):
+        return "".join(
+            "_" if ch in FAT_SHORT_NAME_RESERVED or ord(ch) > 0x7E else ch.upper()
+            for ch in text.replace(" ", "")
+        )
+
+    name, ext = os.path.splitext(filename)
+    ext = ext[1:] if ext.startswith(".") else ext
+    base = clean(name.replace(".", "")) or "_"
+    ext = clean(ext)[:3]
+
+    for number in range(1, 1000000):
+        tail = f"~{number}"
+        alias = (base[:8 - len(tail)] + tail).ljust(8) + ext.ljust(3)
+        if alias not in taken:
+            return alias
+    raise ValueError(f"no free FAT short alias for {filename}")
+
+
+def fat_lfn_checksum(short_name):
+    """Return the checksum stored in LFN slots for an 11 byte short name."""
+    checksum = 0
+    for byte in short_name.encode("ascii"):
+        checksum = ((((checksum & 1) << 7) + (checksum >> 1)) + byte) & 0xFF
+    return checksum
+
+
+def create_lfn_entries(filename, short_name):
+    """Create the LFN slots that precede a short entry, in on-disk order."""
+    checksum = fat_lfn_checksum(short_name)
+    count = (len(filename) + LFN_CHARS_PER_ENTRY - 1) // LFN_CHARS_PER_ENTRY
+    chars = [ord(ch) for ch in filename] + [0x0000]
+    chars += [0xFFFF] * (count * LFN_CHARS_PER_ENTRY - len(chars))
+
+    entries = bytearray()
+    for order in range(count, 0, -1):
+        part = chars[(order - 1) * LFN_CHARS_PER_ENTRY:order * LFN_CHARS_PER_ENTRY]
+        entry = bytearray(32)
+        entry[0] = order | (LFN_LAST_ENTRY if order == count else 0)
+        struct.pack_into("<5H", entry, 1, *part[0:5])
+        entry[11] = LFN_ATTR
+        entry[13] = checksum
+        struct.pack_into("<6H", entry, 14, *part[5:11])
+        struct.pack_into("<2H", entry, 28, *part[11:13])
+        entries += entry
+    return bytes(entries)
+
+
 def load_staged_files(stage_dir, allowed_names=None):
     """
     Load regular files from a staging directory.
 
-    Files must fit FAT 8.3 naming rules because this image builder only emits
-    short directory entries.
+    Names that do not fit FAT 8.3 are kept and written with VFAT long name
+    entries; only names FAT cannot store at all are skipped.
     """
     staged_files = []
 
@@ -267,25 +350,16 @@ def load_staged_files(stage_dir, allowed_names=None):
         if not os.path.isfile(path):
             continue
 
-        short_name = fat_format_name(entry_name)
-        if not short_name:
-            print(f"  [SKIP] {entry_name}: name is not FAT 8.3 compatible")
+        if not fat_long_name_valid(entry_name):
+            print(f"  [SKIP] {entry_name}: name is not a valid FAT file name")
             continue
 
         with open(path, "rb") as stage_file:
             data = stage_file.read()
 
-        staged_files.append(
-            {
-                "name": entry_name,
-                "short_name": short_name,
-                "nt_reserved": fat_short_name_case_flags(entry_name),
-                "size": len(data),
-                "data": data,
-                "cluster": 0,
-                "clusters": 0,
-            }
-        )
+        record = create_file_record(entry_name, data)
+        record["clusters"] = 0
+        staged_files.append(record)
         print(f"  [OK] {entry_name}: {len(data)} bytes")
 
     return staged_files
@@ -316,15 +390,32 @@ def create_base_directory(current_cluster, parent_cluster=ROOT_DIRECTORY_CLUSTER
 
 
 def append_directory_file_entries(cluster, start_offset, items, debug_label):
-    """Append file entries to a directory cluster and log what was written."""
+    """
+    Append file entries to a directory cluster and log what was written.
+
+    Long names get a short alias that is unique within this cluster and the
+    LFN slots are written directly in front of the short entry.
+    """
+    taken = {
+        bytes(cluster[pos:pos + 11]).decode("ascii", "replace")
+        for pos in range(0, start_offset, 32)
+    }
     offset = start_offset
     for item in items or []:
         if item["cluster"] <= 0:
             continue
-        if offset + 32 > len(cluster):
+        short_name = item.get("short_name")
+        lfn_entries = b""
+        if not short_name:
+            short_name = fat_short_alias(item["name"], taken)
+            lfn_entries = create_lfn_entries(item["name"], short_name)
+        if offset + len(lfn_entries) + 32 > len(cluster):
             break
+        taken.add(short_name)
+        cluster[offset:offset + len(lfn_entries)] = lfn_entries
+        offset += len(lfn_entries)
         cluster[offset:offset + 32] = create_directory_entry(
-            item["short_name"],
+            short_name,
             FILE_ATTR,
             item["cluster"],
             item["size"],
@@ -373,18 +464,7 @@ def create_bin_directory(init_record=None, bin_programs=None):
     next_offset = 64
 
     if init_record and init_record["clusters"] > 0:
-        cluster[next_offset:next_offset + 32] = create_directory_entry(
-            init_record["short_name"],
-            FILE_ATTR,
-            init_record["cluster"],
-            init_record["size"],
-            init_record.get("nt_reserved", 0),
-        )
-        print(
-            f"  [DEBUG] Writing {init_record['name']} entry (bin): "
-            f"cluster={init_record['cluster']}, size={init_record['size']}"
-        )
-        next_offset += 32
+        next_offset = append_directory_file_entries(cluster, next_offset, [init_record], "bin")
 
     append_directory_file_entries(cluster, next_offset, bin_programs, "bin")
     return bytes(cluster)
@@ -443,14 +523,19 @@ def load_binary_file(path, label):
 
 
 def create_file_record(name, data):
-    """Create the record shape used through staging, allocation, and writing."""
-    short_name = fat_format_name(name)
-    if not short_name:
+    """
+    Create the record shape used through staging, allocation, and writing.
+
+    Records for long names carry no short name; the directory writer picks a
+    unique alias when it lays out the entries.
+    """
+    if not fat_long_name_valid(name):
         return None
+    long_name = fat_needs_long_name(name)
     return {
         "name": name,
-        "short_name": short_name,
-        "nt_reserved": fat_short_name_case_flags(name),
+        "short_name": None if long_name else fat_format_name(name),
+        "nt_reserved": 0 if long_name else fat_short_name_case_flags(name),
         "size": len(data),
         "data": data,
         "cluster": 0,
@@ -606,7 +691,7 @@ def load_init_record(init_elf_file, init_name_arg):
     init_name = init_name_arg if init_name_arg else os.path.basename(init_elf_file)
     init_record = create_file_record(init_name, init_data)
     if not init_record:
-        print(f"ERROR: init name not 8.3 compatible: {init_name}")
+        print(f"ERROR: init name is not a valid FAT file name: {init_name}")
         raise SystemExit(1)
 
     print(f"  [OK] Clusters needed: {init_record['clusters']}")
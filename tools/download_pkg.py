@@ -71,14 +71,11 @@ def split_word(text: str) -> tuple[str, str]:
     return trim(text[:pos]), trim(text[pos + 1 :])
 
 
-def fat_8dot3_name(name: str) -> str | None:
-    """Return an uppercase FAT 8.3 short name or None."""
-    stem, ext = os.path.splitext(name)
-    if ext.startswith("."):
-        ext = ext[1:]
-    if len(stem) == 0 or len(stem) > 8 or len(ext) > 3:
-        return None
-    return stem.upper().ljust(8) + ext.upper().ljust(3)
+def fat_long_name_valid(name: str) -> bool:
+    """Return True when FAT can store name as a VFAT long file name."""
+    if len(name) > 254 or name in (".", "..") or name[-1] in ". ":
+        return False
+    return all(0x20 <= ord(ch) <= 0x7E and ch not in '"*:<>?|' for ch in name)
 
 
 def validate_stage_name(name: str, label: str) -> None:
@@ -87,8 +84,8 @@ def validate_stage_name(name: str, label: str) -> None:
         raise ValueError(f"{label} is empty")
     if "/" in name or "\\" in name:
         raise ValueError(f"{label} must stay in one /run entry: {name}")
-    if fat_8dot3_name(name) is None:
-        raise ValueError(f"{label} is not FAT 8.3 compatible: {name}")
+    if not fat_long_name_valid(name):
+        raise ValueError(f"{label} is not a valid FAT long file name: {name}")
 
 
 def parse_manifest(text: str) -> PackageManifest:
@@ -116,6 +116,50 @@ struct numos_timer_info {
     uint64_t remaining_ms;
 };
 
+/*
+ * Read-only kernel data page mapped at NUMOS_VDSO_DATA_ADDR on x86_64.
+ * The timer IRQ updates it under a sequence lock (seq is odd mid-update);
+ * use the numos_vdso_* helpers below rather than reading it directly.
+ */
+#define NUMOS_VDSO_DATA_ADDR 0x00000000C0000000ULL
+
+struct numos_vdso_data {
+    uint32_t magic;
+    uint32_t version;
+    volatile uint32_t seq;
+    uint32_t tick_hz;
+    uint64_t ticks;
+    uint64_t uptime_ms;
+    uint64_t tsc_at_tick;
+    uint64_t tsc_khz;
+    uint64_t tsc_to_ns_mult;
+    uint64_t tsc_per_tick;
+    struct numos_calendar_time wall_clock;
+    uint64_t processes_active;
+    uint64_t processes_created;
+    uint64_t context_switches;
+};
+
+/*
+ * Record produced by sys_getdents.  Records are packed back to back;
+ * d_reclen is the distance to the next one.
+ */
+struct numos_dirent {
+    uint32_t d_size;
+    uint16_t d_reclen;
+    uint8_t  d_type;            /* 1 = file, 2 = directory */
+    uint8_t  d_attr;            /* FAT32_ATTR_* bits */
+    char     d_name[];          /* NUL-terminated */
+};
+
+/* One buffer of a sys_readv / sys_writev request */
+#define NUMOS_IOV_MAX 1024
+
+struct numos_iovec {
+    void    *iov_base;
+    uint64_t iov_len;
+};
+
 #define NUMOS_DISK_MODEL_LEN 41
 
 struct numos_disk_info {
@@ -182,6 +226,18 @@ struct numos_net_ping_result {
     uint32_t roundtrip_ms;
 };
 
+struct numos_sockaddr_in {
+    uint8_t  addr[4];
+    uint16_t port;
+    uint16_t reserved;
+};
+
+struct numos_epoll_event {
+    uint32_t events;
+    uint32_t reserved;
+    uint64_t data;          /* Returned as given to sys_epoll_ctl() */
+};
+
 struct numos_net_tcp_info {
     uint8_t  state;
     uint8_t  reset;
@@ -222,16 +278,18 @@ struct numos_net_http_result {
     uint8_t  secure;
     uint8_t  truncated;
     uint8_t  headers_included;
-    uint8_t  reserved0;
+    uint8_t  reused;
     uint32_t bytes_received;
     uint32_t body_offset;
     uint8_t  remote_ip[4];
     char     content_type[64];
     char     location[192];
+    uint32_t content_length;
 };
 
 #define NUMOS_NET_FLAG_INSECURE      0x00000001u
 #define NUMOS_HTTP_FLAG_INCLUDE_HEADERS 0x00000002u
+#define NUMOS_HTTP_FLAG_CLOSE        0x00000004u
 
 #define NUMOS_TIMER_PERIODIC 0x01u
 
@@ -240,9 +298,17 @@ struct numos_net_http_result {
 #define SYS_WRITE       1
 #define SYS_OPEN        2
 #define SYS_CLOSE       3
+#define SYS_LSEEK       8
+#define SYS_MMAP        9
+#define SYS_MUNMAP      11
+#define SYS_PREAD64     17
+#define SYS_PWRITE64    18
+#define SYS_READV       19
+#define SYS_WRITEV      20
 #define SYS_SLEEP_MS    35
 #define SYS_GETPID      39
 #define SYS_EXIT        60
+#define SYS_WAITPID     61
 #define SYS_UPTIME_MS   96
 #define SYS_SYSINFO     99
 #define SYS_HWINFO      100
@@ -289,6 +355,46 @@ struct numos_net_http_result {
 #define SYS_NET_TCP_INFO         239
 #define SYS_NET_TLS_PROBE        240
 #define SYS_NET_HTTP_GET         241
+#define SYS_COPY_FILE_RANGE      242
+#define SYS_GETDENTS             243
+#define SYS_SPAWN                244
+#define SYS_SOCKET               245
+#define SYS_BIND                 246
+#define SYS_LISTEN               247
+#define SYS_ACCEPT               248
+#define SYS_CONNECT              249
+#define SYS_SENDTO               250
+#define SYS_RECVFROM             251
+#define SYS_EPOLL_CREATE         252
+#define SYS_EPOLL_CTL            253
+#define SYS_EPOLL_WAIT           254
+#define SYS_NET_HTTP_FETCH       255
+
+#define NUMOS_SOCK_STREAM 1
+#define NUMOS_SOCK_DGRAM  2
+
+/* Errors returned by the socket and network syscalls */
+#define NUMOS_EINVAL      (-22)
+#define NUMOS_ENETDOWN    (-100)
+#define NUMOS_ECONNRESET  (-104)
+#define NUMOS_ENOTCONN    (-107)
+#define NUMOS_ETIMEDOUT   (-110)
+
+/* Epoll event bits; NUMOS_EPOLL_ET asks for edge-triggered reports. */
+#define NUMOS_EPOLL_IN    0x001u
+#define NUMOS_EPOLL_OUT   0x004u
+#define NUMOS_EPOLL_ERR   0x008u
+#define NUMOS_EPOLL_HUP   0x010u
+#define NUMOS_EPOLL_ET    0x80000000u
+
+#define NUMOS_EPOLL_CTL_ADD 1
+#define NUMOS_EPOLL_CTL_DEL 2
+#define NUMOS_EPOLL_CTL_MOD 3
+
+/* What the id of a registration names */
+#define NUMOS_EPOLL_FD    0   /* Socket descriptor, or 0 for the keyboard */
+#define NUMOS_EPOLL_TIMER 1   /* Timer id from sys_timer_create() */
+#define NUMOS_EPOLL_TCP   2   /* Handle from sys_net_tcp_connect() */
 
 /* Special key codes returned by SYS_INPUT and SYS_INPUT_PEEK. */
 #define KEY_SPECIAL_UP    '\x01'
@@ -309,6 +415,19 @@ struct numos_net_http_result {
 #define FAT32_O_TRUNC       0x08
 #define FAT32_O_APPEND      0x10
 
+/* sys_waitpid options */
+#define WNOHANG             1
+
+/* lseek whence values */
+#define SEEK_SET            0
+#define SEEK_CUR            1
+#define SEEK_END            2
+
+/* mmap protection and flags (only read-only file mappings are supported) */
+#define PROT_READ           0x1
+#define MAP_SHARED          0x01
+#define MAP_PRIVATE         0x02
+
 static inline int64_t sys_call0(int64_t n) {
 #if defined(__aarch64__)
     register int64_t x8 __asm__("x8") = n;
@@ -501,6 +620,38 @@ static inline int64_t sys_close(int fd) {
     return sys_call1(SYS_CLOSE, fd);
 }
 
+/* Returns the new offset, or a negative errno. */
+static inline int64_t sys_lseek(int fd, int64_t offset, int whence) {
+    return sys_call3(SYS_LSEEK, fd, offset, whence);
+}
+
+static inline int64_t sys_pread(int fd, void *buf, size_t count, uint64_t offset) {
+    return sys_call4(SYS_PREAD64, fd, (int64_t)buf, (int64_t)count, (int64_t)offset);
+}
+
+static inline int64_t sys_pwrite(int fd, const void *buf, size_t count, uint64_t offset) {
+    return sys_call4(SYS_PWRITE64, fd, (int64_t)buf, (int64_t)count, (int64_t)offset);
+}
+
+static inline int64_t sys_readv(int fd, const struct numos_iovec *iov, int iovcnt) {
+    return sys_call3(SYS_READV, fd, (int64_t)iov, iovcnt);
+}
+
+static inline int64_t sys_writev(int fd, const struct numos_iovec *iov, int iovcnt) {
+    return sys_call3(SYS_WRITEV, fd, (int64_t)iov, iovcnt);
+}
+
+/* Returns the mapped address, or a negative errno. */
+static inline int64_t sys_mmap(void *addr, size_t length, int prot, int flags,
+                               int fd, uint64_t offset) {
+    return sys_call6(SYS_MMAP, (int64_t)addr, (int64_t)length, prot, flags,
+                     fd, (int64_t)offset);
+}
+
+static inline int64_t sys_munmap(void *addr, size_t length) {
+    return sys_call2(SYS_MUNMAP, (int64_t)addr, (int64_t)length);
+}
+
 static inline int64_t sys_exit(int status) {
     return sys_call1(SYS_EXIT, status);
 }
@@ -541,6 +692,23 @@ static inline int64_t sys_exec_argv(const char *path, const char *cmdline) {
     return sys_call2(SYS_EXEC_ARGV, (int64_t)path, (int64_t)cmdline);
 }
 
+/*
+ * Start a program without waiting for it.  cmdline may be NULL.
+ * Returns the child pid or a negative errno.
+ */
+static inline int64_t sys_spawn(const char *path, const char *cmdline) {
+    return sys_call2(SYS_SPAWN, (int64_t)path, (int64_t)cmdline);
+}
+
+/*
+ * Reap a child started with sys_spawn.  pid -1 waits for any child; with
+ * WNOHANG, 0 is returned while it is still running.  Returns the child
+ * pid, or -10 (ECHILD) when there is nothing to wait for.
+ */
+static inline int64_t sys_waitpid(int pid, int *status, int options) {
+    return sys_call3(SYS_WAITPID, pid, (int64_t)status, options);
+}
+
 static inline int64_t sys_get_cmdline(char *buf, size_t len) {
     return sys_call2(SYS_GET_CMDLINE, (int64_t)buf, (int64_t)len);
 }
@@ -588,6 +756,89 @@ static inline int64_t sys_time_read(struct numos_calendar_time *out) {
     return sys_call1(SYS_TIME_READ, (int64_t)out);
 }
 
+#if defined(__x86_64__)
+static inline const volatile struct numos_vdso_data *numos_vdso(void) {
+    return (const volatile struct numos_vdso_data *)(uintptr_t)NUMOS_VDSO_DATA_ADDR;
+}
+
+static inline uint32_t numos_vdso_read_begin(const volatile struct numos_vdso_data *vd) {
+    uint32_t seq;
+    do {
+        seq = vd->seq;
+    } while (seq & 1u);
+    __asm__ volatile("" ::: "memory");
+    return seq;
+}
+
+static inline int numos_vdso_read_retry(const volatile struct numos_vdso_data *vd,
+                                        uint32_t seq) {
+    __asm__ volatile("" ::: "memory");
+    return vd->seq != seq;
+}
+#endif
+
+/* Milliseconds since boot; no syscall on x86_64. */
+static inline uint64_t numos_uptime_ms(void) {
+#if defined(__x86_64__)
+    const volatile struct numos_vdso_data *vd = numos_vdso();
+    uint32_t seq;
+    uint64_t ms;
+    do {
+        seq = numos_vdso_read_begin(vd);
+        ms = vd->uptime_ms;
+    } while (numos_vdso_read_retry(vd, seq));
+    return ms;
+#else
+    return (uint64_t)sys_uptime_ms();
+#endif
+}
+
+/*
+ * Nanoseconds since boot.  Interpolated with the TSC between timer ticks
+ * once the kernel has calibrated it, tick resolution before that.
+ */
+static inline uint64_t numos_uptime_ns(void) {
+#if defined(__x86_64__)
+    const volatile struct numos_vdso_data *vd = numos_vdso();
+    uint32_t seq;
+    uint64_t ns;
+    do {
+        seq = numos_vdso_read_begin(vd);
+        uint32_t lo, hi;
+        __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        uint64_t delta = (((uint64_t)hi << 32) | lo) - vd->tsc_at_tick;
+        if (delta > vd->tsc_per_tick) delta = vd->tsc_per_tick;
+        ns = vd->uptime_ms * 1000000ULL + ((delta * vd->tsc_to_ns_mult) >> 32);
+    } while (numos_vdso_read_retry(vd, seq));
+    return ns;
+#else
+    return (uint64_t)sys_uptime_ms() * 1000000ULL;
+#endif
+}
+
+/* Same result as sys_time_read(), served from the shared page on x86_64. */
+static inline int64_t numos_time_read(struct numos_calendar_time *out) {
+#if defined(__x86_64__)
+    const volatile struct numos_vdso_data *vd = numos_vdso();
+    uint32_t seq;
+    do {
+        seq = numos_vdso_read_begin(vd);
+        out->year      = vd->wall_clock.year;
+        out->month     = vd->wall_clock.month;
+        out->day       = vd->wall_clock.day;
+        out->hour      = vd->wall_clock.hour;
+        out->minute    = vd->wall_clock.minute;
+        out->second    = vd->wall_clock.second;
+        out->weekday   = vd->wall_clock.weekday;
+        out->valid     = vd->wall_clock.valid;
+        out->uptime_ms = vd->uptime_ms;
+    } while (numos_vdso_read_retry(vd, seq));
+    return out->valid ? 0 : -22;  /* EINVAL, as the syscall returns */
+#else
+    return sys_time_read(out);
+#endif
+}
+
 static inline int64_t sys_timer_create(uint64_t delay_ms, uint64_t period_ms,
                                        uint32_t flags) {
     return sys_call3(SYS_TIMER_CREATE, (int64_t)delay_ms,
@@ -689,6 +940,63 @@ static inline int64_t sys_net_tcp_info(int handle, struct numos_net_tcp_info *ou
     return sys_call2(SYS_NET_TCP_INFO, (int64_t)handle, (int64_t)out);
 }
 
+/*
+ * Sockets.  The descriptors work with read(), write() and close(); calls
+ * block until they complete.  Errors are negative errno values.
+ */
+static inline int64_t sys_socket(int type) {
+    return sys_call1(SYS_SOCKET, (int64_t)type);
+}
+
+static inline int64_t sys_bind(int fd, const struct numos_sockaddr_in *addr) {
+    return sys_call2(SYS_BIND, (int64_t)fd, (int64_t)addr);
+}
+
+static inline int64_t sys_listen(int fd, int backlog) {
+    return sys_call2(SYS_LISTEN, (int64_t)fd, (int64_t)backlog);
+}
+
+/* Returns a new descriptor for the connection; peer may be NULL. */
+static inline int64_t sys_accept(int fd, struct numos_sockaddr_in *peer) {
+    return sys_call2(SYS_ACCEPT, (int64_t)fd, (int64_t)peer);
+}
+
+static inline int64_t sys_connect(int fd, const struct numos_sockaddr_in *addr) {
+    return sys_call2(SYS_CONNECT, (int64_t)fd, (int64_t)addr);
+}
+
+/* addr may be NULL on a connected socket. */
+static inline int64_t sys_sendto(int fd, const void *buf, size_t len,
+                                 const struct numos_sockaddr_in *addr) {
+    return sys_call4(SYS_SENDTO, (int64_t)fd, (int64_t)buf, (int64_t)len, (int64_t)addr);
+}
+
+static inline int64_t sys_recvfrom(int fd, void *buf, size_t len,
+                                   struct numos_sockaddr_in *from) {
+    return sys_call4(SYS_RECVFROM, (int64_t)fd, (int64_t)buf, (int64_t)len, (int64_t)from);
+}
+
+/*
+ * Epoll.  A due timer stays ready until sys_timer_wait() consumes it.
+ * sys_epoll_wait() returns the number of events, 0 on timeout; a negative
+ * timeout waits forever.
+ */
+static inline int64_t sys_epoll_create(void) {
+    return sys_call0(SYS_EPOLL_CREATE);
+}
+
+static inline int64_t sys_epoll_ctl(int epfd, int op, int kind, int id,
+                                    const struct numos_epoll_event *event) {
+    return sys_call5(SYS_EPOLL_CTL, (int64_t)epfd, (int64_t)op, (int64_t)kind,
+                     (int64_t)id, (int64_t)event);
+}
+
+static inline int64_t sys_epoll_wait(int epfd, struct numos_epoll_event *events,
+                                     int max_events, int64_t timeout_ms) {
+    return sys_call4(SYS_EPOLL_WAIT, (int64_t)epfd, (int64_t)events,
+                     (int64_t)max_events, timeout_ms);
+}
+
 static inline int64_t sys_net_tls_probe(const uint8_t *ipv4,
                                         uint16_t port,
                                         const char *server_name,
@@ -708,8 +1016,45 @@ static inline int64_t sys_net_http_get(const struct numos_net_http_request *requ
                      (int64_t)len, (int64_t)out);
 }
 
+/*
+ * GET request->path and write a 2xx response body straight into fd.  The
+ * kernel keeps the connection open afterwards, so the next request to the
+ * same server (a redirect hop or another file) skips the TCP and TLS
+ * handshakes.  Other statuses write nothing; check out->status_code and
+ * out->location.  Returns the bytes written or a negative NUMOS_E* errno
+ * (NUMOS_ETIMEDOUT, NUMOS_ENOTCONN when the server hung up, ...).
+ */
+static inline int64_t sys_net_http_fetch(const struct numos_net_http_request *request,
+                                         int fd,
+                                         struct numos_net_http_result *out) {
+    return sys_call3(SYS_NET_HTTP_FETCH, (int64_t)request, (int64_t)fd, (int64_t)out);
+}
+
 static inline int64_t sys_poweroff(void) {
     return sys_call0(SYS_POWEROFF);
 }
 
+/*
+ * Fill buf with packed numos_dirent records for path, starting at *cursor
+ * (0 for the beginning) and updating it.  Returns the bytes written, 0 at
+ * the end of the directory, or a negative errno.
+ */
+static inline int64_t sys_getdents(const char *path, void *buf, size_t len,
+                                   uint64_t *cursor) {
+    return sys_call4(SYS_GETDENTS, (int64_t)path, (int64_t)buf,
+                     (int64_t)len, (int64_t)cursor);
+}
+
+/*
+ * Copy up to len bytes between two open files inside the kernel.  NULL
+ * offsets use and advance the file positions.  Returns the bytes copied,
+ * 0 at end of input, or a negative errno.
+ */
+static inline int64_t sys_copy_file_range(int fd_in, int64_t *off_in,
+                                          int fd_out, int64_t *off_out,
+                                          size_t len, uint32_t flags) {
+    return sys_call6(SYS_COPY_FILE_RANGE, fd_in, (int64_t)off_in, fd_out,
+                     (int64_t)off_out, (int64_t)len, (int64_t)flags);
+}
+
 #endif /* NUMOS_USER_SYSCALLS_H */
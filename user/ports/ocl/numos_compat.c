@@ -1050,7 +1050,7 @@ static long days_before_month(int year, int month) {
 static time_t unix_from_calendar(const struct numos_calendar_time *ct) {
     long days = 0;
     int year;
-    if (!ct || !ct->valid) return (time_t)(sys_uptime_ms() / 1000);
+    if (!ct || !ct->valid) return (time_t)(numos_uptime_ms() / 1000);
     for (year = 1970; year < (int)ct->year; year++) days += is_leap_year(year) ? 366 : 365;
     days += days_before_month((int)ct->year, (int)ct->month);
     days += (long)ct->day - 1;
@@ -1060,20 +1060,20 @@ static time_t unix_from_calendar(const struct numos_calendar_time *ct) {
 time_t time(time_t *out) {
     struct numos_calendar_time ct;
     time_t value;
-    if (sys_time_read(&ct) < 0 || !ct.valid) value = (time_t)(sys_uptime_ms() / 1000);
+    if (numos_time_read(&ct) < 0 || !ct.valid) value = (time_t)(numos_uptime_ms() / 1000);
     else value = unix_from_calendar(&ct);
     if (out) *out = value;
     return value;
 }
 
 int clock_gettime(int clock_id, struct timespec *ts) {
-    uint64_t ms;
+    uint64_t ns;
     if (!ts || clock_id != CLOCK_MONOTONIC) {
         errno = EINVAL;
         return -1;
     }
-    ms = (uint64_t)sys_uptime_ms();
-    ts->tv_sec = (long)(ms / 1000);
-    ts->tv_nsec = (long)((ms % 1000) * 1000000UL);
+    ns = numos_uptime_ns();
+    ts->tv_sec = (long)(ns / 1000000000ULL);
+    ts->tv_nsec = (long)(ns % 1000000000ULL);
     return 0;
 }
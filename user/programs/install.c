@@ -38,6 +38,7 @@
 #define DEFAULT_INIT_PATH "/bin/shell.elf"
 #define DEFAULT_GFX_MODE "vesa"
 #define MAX_KERNEL_VERSION 9999u
+#define COPY_RANGE_CHUNK  (1024u * 1024u)
 #define MULTIBOOT2_HEADER_MAGIC 0xE85250D6u
 #define MULTIBOOT2_TAG_END 0u
 #define MULTIBOOT2_TAG_FRAMEBUFFER 5u
@@ -47,8 +48,6 @@
 #define HTTP_TIMEOUT_MS   10000u
 #define HTTP_REDIRECT_LIMIT 4
 #define HTTP_REQUEST_RETRY_LIMIT 2
-#define HTTP_STREAM_RECV_BYTES 2048u
-#define HTTP_STREAM_HEADER_BYTES 4096u
 #define DOWNLOAD_PROGRESS_WIDTH 24u
 
 #define MAX_STAGE_FILES 96
@@ -58,13 +57,6 @@
 #define FAT32_ATTR_ARCHIVE   0x20u
 #define FAT32_EOC            0x0FFFFFFFu
 
-#define NET_ERR_GENERIC        -1
-#define NET_ERR_UNAVAILABLE    -2
-#define NET_ERR_TIMEOUT        -3
-#define NET_ERR_NOT_CONFIGURED -4
-#define NET_ERR_INVALID        -5
-#define NET_ERR_CLOSED         -6
-
 /* Each staged file records the short FAT name and the payload location. */
 struct staged_file {
     char name[13];
@@ -107,8 +99,6 @@ static uint8_t fat_buffer[FAT_SIZE_SECTORS * BYTES_PER_SECTOR];
 static uint8_t cluster_buffer[BYTES_PER_CLUSTER];
 static uint8_t zero_buffer[BYTES_PER_CLUSTER];
 static uint8_t transfer_buffer[ATA_MAX_TRANSFER_SECTORS * BYTES_PER_SECTOR];
-static uint8_t http_stream_recv_buffer[HTTP_STREAM_RECV_BYTES];
-static char http_stream_header_buffer[HTTP_STREAM_HEADER_BYTES + 1u];
 static struct fat32_dirent install_dir_entries[64];
 static struct fat32_dirent install_include_entries[16];
 
@@ -290,100 +280,6 @@ static int append_port_text(char *buf, size_t cap, size_t *pos, uint16_t port) {
     return 0;
 }
 
-static int parse_uint32_text(const char *text, uint32_t *out) {
-    uint64_t value = 0;
-
-    if (!text || !out || !*text) return 0;
-    while (*text) {
-        if (!is_digit(*text)) return 0;
-        value = (value * 10u) + (uint64_t)(*text - '0');
-        if (value > 0xFFFFFFFFu) return 0;
-        text++;
-    }
-
-    *out = (uint32_t)value;
-    return 1;
-}
-
-static int parse_header_value(const char *headers,
-                              const char *name,
-                              char *out,
-                              size_t cap) {
-    const char *line = headers;
-    size_t name_len;
-
-    if (!headers || !name || !out || cap == 0) return -1;
-    name_len = strlen(name);
-    out[0] = '\0';
-
-    while (*line) {
-        const char *line_end = line;
-        const char *colon = 0;
-        size_t pos = 0;
-
-        while (*line_end && *line_end != '\n') {
-            if (!colon && *line_end == ':') colon = line_end;
-            line_end++;
-        }
-
-        if (colon && (size_t)(colon - line) == name_len &&
-            strncmp(line, name, name_len) == 0) {
-            const char *value = colon + 1;
-            while (*value == ' ' || *value == '\t') value++;
-            while (value < line_end && *value != '\r' && pos + 1 < cap) {
-                out[pos++] = *value++;
-            }
-            out[pos] = '\0';
-            return 0;
-        }
-
-        if (*line_end == '\n') line = line_end + 1;
-        else break;
-    }
-
-    return -1;
-}
-
-static int parse_http_status_code_text(const char *headers, uint16_t *out_status) {
-    const char *cursor;
-    uint32_t status = 0;
-
-    if (!headers || !out_status) return -1;
-    cursor = headers;
-    while (*cursor && *cursor != ' ') cursor++;
-    while (*cursor == ' ') cursor++;
-    if (!is_digit(cursor[0]) || !is_digit(cursor[1]) || !is_digit(cursor[2])) return -1;
-
-    status = (uint32_t)(cursor[0] - '0') * 100u +
-             (uint32_t)(cursor[1] - '0') * 10u +
-             (uint32_t)(cursor[2] - '0');
-    *out_status = (uint16_t)status;
-    return 0;
-}
-
-static size_t find_http_header_end(const char *buf, size_t len) {
-    if (!buf || len < 4) return 0;
-    for (size_t i = 3; i < len; i++) {
-        if (buf[i - 3] == '\r' && buf[i - 2] == '\n' &&
-            buf[i - 1] == '\r' && buf[i] == '\n') {
-            return i + 1;
-        }
-    }
-    return 0;
-}
-
-static int tcp_send_all(int handle, const void *buf, size_t len, uint32_t timeout_ms) {
-    const uint8_t *cursor = (const uint8_t *)buf;
-    size_t sent = 0;
-
-    while (sent < len) {
-        int64_t rc = sys_net_tcp_send(handle, cursor + sent, len - sent, timeout_ms);
-        if (rc <= 0) return -1;
-        sent += (size_t)rc;
-    }
-    return 0;
-}
-
 static void write_download_progress(uint32_t done, uint32_t total, int finish_line) {
     uint32_t filled = 0;
 
@@ -595,23 +491,19 @@ static int resolve_remote_redirect_location(const struct remote_kernel_url *base
 }
 
 static void write_network_error_reason(int64_t rc) {
-    if (rc == NET_ERR_TIMEOUT) {
+    if (rc == NUMOS_ETIMEDOUT) {
         write_str("install: network request timed out\n");
         return;
     }
-    if (rc == NET_ERR_UNAVAILABLE) {
-        write_str("install: network driver is unavailable\n");
-        return;
-    }
-    if (rc == NET_ERR_NOT_CONFIGURED) {
-        write_str("install: network is not configured\n");
+    if (rc == NUMOS_ENETDOWN) {
+        write_str("install: network is unavailable\n");
         return;
     }
-    if (rc == NET_ERR_INVALID) {
+    if (rc == NUMOS_EINVAL) {
         write_str("install: invalid network request\n");
         return;
     }
-    if (rc == NET_ERR_CLOSED) {
+    if (rc == NUMOS_ENOTCONN) {
         write_str("install: remote host closed the TCP connection\n");
         return;
     }
@@ -619,9 +511,9 @@ static void write_network_error_reason(int64_t rc) {
 }
 
 static int request_should_retry(int64_t rc) {
-    return rc == NET_ERR_TIMEOUT ||
-           rc == NET_ERR_GENERIC ||
-           rc == NET_ERR_CLOSED;
+    return rc == NUMOS_ETIMEDOUT ||
+           rc == NUMOS_ECONNRESET ||
+           rc == NUMOS_ENOTCONN;
 }
 
 static int ensure_network_ready(void) {
@@ -642,8 +534,6 @@ static int ensure_network_ready(void) {
 static int stream_remote_kernel_to_file(const char *url_text, const char *dst_path) {
     char current[URL_BUF_SIZE];
     char next[URL_BUF_SIZE];
-    char location[URL_BUF_SIZE];
-    char content_length_text[32];
 
     if (!url_text || !dst_path) return -1;
     if (ensure_network_ready() != 0) return -1;
@@ -655,236 +545,8 @@ static int stream_remote_kernel_to_file(const char *url_text, const char *dst_pa
         return -1;
     }
 
-    for (int redirect = 0; redirect <= HTTP_REDIRECT_LIMIT; redirect++) {
-        struct remote_kernel_url url;
-        int follow_redirect = 0;
-
-        if (parse_remote_kernel_url(current, &url) != 0 || url.secure) {
-            write_str("install: unsupported kernel URL\n");
-            return -1;
-        }
-        if (url.uses_host_update_port) {
-            write_str("install: using host update port 8080\n");
-        }
-
-        for (int attempt = 0; attempt <= HTTP_REQUEST_RETRY_LIMIT; attempt++) {
-            int handle = -1;
-            int dst = -1;
-            int64_t recv_rc = 0;
-            size_t header_len = 0;
-            size_t header_end = 0;
-            uint16_t status_code = 0;
-            uint32_t expected_bytes = 0;
-            uint32_t total_written = 0;
-            int have_length = 0;
-            int progress_started = 0;
-            size_t req_pos = 0;
-            char request_buf[512];
-
-            request_buf[0] = '\0';
-            if (append_text(request_buf, sizeof(request_buf), &req_pos, "GET ") != 0 ||
-                append_text(request_buf, sizeof(request_buf), &req_pos,
-                            url.path[0] ? url.path : "/") != 0 ||
-                append_text(request_buf, sizeof(request_buf), &req_pos,
-                            " HTTP/1.1\r\nHost: ") != 0 ||
-                append_text(request_buf, sizeof(request_buf), &req_pos, url.host) != 0 ||
-                append_text(request_buf, sizeof(request_buf), &req_pos,
-                            "\r\nConnection: close\r\nUser-Agent: NumOS-Install\r\n\r\n") != 0) {
-                write_str("install: request is too large\n");
-                return -1;
-            }
-
-            handle = (int)sys_net_tcp_connect(url.remote_ip, url.remote_port, HTTP_TIMEOUT_MS);
-            if (handle < 0) {
-                recv_rc = handle;
-                goto stream_attempt_fail;
-            }
-            if (tcp_send_all(handle, request_buf, req_pos, HTTP_TIMEOUT_MS) != 0) {
-                recv_rc = NET_ERR_GENERIC;
-                goto stream_attempt_fail;
-            }
-
-            for (;;) {
-                recv_rc = sys_net_tcp_recv(handle,
-                                           http_stream_recv_buffer,
-                                           sizeof(http_stream_recv_buffer),
-                                           HTTP_TIMEOUT_MS);
-                if (recv_rc <= 0) break;
-
-                if (header_end == 0) {
-                    if (header_len + (size_t)recv_rc > HTTP_STREAM_HEADER_BYTES) {
-                        write_str("install: HTTP headers are too large\n");
-                        recv_rc = NET_ERR_INVALID;
-                        goto stream_attempt_fail;
-                    }
-                    memcpy(http_stream_header_buffer + header_len,
-                           http_stream_recv_buffer,
-                           (size_t)recv_rc);
-                    header_len += (size_t)recv_rc;
-                    http_stream_header_buffer[header_len] = '\0';
-                    header_end = find_http_header_end(http_stream_header_buffer, header_len);
-                    if (header_end == 0) continue;
-
-                    if (parse_http_status_code_text(http_stream_header_buffer, &status_code) != 0) {
-                        write_str("install: invalid HTTP response\n");
-                        recv_rc = NET_ERR_INVALID;
-                        goto stream_attempt_fail;
-                    }
-
-                    if (status_code >= 300u && status_code < 400u) {
-                        if (parse_header_value(http_stream_header_buffer, "Location",
-                                               location, sizeof(location)) != 0 ||
-                            resolve_remote_redirect_location(&url, location,
-                                                             next, sizeof(next)) != 0) {
-                            write_str("install: bad kernel redirect target\n");
-                            return -1;
-                        }
-                        follow_redirect = 1;
-                        break;
-                    }
-
-                    if (status_code < 200u || status_code >= 300u) {
-                        write_str("install: HTTP status ");
-                        write_dec(status_code);
-                        write_str("\n");
-                        return -1;
-                    }
-
-                    if (parse_header_value(http_stream_header_buffer, "Content-Length",
-                                           content_length_text,
-                                           sizeof(content_length_text)) == 0 &&
-                        parse_uint32_text(content_length_text, &expected_bytes)) {
-                        have_length = 1;
-                    }
-
-                    dst = (int)sys_open(dst_path,
-                                        FAT32_O_WRONLY | FAT32_O_CREAT | FAT32_O_TRUNC,
-                                        0);
-                    if (dst < 0) {
-                        write_str("install: failed to create staged kernel file\n");
-                        return -1;
-                    }
-
-                    if (have_length) {
-                        write_download_progress(0, expected_bytes, 0);
-                        progress_started = 1;
-                    }
-
-                    if (header_len > header_end) {
-                        size_t body_bytes = header_len - header_end;
-                        if (sys_write(dst,
-                                      http_stream_header_buffer + header_end,
-                                      body_bytes) != (int64_t)body_bytes) {
-                            write_str("install: failed while staging kernel bytes\n");
-                            recv_rc = NET_ERR_GENERIC;
-                            goto stream_attempt_fail;
-                        }
-                        total_written += (uint32_t)body_bytes;
-                        if (have_length) write_download_progress(total_written, expected_bytes, 0);
-                    }
-                    continue;
-                }
-
-                if (dst < 0) {
-                    write_str("install: missing staged kernel destination\n");
-                    recv_rc = NET_ERR_INVALID;
-                    goto stream_attempt_fail;
-                }
-                if (sys_write(dst, http_stream_recv_buffer, (size_t)recv_rc) != recv_rc) {
-                    write_str("install: failed while staging kernel bytes\n");
-                    recv_rc = NET_ERR_GENERIC;
-                    goto stream_attempt_fail;
-                }
-                total_written += (uint32_t)recv_rc;
-                if (have_length) write_download_progress(total_written, expected_bytes, 0);
-            }
-
-            if (handle >= 0) {
-                sys_net_tcp_close(handle, HTTP_TIMEOUT_MS);
-                handle = -1;
-            }
-
-            if (follow_redirect) {
-                if (dst >= 0) sys_close(dst);
-                write_str("install: following redirect to ");
-                write_str(next);
-                write_str("\n");
-                strncpy(current, next, sizeof(current) - 1);
-                current[sizeof(current) - 1] = '\0';
-                break;
-            }
-
-            if (dst >= 0) {
-                sys_close(dst);
-                dst = -1;
-            }
-
-            if (recv_rc < 0) goto stream_attempt_fail;
-            if (header_end == 0) {
-                write_str("install: incomplete HTTP response\n");
-                return -1;
-            }
-            if (have_length && total_written != expected_bytes) {
-                write_str("install: kernel download ended early\n");
-                return -1;
-            }
-            if (total_written == 0) {
-                write_str("install: downloaded kernel is empty\n");
-                return -1;
-            }
-
-            if (progress_started) write_download_progress(total_written, expected_bytes, 1);
-            else {
-                write_str("install: downloaded ");
-                write_dec(total_written);
-                write_str(" bytes\n");
-            }
-            return 0;
-
-stream_attempt_fail:
-            if (handle >= 0) sys_net_tcp_close(handle, HTTP_TIMEOUT_MS);
-            if (dst >= 0) sys_close(dst);
-            write_file_bytes(dst_path, "", 0);
-
-            if (attempt == HTTP_REQUEST_RETRY_LIMIT || !request_should_retry(recv_rc)) {
-                write_network_error_reason(recv_rc);
-                return -1;
-            }
-
-            write_str("install: kernel download retry ");
-            write_dec((uint64_t)(attempt + 2));
-            write_str("/");
-            write_dec((uint64_t)(HTTP_REQUEST_RETRY_LIMIT + 1));
-            write_str("\n");
-        }
-
-        if (!follow_redirect) break;
-        if (redirect == HTTP_REDIRECT_LIMIT) {
-            write_str("install: too many kernel URL redirects\n");
-            return -1;
-        }
-    }
-
-    write_str("install: too many kernel URL redirects\n");
-    return -1;
-}
-
-static int fetch_remote_kernel_bytes(const char *url_text,
-                                     const uint8_t **out_data,
-                                     size_t *out_len) {
-    char current[URL_BUF_SIZE];
-    char next[URL_BUF_SIZE];
-
-    if (!url_text || !out_data || !out_len) return -1;
-    if (ensure_network_ready() != 0) return -1;
-
-    strncpy(current, url_text, sizeof(current) - 1);
-    current[sizeof(current) - 1] = '\0';
-    if (url_text[strlen(current)] != '\0') {
-        write_str("install: kernel URL is too long\n");
-        return -1;
-    }
-
+    /* The kernel keeps the connection open between requests, so redirect
+     * hops to the same server reuse it instead of reconnecting. */
     for (int redirect = 0; redirect <= HTTP_REDIRECT_LIMIT; redirect++) {
         struct remote_kernel_url url;
         struct numos_net_http_request request;
@@ -900,6 +562,8 @@ static int fetch_remote_kernel_bytes(const char *url_text,
         }
 
         for (int attempt = 0; attempt <= HTTP_REQUEST_RETRY_LIMIT; attempt++) {
+            int dst;
+
             memset(&request, 0, sizeof(request));
             memset(&result, 0, sizeof(result));
             memcpy(request.remote_ip, url.remote_ip, sizeof(url.remote_ip));
@@ -910,8 +574,16 @@ static int fetch_remote_kernel_bytes(const char *url_text,
             strncpy(request.host, url.host, sizeof(request.host) - 1);
             strncpy(request.path, url.path, sizeof(request.path) - 1);
 
-            rc = sys_net_http_get(&request, file_pool, sizeof(file_pool), &result);
+            dst = (int)sys_open(dst_path, FAT32_O_WRONLY | FAT32_O_CREAT | FAT32_O_TRUNC, 0);
+            if (dst < 0) {
+                write_str("install: failed to create staged kernel file\n");
+                return -1;
+            }
+            rc = sys_net_http_fetch(&request, dst, &result);
+            sys_close(dst);
             if (rc >= 0) break;
+
+            write_file_bytes(dst_path, "", 0);
             if (attempt == HTTP_REQUEST_RETRY_LIMIT || !request_should_retry(rc)) {
                 write_network_error_reason(rc);
                 return -1;
@@ -924,23 +596,24 @@ static int fetch_remote_kernel_bytes(const char *url_text,
             write_str("\n");
         }
 
-        if (result.truncated || (size_t)rc > sizeof(file_pool)) {
-            write_str("install: kernel download is too large for staging memory\n");
-            return -1;
-        }
-
         if (result.status_code >= 200u && result.status_code < 300u) {
-            *out_data = file_pool;
-            *out_len = (size_t)rc;
+            if (rc == 0) {
+                write_str("install: downloaded kernel is empty\n");
+                return -1;
+            }
+            if (result.content_length != 0) {
+                write_download_progress((uint32_t)rc, result.content_length, 1);
+            } else {
+                write_str("install: downloaded ");
+                write_dec((uint64_t)rc);
+                write_str(" bytes\n");
+            }
             return 0;
         }
 
         if (result.status_code >= 300u && result.status_code < 400u &&
             result.location[0] != '\0') {
-            if (redirect == HTTP_REDIRECT_LIMIT) {
-                write_str("install: too many kernel URL redirects\n");
-                return -1;
-            }
+            if (redirect == HTTP_REDIRECT_LIMIT) break;
             if (resolve_remote_redirect_location(&url, result.location,
                                                  next, sizeof(next)) != 0) {
                 write_str("install: bad kernel redirect target\n");
@@ -971,22 +644,7 @@ static int stage_kernel_from_source(const char *src_path, const char *dst_path)
         write_str("install: downloading kernel from ");
         write_str(src_path);
         write_str("\n");
-
-        if (starts_with_text(src_path, "http://")) {
-            return stream_remote_kernel_to_file(src_path, dst_path);
-        }
-
-        const uint8_t *downloaded = 0;
-        size_t downloaded_len = 0;
-
-        if (fetch_remote_kernel_bytes(src_path, &downloaded, &downloaded_len) != 0) {
-            return -1;
-        }
-        if (downloaded_len == 0) {
-            write_str("install: downloaded kernel is empty\n");
-            return -1;
-        }
-        return write_file_bytes(dst_path, (const char *)downloaded, downloaded_len);
+        return stream_remote_kernel_to_file(src_path, dst_path);
     }
 
     return copy_file(src_path, dst_path);
@@ -1075,6 +733,24 @@ static int copy_file(const char *src_path, const char *dst_path) {
         return -1;
     }
 
+    /* Copy in the kernel; fall back to a user buffer on older kernels. */
+    int copied_any = 0;
+    for (;;) {
+        int64_t copied = sys_copy_file_range(src, NULL, dst, NULL, COPY_RANGE_CHUNK, 0);
+        if (copied == 0) {
+            sys_close(src);
+            sys_close(dst);
+            return 0;
+        }
+        if (copied < 0) break;
+        copied_any = 1;
+    }
+    if (copied_any) {
+        sys_close(src);
+        sys_close(dst);
+        return -1;
+    }
+
     for (;;) {
         int64_t got = sys_read(src, buf, sizeof(buf));
         if (got < 0) {
@@ -84,7 +84,7 @@ static int has_char(const char *s, char ch) {
     return 0;
 }
 
-static struct fat32_dirent shell_dir_entries[64];
+static uint8_t shell_dirent_buf[2048] __attribute__((aligned(8)));
 
 static char ascii_upper(char c) {
     if (c >= 'a' && c <= 'z') return (char)(c - 'a' + 'A');
@@ -227,6 +227,132 @@ static int find_interpreter_for_ext(const char *ext, char *out, size_t cap) {
     return 1;
 }
 
+/* =========================================================================
+ * Background jobs
+ *
+ * A command line ending in '&' is started with sys_spawn and recorded here
+ * instead of being waited for.  Finished jobs are collected with a
+ * non-blocking sys_waitpid before each prompt.
+ * ========================================================================= */
+
+#define SHELL_MAX_JOBS     8
+#define SHELL_JOB_CMD_LEN  48
+
+struct shell_job {
+    int64_t pid;                        /* 0 when the slot is free */
+    char    cmd[SHELL_JOB_CMD_LEN];
+};
+
+static struct shell_job shell_jobs[SHELL_MAX_JOBS];
+static int shell_background;            /* Current command ends in '&' */
+
+static void write_dec(uint32_t value) {
+    char buf[16];
+    char tmp[16];
+    int pos = 0;
+    int t = 0;
+
+    if (value == 0) {
+        buf[pos++] = '0';
+        sys_write(FD_STDOUT, buf, (size_t)pos);
+        return;
+    }
+
+    while (value > 0 && t < (int)sizeof(tmp)) {
+        tmp[t++] = (char)('0' + (value % 10));
+        value /= 10;
+    }
+    for (int i = t - 1; i >= 0; i--) {
+        buf[pos++] = tmp[i];
+    }
+    sys_write(FD_STDOUT, buf, (size_t)pos);
+}
+
+static void write_job(int slot, const char *state) {
+    write_str("[");
+    write_dec((uint32_t)(slot + 1));
+    write_str("] ");
+    write_dec((uint32_t)shell_jobs[slot].pid);
+    write_str(" ");
+    write_str(state);
+    write_str(" ");
+    write_str(shell_jobs[slot].cmd);
+    write_str("\n");
+}
+
+static void finish_job(int64_t pid, int status) {
+    for (int i = 0; i < SHELL_MAX_JOBS; i++) {
+        if (shell_jobs[i].pid != pid) continue;
+        write_job(i, status == 0 ? "done" : "failed");
+        shell_jobs[i].pid = 0;
+        return;
+    }
+}
+
+/* Collect every background job that has exited since the last prompt */
+static void reap_jobs(void) {
+    int status = 0;
+    int64_t pid;
+
+    while ((pid = sys_waitpid(-1, &status, WNOHANG)) > 0) {
+        finish_job(pid, status);
+    }
+}
+
+static void list_jobs(void) {
+    for (int i = 0; i < SHELL_MAX_JOBS; i++) {
+        if (shell_jobs[i].pid) write_job(i, "running");
+    }
+}
+
+/* Block until one job (pid > 0) or every job (pid == -1) has exited */
+static void wait_jobs(int64_t pid) {
+    int status = 0;
+    int64_t done;
+
+    while ((done = sys_waitpid((int)pid, &status, 0)) > 0) {
+        finish_job(done, status);
+        if (pid > 0) return;
+    }
+}
+
+/*
+ * run_program - start an ELF with a command line.  In the foreground this
+ * waits for it and returns its exit code; with '&' it records a job and
+ * returns 0.  Negative values mean the program could not be started.
+ */
+static int64_t run_program(const char *path, const char *cmdline) {
+    if (!shell_background) return sys_exec_argv(path, cmdline);
+
+    int slot = -1;
+    for (int i = 0; i < SHELL_MAX_JOBS; i++) {
+        if (shell_jobs[i].pid == 0) { slot = i; break; }
+    }
+    if (slot < 0) {
+        write_str("too many background jobs\n");
+        return 0;
+    }
+
+    int64_t pid = sys_spawn(path, cmdline);
+    if (pid < 0) return pid;
+
+    const char *name = (cmdline && cmdline[0]) ? cmdline : path;
+    size_t n = 0;
+    while (name[n] && n < SHELL_JOB_CMD_LEN - 1) {
+        shell_jobs[slot].cmd[n] = name[n];
+        n++;
+    }
+    shell_jobs[slot].cmd[n] = '\0';
+    shell_jobs[slot].pid = pid;
+
+    write_str("[");
+    write_dec((uint32_t)(slot + 1));
+    write_str("] ");
+    write_dec((uint32_t)pid);
+    write_str("\n");
+    return 0;
+}
+
 /*
  * try_run_as_script — attempt to execute path as an interpreted script.
  *
@@ -246,7 +372,7 @@ static int try_run_as_script(const char *path) {
         const char *interp = skip_spaces(first_line + 2);
         /* Shebang path must not be empty and the ELF must exist */
         if (interp[0] != '\0' && file_exists(interp)) {
-            int64_t rc = sys_exec_argv(interp, path);
+            int64_t rc = run_program(interp, path);
             return (rc >= 0) ? 0 : -1;
         }
     }
@@ -255,7 +381,7 @@ static int try_run_as_script(const char *path) {
     const char *ext = get_extension(path);
     char interp[64];
     if (find_interpreter_for_ext(ext, interp, sizeof(interp))) {
-        int64_t rc = sys_exec_argv(interp, path);
+        int64_t rc = run_program(interp, path);
         return (rc >= 0) ? 0 : -1;
     }
 
@@ -272,7 +398,7 @@ static int try_run_as_script(const char *path) {
 static int try_script_or_exec(const char *path, const char *cmdline) {
     if (!file_exists(path)) return -1;
     if (try_run_as_script(path) == 0) return 0;
-    if (sys_exec_argv(path, cmdline) >= 0) return 0;
+    if (run_program(path, cmdline) >= 0) return 0;
     return -1;
 }
 
@@ -286,7 +412,7 @@ static int try_exec_or_script(const char *cmd, const char *cmdline) {
 
     if (!has_char(cmd, '.')) {
         if (build_prefixed_path(path, sizeof(path), "/bin/", cmd, ".ELF", 1) &&
-            file_exists(path) && sys_exec_argv(path, line) >= 0) return 0;
+            file_exists(path) && run_program(path, line) >= 0) return 0;
     }
 
     if (try_script_or_exec(cmd, line) == 0) return 0;
@@ -333,7 +459,7 @@ static int try_exec_or_script_run(const char *cmd, const char *cmdline) {
 
     {
         if (build_prefixed_path(path, sizeof(path), "/bin/", cmd, ".ELF", 1) &&
-            file_exists(path) && sys_exec_argv(path, line) >= 0) return 0;
+            file_exists(path) && run_program(path, line) >= 0) return 0;
     }
 
     {
@@ -344,28 +470,6 @@ static int try_exec_or_script_run(const char *cmd, const char *cmdline) {
     }
 }
 
-static void write_dec(uint32_t value) {
-    char buf[16];
-    char tmp[16];
-    int pos = 0;
-    int t = 0;
-
-    if (value == 0) {
-        buf[pos++] = '0';
-        sys_write(FD_STDOUT, buf, (size_t)pos);
-        return;
-    }
-
-    while (value > 0 && t < (int)sizeof(tmp)) {
-        tmp[t++] = (char)('0' + (value % 10));
-        value /= 10;
-    }
-    for (int i = t - 1; i >= 0; i--) {
-        buf[pos++] = tmp[i];
-    }
-    sys_write(FD_STDOUT, buf, (size_t)pos);
-}
-
 static int is_system_dir_name(const char *path) {
     return str_eq(path, "bin") ||
            str_eq(path, "run") ||
@@ -374,10 +478,42 @@ static int is_system_dir_name(const char *path) {
            str_eq(path, "home");
 }
 
+/*
+ * print_directory - stream the entries of path to the console.  Sizes and
+ * attributes arrive with each record, so nothing is stat'ed separately.
+ * Returns 0, or a negative errno if path could not be listed.
+ */
+static int64_t print_directory(const char *path) {
+    uint64_t cursor = 0;
+    int64_t n;
+
+    while ((n = sys_getdents(path, shell_dirent_buf, sizeof(shell_dirent_buf),
+                             &cursor)) > 0) {
+        for (int64_t off = 0; off < n;) {
+            const struct numos_dirent *rec =
+                (const struct numos_dirent *)(shell_dirent_buf + off);
+
+            if (rec->d_attr & FAT32_ATTR_DIRECTORY) {
+                write_str("[DIR]  ");
+            } else {
+                write_str("[FILE] ");
+            }
+            write_str(rec->d_name);
+            if (!(rec->d_attr & FAT32_ATTR_DIRECTORY)) {
+                write_str(" ");
+                write_dec(rec->d_size);
+                write_str(" bytes");
+            }
+            write_str("\n");
+            off += rec->d_reclen;
+        }
+    }
+    return n;
+}
+
 static void list_directory_cmd(const char *path) {
     const char *use_path = (path && path[0]) ? path : "";
     char norm_path[64];
-    int64_t count = sys_listdir(use_path, shell_dir_entries, 64);
     char abs_path[64];
 
     if (use_path[0]) {
@@ -387,11 +523,12 @@ static void list_directory_cmd(const char *path) {
             for (size_t i = 0; i < len; i++) norm_path[i] = use_path[i];
             norm_path[len] = '\0';
             use_path = norm_path;
-            count = sys_listdir(use_path, shell_dir_entries, 64);
         }
     }
 
-    if (count < 0 && use_path[0] && use_path[0] != '/' && is_system_dir_name(use_path)) {
+    int64_t rc = print_directory(use_path);
+
+    if (rc < 0 && use_path[0] && use_path[0] != '/' && is_system_dir_name(use_path)) {
         size_t pos = 0;
         size_t i = 0;
         abs_path[pos++] = '/';
@@ -399,27 +536,11 @@ static void list_directory_cmd(const char *path) {
             abs_path[pos++] = use_path[i++];
         }
         abs_path[pos] = '\0';
-        count = sys_listdir(abs_path, shell_dir_entries, 64);
+        rc = print_directory(abs_path);
     }
 
-    if (count < 0) {
+    if (rc < 0) {
         write_str("list failed\n");
-        return;
-    }
-
-    for (int i = 0; i < count; i++) {
-        if (shell_dir_entries[i].attr & FAT32_ATTR_DIRECTORY) {
-            write_str("[DIR]  ");
-        } else {
-            write_str("[FILE] ");
-        }
-        write_str(shell_dir_entries[i].name);
-        if (!(shell_dir_entries[i].attr & FAT32_ATTR_DIRECTORY)) {
-            write_str(" ");
-            write_dec(shell_dir_entries[i].size);
-            write_str(" bytes");
-        }
-        write_str("\n");
     }
 }
 
@@ -444,6 +565,8 @@ static void print_help(void) {
     write_str("  pkg kernel <path|URL> [reboot]  stage a new /boot kernel with fallback\n");
     write_str("  run          list or run programs in /bin/\n");
     write_str("  list         list directory entries\n");
+    write_str("  jobs         list background jobs\n");
+    write_str("  wait [pid]   wait for one or all background jobs\n");
     write_str("\nbundled tools:\n");
     write_str("  mk           run targets from /home/BUILD.MK or another build file\n");
     write_str("  numloss      compress or decompress files with NMLS archives\n");
@@ -458,6 +581,7 @@ static void print_help(void) {
     write_str("  <file>       run file in current directory\n");
     write_str("  <file.ext>   run script in current directory via /bin/EXT.ELF\n");
     write_str("  /path/file   run ELF or script at an explicit path\n");
+    write_str("  <cmd> &      run a program in the background\n");
     write_str("  #!/bin/x     scripts with a shebang use that interpreter\n");
 }
 
@@ -475,7 +599,21 @@ static void print_lang_registry(void) {
  * ========================================================================= */
 
 static int handle_command(const char *line) {
-    const char *s = skip_spaces(line);
+    char        text[256];
+    size_t      text_len = 0;
+
+    /* A trailing '&' runs the command as a background job */
+    while (line[text_len] && text_len < sizeof(text) - 1) {
+        text[text_len] = line[text_len];
+        text_len++;
+    }
+    while (text_len > 0 && text[text_len - 1] == ' ') text_len--;
+    shell_background = (text_len > 0 && text[text_len - 1] == '&');
+    if (shell_background) text_len--;
+    while (text_len > 0 && text[text_len - 1] == ' ') text_len--;
+    text[text_len] = '\0';
+
+    const char *s = skip_spaces(text);
     if (*s == '\0') return 0;  /* empty line */
 
     char        cmd[64];
@@ -538,6 +676,23 @@ static int handle_command(const char *line) {
         return 0;
     }
 
+    /* ---- Built-in: jobs / wait ---- */
+    if (str_eq(cmd, "jobs")) {
+        list_jobs();
+        return 0;
+    }
+    if (str_eq(cmd, "wait")) {
+        int64_t pid = -1;
+        if (args && args[0] >= '0' && args[0] <= '9') {
+            pid = 0;
+            for (const char *p = args; *p >= '0' && *p <= '9'; p++) {
+                pid = pid * 10 + (*p - '0');
+            }
+        }
+        wait_jobs(pid);
+        return 0;
+    }
+
     /* ---- Built-in: list / dir ---- */
     if (str_eq(cmd, "list") || str_eq(cmd, "dir")) {
         list_directory_cmd(args);
@@ -602,6 +757,7 @@ int main(int argc, char **argv) {
             write_str("\n");
             int handled = handle_command(buf);
             len = 0;
+            reap_jobs();
             if (!handled) prompt();
             continue;
         }
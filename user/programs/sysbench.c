@@ -0,0 +1,124 @@
+#include "syscalls.h"
+#include "program_version.h"
+
+/*
+ * sysbench - time the syscall path from user space.
+ *
+ * getpid measures the bare entry/dispatch/return cost; time_read adds a
+ * checked copy back to user memory; vdso_uptime reads the shared kernel
+ * data page with no syscall at all.  Cycles come from rdtsc, nanoseconds
+ * from the millisecond uptime clock over the whole run.
+ */
+
+#define DEFAULT_ITERATIONS 100000ULL
+
+static size_t str_len(const char *s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static void write_str(const char *s) {
+    sys_write(FD_STDOUT, s, str_len(s));
+}
+
+static void write_u64(uint64_t v) {
+    char tmp[32];
+    size_t i = 0;
+
+    if (v == 0) {
+        write_str("0");
+        return;
+    }
+    while (v > 0 && i < sizeof(tmp)) {
+        tmp[i++] = (char)('0' + (v % 10));
+        v /= 10;
+    }
+
+    char out[32];
+    for (size_t j = 0; j < i; j++) out[j] = tmp[i - 1 - j];
+    sys_write(FD_STDOUT, out, i);
+}
+
+static uint64_t parse_u64(const char *s) {
+    uint64_t v = 0;
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (uint64_t)(*s - '0');
+        s++;
+    }
+    return v;
+}
+
+static inline uint64_t read_tsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static void report(const char *name, uint64_t iterations,
+                   uint64_t cycles, uint64_t elapsed_ms) {
+    write_str(name);
+    write_str(": ");
+    write_u64(cycles / iterations);
+    write_str(" cycles/call, ");
+    write_u64((elapsed_ms * 1000000ULL) / iterations);
+    write_str(" ns/call (");
+    write_u64(iterations);
+    write_str(" calls in ");
+    write_u64(elapsed_ms);
+    write_str(" ms)\n");
+}
+
+static void bench_getpid(uint64_t iterations) {
+    uint64_t start_ms = (uint64_t)sys_uptime_ms();
+    uint64_t start = read_tsc();
+    for (uint64_t i = 0; i < iterations; i++) {
+        sys_getpid();
+    }
+    uint64_t cycles = read_tsc() - start;
+    report("getpid", iterations, cycles, (uint64_t)sys_uptime_ms() - start_ms);
+}
+
+static void bench_time_read(uint64_t iterations) {
+    struct numos_calendar_time now;
+    uint64_t start_ms = (uint64_t)sys_uptime_ms();
+    uint64_t start = read_tsc();
+    for (uint64_t i = 0; i < iterations; i++) {
+        sys_time_read(&now);
+    }
+    uint64_t cycles = read_tsc() - start;
+    report("time_read", iterations, cycles, (uint64_t)sys_uptime_ms() - start_ms);
+}
+
+static void bench_vdso_uptime(uint64_t iterations) {
+    volatile uint64_t sink = 0;
+    uint64_t start_ms = (uint64_t)sys_uptime_ms();
+    uint64_t start = read_tsc();
+    for (uint64_t i = 0; i < iterations; i++) {
+        sink += numos_uptime_ns();
+    }
+    uint64_t cycles = read_tsc() - start;
+    (void)sink;
+    report("vdso_uptime", iterations, cycles, (uint64_t)sys_uptime_ms() - start_ms);
+}
+
+int main(int argc, char **argv) {
+    uint64_t iterations = DEFAULT_ITERATIONS;
+
+    if (argc >= 2 && numos_is_version_flag(argv[1])) {
+        numos_print_program_version("sysbench");
+        return 0;
+    }
+    if (argc >= 2) {
+        iterations = parse_u64(argv[1]);
+        if (iterations == 0) {
+            write_str("usage: sysbench [iterations]\n");
+            return 1;
+        }
+    }
+
+    bench_getpid(iterations);
+    bench_time_read(iterations);
+    bench_vdso_uptime(iterations);
+    return 0;
+}